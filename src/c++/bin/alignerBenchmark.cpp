@@ -0,0 +1,387 @@
+/**
+ ** Copyright (c) 2007-2010 Illumina, Inc.
+ **
+ ** This software is covered by the "Illumina Genome Analyzer Software
+ ** License Agreement" and the "Illumina Source Code License Agreement",
+ ** and certain third party copyright/licenses, and any user of this
+ ** source file is bound by the terms therein (see accompanying files
+ ** Illumina_Genome_Analyzer_Software_License_Agreement.pdf and
+ ** Illumina_Source_Code_License_Agreement.pdf and third party
+ ** copyright/license notices).
+ **
+ ** This file is part of the Consensus Assessment of Sequence And VAriation
+ ** (CASAVA) software package.
+ **
+ ** \file alignerBenchmark.cpp
+ **
+ ** \brief Throughput and equivalence check of the gapped aligner.
+ **
+ ** Aligns a set of synthetic reads with ga::alignment::Aligner and with
+ ** the double precision DP it replaced, reports the alignments/sec of
+ ** each and the alignments on which they differ. Fails if there are any.
+ **/
+
+#include <cassert>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <sys/time.h>
+
+#include "alignment/aligner.h"
+
+using namespace std;
+using ga::alignment::Aligner;
+using ga::alignment::ScoreType;
+
+
+// DoubleAligner: the DP of Aligner::operator() as it was before the band
+// was held in integers, six full (x_size+1)x(y_size+1) matrices of
+// doubles compared to EPSILON. Kept here only as the reference the
+// current Aligner is checked against
+struct DoubleAligner
+{
+    typedef vector<vector<ScoreType> > DPMatrix;
+
+    DoubleAligner( ScoreType w_match, ScoreType w_mismatch,
+                   ScoreType w_open, ScoreType w_extend, int w ) :
+        w_match_(w_match), w_mismatch_(w_mismatch),
+        w_open_(w_open), w_extend_(w_extend), width_(w) {}
+
+    void init( const int x_size, const int y_size )
+    {
+        DPMatrix* matrices[6] = { &E_, &F_, &G_, &TE_, &TF_, &TG_ };
+        for (int m(0);m<6;m++)
+        {
+            matrices[m]->assign(x_size+1, vector<ScoreType>(y_size+1));
+        } // ~for m
+    } // ~init
+
+    void max3( ScoreType& max, ScoreType& which,
+               const ScoreType& v0, const ScoreType& v1, const ScoreType& v2,
+               const bool& forward )
+    {
+        if (forward)
+        {
+            max=v0; which=0;
+            if ( (v1-v0) > EPSILON )  { max=v1; which=1; }
+            if ( (v2-max) > EPSILON ) { max=v2; which=2; }
+        }
+        else
+        {
+            max=v2; which=2;
+            if ( (v1-v2) > EPSILON )  { max=v1; which=1; }
+            if ( (v0-max) > EPSILON ) { max=v0; which=0; }
+        }
+    } // ~max3
+
+    void operator()( const char* qvals_, const char* x, const char* y,
+                     const int x_size, const int y_size, const bool& flag );
+
+    ScoreType w_match_;
+    ScoreType w_mismatch_;
+    ScoreType w_open_;
+    ScoreType w_extend_;
+    int width_;
+
+    DPMatrix E_,F_,G_,TE_,TF_,TG_;
+
+    string xt_;
+    string yt_;
+    int x_start_;
+    int y_start_;
+    ScoreType score_;
+}; // ~struct DoubleAligner
+
+void DoubleAligner::operator()
+    ( const char* qvals_, const char* x, const char* y,
+      const int x_size, const int y_size, const bool& flag )
+{
+    ScoreType max(-1), whichMatrix(-1), thisMax(-1), thisMatrix(-1);
+    int ii(-1), jj(-1);
+
+    xt_.clear();
+    yt_.clear();
+
+    for (int i(0);i<=x_size;i++)
+    {
+        E_[i][0]=0;
+        F_[i][0]=-10000;
+        G_[i][0]=-10000;
+    } // ~for i
+
+    for (int j(0);j<=y_size;j++)
+    {
+        E_[0][j]=-10000;
+        F_[0][j]=0;
+        G_[0][j]=-10000;
+    } // ~for j
+
+    for (int i(1);i<=x_size;i++)
+    {
+        const int endIdx( ((i+2*width_)>y_size) ? y_size : (i+2*width_) );
+        for (int j(i);j<=endIdx;j++)
+        {
+            max3(G_[i][j],TG_[i][j],
+                 G_[i-1][j-1],E_[i-1][j-1],F_[i-1][j-1],flag);
+            G_[i][j]+=(((x[i-1]==y[j-1]) ? w_match_ : w_mismatch_)
+                       *(qvals_[i-1]-64)*QUALSCALE);
+            max3(E_[i][j],TE_[i][j],
+                 G_[i][j-1]-w_open_, E_[i][j-1]-w_extend_, F_[i][j-1]-w_open_,
+                 flag);
+            max3(F_[i][j],TF_[i][j],
+                 G_[i-1][j]-w_open_, E_[i-1][j]-w_open_, F_[i-1][j]-w_extend_,
+                 flag);
+        } // ~for j
+    } // ~for i
+
+    max=-10000;
+    for (int i(0);i<=x_size;i++)
+    {
+        max3(thisMax, thisMatrix, G_[i][y_size], E_[i][y_size], F_[i][y_size], flag);
+        if (thisMax>max)
+        {
+            max=thisMax; ii=i; jj=y_size; whichMatrix=thisMatrix;
+        } // ~if
+    } // ~for i
+    for (int j(0);j<=y_size;j++)
+    {
+        max3(thisMax, thisMatrix, G_[x_size][j], E_[x_size][j], F_[x_size][j], flag);
+        if (thisMax>max)
+        {
+            max=thisMax; ii=x_size; jj=j; whichMatrix=thisMatrix;
+        } // ~if
+    } // ~for j
+
+    score_=max;
+    x_start_=ii;
+    y_start_=jj;
+
+    // end gaps
+    for (int j(y_size);j>y_start_;j--) { xt_+='-'; yt_+=y[j-1]; }
+    for (int i(x_size);i>x_start_;i--) { xt_+=x[i-1]; yt_+='-'; }
+
+    while ((ii>0)&&(jj>0))
+    {
+        const DPMatrix& t( (whichMatrix==0) ? TG_ : ((whichMatrix==1) ? TE_ : TF_) );
+        const ScoreType nextMatrix(t[ii][jj]);
+        if (whichMatrix==0)
+        {
+            xt_+=x[ii-1]; yt_+=y[jj-1]; ii--; jj--;
+        } // ~if
+        else if (whichMatrix==1)
+        {
+            xt_+='-'; yt_+=y[jj-1]; jj--;
+        } // ~else if
+        else
+        {
+            assert(whichMatrix==2);
+            xt_+=x[ii-1]; yt_+='-'; ii--;
+        } // ~else
+        whichMatrix=nextMatrix;
+    } // ~while
+
+    for (;jj>0;jj--) { xt_+='-'; yt_+=y[jj-1]; }
+    for (;ii>0;ii--) { xt_+=x[ii-1]; yt_+='-'; }
+
+    reverse(xt_.begin(),xt_.end());
+    reverse(yt_.begin(),yt_.end());
+} // ~DoubleAligner::operator()
+
+
+// AlignmentCase: a read, the reference fragment it is aligned to and the
+// strand flag passed to the aligner
+struct AlignmentCase
+{
+    string read_;
+    string fragment_;
+    bool flag_;
+}; // ~struct AlignmentCase
+
+// the shapes of the two callers of the aligner
+struct BenchmarkShape
+{
+    const char* name_;
+    int readLength_;
+    int fragmentLength_;
+    int width_;
+    ScoreType match_;
+    char quality_;
+}; // ~struct BenchmarkShape
+
+static const BenchmarkShape shapes[] =
+{
+    // unsquashRequests in eland_ms: a read against its gapped seed region
+    { "eland", 100, 110, 5, 2, (char)94 },
+    // orphan rescue in orphanAligner: a read anywhere in the mate's window
+    { "orphan", 100, 400, 400, 6, 'a' }
+};
+
+static unsigned int randomState(12345);
+
+static unsigned int nextRandom( void )
+{
+    randomState=randomState*1103515245u+12345u;
+    return (randomState>>8);
+} // ~nextRandom
+
+static char randomBase( void ) { return "ACGT"[nextRandom()%4]; }
+
+// makeCases: reads taken from random fragments, with up to 7 mismatches and
+// 2 indels of up to 4 bases; some fragments are low complexity and one read
+// in ten is random, so both easy and ambiguous alignments are covered
+static void makeCases( const BenchmarkShape& shape, const int numCases,
+                       vector<AlignmentCase>& cases )
+{
+    const bool isOrphan(shape.fragmentLength_>shape.readLength_+10);
+    cases.resize(numCases);
+    for (int c(0);c<numCases;c++)
+    {
+        AlignmentCase& ac(cases[c]);
+        ac.fragment_.clear();
+        for (int i(0);i<shape.fragmentLength_;i++) ac.fragment_+=randomBase();
+        if (nextRandom()%4==0)
+        {
+            for (int i(0);i<shape.fragmentLength_;i+=2) ac.fragment_[i]='A';
+        } // ~if
+
+        const int offset( isOrphan
+                          ? nextRandom()%(shape.fragmentLength_-shape.readLength_-10)
+                          : 5 );
+        string& r(ac.read_);
+        r=ac.fragment_.substr(offset, shape.readLength_+10);
+        const int numMismatches(nextRandom()%8);
+        for (int k(0);k<numMismatches;k++) r[nextRandom()%r.size()]=randomBase();
+        const int numGaps(nextRandom()%3);
+        for (int k(0);k<numGaps;k++)
+        {
+            const int pos(nextRandom()%(r.size()-5));
+            const int len(1+nextRandom()%4);
+            if (nextRandom()%2) r.erase(pos, len);
+            else r.insert(pos, string(len, randomBase()));
+        } // ~for k
+        r=r.substr(0, shape.readLength_);
+        while ((int)r.size()<shape.readLength_) r+=randomBase();
+        if (nextRandom()%10==0)
+        {
+            r.clear();
+            for (int i(0);i<shape.readLength_;i++) r+=randomBase();
+        } // ~if
+        ac.flag_=(nextRandom()%2==1);
+    } // ~for c
+} // ~makeCases
+
+static double getTime( void )
+{
+    timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec+1e-6*tv.tv_usec;
+} // ~getTime
+
+// AlignmentResult: what the callers of the aligner use from it
+struct AlignmentResult
+{
+    ScoreType score_;
+    string cigar_;
+    string descriptor_;
+    int beginOffset_;
+    int endOffset_;
+}; // ~struct AlignmentResult
+
+template <class AlignerType>
+static double runAligner( AlignerType& aligner, Aligner& converter,
+                          const BenchmarkShape& shape,
+                          const vector<AlignmentCase>& cases,
+                          vector<AlignmentResult>& results )
+{
+    const string qualities(shape.readLength_, shape.quality_);
+    results.resize(cases.size());
+    const double start(getTime());
+    for (unsigned int c(0);c<cases.size();c++)
+    {
+        aligner(qualities.c_str(), cases[c].read_.c_str(), cases[c].fragment_.c_str(),
+                shape.readLength_, shape.fragmentLength_, cases[c].flag_);
+        AlignmentResult& result(results[c]);
+        int numMismatches(0);
+        result.score_=aligner.score_;
+        result.cigar_=converter.convertToCIGAR(aligner.xt_, aligner.yt_);
+        result.descriptor_=converter.convertToNewAlignmentDescriptor
+            (aligner.xt_, aligner.yt_, numMismatches, result.beginOffset_, result.endOffset_);
+    } // ~for c
+    return cases.size()/(getTime()-start);
+} // ~runAligner
+
+int main( int argc, char** argv )
+{
+    if (argc<3)
+    {
+        cerr << "Usage: " << argv[0] << " eland|orphan <number of alignments> [-v]" << endl
+             << "Aligns synthetic reads with the gapped aligner and with the double" << endl
+             << "precision DP it replaced, reports the alignments/sec of both and" << endl
+             << "the number of alignments that differ (-v lists them). Exits with" << endl
+             << "status 1 if any do." << endl;
+        return 1;
+    }
+
+    const BenchmarkShape* pShape(NULL);
+    for (unsigned int s(0);s<sizeof(shapes)/sizeof(shapes[0]);s++)
+    {
+        if (strcmp(argv[1], shapes[s].name_)==0) pShape=&shapes[s];
+    } // ~for s
+    const int numCases(atoi(argv[2]));
+    if ((pShape==NULL)||(numCases<=0))
+    {
+        cerr << "ERROR: unknown shape " << argv[1] << " or bad number of alignments "
+             << argv[2] << endl;
+        return 1;
+    }
+    const BenchmarkShape& shape(*pShape);
+    const bool isVerbose((argc>3)&&(strcmp(argv[3], "-v")==0));
+
+    vector<AlignmentCase> cases;
+    makeCases(shape, numCases, cases);
+
+    Aligner aligner(shape.match_, -1, 15, 3, shape.width_, 0, 0);
+    aligner.init(shape.readLength_, shape.fragmentLength_, 0, 0);
+    DoubleAligner doubleAligner(shape.match_, -1, 15, 3, shape.width_);
+    doubleAligner.init(shape.readLength_, shape.fragmentLength_);
+
+    vector<AlignmentResult> oldResults, newResults;
+    const double oldRate(runAligner(doubleAligner, aligner, shape, cases, oldResults));
+    const double newRate(runAligner(aligner, aligner, shape, cases, newResults));
+
+    int numDiffering(0);
+    for (int c(0);c<numCases;c++)
+    {
+        const AlignmentResult& o(oldResults[c]);
+        const AlignmentResult& n(newResults[c]);
+        if ((o.cigar_==n.cigar_)&&(o.descriptor_==n.descriptor_)
+            &&(o.beginOffset_==n.beginOffset_)&&(o.endOffset_==n.endOffset_)
+            &&(fabs(o.score_-n.score_)<0.5/SCORE_SCALE))
+            continue;
+        numDiffering++;
+        if (isVerbose)
+        {
+            cout << "case " << c << ": score " << o.score_ << " / " << n.score_ << endl
+                 << "  double:  " << o.cigar_ << " " << o.descriptor_
+                 << " " << o.beginOffset_ << " " << o.endOffset_ << endl
+                 << "  integer: " << n.cigar_ << " " << n.descriptor_
+                 << " " << n.beginOffset_ << " " << n.endOffset_ << endl;
+        } // ~if
+    } // ~for c
+
+    cout << shape.name_ << " (" << shape.readLength_ << " x " << shape.fragmentLength_
+         << ", width " << shape.width_ << "): " << numCases << " alignments" << endl
+         << "  double DP:   " << (int)oldRate << " alignments/sec" << endl
+         << "  integer DP:  " << (int)newRate << " alignments/sec" << endl
+         << "  differing:   " << numDiffering << endl;
+    if (numDiffering!=0)
+    {
+        cerr << "ERROR: the integer DP gave " << numDiffering
+             << " alignments different from the double DP" << endl;
+        return 1;
+    }
+    return 0;
+} // ~main
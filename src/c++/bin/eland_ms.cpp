@@ -29,6 +29,7 @@ void run_eland(unsigned int len,
       const fs::path &outputFile,
       const std::vector<unsigned int> &multi,
       const fs::path &repeatFile,
+      const bool &repeatMask,
       const bool &singleSeed,
       const bool &debug,
       const bool &ungap,
@@ -48,7 +49,11 @@ void run_eland(unsigned int len,
       const std::string &sample,
       const std::string &barcode,
       const std::vector<unsigned int> &clusterSets,
-      const boost::format &positionsFileNameFormat)
+      const boost::format &positionsFileNameFormat,
+      const unsigned int numThreads,
+      const unsigned int batchSize,
+      const unsigned int prefetchDistance,
+      const unsigned int matchMemory)
 {
   if (MAX_OLIGO_LEN == len){
     casava::eland_ms::ELAND<MAX_OLIGO_LEN> eland(
@@ -57,6 +62,7 @@ void run_eland(unsigned int len,
         outputFile,
         multi,
         repeatFile,
+        repeatMask,
         singleSeed,
         debug,
         ungap,
@@ -76,7 +82,11 @@ void run_eland(unsigned int len,
         sample,
         barcode,
         clusterSets,
-        positionsFileNameFormat);
+        positionsFileNameFormat,
+        numThreads,
+        batchSize,
+        prefetchDistance,
+        matchMemory);
     eland.run();
   } else {
     run_eland<MAX_OLIGO_LEN-1>(len, oligoFile,
@@ -84,6 +94,7 @@ void run_eland(unsigned int len,
         outputFile,
         multi,
         repeatFile,
+        repeatMask,
         singleSeed,
         debug,
         ungap,
@@ -103,7 +114,11 @@ void run_eland(unsigned int len,
         sample,
         barcode,
         clusterSets,
-        positionsFileNameFormat);
+        positionsFileNameFormat,
+        numThreads,
+        batchSize,
+        prefetchDistance,
+        matchMemory);
   }
 }
 
@@ -115,6 +130,7 @@ void run_eland<7>(unsigned int len,
       const fs::path &/*outputFile*/,
       const std::vector<unsigned int> &/*multi*/,
       const fs::path &/*repeatFile*/,
+      const bool &/*repeatMask*/,
       const bool &/*singleSeed*/,
       const bool &/*debug*/,
       const bool &/*ungap*/,
@@ -134,7 +150,11 @@ void run_eland<7>(unsigned int len,
       const std::string &/*sample*/,
       const std::string &/*barcode*/,
       const std::vector<unsigned int> &/*clusterSets*/,
-      const boost::format &/*positionsFileNameFormat*/)
+      const boost::format &/*positionsFileNameFormat*/,
+      const unsigned int /*numThreads*/,
+      const unsigned int /*batchSize*/,
+      const unsigned int /*prefetchDistance*/,
+      const unsigned int /*matchMemory*/)
 {
   BOOST_THROW_EXCEPTION(cc::InvalidParameterException(
         (boost::format("Eland oligo length %u not supported") % len).str()));
@@ -143,12 +163,14 @@ void run_eland<7>(unsigned int len,
 
 void eland_ms(const casava::eland_ms::ElandOptions &options)
 {
+  casava::alignment::GenomeBundle::setPopulate(options.populateGenome_);
   run_eland<32>(options.oligoLength_,
       options.oligoFile_,
       options.genomeDirectory_,
       options.outputFile_,
       options.maxNumMatches_,
       options.repeatFile_,
+      options.repeatMask_,
       options.singleseed_,
       options.debug_,
       options.ungapped_,
@@ -168,7 +190,11 @@ void eland_ms(const casava::eland_ms::ElandOptions &options)
       options.sample_,
       options.barcode_,
       options.clusterSets_,
-      options.positionsFormat_);
+      options.positionsFormat_,
+      options.numThreads_,
+      options.batchSize_,
+      options.prefetchDistance_,
+      options.matchMemory_);
 }
 
 
@@ -86,6 +86,9 @@ int main(int argc, char* argv[]) {
         ("sl1", po::value<uint16_t>(&ConfigSettings.Mate1SeedLength)->default_value(DEFAULT_ELAND_SEED_LENGTH),
         "the ELAND seed length for the mate 1 reads")
 
+        ("threads", po::value<uint32_t>(&ConfigSettings.NumThreads)->default_value(DEFAULT_NUM_THREADS),
+        "the number of threads used to resolve the read fragments and compress the export files")
+
         ("ub1", po::value<string>(&ConfigSettings.Mate1UseBases), "specifies which mate 1 bases should be used")
 
         ("ucn", "use contig names rather than the reference filenames");
@@ -98,6 +101,9 @@ int main(int argc, char* argv[]) {
         ("flt", po::value<uint32_t>(&ConfigSettings.FragmentLengthThreshold)->default_value(DEFAULT_FRAGMENT_LENGTH_THRESHOLD),
         "fragments longer than this value will be ignored when calculating the fragment length distribution")
 
+        ("flm", po::value<string>(&ConfigSettings.FragmentLengthModelFilename),
+        "caches the fragment length distribution in this file. If the file was written by a run over the same inputs, the distribution is not rebuilt")
+
         ("ie2", po::value<string>(&ConfigSettings.Mate2AlignmentFilename),
         "the ELAND extended filename for the mate 2 reads")
 
@@ -27,12 +27,15 @@
 #include <sstream>
 #include <fstream>
 #include <locale>
+#include <map>
 
+#include <boost/cstdint.hpp>
 #include <boost/shared_ptr.hpp>
 
 #include "alignment/ELAND_unsquash.h"
 #include "alignment/aligner.h"
 #include "common/ExtendedFileReader.h"
+#include "common/ParallelFor.hh"
 
 
 #define FRAGMENT_LENGTH 450
@@ -40,6 +43,13 @@
 #define MAX_ERROR_RATE 0.1
 
 #define REQUEST_SIZE 262144
+// number of read pairs held at most before their orphans get rescued and
+// they are written out
+#define WINDOW_SIZE 262144
+
+// insert sizes below DENSE_INSERT_SIZE are counted in an array, the
+// others in a map
+#define DENSE_INSERT_SIZE 65536
 
 
 // singleton request
@@ -105,15 +115,135 @@ struct SingletonAlignment
 }; // ~struct SeqRequest
 
 
+// the insert sizes of the uniquely placed read pairs, counted per size
+// rather than kept one by one, so that the statistics of a lane take the
+// same memory whatever its size
+class InsertSizeHistogram
+{
+public:
+    InsertSizeHistogram() : dense_(DENSE_INSERT_SIZE,0), size_(0), sum_(0) {}
+
+    void add( const int insertSize )
+    {
+        if( insertSize < DENSE_INSERT_SIZE )
+        {
+            dense_[insertSize]++;
+        }
+        else
+        {
+            sparse_[insertSize]++;
+        }
+        size_++;
+        sum_ += insertSize;
+    }
+
+    boost::uint64_t size( void ) const { return size_; }
+
+    // the insert size at position size()/2 of the sorted insert sizes
+    int getMedian( void ) const;
+
+    // the sum is kept in 64 bits and the squared deviations are taken in
+    // doubles. Versions before the histogram summed both in int, which
+    // overflows once the insert sizes of a lane add up past 2^31 or one
+    // of them is more than 46340 from the mean, so on such lanes the
+    // mean, and the deviation the orphan aligners are given, differ from
+    // theirs
+    int getMean( void ) const { return (int)(sum_/size_); }
+
+    // the sample variance of the insert sizes around mean
+    double getVariance( const int mean ) const;
+
+private:
+    vector<boost::uint64_t> dense_;
+    map<int,boost::uint64_t> sparse_;
+    boost::uint64_t size_;
+    boost::uint64_t sum_;
+}; // ~class InsertSizeHistogram
+
+
+// the fields of a line of an extended file, kept until the line is written
+struct ExtendedEntry
+{
+    void assign( const ExtendedFileReader& reader )
+    {
+        machine_.assign( reader.getMachine() );
+        read_.assign( reader.getRead() );
+        xyz_.assign( reader.getXYZ() );
+        matches_.assign( reader.getMatches() );
+    }
+    string machine_;
+    string read_;
+    string xyz_;
+    string matches_; // ends with the newline of the line
+}; // ~struct ExtendedEntry
+
+
 bool parseMatch( const string& match,string &chr,char& strand,uint& pos );
 void parseXYZ( const char* xyz,int& oneError,int& twoError );
 string reverseComplement( const string& s );
+void writeWindow( StringIndex& files,
+                  vector<SingletonAlignment>& alns,
+                  const vector<ExtendedEntry>& left,
+                  const vector<ExtendedEntry>& right,
+                  const uint numLines,
+                  const uint firstLine,
+                  ofstream& out_left_extended,
+                  ofstream& out_right_extended );
 
 int global_upper_bound_occ = UPPER_BOUND_OCC;
 int global_fragment_length = FRAGMENT_LENGTH;
 
 
 
+// OrphanRescuer: aligns the orphans of a window of requests against the
+// fragments they are expected in, for pullOutFragments. Task t of
+// numTasks takes every numTasks-th request with its own copies of the
+// aligners and its own fragment buffers, reading the fragments from the
+// shared mapping of the squashed files, and writes its results to the
+// slots of those requests, so the orphans rescued are the same whatever
+// the number of threads
+struct OrphanRescuer
+{
+    OrphanRescuer( const ga::alignment::Aligner& align_forward,
+                   const ga::alignment::Aligner& align_reverse,
+                   const unsigned int numTasks,
+                   const vector<SingletonRequest>& req,
+                   const vector<boost::shared_ptr<SquashFile> >& squashFiles,
+                   const string& qual_string,
+                   const uint jump_forward,
+                   const int maxNumberMismatches,
+                   vector<int>& positions,
+                   vector<string>& descriptors ) :
+        align_forward_(numTasks,align_forward),
+        align_reverse_(numTasks,align_reverse),
+        numTasks_(numTasks),
+        req_(req),
+        squashFiles_(squashFiles),
+        qual_string_(qual_string),
+        jump_forward_(jump_forward),
+        maxNumberMismatches_(maxNumberMismatches),
+        positions_(positions),
+        descriptors_(descriptors) {}
+
+    void operator()( const unsigned int taskNum );
+
+private:
+    vector<ga::alignment::Aligner> align_forward_;
+    vector<ga::alignment::Aligner> align_reverse_;
+    const unsigned int numTasks_;
+    const vector<SingletonRequest>& req_;
+    const vector<boost::shared_ptr<SquashFile> >& squashFiles_;
+    const string& qual_string_;
+    const uint jump_forward_;
+    const int maxNumberMismatches_;
+    // match position and alignment descriptor of each rescued orphan,
+    // "" for the others
+    vector<int>& positions_;
+    vector<string>& descriptors_;
+}; // ~struct OrphanRescuer
+
+
+
 class OrphanAligner {
 public:
     OrphanAligner( const string& squashed_genome,
@@ -124,11 +254,13 @@ public:
                    const int& read_length,
                    const int& maxNumberMismatches,
                    const int& expected_insertsize,
-                   const int& expDeviation
+                   const int& expDeviation,
+                   const unsigned int numThreads
         ) : squashed_genome_(squashed_genome),
             align_forward_(match,mismatch,gapopen,gapextend,global_fragment_length,expected_insertsize,expDeviation),
             align_reverse_(match,mismatch,gapopen,gapextend,global_fragment_length,expected_insertsize,expDeviation),
-            maxNumberMismatches_(maxNumberMismatches)
+            maxNumberMismatches_(maxNumberMismatches),
+            numThreads_((numThreads>0) ? numThreads : 1)
     {
         // if the read length was greater then the expected insert size, we'd have overlapping reads
 //        assert(expected_insertsize>read_length);
@@ -176,7 +308,15 @@ public:
 
 
 private:
-    boost::shared_ptr<SquashFile> pSquash_;
+    // getSquashFile: the squashed file of fileIndex, opened when first
+    // needed and kept for the windows that follow. It is opened again once
+    // its contig index has been read, as that is when SquashFile numbers
+    // the contigs of its valid regions
+    void getSquashFile( const uint fileIndex, const StringIndex& files );
+
+    // squashFiles_: one per chromosome file, by file index
+    vector<boost::shared_ptr<SquashFile> > squashFiles_;
+    vector<bool> hasContigIndex_;
     string squashed_genome_;
     string qual_string_;
     ga::alignment::Aligner align_forward_;
@@ -185,6 +325,8 @@ private:
     uint jump_backward_;
     // threshold for orphans to be rescued. or not.
     const int maxNumberMismatches_;
+    // threads the orphans of a window are aligned on
+    const unsigned int numThreads_;
 
 };
 
@@ -214,9 +356,9 @@ bool lessThanSingletonAlignment(const SingletonAlignment& a, const SingletonAlig
 
 int main( int numArgs, const char** args)
 {
-    if (numArgs != 6 )
+    if (numArgs != 6 && numArgs != 7 )
     {
-        cerr << "usage : " << args[0] << " <extended1> <extended2> <genome> <output_suffix> <upper_bound>" << endl
+        cerr << "usage : " << args[0] << " <extended1> <extended2> <genome> <output_suffix> <upper_bound> [<num_threads>]" << endl
              << "(input file has to be in the export file format, genome has to point to a squashed genome directory)" << endl;
         exit (1);
     }
@@ -245,12 +387,22 @@ int main( int numArgs, const char** args)
     left.rewind();
 
     cerr << "estimating insert size...";
-    vector<int> insertSizes;
-    // come up with statistics for the insert size distribution
+    InsertSizeHistogram insertSizes;
+    int left_read_length = -1;
+    int right_read_length = -1;
+    // come up with statistics for the insert size distribution; the
+    // aligners are set up from them, so this takes a pass of its own
     while( left.getNextEntry() == true )
     {
         right.getNextEntry();
 
+        // determine read length
+        if( left_read_length == -1 )
+        {
+            left_read_length = strlen(left.getRead());
+            right_read_length = strlen(right.getRead());
+        }
+
         int left_matchcounter   = left.getMatchCounter();
         string left_matches   = string(left.getMatches());
 
@@ -302,15 +454,13 @@ int main( int numArgs, const char** args)
 
         if( currentInsertSize != -1 )
         {
-            insertSizes.push_back( currentInsertSize );
+            insertSizes.add( currentInsertSize );
 //            cout << currentInsertSize << endl;
         }
     }
     cerr << "done." << endl;
 
     // insertSizes now hold all the information
-    // get the median
-    sort( insertSizes.begin(),insertSizes.end() );
     int medianDistribution = 0;
     // calculate variance + standard deviation
     double varianceDistribution = 0.0;
@@ -321,23 +471,15 @@ int main( int numArgs, const char** args)
 
     if( insertSizes.size() > 0 )
     {
-        medianDistribution = insertSizes[ insertSizes.size()/2 ];
+        medianDistribution = insertSizes.getMedian();
 
         // get the mean
-        int sumOfAll = 0;
-        for( unsigned int i=0;i<insertSizes.size();i++ )
-        {
-            sumOfAll += insertSizes[i];
-        }
-        meanDistribution = sumOfAll/insertSizes.size();
+        meanDistribution = insertSizes.getMean();
 
         cerr << "median of distribution : " << medianDistribution << endl;
 
         // calculate variance + standard deviation
-        for( unsigned int i=0;i<insertSizes.size();i++ )
-        {
-            varianceDistribution += (double)((insertSizes[i]-meanDistribution)*(insertSizes[i]-meanDistribution))/(double)(insertSizes.size()-1);
-        }
+        varianceDistribution = insertSizes.getVariance( meanDistribution );
         d_stdDeviationDistribution = sqrt(varianceDistribution);
         i_stdDeviationDistribution = static_cast<int>(d_stdDeviationDistribution);
 
@@ -352,20 +494,15 @@ int main( int numArgs, const char** args)
     // setting the number of occurrences, upper bound
     global_upper_bound_occ=atoi(args[5]);
 
+    // threads the orphans are aligned on
+    const int numThreads = (numArgs==7) ? atoi(args[6]) : 1;
+
 
     ga::alignment::ScoreType match = 6;
     ga::alignment::ScoreType mismatch = -1;
     ga::alignment::ScoreType gapopen = 15;
     ga::alignment::ScoreType gapextend = 3;
 
-    // determine read length
-    left.getNextEntry();
-    int left_read_length = string(left.getRead()).size();
-    left.rewind();
-    right.getNextEntry();
-    int right_read_length = string(right.getRead()).size();
-    right.rewind();
-
     int read_length = (left_read_length>right_read_length)?left_read_length:right_read_length;
 
 
@@ -383,23 +520,41 @@ int main( int numArgs, const char** args)
                       read_length,
                       maxNumberMismatches,
                       medianDistribution,
-                      i_stdDeviationDistribution );
-    vector<SingletonAlignment> alns;
+                      i_stdDeviationDistribution,
+                      (numThreads>0) ? numThreads : 1 );
+
+    // the read pairs of the current window
+    vector<ExtendedEntry> window_left;
+    vector<ExtendedEntry> window_right;
+    uint window_lines = 0;
 
     uint cur_line_idx = 0;
     uint orphans_rescued = 0;
     uint total_no_of_candidates = 0;
+    uint alns_written = 0;
 
 
-    // main loop
-    while( left.getNextEntry()==true ) {
+    // main loop; the read pairs are taken a window at a time, each window
+    // being written out as soon as its orphans are rescued
+    bool more_entries = left.getNextEntry();
+    while( more_entries ) {
         right.getNextEntry();
 
+        if( window_lines == window_left.size() )
+        {
+            window_left.resize( window_lines+1 );
+            window_right.resize( window_lines+1 );
+        }
+        window_left[window_lines].assign( left );
+        window_right[window_lines].assign( right );
+
         int left_matchcounter   = left.getMatchCounter();
-        string left_matches   = string(left.getMatches());
+        const string& left_matches   = window_left[window_lines].matches_;
 
         int right_matchcounter   = right.getMatchCounter();
-        string right_matches   = string(right.getMatches());
+        const string& right_matches   = window_right[window_lines].matches_;
+
+        window_lines++;
 
         string match_chr = "";
         uint i_match_position = 0;
@@ -575,174 +730,161 @@ int main( int numArgs, const char** args)
 
             }
 
+        } // candidate
 
-            if( cur_request > REQUEST_SIZE )
-            {
-                cerr << "pulling out fragments..." << endl;
-                total_no_of_candidates += cur_request;
-                vector<SingletonAlignment> orphan_alignments  = oa.pullOutFragments( files,req,orphans_rescued );
-                alns.insert( alns.end(),orphan_alignments.begin(),orphan_alignments.end() );
-
-
-                {
-                    vector<SingletonRequest> req_tmp;
-                    req.swap( req_tmp );
-                    req.clear();
-                }
-                cur_request = 0;
-
+        cur_line_idx++;
+        more_entries = left.getNextEntry();
 
-            } // else
+        if( more_entries == false || cur_request > REQUEST_SIZE || window_lines == WINDOW_SIZE )
+        {
+            cerr << "pulling out fragments..." << endl;
+            total_no_of_candidates += cur_request;
+            vector<SingletonAlignment> orphan_alignments  = oa.pullOutFragments( files,req,orphans_rescued );
+            alns_written += orphan_alignments.size();
+
+            writeWindow( files,
+                         orphan_alignments,
+                         window_left,
+                         window_right,
+                         window_lines,
+                         cur_line_idx-window_lines,
+                         out_left_extended,
+                         out_right_extended );
 
-        } // candidate
+            {
+                vector<SingletonRequest> req_tmp;
+                req.swap( req_tmp );
+                req.clear();
+            }
+            cur_request = 0;
+            window_lines = 0;
 
-        cur_line_idx++;
+        }
     } // while
 
 
-    if( req.size() > 0 )
-    {
-        vector<SingletonAlignment> orphan_alignments  = oa.pullOutFragments( files,req,orphans_rescued );
-        alns.insert( alns.end(),orphan_alignments.begin(),orphan_alignments.end() );
+    cerr << "total number of candidates = " << total_no_of_candidates << endl;
+    cerr << "orphans rescued            = " << orphans_rescued << endl;
+    cerr << "list size                  = " << alns_written << endl;
 
-        total_no_of_candidates += cur_request;
+    cerr << "done." << endl << "mission accomplished." << endl;
 
 
-        req.clear();
-        cur_request = 0;
-    } // if( req.size() ... )
 
-    cerr << "total number of candidates = " << total_no_of_candidates << endl;
-    cerr << "orphans rescued            = " << orphans_rescued << endl;
-    cerr << "list size                  = " << alns.size() << endl;
 
-    cerr << "sorting singleton alignments...";
-    sort( alns.begin(),alns.end(),lessThanSingletonAlignment );
-    cerr << "done." << endl;
+} // main
 
 
-    // =================================== OUTPUT ===================================
-    cerr << "writing output...";
-    // print the new alignments to the extended files
-    cerr << "we got " << alns.size() << " orphans to write." << endl;
 
-    left.rewind();
-    right.rewind();
-    int line_cnt_extended = 0;
+// print the read pairs of a window to the extended files, with the new
+// alignments of their orphans, alns, in place of the orphan's matches
+void writeWindow( StringIndex& files,
+                  vector<SingletonAlignment>& alns,
+                  const vector<ExtendedEntry>& left,
+                  const vector<ExtendedEntry>& right,
+                  const uint numLines,
+                  const uint firstLine,
+                  ofstream& out_left_extended,
+                  ofstream& out_right_extended )
+{
+    // stable, so that the alignments of a read keep the order of the
+    // requests, whatever the size of the window
+    stable_sort( alns.begin(),alns.end(),lessThanSingletonAlignment );
+
     uint cur_idx_alns = 0;
-    while( left.getNextEntry()==true ) {
-        right.getNextEntry();
+    for( uint i=0;i<numLines;i++ )
+    {
+        const int line_cnt_extended = firstLine + i;
 
-        if( alns.size() > 0 )
+        if( (cur_idx_alns<alns.size()) && (alns[cur_idx_alns].readNum_ == line_cnt_extended) )
         {
-            if( alns[cur_idx_alns].readNum_ == line_cnt_extended )
-            {
-                short left_or_right = alns[cur_idx_alns].left_or_right_;
-                int cnt_matches = 0;
+            short left_or_right = alns[cur_idx_alns].left_or_right_;
+            int cnt_matches = 0;
 
-                // build up the new match string, extend it to a contig level,
-                // we only have to extend the loop below
-                ostringstream new_match;
-                uint cur_chrom = UINT_INIT; // initializes to 2^XX
-                uint cur_contig = UINT_INIT; // initializes to 2^XX
-                int cur_offset = 0;
+            // build up the new match string, extend it to a contig level,
+            // we only have to extend the loop below
+            ostringstream new_match;
+            uint cur_chrom = UINT_INIT; // initializes to 2^XX
+            uint cur_contig = UINT_INIT; // initializes to 2^XX
+            int cur_offset = 0;
 
-                while( (alns[cur_idx_alns].readNum_ == line_cnt_extended) && (cur_idx_alns<alns.size()) )
+            while( (cur_idx_alns<alns.size()) && (alns[cur_idx_alns].readNum_ == line_cnt_extended) )
+            {
+                if( cur_chrom != UINT_INIT )
                 {
-                    if( cur_chrom != UINT_INIT )
-                    {
-                        new_match << ",";
-                    }
+                    new_match << ",";
+                }
 
-                    bool changed_contig = false;
-                    if( alns[cur_idx_alns].fileIndex_ != cur_chrom )
-                    {
-                        cur_chrom = alns[cur_idx_alns].fileIndex_;
-                        changed_contig = true;
-                    }
-                    if( alns[cur_idx_alns].contigNum_ != cur_contig )
-                    {
-                        cur_contig = alns[cur_idx_alns].contigNum_;
-                        changed_contig = true;
-                    }
+                bool changed_contig = false;
+                if( alns[cur_idx_alns].fileIndex_ != cur_chrom )
+                {
+                    cur_chrom = alns[cur_idx_alns].fileIndex_;
+                    changed_contig = true;
+                }
+                if( alns[cur_idx_alns].contigNum_ != cur_contig )
+                {
+                    cur_contig = alns[cur_idx_alns].contigNum_;
+                    changed_contig = true;
+                }
 
-                    if( changed_contig == true )
+                if( changed_contig == true )
+                {
+                    string contigName = files.getContigName( cur_chrom,cur_contig,cur_offset );
+                    new_match << files.names_[ cur_chrom ];
+                    if( contigName != "" )
                     {
-                        string contigName = files.getContigName( cur_chrom,cur_contig,cur_offset );
-                        new_match << files.names_[ cur_chrom ];
-                        if( contigName != "" )
-                        {
-                            new_match << "/" << contigName;
-                        }
-                        new_match << ":";
+                        new_match << "/" << contigName;
                     }
-                    new_match << (alns[cur_idx_alns].aligned_position_-cur_offset) << alns[cur_idx_alns].strand_ << alns[cur_idx_alns].matchDesc_;
-
-                    // don't forget to increment
-                    cnt_matches++;
-                    cur_idx_alns++;
+                    new_match << ":";
                 }
+                new_match << (alns[cur_idx_alns].aligned_position_-cur_offset) << alns[cur_idx_alns].strand_ << alns[cur_idx_alns].matchDesc_;
 
+                // don't forget to increment
+                cnt_matches++;
+                cur_idx_alns++;
+            }
 
-                if( left_or_right == 1 )
-                {
-                    // parse left.getXYZ()
-                    int oneE = 0;
-                    int twoE = 0;
-                    parseXYZ( left.getXYZ(),oneE,twoE );
-                    ostringstream string_xyz;
-//                    string_xyz << "1:" << oneE << ":" << twoE;
-                    string_xyz << cnt_matches << ":" << oneE << ":" << twoE;
-
-
-                    // write new hit in read1 file
-                    out_left_extended << left.getMachine() << "\t" << left.getRead() << "\t" << string_xyz.str() << "\t" << new_match.str() << endl;
-                    // write standard for read2
-                    out_right_extended << right.getMachine() << "\t" << right.getRead() << "\t" << right.getXYZ() << "\t" << right.getMatches();
-                }
-                else
-                {
-                    // parse right.getXYZ()
-                    int oneE = 0;
-                    int twoE = 0;
-                    parseXYZ( right.getXYZ(),oneE,twoE );
-                    ostringstream string_xyz;
-//                    string_xyz << "1:" << oneE << ":" << twoE;
-                    string_xyz << cnt_matches << ":" << oneE << ":" << twoE;
-
-
-                    // write standard hit in read1 file
-                    out_left_extended << left.getMachine() << "\t" << left.getRead() << "\t" << left.getXYZ() << "\t" << left.getMatches();
-                    // write new hit in read2 file
-                    out_right_extended << right.getMachine() << "\t" << right.getRead() << "\t" << string_xyz.str() << "\t" << new_match.str() << endl;
-                }
 
-                // we already increment the number above
-                // cur_idx_alns++;
+            if( left_or_right == 1 )
+            {
+                // parse left XYZ
+                int oneE = 0;
+                int twoE = 0;
+                parseXYZ( left[i].xyz_.c_str(),oneE,twoE );
+                ostringstream string_xyz;
+//                string_xyz << "1:" << oneE << ":" << twoE;
+                string_xyz << cnt_matches << ":" << oneE << ":" << twoE;
+
+
+                // write new hit in read1 file
+                out_left_extended << left[i].machine_ << "\t" << left[i].read_ << "\t" << string_xyz.str() << "\t" << new_match.str() << endl;
+                // write standard for read2
+                out_right_extended << right[i].machine_ << "\t" << right[i].read_ << "\t" << right[i].xyz_ << "\t" << right[i].matches_;
             }
             else
             {
-                out_left_extended << left.getMachine() << "\t" << left.getRead() << "\t" << left.getXYZ() << "\t" << left.getMatches();
-                out_right_extended << right.getMachine() << "\t" << right.getRead() << "\t" << right.getXYZ() << "\t" << right.getMatches();
+                // parse right XYZ
+                int oneE = 0;
+                int twoE = 0;
+                parseXYZ( right[i].xyz_.c_str(),oneE,twoE );
+                ostringstream string_xyz;
+//                string_xyz << "1:" << oneE << ":" << twoE;
+                string_xyz << cnt_matches << ":" << oneE << ":" << twoE;
+
+
+                // write standard hit in read1 file
+                out_left_extended << left[i].machine_ << "\t" << left[i].read_ << "\t" << left[i].xyz_ << "\t" << left[i].matches_;
+                // write new hit in read2 file
+                out_right_extended << right[i].machine_ << "\t" << right[i].read_ << "\t" << string_xyz.str() << "\t" << new_match.str() << endl;
             }
         }
         else
         {
-            out_left_extended << left.getMachine() << "\t" << left.getRead() << "\t" << left.getXYZ() << "\t" << left.getMatches();
-            out_right_extended << right.getMachine() << "\t" << right.getRead() << "\t" << right.getXYZ() << "\t" << right.getMatches();
+            out_left_extended << left[i].machine_ << "\t" << left[i].read_ << "\t" << left[i].xyz_ << "\t" << left[i].matches_;
+            out_right_extended << right[i].machine_ << "\t" << right[i].read_ << "\t" << right[i].xyz_ << "\t" << right[i].matches_;
         }
-
-
-        line_cnt_extended++;
     }
-
-
-    cerr << "done." << endl << "mission accomplished." << endl;
-
-
-
-
-} // main
+} // writeWindow
 
 
 
@@ -791,32 +933,20 @@ bool parseMatch( const string& match,string &chr,char& strand,uint& pos )
 }
 
 
-vector<SingletonAlignment> OrphanAligner::pullOutFragments( StringIndex& files,vector<SingletonRequest>& req,uint& orphans_rescued )
+void OrphanRescuer::operator()( const unsigned int taskNum )
 {
-    vector<SingletonAlignment> res;
-
-    if( req.size() == 0 )
-    {
-        return res;
-    }
+    const vector<SingletonRequest>& req(req_);
 
-    sort( req.begin(),req.end(),lessThanSingleton );
+    // the fragment as aligned and as read from the squashed file
+    vector<char> result( global_fragment_length+1,'\0' );
+    vector<char> non_reversed_result( global_fragment_length+1,'\0' );
 
-    uint cur_file_idx = UINT_INIT;
-
-    for( uint j=0;j<req.size();j++ )
+    for( uint j=taskNum;j<req.size();j+=numTasks_ )
     {
 #ifdef DEBUG
         cerr << "CUR_REQUEST:\t" << req[j].fileIndex_ << "\t" << req[j].filePos_ << "\t" << req[j].strand_ << endl;
 #endif
 
-        if( cur_file_idx != req[j].fileIndex_ )
-        {
-            pSquash_=boost::shared_ptr<SquashFile>(
-                new SquashFile(squashed_genome_, files.names_[req[j].fileIndex_], files));
-            cur_file_idx = req[j].fileIndex_;
-        }
-
         uint adapted_pos = (req[j].filePos_-1);
 
         if( req[j].strand_=='R' )
@@ -843,45 +973,37 @@ vector<SingletonAlignment> OrphanAligner::pullOutFragments( StringIndex& files,v
 #endif
 
 
-        string result = "";
-        string non_reversed_result = "";
-        pSquash_->goToPos
-            ( req[j].contigNum_,adapted_pos );
+        const SquashFile& squash(*squashFiles_[req[j].fileIndex_]);
 
         if( req[j].strand_=='R' )
         {
-            for (int jj1(0);jj1<global_fragment_length;jj1++)
-            {
-                result+=pSquash_->getNextBase();
-            }
+            squash.getBases( req[j].contigNum_,adapted_pos,global_fragment_length,&result[0] );
         }
         else
         {
             // pull out the reverse complement
+            squash.getBases( req[j].contigNum_,adapted_pos,global_fragment_length,&non_reversed_result[0] );
             for (int jj1(0);jj1<global_fragment_length;jj1++)
             {
-                char cur_base = pSquash_->getNextBase();
-                result += reverseCharASCII[(uint)(cur_base) ];
-                non_reversed_result+=cur_base;
+                result[jj1] = reverseCharASCII[(uint)(non_reversed_result[global_fragment_length-1-jj1]) ];
             }
-            reverse( result.begin(),result.end() );
         }
 
 #ifdef DEBUG
-        cerr << "FRAGMENT PULLED OUT: " << result << endl;
+        cerr << "FRAGMENT PULLED OUT: " << &result[0] << endl;
         cerr << req[j].strand_ << endl
              << req[j].orphan_ << endl
-             << result << endl << endl;
+             << &result[0] << endl << endl;
 #endif
 
-        ga::alignment::Aligner* curAligner = &align_forward_;
+        ga::alignment::Aligner* curAligner = &align_forward_[taskNum];
         if( req[j].strand_ == 'F' )
         {
             // we need to take the align_forward_object
-            curAligner = &align_reverse_;
+            curAligner = &align_reverse_[taskNum];
         }
 
-        int retCode = (*curAligner)( qual_string_.c_str(),req[j].orphan_.c_str(),result.c_str(),req[j].orphan_.size(),result.size(),(req[j].strand_=='R') );
+        int retCode = (*curAligner)( qual_string_.c_str(),req[j].orphan_.c_str(),&result[0],req[j].orphan_.size(),global_fragment_length,(req[j].strand_=='R') );
 
         assert(retCode>0); // assume everything went fine
 
@@ -922,7 +1044,7 @@ vector<SingletonAlignment> OrphanAligner::pullOutFragments( StringIndex& files,v
             // check if we get the same alignment if we reverse-complement the read and align it against the non-reversed reference
             string orphan_revComplement = reverseComplement( req[j].orphan_ );
 
-            align_( qual_string_.c_str(),orphan_revComplement.c_str(),non_reversed_result.c_str(),orphan_revComplement.size(),non_reversed_result.size() );
+            (*curAligner)( qual_string_.c_str(),orphan_revComplement.c_str(),&non_reversed_result[0],orphan_revComplement.size(),global_fragment_length );
 
             cerr << endl << "NON REVERSED" << endl;
             cerr << curAligner->xt_ << endl
@@ -977,19 +1099,9 @@ vector<SingletonAlignment> OrphanAligner::pullOutFragments( StringIndex& files,v
                 orphan_match_position += offset_begin;
             }
 
-            // pull together SingletonAlignment
-            res.push_back( SingletonAlignment(
-                               req[j].readNum_,
-                               req[j].left_or_right_,
-                               req[j].fileIndex_,
-                               req[j].contigNum_,
-                               req[j].filePos_,
-                               (req[j].strand_=='F')?'R':'F',
-                               req[j].orphan_,
-                               orphan_match_position,
-                               new_ad )
-                );
-            orphans_rescued++;
+            // keep what the SingletonAlignment needs
+            positions_[j] = orphan_match_position;
+            descriptors_[j] = new_ad;
 
 #ifdef DEBUG
             cerr << "ORPHAN RESCUED" << endl;
@@ -1007,6 +1119,83 @@ vector<SingletonAlignment> OrphanAligner::pullOutFragments( StringIndex& files,v
 #endif
 
     } // for
+} // ~OrphanRescuer::operator()
+
+
+void OrphanAligner::getSquashFile( const uint fileIndex, const StringIndex& files )
+{
+    if( fileIndex >= squashFiles_.size() )
+    {
+        squashFiles_.resize( fileIndex+1 );
+        hasContigIndex_.resize( fileIndex+1,false );
+    }
+    const bool hasContigIndex( files.contig_[fileIndex]!=NULL );
+    if( (squashFiles_[fileIndex].get()==NULL)
+        || (hasContigIndex_[fileIndex]!=hasContigIndex) )
+    {
+        squashFiles_[fileIndex]=boost::shared_ptr<SquashFile>(
+            new SquashFile(squashed_genome_, files.names_[fileIndex], files));
+        hasContigIndex_[fileIndex]=hasContigIndex;
+    }
+}
+
+
+vector<SingletonAlignment> OrphanAligner::pullOutFragments( StringIndex& files,vector<SingletonRequest>& req,uint& orphans_rescued )
+{
+    vector<SingletonAlignment> res;
+
+    if( req.size() == 0 )
+    {
+        return res;
+    }
+
+    sort( req.begin(),req.end(),lessThanSingleton );
+
+    // open the squashed files of the window before the threads start
+    uint cur_file_idx = UINT_INIT;
+    for( uint j=0;j<req.size();j++ )
+    {
+        if( cur_file_idx != req[j].fileIndex_ )
+        {
+            getSquashFile( req[j].fileIndex_,files );
+            cur_file_idx = req[j].fileIndex_;
+        }
+    }
+
+    vector<int> positions( req.size(),0 );
+    vector<string> descriptors( req.size() );
+    OrphanRescuer rescue( align_forward_,
+                          align_reverse_,
+                          numThreads_,
+                          req,
+                          squashFiles_,
+                          qual_string_,
+                          jump_forward_,
+                          maxNumberMismatches_,
+                          positions,
+                          descriptors );
+    casava::common::parallelFor( rescue,numThreads_,numThreads_ );
+
+    // gather the rescued orphans in request order
+    for( uint j=0;j<req.size();j++ )
+    {
+        if( descriptors[j] != "" )
+        {
+            // pull together SingletonAlignment
+            res.push_back( SingletonAlignment(
+                               req[j].readNum_,
+                               req[j].left_or_right_,
+                               req[j].fileIndex_,
+                               req[j].contigNum_,
+                               req[j].filePos_,
+                               (req[j].strand_=='F')?'R':'F',
+                               req[j].orphan_,
+                               positions[j],
+                               descriptors[j] )
+                );
+            orphans_rescued++;
+        }
+    }
 
     return res;
 }
@@ -1056,3 +1245,52 @@ string reverseComplement( const string& s )
 
   return result;
 }
+
+
+int InsertSizeHistogram::getMedian( void ) const
+{
+    assert( size_ > 0 );
+    boost::uint64_t rank = size_/2;
+
+    for( int i=0;i<DENSE_INSERT_SIZE;i++ )
+    {
+        if( rank < dense_[i] )
+        {
+            return i;
+        }
+        rank -= dense_[i];
+    }
+    for( map<int,boost::uint64_t>::const_iterator it=sparse_.begin();it!=sparse_.end();++it )
+    {
+        if( rank < it->second )
+        {
+            return it->first;
+        }
+        rank -= it->second;
+    }
+
+    assert( false ); // we counted size_ insert sizes
+    return 0;
+}
+
+
+double InsertSizeHistogram::getVariance( const int mean ) const
+{
+    double variance = 0.0;
+
+    for( int i=0;i<DENSE_INSERT_SIZE;i++ )
+    {
+        if( dense_[i] > 0 )
+        {
+            const double deviation = i-mean;
+            variance += dense_[i]*(deviation*deviation)/(double)(size_-1);
+        }
+    }
+    for( map<int,boost::uint64_t>::const_iterator it=sparse_.begin();it!=sparse_.end();++it )
+    {
+        const double deviation = it->first-mean;
+        variance += it->second*(deviation*deviation)/(double)(size_-1);
+    }
+
+    return variance;
+}
@@ -29,7 +29,7 @@
 
 #include <boost/bind.hpp>
 #include <boost/filesystem.hpp>
-#include <boost/ptr_container/ptr_vector.hpp>
+#include <boost/noncopyable.hpp>
 
 #include "common/Exceptions.hh"
 
@@ -41,14 +41,19 @@ namespace alignment
 namespace fs = boost::filesystem;
 
 /**
- ** \brief Parallel ifstream providing sequences and qualities cluster by cluster.
+ ** \brief BCL files of the cycles of a tile providing sequences and qualities cluster by cluster.
+ **
+ ** The clusters are read a block at a time, with one read per cycle file,
+ ** and the cycle-major bytes of the block are decoded into cluster-major
+ ** sequences and qualities that getCluster then copies out.
  **/
-class BclReader: protected boost::ptr_vector<std::ifstream>
+class BclReader: boost::noncopyable
 {
 public:
     typedef std::pair<std::string, std::string> Cluster;
     typedef Cluster RecordType;
     BclReader(const std::vector<fs::path> &pathList, const bool ignoreMissingBcl = false);
+    ~BclReader();
     unsigned int getClusterCount() const {return clusterCount_;}
     RecordType &get(RecordType &whereTo){
         getCluster(whereTo.first, whereTo.second);
@@ -61,19 +66,30 @@ public:
     void getCluster(std::string &bases);
 private:
     BclReader();
-    BclReader(const BclReader &);
-    BclReader &operator=(const BclReader &);
     const std::vector<fs::path> pathList_;
     const bool ignoreMissingBcl_;
+    /// one per BCL file, -1 for the files that could not be opened
+    std::vector<int> fileDescriptors_;
     const unsigned int clusterCount_;
     unsigned int currentCluster_;
+    /// clusters of the current block: [blockBegin_, blockEnd_)
+    unsigned int blockBegin_;
+    unsigned int blockEnd_;
+    /// BCL bytes of the current block, one cycle after the other
+    std::vector<unsigned char> blockBcl_;
+    /// decoded bases and qualities of the current block, one cluster after the other
+    std::vector<char> blockBases_;
+    std::vector<char> blockQualities_;
     unsigned int readClusterCount();
     unsigned int readClusterCount(const size_t index);
-    unsigned char decode(const size_t value) const;
+    void readBlock();
 };
 
 /**
- ** \brief ifstream providing filter information cluster by cluster.
+ ** \brief Filter file providing filter information cluster by cluster.
+ **
+ ** The filter values of all the clusters are loaded with a single read
+ ** once the header has been parsed.
  **/
 class FiltersReader : boost::noncopyable
 {
@@ -110,7 +126,7 @@ public:
         ++currentCluster_;
 
         whereTo = executeGuarded<unsigned int>(
-                boost::bind(&FiltersReaderImpl::doGetNextFilter, readerImplPtr_, boost::ref(is_)));
+                boost::bind(&FiltersReader::getLoadedFilter, this));
         return whereTo;
     }
 
@@ -123,7 +139,9 @@ public:
     public:
         virtual ~FiltersReaderImpl(){;}
         virtual unsigned int doReadClusterCount(std::istream &is) = 0;
-        virtual unsigned int doGetNextFilter(std::istream& is) = 0;
+        /// number of bytes per cluster
+        virtual unsigned int doGetFilterSize() const = 0;
+        virtual unsigned int doDecodeFilter(const unsigned char *filter) const = 0;
     };
 
 private:
@@ -133,12 +151,20 @@ private:
     boost::shared_ptr<FiltersReaderImpl> readerImplPtr_;
     const unsigned int clusterCount_;
     unsigned int currentCluster_;
+    /// filter values as stored in the file, for the clusters that could be read
+    std::vector<unsigned char> filters_;
+    unsigned int loadedClusterCount_;
 
     boost::shared_ptr<FiltersReaderImpl> createReader();
+    void loadFilters();
+    unsigned int getLoadedFilter() const;
 };
 
 /**
  ** \brief ifstream providing position information cluster by cluster.
+ **
+ ** The binary formats load the positions of all the clusters with a single
+ ** read once the header has been parsed (see loadData).
  **/
 class PositionsReader
 {
@@ -149,7 +175,7 @@ public:
     typedef std::pair<int, int> Position;
 
     PositionsReader(const fs::path &filePath, std::ios_base::openmode mode)
-    : filePath_(filePath), is_(filePath_.string().c_str(), mode), currentCluster_(0) {}
+    : filePath_(filePath), is_(filePath_.string().c_str(), mode), currentCluster_(0), dataOffset_(0) {}
 
     RecordType& get(RecordType &whereTo) {
         doGetFloatPosition(whereTo);
@@ -176,6 +202,12 @@ protected:
     const fs::path filePath_;
     std::ifstream is_;
     unsigned int currentCluster_;
+    /// the rest of the file after the header, for the binary formats
+    std::vector<char> data_;
+    size_t dataOffset_;
+    void loadData();
+    /// copies the next size bytes of data_, false if there are not enough left
+    bool readData(char *whereTo, const size_t size);
 private:
     virtual FloatPosition &doGetFloatPosition(FloatPosition &whereTo) = 0;
 };
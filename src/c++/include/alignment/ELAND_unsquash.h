@@ -37,6 +37,7 @@
 #include <sys/stat.h>
 
 
+#include "alignment/GenomeBundle.hh"
 #include "alignment/GlobalUtilities.hh"
 
 
@@ -124,13 +125,16 @@ private:
 struct ContigIndex
 {
 
-  ContigIndex( const string& squashDirName, const char* name ) { open(squashDirName + "/" + name + ".idx"); }
-  ContigIndex(const string& indexFilePath) { open(indexFilePath); }
+  ContigIndex( const string& squashDirName, const char* name )
+  {
+    const string chromPath(squashDirName + "/" + name);
+    read(casava::alignment::GenomeBundle::openIndex(chromPath), chromPath + ".idx");
+  }
+  ContigIndex(const string& indexFilePath) { read(fopen(indexFilePath.c_str(),"r"), indexFilePath); }
 
-  void open(const string& indexFilePath)
+  void read(FILE* pIndex, const string& indexFilePath)
   {
     cerr << "Making index " << indexFilePath << endl;
-    FILE* pIndex=fopen(indexFilePath.c_str(),"r");
     if (pIndex==NULL)
     {
       cerr << "Could not find index file " << indexFilePath << endl;
@@ -419,7 +423,7 @@ class SquashFile
 {
 public:
   //  SquashFile( string name, const StringIndex& files );
-  ~SquashFile() { munmap( pMap, fileSize ); }
+  ~SquashFile() { if (pMap!=NULL) munmap( pMap, fileSize ); }
 
   uint getNextBase( long long i)
   {
@@ -493,8 +497,93 @@ public:
   } // ~operator[]
 
 
+  // getBases: copy length bases of contig, starting at pos, to buf - the
+  // same bases as length calls to getNextBase() after goToPos(contig,pos),
+  // with 'N' outside the valid regions of the contig. Works a region at a
+  // time and, within a region, 16 bases per Word; does not move the
+  // position used by getNextBase(), so may be called from several threads
+  void getBases( int contig, long long pos, int length, char* buf ) const
+  {
+    const long long end(pos+length);
+    const pair<vector<ContigValidRegion>::const_iterator,
+               vector<ContigValidRegion>::const_iterator > regions
+      (equal_range(valid_.begin(),valid_.end(),
+                   ContigValidRegion(contig,pos,pos),
+                   lessThanContigNumContigValidRegion));
+    // first region of the contig ending at or after pos
+    vector<ContigValidRegion>::const_iterator region
+      (lower_bound(regions.first,regions.second,
+                   ContigValidRegion(contig,pos,pos),
+                   lessThanFinishContigValidRegion));
+
+    for (;(pos<end)&&(region!=regions.second);++region)
+    {
+      if (pos<region->start_)
+      { // not yet at start of region
+        const long long n(((end<region->start_) ? end : region->start_)-pos);
+        memset(buf,'N',n);
+        buf+=n;
+        pos+=n;
+      } // ~if
+      if (pos<end)
+      {
+        const long long n(((end<=region->finish_) ? end : region->finish_+1)-pos);
+        unpackBases(pos,n,buf);
+        buf+=n;
+        pos+=n;
+      } // ~if
+    } // ~for
+    if (pos<end) memset(buf,'N',end-pos);
+  } // ~getBases
+
   int getNumChars( void ) const { return numChars; }
 private:
+  // BaseQuads: the ASCII bases coded by each byte of a squashed Word
+  struct BaseQuads
+  {
+    BaseQuads( void )
+    {
+      for (uint b(0);b<256;b++)
+        for (uint k(0);k<4;k++)
+          quad_[b][k]=baseNames[(b>>(2*(3-k)))&0x3];
+    } // ~ctor
+    char quad_[256][4];
+  }; // ~struct BaseQuads
+
+  static const BaseQuads& getBaseQuads( void )
+  {
+    static const BaseQuads baseQuads;
+    return baseQuads;
+  } // ~getBaseQuads
+
+  // unpackBases: copy n bases from pos onwards to buf, all in a valid region
+  void unpackBases( long long pos, long long n, char* buf ) const
+  {
+    const Word* p(pWord+(pos>>4));
+    uint offset(pos&0xF);
+    if (offset!=0)
+    { // finish off a partly used Word
+      const Word w(*p++);
+      for (;(offset<16)&&(n>0);++offset,--n)
+        *buf++=baseNames[(w>>(2*(offset^0xF)))&0x3];
+    } // ~if
+    const BaseQuads& quads(getBaseQuads());
+    for (;n>=16;n-=16,buf+=16)
+    {
+      const Word w(*p++);
+      memcpy(buf,quads.quad_[w>>24],4);
+      memcpy(buf+4,quads.quad_[(w>>16)&0xFF],4);
+      memcpy(buf+8,quads.quad_[(w>>8)&0xFF],4);
+      memcpy(buf+12,quads.quad_[w&0xFF],4);
+    } // ~for
+    if (n>0)
+    {
+      const Word w(*p);
+      for (offset=0;offset<n;++offset)
+        *buf++=baseNames[(w>>(2*(offset^0xF)))&0x3];
+    } // ~if
+  } // ~unpackBases
+
   void *pMap;
   const char* pStart;
   const char* pEnd;
@@ -576,6 +665,20 @@ SquashFile( string squashDirName,
   } // ~else
 
 
+  // use the genome bundle's copy of the sequence if there is one
+  unsigned int chromNum(0);
+  const casava::alignment::GenomeBundle* pBundle
+    (casava::alignment::GenomeBundle::find(name, chromNum));
+  if (pBundle!=NULL)
+  {
+    pMap=NULL;
+    fileSize=pBundle->getSeqSize(chromNum);
+    pStart=pBundle->getSeq(chromNum);
+    pEnd=pStart+fileSize;
+    pWord = (const Word*) pStart;
+    return;
+  } // ~if
+
   // memory map sequence file
   name+=(string)".2bpb";
 
@@ -631,7 +734,17 @@ struct FragmentFinder
   reverseStrandStartOffset_(reverseStrandStartOffset)
   { assert(fragmentLength>=readLength); } // ~c'tor
 
+  ~FragmentFinder()
+  {
+    for (vector<SquashFile*>::iterator i(squashFiles_.begin());
+         i!=squashFiles_.end(); ++i)
+      delete *i;
+  } // ~d'tor
+
 private:
+  FragmentFinder( const FragmentFinder& );
+  FragmentFinder& operator=( const FragmentFinder& );
+
   const int readLength_;
   const int fragmentLength_;
   const int bases_ahead_;
@@ -639,12 +752,38 @@ private:
   const int reverseStrandStartOffset_;
   //  vector<int> numNs_;
   vector<NInfo> numNs_;
+  // squashFiles_: one per chromosome file, by file index, opened when
+  // first needed and kept until the FragmentFinder is destroyed.
+  // hasContigIndex_ notes whether the file's contig index had been read
+  // when it was opened, as it is only read once a request names a contig
+  vector<SquashFile*> squashFiles_;
+  vector<bool> hasContigIndex_;
+
+SquashFile& getSquashFile( const int fileIndex, const StringIndex& files )
+{
+  if ((uint)fileIndex>=squashFiles_.size())
+  {
+    squashFiles_.resize(fileIndex+1,NULL);
+    hasContigIndex_.resize(fileIndex+1,false);
+  } // ~if
+  const bool hasContigIndex(files.contig_[fileIndex]!=NULL);
+  if ((squashFiles_[fileIndex]==NULL)
+      ||(hasContigIndex_[fileIndex]!=hasContigIndex))
+  {
+    delete squashFiles_[fileIndex];
+    squashFiles_[fileIndex]=new SquashFile(squashDirName_,
+                                           files.names_[fileIndex],
+                                           files);
+    hasContigIndex_[fileIndex]=hasContigIndex;
+  } // ~if
+  return *squashFiles_[fileIndex];
+} // ~getSquashFile
 
 // default (= base class) behaviour of fetchFragment is to pull
 // genomic fragments from the squash files, orienting them in the
 // same direction as the read
 void fetchFragment
-(SquashFile& squash, const SeqRequest& i, const vector<char*>& reads, char* buf)
+(const SquashFile& squash, const SeqRequest& i, const vector<char*>& reads, char* buf)
 {
       buf[fragmentLength_]=0;
       if (NInfo::initSize_ == numNs_[i.readNum_].headSize_)
@@ -660,32 +799,25 @@ void fetchFragment
 
       if (i.strand_=='F')
       {
-	squash.goToPos
-	  (i.contigNum_,static_cast<long long>(i.filePos_)-numNs_[i.readNum_].headSize_-1-bases_ahead_);
-	for (int j(0);j<fragmentLength_;j++)
-	{
-	  buf[j]=squash.getNextBase();
-	  //	  buf[j]=(*squash_)[i.filePos_+j-numNs_[i.readNum_].headSize_-1];
-	} // ~for j
+	squash.getBases
+	  (i.contigNum_,
+	   static_cast<long long>(i.filePos_)-numNs_[i.readNum_].headSize_-1-bases_ahead_,
+	   fragmentLength_,buf);
       } // ~if
       else
       {
-
-	squash.goToPos(i.contigNum_,
-			  static_cast<long long>(i.filePos_)
-			  +numNs_[i.readNum_].headSize_
-			  -reverseStrandStartOffset_-1-bases_ahead_);
-
-	for (int j(0);j<fragmentLength_;j++)
+	squash.getBases(i.contigNum_,
+			static_cast<long long>(i.filePos_)
+			+numNs_[i.readNum_].headSize_
+			-reverseStrandStartOffset_-1-bases_ahead_,
+			fragmentLength_,buf);
+
+	// reverse complement in place
+	for (int j(0),k(fragmentLength_-1);j<=k;j++,k--)
 	{
-
-	  buf[fragmentLength_-1-j]
-	    =reverseCharASCII[(uint)(squash.getNextBase()) ];
-	  //	  buf[readLength_-1-j]
-	  //=reverseCharASCII[(uint)(*squash_)
-	  //	      [i.filePos_+j
-	  //	       +numNs_[i.readNum_].headSize_
-	  //	       -reverseStrandStartOffset_-1]];
+	  const char c(buf[j]);
+	  buf[j]=reverseCharASCII[(uint)buf[k]];
+	  buf[k]=reverseCharASCII[(uint)c];
 	} // ~for
       } // ~else
       //      cout << reads[i.readNum_] << " " << i.filePos_
@@ -702,8 +834,6 @@ void operator()
 {
   if (requests.empty()) return;
 
-  std::auto_ptr<SquashFile> pSquash;
-  int lastFile=requests[0].fileIndex_+1; // ensure false on first go
   sort( requests.begin(), requests.end(), lessThanRequest );
 
   numNs_.clear();
@@ -712,23 +842,6 @@ void operator()
   typedef std::vector<SeqRequest>::iterator sriter;
   sriter i(requests.begin()),i_end(requests.end());
   for (;i!=i_end;++i){
-    if (i->fileIndex_!=lastFile)
-    {
-	//	squashFileName=squashDirName_
-	//  +(string)"/"
-	//  +files.names_[i->fileIndex_]
-	//  +(string)".2bpb";
-
-	//	squashFileName=squashDirName_
-	//	  +(string)"/"
-	//  +files.names_[i->fileIndex_];
-
-      pSquash.reset(new SquashFile(squashDirName_,
-                                   files.names_[i->fileIndex_],
-                                   files));
-    } // ~if
-    lastFile=i->fileIndex_;
-
 #ifdef DEBUG
       cerr << "fetchFragment: DUMP SeqRequest = requestNum/readNum/fileIndex/contigNum/filePos/strand = "
 	   << i->requestNum_ << "/"
@@ -739,7 +852,7 @@ void operator()
 	   << i->strand_ << endl;
 #endif
 
-    fetchFragment(*(pSquash.get()), *i, reads, frags[i->requestNum_]);
+    fetchFragment(getSquashFile(i->fileIndex_, files), *i, reads, frags[i->requestNum_]);
   } // ~for i
 } // ~FragmentFinder::operator()
 }; // ~struct FragmentFinder
@@ -0,0 +1,149 @@
+/**
+ ** Copyright (c) 2007-2010 Illumina, Inc.
+ **
+ ** This software is covered by the "Illumina Genome Analyzer Software
+ ** License Agreement" and the "Illumina Source Code License Agreement",
+ ** and certain third party copyright/licenses, and any user of this
+ ** source file is bound by the terms therein (see accompanying files
+ ** Illumina_Genome_Analyzer_Software_License_Agreement.pdf and
+ ** Illumina_Source_Code_License_Agreement.pdf and third party
+ ** copyright/license notices).
+ **
+ ** This file is part of the Consensus Assessment of Sequence And VAriation
+ ** (CASAVA) software package.
+ **
+ ** \file GenomeBundle.hh
+ **
+ ** \brief All the squashed files of a genome directory in a single file.
+ **/
+
+
+#ifndef CASAVA_ALIGNMENT_GENOME_BUNDLE_HH
+#define CASAVA_ALIGNMENT_GENOME_BUNDLE_HH
+
+#include <cstdio>
+#include <map>
+#include <string>
+#include <boost/cstdint.hpp>
+
+namespace casava
+{
+namespace alignment
+{
+
+/*****************************************************************************/
+// GenomeBundle
+// Packs the .2bpb, .vld and .idx files of every squashed chromosome of a
+// directory into one file, written by squashGenome --bundle. The bundle is
+// memory mapped once per process and read in place: concurrent processes
+// aligning against the same genome share its pages, and nothing is parsed
+// or listed on start up.
+//
+// Layout: Header, one Entry per chromosome sorted by name, the null
+// terminated chromosome names, then for each chromosome the contents of its
+// .2bpb, .vld and .idx files, verbatim. Each .2bpb section starts on a page
+// boundary, the other sections on a Word boundary. Each Entry also records
+// the size and modification time of the files it was copied from: if any of
+// them has changed since, or a chromosome was added, the bundle is out of
+// date and get() ignores it, so that the individual files are read instead.
+// Files that have been deleted since are not checked, which leaves
+// directories holding only a bundle usable.
+//
+// Readers of squashed files (FileReader, SquashFile, ContigIndex,
+// ContigNameFinder) look the bundle up by directory through get(), and
+// fall back to the individual files if there is none.
+class GenomeBundle
+{
+public:
+    // name of the bundle within the genome directory
+    static const char* const fileName;
+
+    // get: bundle of directoryName, mapped on first use. NULL if the
+    // directory has no bundle, or one that is out of date. Bundles stay
+    // mapped until exit
+    static const GenomeBundle* get( const std::string& directoryName );
+
+    // setPopulate: prefault bundles mapped from now on into memory
+    // (MAP_POPULATE) rather than paging them in as the genome is scanned
+    static void setPopulate( const bool populate );
+
+    // find: bundle containing the chromosome at path dir/chromName,
+    // NULL if none. chromNum is set to its index in the bundle
+    static const GenomeBundle* find( const std::string& chromPath, unsigned int& chromNum );
+
+    // openIndex: open the .idx of the chromosome at chromPath for reading,
+    // from the bundle if there is one. NULL if the chromosome has no index
+    static FILE* openIndex( const std::string& chromPath );
+
+    // build: pack the squashed files of directoryName into its bundle
+    static void build( const std::string& directoryName, const int logLevel );
+
+    // remove: delete the bundle of directoryName, if any
+    static void remove( const std::string& directoryName, const int logLevel );
+
+    ~GenomeBundle();
+
+    unsigned int getNumChroms( void ) const { return pHeader_->numChroms_; }
+    const char* getChromName( const unsigned int i ) const { return pBase_ + pEntries_[i].nameOffset_; }
+    // findChrom: index of the chromosome, -1 if not in the bundle
+    int findChrom( const std::string& chromName ) const;
+
+    const char* getSeq( const unsigned int i ) const { return pBase_ + pEntries_[i].seqOffset_; }
+    boost::uint64_t getSeqSize( const unsigned int i ) const { return pEntries_[i].seqSize_; }
+    const char* getVld( const unsigned int i ) const { return pBase_ + pEntries_[i].vldOffset_; }
+    boost::uint64_t getVldSize( const unsigned int i ) const { return pEntries_[i].vldSize_; }
+    const char* getIdx( const unsigned int i ) const { return pBase_ + pEntries_[i].idxOffset_; }
+    // getIdxSize: 0 if the chromosome has no index
+    boost::uint64_t getIdxSize( const unsigned int i ) const { return pEntries_[i].idxSize_; }
+
+private:
+    struct Header
+    {
+        char magic_[8];
+        boost::uint32_t version_;
+        boost::uint32_t numChroms_;
+        boost::uint64_t fileSize_;
+    }; // ~struct Header
+
+    struct Entry
+    {
+        boost::uint64_t nameOffset_;
+        boost::uint64_t seqOffset_;
+        boost::uint64_t seqSize_;
+        boost::uint64_t vldOffset_;
+        boost::uint64_t vldSize_;
+        boost::uint64_t idxOffset_;
+        boost::uint64_t idxSize_;
+        // modification times of the .2bpb, .vld and .idx files, -1 if the
+        // chromosome had no .idx
+        boost::int64_t seqMtime_;
+        boost::int64_t vldMtime_;
+        boost::int64_t idxMtime_;
+    }; // ~struct Entry
+
+    GenomeBundle( const std::string& bundleName, const bool populate );
+    // isCurrent: false, with the reason why, if the files of directoryName
+    // the bundle was built from have changed since
+    bool isCurrent( const std::string& directoryName, std::string& reason ) const;
+
+    GenomeBundle( const GenomeBundle& );
+    GenomeBundle& operator=( const GenomeBundle& );
+
+    static const char magic[8];
+    static const boost::uint32_t version;
+
+    static std::map<std::string, GenomeBundle*> bundles_;
+    static bool populate_;
+
+    const std::string bundleName_;
+    size_t mapSize_;
+    void* pMap_;
+    const char* pBase_;
+    const Header* pHeader_;
+    const Entry* pEntries_;
+}; // ~class GenomeBundle
+
+} //namespace alignment
+} //namespace casava
+
+#endif //CASAVA_ALIGNMENT_GENOME_BUNDLE_HH
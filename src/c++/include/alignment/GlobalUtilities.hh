@@ -489,6 +489,50 @@ class ScoreSourceFilter : public ScoreSource
   }; // ~class ScoreSourceFilter
 
 
+/*****************************************************************************/
+// ReadName: the fields an Illumina read name is made of, for the sources
+// that build their names from them rather than read them (OligoSourceBcl).
+// Lets the names be stored and passed around without their text, which is
+// only produced by print when someone asks for it. The machine name, run
+// number and lane are the same for all the reads of a source and are kept
+// already formatted in prefix_.
+//
+// ReadNameFields are the fields that change from read to read, so that a
+// consumer holding many names can keep those and share a single ReadName
+// for the rest.
+struct ReadNameFields
+{
+  unsigned int tile_;
+  int x_;
+  int y_;
+  std::string index_;
+
+  ReadNameFields() : tile_(0), x_(0), y_(0) {}
+}; // ~struct ReadNameFields
+
+struct ReadName : public ReadNameFields
+{
+  std::string prefix_;
+  unsigned int readNumber_;
+
+  ReadName() : readNumber_(0) {}
+
+  // setPrefix: machine name, run number and lane of the reads
+  void setPrefix( const std::string& machineName,
+                  const unsigned int runNumber,
+                  const unsigned int lane );
+
+  // print: replace whereTo by ">machine_run:lane:tile:x:y#index/read",
+  // the run number being at least 4 digits
+  void print( std::string& whereTo ) const;
+
+  // print: write the name made of fields and of the prefix and read number
+  // of this ReadName to pOut or out, without building its text first
+  void print( FILE* pOut, const ReadNameFields& fields ) const;
+  void print( std::ostream& out, const ReadNameFields& fields ) const;
+}; // ~struct ReadName
+
+
 /*****************************************************************************/
 // OligoSource: obtain oligos in ASCII format from some source
 // (e.g. fasta file, raw sequence file, database, ... )
@@ -542,6 +586,13 @@ class OligoSource
     return NULL;
   } // ~getLastName
 
+  // Returns pointer to the fields of the name of last oligo read, or null
+  // if the source only has the name as text (see getLastName)
+  virtual const ReadName* getLastReadName( void )
+  {
+    return NULL;
+  } // ~getLastReadName
+
   // Rewind - next oligo read will be first in list
   virtual void rewind ( void ) =0;
 
@@ -646,6 +697,12 @@ class OligoSourceFilter : public OligoSource
     return pRaw_->getLastName();
   } // ~getLastName
 
+  // Returns pointer to the fields of the name of last oligo read
+  virtual const ReadName* getLastReadName( void )
+  {
+    return pRaw_->getLastReadName();
+  } // ~getLastReadName
+
   // Rewind - next oligo read will be first in list
   virtual void rewind ( void )
   {
@@ -66,6 +66,9 @@ class OligoSourceBcl : public OligoSource
     // Returns pointer to ASCII name of last oligo read
     virtual const char* getLastName( void );
 
+    // Returns pointer to the fields of the name of last oligo read
+    virtual const ReadName* getLastReadName( void );
+
     // Rewind - all streams
     virtual void rewind ( void );
 
@@ -87,6 +90,7 @@ class OligoSourceBcl : public OligoSource
     casava::alignment::FiltersReader *filtersReader_;
     casava::common::Sequence sequence_;
     std::string sequenceName_;
+    ReadName readName_;
     void initializeNewTile();
     bool getCluster();
 };
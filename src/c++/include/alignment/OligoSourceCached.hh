@@ -0,0 +1,182 @@
+/**
+ ** Copyright (c) 2007-2010 Illumina, Inc.
+ **
+ ** This software is covered by the "Illumina Genome Analyzer Software
+ ** License Agreement" and the "Illumina Source Code License Agreement",
+ ** and certain third party copyright/licenses, and any user of this
+ ** source file is bound by the terms therein (see accompanying files
+ ** Illumina_Genome_Analyzer_Software_License_Agreement.pdf and
+ ** Illumina_Source_Code_License_Agreement.pdf and third party
+ ** copyright/license notices).
+ **
+ ** This file is part of the Consensus Assessment of Sequence And VAriation
+ ** (CASAVA) software package.
+ **
+ ** \file OligoSourceCached.hh
+ **
+ ** \brief Keeps all the reads of another OligoSource in memory.
+ **/
+
+
+#ifndef CASAVA_ALIGNMENT_OLIGO_SOURCE_CACHED_HH
+#define CASAVA_ALIGNMENT_OLIGO_SOURCE_CACHED_HH
+
+#include <map>
+#include <boost/cstdint.hpp>
+
+#include "GlobalUtilities.hh"
+
+namespace casava
+{
+namespace alignment
+{
+
+/*****************************************************************************/
+// OligoSourceCached
+// Reads every oligo of another OligoSource once, on construction, and
+// serves all subsequent passes from memory, so that a rewind costs nothing
+// however expensive the original source is to decode (bcl, gzipped fastq).
+//
+// Bases are packed 2 bits per base, 16 bases per Word, each read starting
+// on a new Word. Anything that isn't A, C, G or T is flagged in a separate
+// bit mask, 1 bit per base, and comes back as 'N'; the mask is only stored
+// for the reads that need one. Reads containing any other non-ACGT
+// character are stored verbatim so that they are output exactly as they
+// were read. Names are kept in a side store, and qualities too if
+// isCachingQualities is set. Sources that provide the fields of their
+// names (see ReadName) have those stored instead, and the text of a name
+// is only produced when asked for.
+//
+// The reads are only ever visited in order, so where each one starts is
+// worked out from the lengths of the ones before it rather than stored.
+// The mask set by setMask is applied by read index. Only the sequence,
+// name and, if cached, quality of each read are retained.
+//
+// If batchSize is non-zero, at most batchSize oligos are held at a time:
+// the source then looks like it only contains the current batch, and
+// nextBatch replaces it with the following one.
+// Memory management policy: deletes pRaw_.
+class OligoSourceCached : public OligoSource
+{
+public:
+    OligoSourceCached( OligoSource* pRaw, const unsigned int batchSize=0,
+                       const bool isCachingQualities=false );
+    virtual ~OligoSourceCached();
+
+    // nextBatch: replace the oligos held by the next batchSize oligos
+    // of the raw source. Returns false if there are none left
+    bool nextBatch( void );
+
+    // Returns reference to next Sequence (supersedes getNextOligo).
+    // isValid will be false if there are no sequences left.
+    virtual const casava::common::Sequence& getNextSequenceSelect(bool& isValid,
+                                                                  const bool isProvideHeader,
+                                                                  const bool isProvideQualities);
+
+    // Returns reference to last Sequence fetched (supersedes getLastOligo).
+    // isValid will be false if there are no sequences left.
+    virtual const casava::common::Sequence& getLastSequence(bool& isValid) const
+    {
+        isValid = sequenceIsValid_;
+        return sequence_;
+    }
+
+    // Returns pointer to ASCII sequence of next oligo, or null if at end
+    virtual const char* getNextOligo( void )
+    {
+        bool unusedBool(false);
+        (void) getNextSequenceSelect(unusedBool, false, false);
+        return getLastOligo();
+    } // ~getNextOligo
+
+    // Returns pointer to ASCII sequence of last oligo fetched
+    virtual const char* getLastOligo( void ) const
+    {
+        return (sequenceIsValid_ ? sequence_.getData().c_str() : NULL);
+    } // ~getLastOligo
+
+    // Returns pointer to ASCII name of last oligo read
+    virtual const char* getLastName( void );
+
+    // Returns pointer to the fields of the name of last oligo read
+    virtual const ReadName* getLastReadName( void );
+
+    // Rewind - next oligo read will be first in list
+    virtual void rewind ( void )
+    {
+        current_ = 0;
+        baseCursor_ = 0;
+        nMaskCursor_ = 0;
+        nameCursor_ = 0;
+        qualityCursor_ = 0;
+        sequenceIsValid_ = false;
+    } // ~rewind
+
+    virtual int getNoSkippedSequences( void ) { return skippedSequences_; }
+
+    // number of oligos held
+    unsigned int getNumOligos( void ) const { return length_.size(); }
+
+    // true if the oligos held are the last of the raw source
+    bool isLastBatch( void ) const { return isRawExhausted_; }
+
+private:
+    // fill: read the next batch from pRaw_
+    void fill( void );
+    void store( const std::string& data, const std::string& quality,
+                const char* pName, const ReadName* pReadName );
+    void unpack( const unsigned int oligoNum );
+    // skip: move the cursors past oligo current_, and on to the next one
+    void skip( void );
+
+    OligoSource* pRaw_;
+    const unsigned int batchSize_;
+    const bool isCachingQualities_;
+    bool isRawExhausted_;
+
+    // bits 2n and 2n+1 of the 2-bit base codes (A=0, C=1, G=2, T=3)
+    std::vector<Word> bases_;
+    // 1 bit per base, set if the base is not A, C, G or T, only for the
+    // oligos that have any such base
+    std::vector<Word> nMask_;
+    // number of bases of each oligo, with the top bit set if it has an
+    // N mask
+    std::vector<unsigned short> length_;
+
+    // oligos containing characters other than ACGTN, stored verbatim
+    std::map<unsigned int, std::string> irregular_;
+
+    // null terminated names (or indexes, see nameFields_) and qualities,
+    // one after another
+    std::vector<char> names_;
+    std::vector<char> qualities_;
+    bool hasNames_;
+    bool hasQualities_;
+
+    // if the names come as ReadName, the tile, x and y of each oligo. The
+    // prefix and read number, common to all, are kept in readName_ along
+    // with the fields of the last oligo, and name_ is its text
+    bool hasReadNames_;
+    std::vector<int> nameFields_;
+    ReadName readName_;
+    std::string name_;
+
+    // oligo to be returned next, and where its bases, N mask, name and
+    // quality start
+    unsigned int current_;
+    boost::uint64_t baseCursor_;
+    boost::uint64_t nMaskCursor_;
+    boost::uint64_t nameCursor_;
+    boost::uint64_t qualityCursor_;
+    // where the name of the last oligo returned starts
+    boost::uint64_t lastName_;
+    int skippedSequences_;
+
+    casava::common::Sequence sequence_;
+    bool sequenceIsValid_;
+}; // ~class OligoSourceCached
+
+} //namespace alignment
+} //namespace casava
+
+#endif //CASAVA_ALIGNMENT_OLIGO_SOURCE_CACHED_HH
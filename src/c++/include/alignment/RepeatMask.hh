@@ -0,0 +1,111 @@
+/**
+ ** Copyright (c) 2007-2010 Illumina, Inc.
+ **
+ ** This software is covered by the "Illumina Genome Analyzer Software
+ ** License Agreement" and the "Illumina Source Code License Agreement",
+ ** and certain third party copyright/licenses, and any user of this
+ ** source file is bound by the terms therein (see accompanying files
+ ** Illumina_Genome_Analyzer_Software_License_Agreement.pdf and
+ ** Illumina_Source_Code_License_Agreement.pdf and third party
+ ** copyright/license notices).
+ **
+ ** This file is part of the Consensus Assessment of Sequence And VAriation
+ ** (CASAVA) software package.
+ **
+ ** \file RepeatMask.hh
+ **
+ ** \brief The high copy oligos of a squashed genome, for eland_ms to mask
+ ** repeat reads with.
+ **/
+
+
+#ifndef CASAVA_ALIGNMENT_REPEAT_MASK_HH
+#define CASAVA_ALIGNMENT_REPEAT_MASK_HH
+
+#include <string>
+#include <boost/cstdint.hpp>
+
+namespace casava
+{
+namespace alignment
+{
+
+/*****************************************************************************/
+// RepeatMask
+// The oligos of a given length that occur at least a given number of times
+// in the squashed files of a directory, counting both strands, written by
+// squashGenome --repeat-mask. eland_ms --repeat-mask maps it and masks the
+// reads whose first oligo is in it as repeats before hashing them, which is
+// what --repeat-file does with a list of repeats typed in by hand.
+//
+// Each oligo is stored 2 bits per base, first base in the most significant
+// bits, as the smaller of itself and its reverse complement. The oligos are
+// grouped into buckets by a hash of their value, the buckets being sized so
+// that they hold about one oligo each: a lookup reads one bucket start
+// from the directory then compares with the few oligos of the bucket.
+//
+// Layout: Header, the (numBuckets+1) bucket starts, padded to a Word
+// boundary, then the oligos sorted by bucket then value.
+class RepeatMask
+{
+public:
+    // name of the mask within the genome directory
+    static const char* const fileName;
+
+    // open: map the mask of directoryName. NULL if the directory has none
+    static RepeatMask* open( const std::string& directoryName );
+
+    // build: count the oligos of the squashed files of directoryName on
+    // numThreads threads, using about memoryLimit bytes, and store those
+    // found at least minCount times as its mask
+    static void build( const std::string& directoryName,
+                       const unsigned int oligoLength,
+                       const unsigned int minCount,
+                       const unsigned int numThreads,
+                       const boost::uint64_t memoryLimit,
+                       const int logLevel );
+
+    // remove: delete the mask of directoryName, if any
+    static void remove( const std::string& directoryName, const int logLevel );
+
+    ~RepeatMask();
+
+    unsigned int getOligoLength( void ) const { return pHeader_->oligoLength_; }
+    unsigned int getMinCount( void ) const { return pHeader_->minCount_; }
+    boost::uint64_t getNumOligos( void ) const { return pHeader_->numOligos_; }
+
+    // isRepeat: true if the first oligoLength bases of the read are a high
+    // copy oligo. Reads with anything other than ACGT in them are not
+    bool isRepeat( const char* pRead ) const;
+
+private:
+    struct Header
+    {
+        char magic_[8];
+        boost::uint32_t version_;
+        boost::uint32_t oligoLength_;
+        boost::uint32_t minCount_;
+        boost::uint32_t bucketBits_;
+        boost::uint64_t numOligos_;
+        boost::uint64_t fileSize_;
+    }; // ~struct Header
+
+    RepeatMask( const std::string& maskName );
+    RepeatMask( const RepeatMask& );
+    RepeatMask& operator=( const RepeatMask& );
+
+    static const char magic[8];
+    static const boost::uint32_t version;
+
+    const std::string maskName_;
+    size_t mapSize_;
+    void* pMap_;
+    const Header* pHeader_;
+    const boost::uint32_t* pBucketStarts_;
+    const boost::uint64_t* pOligos_;
+}; // ~class RepeatMask
+
+} //namespace alignment
+} //namespace casava
+
+#endif //CASAVA_ALIGNMENT_REPEAT_MASK_HH
@@ -18,34 +18,27 @@
 #ifndef GA_ALIGNER_H
 #define GA_AlIGNER_H
 
+#include <vector>
+#include <string>
+#include <algorithm>
+
 using namespace std;
 
 typedef unsigned char uchar;
 
 #define QUALSCALE 0.0333
 #define EPSILON 0.0000001
+#define SCORE_SCALE 10000 // QUALSCALE*SCORE_SCALE is a whole number
 #define UINT_INIT 1048576 // 2^20
 
 namespace ga { namespace alignment {
 
     typedef double ScoreType;
 
-    struct DPMatrix : public   vector<vector<ScoreType> >
-    {
-        DPMatrix( void ) {}
-        DPMatrix( int x, int y)
-        {
-            resize(x,y);
-        } // ~ctor
-
-        void resize( int x, int y)
-        {
-            vector<vector<ScoreType> >::resize(x);
-            for (int j(0);j<x;j++)
-                (*this)[j].resize(y);
-        } // ~resize;
-
-    };
+    // DPScore: a score held in the DP band, in units of 1/SCORE_SCALE.
+    // At that scale QUALSCALE-weighted integral match/mismatch scores are
+    // whole numbers, so cells compare exactly rather than to EPSILON
+    typedef int DPScore;
 
     struct Aligner
     {
@@ -80,6 +73,11 @@ Aligner( ScoreType w_match,
         } // ~operator()
 
 
+        // replayScore: the score the double precision DP would have given
+        // cell (i,j) of matrix m, from the traceback
+        ScoreType replayScore( const char* qvals_, const char* x, const char* y,
+                               int i, int j, int m, const int bandPad ) const;
+
         bool readAlignScoreFile( ifstream& in, ScoreType& m, ScoreType& mm, ScoreType& go, ScoreType& ge );
 
 
@@ -99,7 +97,20 @@ Aligner( ScoreType w_match,
         int expectedGapHit_;
 
 
-        DPMatrix E_,F_,G_,TE_,TF_,TG_;
+        // The DP only covers the band of cells (i,j) with i<=j<=i+2*width_.
+        // rows_ holds G, E and F for the previous and current row of the
+        // band, indexed by j-i; trace_ holds, for every row, one byte per
+        // band cell packing the G (bits 0-1), E (bits 2-3) and F (bits 4-5)
+        // traceback matrices, and lastCol_ the G/E/F scores of the cell in
+        // column y_size of each row
+        vector<DPScore> rows_;
+        vector<uchar> trace_;
+        vector<DPScore> lastCol_;
+        vector<DPScore> matchScore_;
+        vector<DPScore> mismatchScore_;
+        string yPad_;
+        // i, j and matrix of the end cells tied for the best score
+        vector<int> ties_;
 
         string xt_;
         string yt_;
@@ -114,39 +125,17 @@ Aligner( ScoreType w_match,
 
         void init( const int x_size, const int y_size, const int expected_gap, const int )
         {
-            E_ = DPMatrix(x_size+1,y_size+1);
-            F_ = DPMatrix(x_size+1,y_size+1);
-            G_ = DPMatrix(x_size+1,y_size+1);
-            TE_ = DPMatrix(x_size+1,y_size+1);
-            TF_ = DPMatrix(x_size+1,y_size+1);
-            TG_ = DPMatrix(x_size+1,y_size+1);
+            const int bandSize(min(2*width_,y_size)+1);
+            rows_.reserve(6*(bandSize+8));
+            trace_.reserve((x_size+1)*(bandSize+4));
+            lastCol_.reserve(3*(x_size+1));
+            yPad_.reserve(y_size+bandSize+4);
 
             expectedGapHit_ = expected_gap;
 
             init_ = true;
         } // init
 
-        void max3( ScoreType& max, ScoreType& which,
-                   const ScoreType& v0,
-                   const ScoreType& v1,
-                   const ScoreType& v2,
-                   const bool& forward)
-        {
-            if( forward == true )
-            {
-                max=v0; which=0;
-                if ( (v1-v0) > EPSILON )  { max=v1; which=1; }
-                if ( (v2-max) > EPSILON ) { max=v2; which=2; }
-            }
-            else
-            {
-                max=v2; which=2;
-                if ( (v1-v2) > EPSILON )  { max=v1; which=1; }
-                if ( (v0-max) > EPSILON ) { max=v0; which=0; }
-            }
-
-        } // ~Aligner::max3
-
 
 
         // GET/SET METHODS -------------------------------------------------------------------------
@@ -22,7 +22,6 @@
 #pragma once
 
 #include <boost/algorithm/string.hpp>
-#include <boost/regex.hpp>
 #include <cstdlib>
 #include <iostream>
 #include <stdint.h>
@@ -50,8 +49,8 @@ public:
 private:
     // populates the supplied casava read with the ELAND extended read name
     static void ExtractReadName(CasavaRead& cr, const char* pBegin, const char* pEnd);
-    // regex that captures information from a VMF file
-    static const boost::regex mPositionsRegex;
+    // parses a single position ("-?\d+(F|R)\S+") into the supplied alignment
+    static void ParsePosition(CasavaAlignment& ca, const char* pBegin, const char* pEnd);
     // flags used for the reference renaming strategy (both are false by default)
     bool mUseContigNames;
     bool mUseReferenceNames;
@@ -118,23 +118,27 @@ int sprintFloat(char *buffer, const float originalValue)
 }
 
 /**
- ** @brief Fast and portable output of an unsigned integer into a stream.
+ ** @brief Fast output of an unsigned integer into a buffer.
  **
  ** Drops all the usual formatting options to the benefit of speed.
  **
  ** Can be instantiated on unsigned versions of char, short, int and
  ** long, and generally on any type supporting '<=', '%', '/=', '+'
  ** and defining 'digits10 in std::numeric_limits.
+ **
+ ** @param buffer: the output buffer. Must have enough space available to store
+ ** 1 + digits10 characters. No terminating '\0' is written.
+ **
+ ** @return the number of characters written
  **/
 template<class T>
-std::ostream &putUnsignedInteger(std::ostream &os, T value)
+int sprintUnsignedInteger(char *buffer, T value)
 {
     // generate a compilation error when instantiated on signed types
     BOOST_MPL_ASSERT_MSG(boost::is_unsigned<T>::value,
-            SIGNED_TYPES_ARE_NOT_ALLOWED_FOR_putUnsignedInteger, (T));
+            SIGNED_TYPES_ARE_NOT_ALLOWED_FOR_sprintUnsignedInteger, (T));
 
-    char begin[1 + std::numeric_limits<T>::digits10];
-    char *buffer = begin;
+    char * const begin = buffer;
     while (10 <= value)
     {
         *buffer++ = '0' + (value % 10);
@@ -142,7 +146,40 @@ std::ostream &putUnsignedInteger(std::ostream &os, T value)
     }
     *buffer++ = '0' + value;
     std::reverse(begin, buffer);
-    return os.write(begin, buffer - begin);
+    return buffer - begin;
+}
+
+/**
+ ** @brief Fast output of an integer into a buffer.
+ **
+ ** Can be instantiated on (signed versions of) char, short, int and long.
+ ** The buffer must have enough space available to store 2 + digits10
+ ** characters.
+ **
+ ** @see sprintUnsignedInteger
+ **/
+template<class T>
+int sprintInteger(char *buffer, T value)
+{
+typedef    typename boost::make_unsigned<T>::type Unsigned;
+    if (0 > value)
+    {
+        *buffer = '-';
+        return 1 + sprintUnsignedInteger<Unsigned>(buffer + 1, Unsigned(0) - static_cast<Unsigned>(value));
+    }
+    return sprintUnsignedInteger<Unsigned>(buffer, static_cast<Unsigned>(value));
+}
+
+/**
+ ** @brief Fast and portable output of an unsigned integer into a stream.
+ **
+ ** @see sprintUnsignedInteger
+ **/
+template<class T>
+std::ostream &putUnsignedInteger(std::ostream &os, T value)
+{
+    char begin[1 + std::numeric_limits<T>::digits10];
+    return os.write(begin, sprintUnsignedInteger<T>(begin, value));
 }
 
 /**
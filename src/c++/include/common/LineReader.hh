@@ -57,6 +57,9 @@ protected:
     ~LineReader(void);
     // extracts another line from our memory buffer
     bool GetNextLine(std::string& s);
+    // points to the next line in our memory buffer (without the newline);
+    // the line stays valid until the next call
+    bool GetNextLine(const char*& pBegin, const char*& pEnd);
     // toggled according to the status of the underlying file stream(s)
     bool mIsOpen;
     // toggles base quality trimming
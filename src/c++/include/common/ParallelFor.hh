@@ -0,0 +1,153 @@
+/**
+ ** copyright (c) 2007-2010 Illumina, Inc.
+ **
+ ** This software is covered by the "Illumina Genome Analyzer Software
+ ** License Agreement" and the "Illumina Source Code License Agreement",
+ ** and certain third party copyright/licenses, and any user of this
+ ** source file is bound by the terms therein (see accompanying files
+ ** Illumina_Genome_Analyzer_Software_License_Agreement.pdf and
+ ** Illumina_Source_Code_License_Agreement.pdf and third party
+ ** copyright/license notices).
+ **
+ ** This file is part of the Consensus Assessment of Sequence And VAriation
+ ** (CASAVA) software package.
+ **
+ ** \file ParallelFor.hh
+ **
+ ** \brief Parallel loop over independent tasks
+ **
+ ** Runs a set of independent tasks on several threads
+ **/
+
+#ifndef CASAVA_COMMON_PARALLEL_FOR_H
+#define CASAVA_COMMON_PARALLEL_FOR_H
+
+#include <pthread.h>
+#include <cstring>
+#include <vector>
+#include <boost/exception_ptr.hpp>
+#include <boost/format.hpp>
+
+#include "common/Exceptions.hh"
+
+namespace casava
+{
+namespace common
+{
+
+// ParallelFor: calls task(i) once for each i in [0, numTasks), using up
+// to numThreads threads. Threads take the next task number due as they
+// become free, so tasks may complete in any order; any ordering the
+// caller needs must be restored afterwards. Returns when all the tasks
+// are done.
+//
+// If a task throws, no further tasks are started, and once the tasks
+// already running are done the first exception thrown is rethrown on the
+// calling thread. The same goes if a thread can't be created: the tasks
+// running are finished and a CasavaException is thrown
+template <class Task> class ParallelFor
+{
+public:
+  ParallelFor( Task& task, const unsigned int numTasks ) :
+    task_(task), numTasks_(numTasks), nextTask_(0), isFailed_(false)
+  {
+    pthread_mutex_init(&failLock_, NULL);
+  } // ~ctor
+
+  ~ParallelFor()
+  {
+    pthread_mutex_destroy(&failLock_);
+  } // ~dtor
+
+  void run( const unsigned int numThreads )
+  {
+    const unsigned int n((numThreads<numTasks_) ? numThreads : numTasks_);
+    if (n<=1)
+    {
+      for (unsigned int i(0);i<numTasks_;i++) task_(i);
+      return;
+    } // ~if
+
+    // the calling thread is one of the n
+    std::vector<pthread_t> threads(n-1);
+    unsigned int numCreated(0);
+    int createError(0);
+    for (;numCreated<n-1;numCreated++)
+    {
+      createError=pthread_create(&threads[numCreated], NULL, worker, (void*) this);
+      if (createError!=0)
+      {
+        // stop the threads already running from starting any more tasks
+        fail(boost::exception_ptr());
+        break;
+      } // ~if
+    } // ~for numCreated
+    if (createError==0) worker((void*) this);
+    for (unsigned int i(0);i<numCreated;i++)
+    {
+      pthread_join(threads[i], NULL);
+    } // ~for i
+
+    if (exception_) boost::rethrow_exception(exception_);
+    if (createError!=0)
+    {
+      // pthread_create returns its error code rather than setting errno
+      BOOST_THROW_EXCEPTION(CasavaException(createError,
+          (boost::format("Failed to create thread %d of %d: %s")
+           % (numCreated+1) % n % strerror(createError)).str()));
+    } // ~if
+  } // ~run
+
+private:
+  static void* worker( void* pv )
+  {
+    ParallelFor* pThis((ParallelFor*)pv);
+    try
+    {
+      for (unsigned int i(__sync_fetch_and_add(&pThis->nextTask_, 1));
+           (i<pThis->numTasks_)&&(!pThis->isFailed_);
+           i=__sync_fetch_and_add(&pThis->nextTask_, 1))
+      {
+        pThis->task_(i);
+      } // ~for i
+    } // ~try
+    catch (...)
+    {
+      pThis->fail(boost::current_exception());
+    } // ~catch
+    return NULL;
+  } // ~worker
+
+  // fail: stop handing out tasks, keeping the first exception
+  void fail( const boost::exception_ptr& exception )
+  {
+    pthread_mutex_lock(&failLock_);
+    if (!isFailed_)
+    {
+      isFailed_=true;
+      exception_=exception;
+    } // ~if
+    pthread_mutex_unlock(&failLock_);
+  } // ~fail
+
+  Task& task_;
+  const unsigned int numTasks_;
+  unsigned int nextTask_;
+
+  // set once a task has thrown or a thread couldn't be created
+  volatile bool isFailed_;
+  boost::exception_ptr exception_;
+  pthread_mutex_t failLock_;
+}; // ~class ParallelFor
+
+// parallelFor: run task(0) ... task(numTasks-1) on up to numThreads threads
+template <class Task>
+void parallelFor( Task& task, const unsigned int numTasks, const unsigned int numThreads )
+{
+  ParallelFor<Task>(task, numTasks).run(numThreads);
+} // ~parallelFor
+
+} //namespace common
+} //namespace casava
+
+#endif // CASAVA_COMMON_PARALLEL_FOR_H
@@ -25,13 +25,17 @@
 #define CASAVA_ALIGNMENT_ELAND_MAIN_HH
 
 #include <dirent.h>
+#include <malloc.h>
 #include <boost/filesystem.hpp>
 #include <boost/format.hpp>
 #include <boost/foreach.hpp>
 
+#include "alignment/GenomeBundle.hh"
 #include "alignment/OligoSourceBcl.hh"
+#include "alignment/OligoSourceCached.hh"
 #include "alignment/OligoSourceQseq.hh"
 #include "alignment/OligoSourceFastq.hh"
+#include "alignment/RepeatMask.hh"
 
 #include "MatchPositionTranslator.hh"
 #include "SuffixScoreTable.hh"
@@ -60,14 +64,23 @@ private:
     const unsigned int oligoLength;
     const std::list<fs::path> qseq_file_list;
     const std::string genome_dir;
-    OligoSource* pOligos;
+    ca::OligoSourceCached* pOligos;
     short no_of_seeds;
+    int read_length;
     MatchTable* pResults;
     MatchTable* pResults_2;
+    RepeatTable<OLIGO_LEN>* pRepeats;
+    ca::RepeatMask* pRepeatMask;
+    const fs::path output_file;
+    const fs::path tmp_file_prefix;
+    const std::vector<unsigned int> max_num_matches;
     const bool do_ungapped;
     bool do_singleseed;
     const bool do_debug;
     const bool do_sensitive;
+    const unsigned int num_threads;
+    const unsigned int prefetch_distance;
+    const unsigned int match_memory;
     Timer timer;
 
     OligoSource* getOligoSource(const std::string &dataFormat,
@@ -138,6 +151,7 @@ ELAND(const fs::path &oligoFile,
              const fs::path &outputFile,
              const std::vector<unsigned int> &maxNumMatches,
              const fs::path &repeatFile,
+             const bool &repeatMask,
              const bool &singleSeed,
              const bool &debug,
              const bool &ungap,
@@ -157,18 +171,34 @@ ELAND(const fs::path &oligoFile,
              const std::string &sample,
              const std::string &barcode,
              const std::vector<unsigned int> &clusterSets,
-             const boost::format &positionsFileNameFormat)
+             const boost::format &positionsFileNameFormat,
+             const unsigned int numThreads,
+             const unsigned int batchSize,
+             const unsigned int prefetchDistance,
+             const unsigned int matchMemory)
     : oligoLength(OLIGO_LEN)
     , genome_dir(genomeDirectory.string())
-    , pOligos(getOligoSource(dataFormat, instrumentName, runNumber, lane, read, tiles,
-            sample, barcode, clusterSets,
-            inputDirectory, filterDirectory, positionsDirectory, useBases, cycles,
-            oligoFile, positionsFileNameFormat))
+    // the oligos get read about ten times per run, so decode them only once
+    , pOligos(new ca::OligoSourceCached(
+            getOligoSource(dataFormat, instrumentName, runNumber, lane, read, tiles,
+                           sample, barcode, clusterSets,
+                           inputDirectory, filterDirectory, positionsDirectory, useBases, cycles,
+                           oligoFile, positionsFileNameFormat),
+            batchSize))
     , pResults(NULL)
+    , pResults_2(NULL)
+    , pRepeats(NULL)
+    , pRepeatMask(NULL)
+    , output_file(outputFile)
+    , tmp_file_prefix(tmpFilePrefix)
+    , max_num_matches(maxNumMatches)
     , do_ungapped(ungap)
     , do_singleseed(singleSeed)
     , do_debug(debug)
     , do_sensitive(sensitive)
+    , num_threads(numThreads)
+    , prefetch_distance(prefetchDistance)
+    , match_memory(matchMemory)
 {
     assert(oligoLength!=0);
 
@@ -200,8 +230,14 @@ ELAND(const fs::path &oligoFile,
        << "and recompile." << endl;
 #endif
 
+  if (0 != batchSize)
+      cerr << "Will align oligos in batches of " << batchSize << endl;
+  if (0 != prefetchDistance)
+      cerr << "Will hash " << prefetchDistance
+           << " genome positions ahead of the scan" << endl;
+
   const char* pTest=pOligos->getNextOligo();
-  const int read_length = pTest ? strlen(pTest) : 0;
+  read_length = pTest ? strlen(pTest) : 0;
   if (pTest==NULL)
   {
     cerr << "WARNING: there do not appear to be any sequences in file "
@@ -261,44 +297,39 @@ ELAND(const fs::path &oligoFile,
       cerr << "Will use only one seed per read." << endl;
 
   // MULTI command line argument
-  if (3 == maxNumMatches.size())
+  if (3 != maxNumMatches.size())
   {
-      pResults = new MatchTableMulti(OLIGO_LEN,outputFile.string().c_str(),
-                                     debug,
-                                     maxNumMatches[0],
-                                     maxNumMatches[1],
-                                     maxNumMatches[2],
-                                     tmpFilePrefix.empty() ? 0 : tmpFilePrefix.string().c_str());
-      pResults->setSensitivity(do_sensitive);
-
-      // build up a second match table for the second tier
-      pResults_2 = new MatchTableMultiSquareSeed(OLIGO_LEN,"/dev/null",
-                                                 false,
-                                                 (maxNumMatches[0]*6),
-                                                 (maxNumMatches[1]*6),
-                                                 (maxNumMatches[2]*6),
-                                                 tmpFilePrefix.empty() ? 0 : (tmpFilePrefix.string() + ".t2").c_str());
-//      pResults_2->setNoOfSeeds(no_of_seeds);
-      pResults_2->setSensitivity(do_sensitive);
-      pResults_2->setNoOfSeeds(4);
-      pResults_2->setReadLength(read_length);
-  } else {
       BOOST_THROW_EXCEPTION( CasavaException(EINVAL,
             (boost::format("Cannot match Table with given --multi. Expected 3, got %d parameters.") % maxNumMatches.size()).str()
       ));
   }
 
-  RepeatTable<OLIGO_LEN>* pRepeats(NULL);
   if (!repeatFile.empty())
+  {
       pRepeats = new RepeatTable<OLIGO_LEN>(repeatFile.string().c_str());
+      cerr << "Will scan for repeats in list " << repeatFile.string() << endl;
+  }
 
-  if (pRepeats!=NULL)
+  // use the repeat mask squashGenome built for the genome, if asked to
+  if (repeatMask)
   {
-    cerr << "Scanning for repeats in list " << repeatFile.string() << ": " << timer << endl;
-    pRepeats->checkOligos( *pOligos, *pResults );
-    cerr << "Scanned repeats: " << timer << endl;
-    delete pRepeats;
-  } // ~if
+      pRepeatMask = ca::RepeatMask::open(genome_dir);
+      if (pRepeatMask==NULL)
+      {
+          cerr << "WARNING: --repeat-mask given but " << genome_dir << " has no repeat mask" << endl;
+      }
+  }
+  if (pRepeatMask!=NULL && pRepeatMask->getOligoLength()!=oligoLength)
+  {
+      cerr << "WARNING: ignoring the repeat mask of " << genome_dir << ": it was built for oligos of length "
+           << pRepeatMask->getOligoLength() << endl;
+      delete pRepeatMask;
+      pRepeatMask = NULL;
+  }
+  else if (pRepeatMask!=NULL)
+  {
+      cerr << "Will scan for repeats in the repeat mask of " << genome_dir << endl;
+  }
 }
 
 
@@ -306,6 +337,79 @@ ELAND(const fs::path &oligoFile,
 {
     delete pOligos;
     delete pResults;
+    delete pResults_2;
+    delete pRepeats;
+    delete pRepeatMask;
+}
+
+// createResults: build the match tables for the batch of oligos currently
+// held by pOligos. firstOligo is the number of oligos in earlier batches
+void createResults( const unsigned int firstOligo )
+{
+  delete pResults;
+  delete pResults_2;
+
+  MatchTableMulti* pMulti = new MatchTableMulti(OLIGO_LEN,output_file.string().c_str(),
+                                 do_debug,
+                                 max_num_matches[0],
+                                 max_num_matches[1],
+                                 max_num_matches[2],
+                                 tmp_file_prefix.empty() ? 0 : tmp_file_prefix.string().c_str(),
+                                 firstOligo);
+  pMulti->setHitMemoryLimit((size_t)match_memory<<20);
+  pMulti->setNumThreads(num_threads);
+  pResults = pMulti;
+  pResults->setSensitivity(do_sensitive);
+
+  // build up a second match table for the second tier
+  MatchTableMultiSquareSeed* pMultiSeed = new MatchTableMultiSquareSeed(OLIGO_LEN,"/dev/null",
+                                             false,
+                                             (max_num_matches[0]*6),
+                                             (max_num_matches[1]*6),
+                                             (max_num_matches[2]*6),
+                                             tmp_file_prefix.empty() ? 0 : (tmp_file_prefix.string() + ".t2").c_str());
+  pMultiSeed->setHitMemoryLimit((size_t)match_memory<<20);
+  pResults_2 = pMultiSeed;
+//  pResults_2->setNoOfSeeds(no_of_seeds);
+  pResults_2->setSensitivity(do_sensitive);
+  pResults_2->setNoOfSeeds(4);
+  pResults_2->setReadLength(read_length);
+
+  if (pRepeats!=NULL)
+  {
+    cerr << "Scanning for repeats: " << timer << endl;
+    pRepeats->checkOligos( *pOligos, *pResults );
+    cerr << "Scanned repeats: " << timer << endl;
+  } // ~if
+
+  if (pRepeatMask!=NULL)
+  {
+    cerr << "Scanning for genome repeats: " << timer << endl;
+    maskRepeats();
+    cerr << "Scanned genome repeats: " << timer << endl;
+  } // ~if
+}
+
+// maskRepeats: flag the oligos of the batch whose first seed is in the
+// repeat mask, so that they are not hashed
+void maskRepeats()
+{
+  const char* pOligo;
+  unsigned int numRepeats(0), numEntries(0);
+  while ((pOligo=pOligos->getNextOligoSelect(false,false))!=NULL)
+  {
+    ++numEntries;
+    if (pRepeatMask->isRepeat(pOligo))
+    {
+      ++numRepeats;
+      pResults->resize(numEntries+1);
+      pResults->setRepeatMasked__(numEntries);
+    } // ~if
+  } // ~while
+
+  pOligos->rewind();
+  cerr << "found " << numRepeats << " genome repeats in " << numEntries << " oligos" << endl;
+  pResults->resize(numEntries+1);
 }
 
 void presentation()
@@ -337,50 +441,60 @@ void run()
                               ElandConstants<OLIGO_LEN>::fragLengthB,
                               ElandConstants<OLIGO_LEN>::fragLengthC,
                               ElandConstants<OLIGO_LEN>::fragLengthD);
+  // the hash table buffers, used by both tiers: each table built clears
+  // what the previous one left
   HashTableDataStore<ElandConstants<OLIGO_LEN>::useSplitPrefix> htds1, htds2;
-  // second tier
-  HashTableDataStore<ElandConstants<OLIGO_LEN>::useSplitPrefix> htds1_2, htds2_2;
-
-  const char suffixName[] = ".2bpb";
-  cerr << "Trying to open directory " << genome_dir  << " ..." << endl;
-
-  DIR* pDir;
-  if ( ! ( pDir = opendir( genome_dir.c_str() ) ) )
-  {
-    cerr << " ... failed!" << endl;
-    exit(-1);
-  } // ~if
-
-  char dirBuffer[80];
-  dirent* dirEntry;
 
   // chromosome names are indexed starting at 1
   // (because in OligoInfo a chromosome num of 0 indicates no match found)
   vector<string> chromNames(1); // %%%%% (1);
-  vector<MatchPosition> blockStarts(1);
 
   // variables for the second tier
   vector<string> chromNames_2(1); // %%%%% (1);
-  vector<MatchPosition> blockStarts_2(1);
 
 
   const string directoryName((genome_dir)+'/');
   //  string fullChromName;
 
-  // get chromosome names from directory then close it
-  while( (dirEntry = readdir(pDir)) )
+  const ca::GenomeBundle* pBundle(ca::GenomeBundle::get(genome_dir));
+  if (pBundle != NULL)
+  {
+    // get chromosome names from the bundle
+    cerr << "Using genome bundle of directory " << genome_dir << endl;
+    for (unsigned int i(0); i < pBundle->getNumChroms(); ++i)
+    {
+      chromNames.push_back(pBundle->getChromName(i));
+      chromNames_2.push_back(pBundle->getChromName(i));
+    } // ~for i
+  } // ~if
+  else
   {
-    strcpy(dirBuffer, dirEntry->d_name);
-    // keep only the files with suffix matching suffixName
-    char* const pSuffixStart = dirBuffer + strlen(dirBuffer) - strlen(suffixName);
-    if ( strlen(dirBuffer) >= strlen(suffixName) && 0 == strcmp(pSuffixStart, suffixName) )
+    const string suffixName(".2bpb");
+    cerr << "Trying to open directory " << genome_dir  << " ..." << endl;
+
+    DIR* pDir;
+    if ( ! ( pDir = opendir( genome_dir.c_str() ) ) )
     {
-      *pSuffixStart='\0';
-      chromNames.push_back((string)dirBuffer);
-      chromNames_2.push_back((string)dirBuffer);
+      cerr << " ... failed!" << endl;
+      exit(-1);
     } // ~if
-  } // ~while
-  closedir( pDir );
+
+    dirent* dirEntry;
+
+    // get chromosome names from directory then close it
+    while( (dirEntry = readdir(pDir)) )
+    {
+      const string fileName(dirEntry->d_name);
+      // keep only the files with suffix matching suffixName
+      if ( fileName.size() >= suffixName.size()
+           && 0 == fileName.compare(fileName.size() - suffixName.size(), suffixName.size(), suffixName) )
+      {
+        chromNames.push_back(fileName.substr(0, fileName.size() - suffixName.size()));
+        chromNames_2.push_back(chromNames.back());
+      } // ~if
+    } // ~while
+    closedir( pDir );
+  } // ~else
 
   // Add in fix to issue IMP-21 - sort chromosome names so as to always get
   // consistent results
@@ -388,105 +502,131 @@ void run()
   sort (chromNames.begin(),chromNames.end());
   sort (chromNames_2.begin(),chromNames_2.end());
 
-
-  // do pass 0
+  // align the oligos one batch at a time. Each batch gives the hash table
+  // buffers back once its scans are done, so that they are not held while
+  // its results are merged and output
+  unsigned int firstOligo(0);
+  do
   {
-    OligoHashTable<0, OLIGO_LEN> hashTable (oligoLength, htds1, htds2, scoreTable, *pResults);
-    scanAll<0, OLIGO_LEN>( pOligos, directoryName, chromNames, blockStarts, hashTable, timer,true );
-  } // ~scope of hashTable
+    if (0 != firstOligo)
+        cerr << "Starting batch at oligo " << firstOligo << ": " << timer << endl;
+
+    createResults(firstOligo);
+
+    vector<MatchPosition> blockStarts(1);
+    vector<MatchPosition> blockStarts_2(1);
+
+    // do pass 0
+    {
+      OligoHashTable<0, OLIGO_LEN> hashTable (oligoLength, htds1, htds2, scoreTable, *pResults, prefetch_distance);
+      scanAll<0, OLIGO_LEN>( pOligos, directoryName, chromNames, blockStarts, hashTable, timer,true, num_threads );
+    } // ~scope of hashTable
 
 #ifndef ONE_ERROR_PER_OLIGO
-  // do pass 1
-  {
-    OligoHashTable<1, OLIGO_LEN> hashTable (oligoLength, htds1, htds2, scoreTable, *pResults);
-    scanAll<1, OLIGO_LEN>( pOligos, directoryName, chromNames, blockStarts, hashTable, timer,true );
-  } // ~scope of hashTable
+    // do pass 1
+    {
+      OligoHashTable<1, OLIGO_LEN> hashTable (oligoLength, htds1, htds2, scoreTable, *pResults, prefetch_distance);
+      scanAll<1, OLIGO_LEN>( pOligos, directoryName, chromNames, blockStarts, hashTable, timer,true, num_threads );
+    } // ~scope of hashTable
 
-  // do pass 2
-  {
-    OligoHashTable<2, OLIGO_LEN> hashTable (oligoLength, htds1, htds2, scoreTable, *pResults);
-    scanAll<2, OLIGO_LEN>( pOligos, directoryName, chromNames, blockStarts, hashTable, timer,true );
-  } // ~scope of hashTable
+    // do pass 2
+    {
+      OligoHashTable<2, OLIGO_LEN> hashTable (oligoLength, htds1, htds2, scoreTable, *pResults, prefetch_distance);
+      scanAll<2, OLIGO_LEN>( pOligos, directoryName, chromNames, blockStarts, hashTable, timer,true, num_threads );
+    } // ~scope of hashTable
 #endif
 
-  // clear some space - pResults->print may need it for MatchTableMulti
-  htds1.clear();
-  htds2.clear();
+    // clear some space - pResults->print may need it for MatchTableMulti.
+    // The second tier, if any, builds its tables in the same buffers
+    if (do_singleseed)
+    {
+      htds1.clear();
+      htds2.clear();
+    }
 
-  MatchPositionTranslator getMatchPos( chromNames, blockStarts, directoryName );
+    MatchPositionTranslator getMatchPos( chromNames, blockStarts, directoryName );
 
 
-  if( !do_singleseed )
-  {
+    if( !do_singleseed )
+    {
 
-      cerr << "Looking for unmapped reads... ";
-      vector<bool> unmappedReads;
-      if( pResults->getUnmappedReads( unmappedReads ) == true )
-      {
-          cerr << "done." << endl;
-      }
-      else
-      {
-          cerr << "failed." << endl;
-      }
+        cerr << "Looking for unmapped reads... ";
+        vector<bool> unmappedReads;
+        if( pResults->getUnmappedReads( unmappedReads ) == true )
+        {
+            cerr << "done." << endl;
+        }
+        else
+        {
+            cerr << "failed." << endl;
+        }
 
-      cerr << "Setting oligo mask...";
-      pOligos->setMask( unmappedReads );
+        cerr << "Setting oligo mask...";
+        pOligos->setMask( unmappedReads );
 
-      // rewind pOligos again
-      pOligos->rewind();
+        // rewind pOligos again
+        pOligos->rewind();
 
 
-      // do the multiseed stage
-      cerr << "Performing multi-seed for reads not matched so far..." << endl;
+        // do the multiseed stage
+        cerr << "Performing multi-seed for reads not matched so far..." << endl;
 
-      // do pass 0
-      {
-          OligoHashTable<0, OLIGO_LEN> hashTable(oligoLength, htds1_2, htds2_2, scoreTable, *pResults_2);
-          scanAll<0, OLIGO_LEN>( pOligos, directoryName, chromNames_2, blockStarts_2, hashTable, timer,false );
-      } // ~scope of hashTable
+        // do pass 0
+        {
+            OligoHashTable<0, OLIGO_LEN> hashTable(oligoLength, htds1, htds2, scoreTable, *pResults_2, prefetch_distance);
+            scanAll<0, OLIGO_LEN>( pOligos, directoryName, chromNames_2, blockStarts_2, hashTable, timer,false, num_threads );
+        } // ~scope of hashTable
 
 #ifndef ONE_ERROR_PER_OLIGO
-      // do pass 1
-      {
-          OligoHashTable<1, OLIGO_LEN> hashTable(oligoLength, htds1_2, htds2_2, scoreTable, *pResults_2);
-          scanAll<1, OLIGO_LEN>( pOligos, directoryName, chromNames_2, blockStarts_2, hashTable, timer,false );
-      } // ~scope of hashTable
+        // do pass 1
+        {
+            OligoHashTable<1, OLIGO_LEN> hashTable(oligoLength, htds1, htds2, scoreTable, *pResults_2, prefetch_distance);
+            scanAll<1, OLIGO_LEN>( pOligos, directoryName, chromNames_2, blockStarts_2, hashTable, timer,false, num_threads );
+        } // ~scope of hashTable
 
-      // do pass 2
-      {
-          OligoHashTable<2, OLIGO_LEN> hashTable(oligoLength, htds1_2, htds2_2, scoreTable, *pResults_2);
-          scanAll<2, OLIGO_LEN>( pOligos, directoryName, chromNames_2, blockStarts_2, hashTable, timer,false );
-      } // ~scope of hashTable
+        // do pass 2
+        {
+            OligoHashTable<2, OLIGO_LEN> hashTable(oligoLength, htds1, htds2, scoreTable, *pResults_2, prefetch_distance);
+            scanAll<2, OLIGO_LEN>( pOligos, directoryName, chromNames_2, blockStarts_2, hashTable, timer,false, num_threads );
+        } // ~scope of hashTable
 #endif
 
-      htds1_2.clear();
-      htds2_2.clear();
+        htds1.clear();
+        htds2.clear();
 
 
-      // reset pOligos, otherwise we only print a subset of all the reads
-      pOligos->unSetMask();
+        // reset pOligos, otherwise we only print a subset of all the reads
+        pOligos->unSetMask();
 
-      // you have to ensure that pResults_2 is of type MatchTableMulti
-      cerr << "Merging results..." << endl;
-      if( pResults->mergeTable( pResults_2,getMatchPos ) == false )
-      {
-          cerr << "Error retrieving match information from the second run, will use information only from singleseed run." << endl;
-      }
-      // get rid of pResults_2 do save memory
-      delete pResults_2;
-      cerr << "done." << endl;
+        // you have to ensure that pResults_2 is of type MatchTableMulti
+        cerr << "Merging results..." << endl;
+        if( pResults->mergeTable( pResults_2,getMatchPos ) == false )
+        {
+            cerr << "Error retrieving match information from the second run, will use information only from singleseed run." << endl;
+        }
+        // get rid of pResults_2 do save memory
+        delete pResults_2;
+        pResults_2 = NULL;
+        cerr << "done." << endl;
 
-  } //~if( !do_singleseed )
+    } //~if( !do_singleseed )
 
 
-  cerr << "Outputting results: " << timer << endl;
+    cerr << "Outputting results: " << timer << endl;
 
 
-  pResults->setNoOfSeeds(no_of_seeds);
-  pResults->printSquash
-    ( *pOligos , getMatchPos, chromNames, blockStarts, scoreTable, oligoLength,directoryName,!do_ungapped );
+    pResults->setNoOfSeeds(no_of_seeds);
+    pResults->printSquash
+      ( *pOligos , getMatchPos, chromNames, blockStarts, scoreTable, oligoLength,directoryName,!do_ungapped );
 
+    firstOligo += pOligos->getNumOligos();
+    delete pResults;
+    pResults = NULL;
+    // the output leaves its freed memory scattered over the heap; give it
+    // back to the system rather than hold it on top of the next batch's
+    // hash tables
+    malloc_trim(0);
+  } while (pOligos->nextBatch());
 
   cerr << "... done " << timer << endl;
   cerr << "Run complete! Time now: " << timer.timeNow();
@@ -49,6 +49,8 @@ namespace eland_ms
           bool singleseed_;
           bool debug_;
           bool sensitive_;
+          bool populateGenome_;
+          bool repeatMask_;
           std::string useBases_;
           std::vector<unsigned int> cycles_;
           unsigned int lane_;
@@ -65,6 +67,10 @@ namespace eland_ms
           unsigned int runNumber_;
           fs::path tmpFilePrefix_;
           unsigned int oligoLength_;
+          unsigned int numThreads_;
+          unsigned int batchSize_;
+          unsigned int prefetchDistance_;
+          unsigned int matchMemory_;
       private:
           std::string usagePrefix() const;
           void postProcess(po::variables_map &);
@@ -29,6 +29,7 @@
 
 
 #include <boost/assert.hpp>
+#include <boost/cstdint.hpp>
 #include <boost/integer/static_min_max.hpp>
 #include "alignment/GlobalUtilities.hh"
 #include "ElandDefines.hh"
@@ -194,23 +195,35 @@ const FragmentErrorType noErrors__(0);
 
 
 // MatchPosition stores a position in the genome (chromosome number + position)
-// as a single unsigned int
-// Capacity of an unsigned int is split into blocks according to the
-// value of the most significant byte
+// as a single unsigned integer
+// The bits above blockShift give the block, each chromosome starting on a
+// new block. The value of the most significant byte means:
 // 0 : no match
 // 1 - 239 : reserved for sequence data
 // 240 - 255 : repeat
 // blockRepeat + x : this oligo is the same as oligo number x in the batch
 // ~0 (all bits 1) : match not attempted - oligo failed quality control (too many Ns etc)
-
-
+//
+// By default MatchPosition is 32 bits, which limits the reference to
+// 239 blocks of 16Mb. Defining ELAND_64BIT_MATCH_POSITION (see
+// ElandDefines.hh) removes the limit at the cost of 4 more bytes per
+// stored match.
+
+#ifdef ELAND_64BIT_MATCH_POSITION
+typedef boost::uint64_t MatchPosition;
+// signed type able to hold the difference between two MatchPositions
+typedef boost::int64_t MatchPositionDifference;
+#else
 typedef uint MatchPosition;
+typedef int MatchPositionDifference;
+#endif
 
 const MatchPosition noMatch(0);
 const int blockShift(24);
-const MatchPosition blockMask(((MatchPosition)0xFF)<<blockShift);
+const int topByteShift(8 * sizeof(MatchPosition) - 8);
 const MatchPosition blockPositionMask(((MatchPosition)-1)>>(8 * sizeof(MatchPosition) - blockShift));
-const MatchPosition blockRepeat(((MatchPosition)0xF0)<<blockShift);
+const MatchPosition blockMask(~blockPositionMask);
+const MatchPosition blockRepeat(((MatchPosition)0xF0)<<topByteShift);
 const MatchPosition blockSize(((MatchPosition)1)<<blockShift);
 const MatchPosition qualityFailed(~(MatchPosition)0);
 const MatchPosition repeatMasked(qualityFailed-1);
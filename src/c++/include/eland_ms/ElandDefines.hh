@@ -34,7 +34,27 @@ namespace eland_ms
 
 #define MAX_HASH_BITS 25
 
-#define NUM_THREADS 1
+// if next line is uncommented, genome positions are held in 64 bits,
+// so that references of more than about 4Gb (239 blocks of 16Mb) can be
+// used. Costs 4 extra bytes for each match stored
+//#define ELAND_64BIT_MATCH_POSITION
+
+// number of oligo positions in each piece of work handed out to the
+// threads that scan the genome (see --threads)
+#define SCAN_CHUNK_SIZE (1<<20)
+
+// number of chunks per scan thread that may be scanned ahead of the
+// first chunk whose matches have not been passed on yet. Bounds the
+// matches held back behind a slow chunk
+#define SCAN_CHUNKS_AHEAD 4
+
+// number of oligos read from the source at a time and shared out between
+// the threads that build the hash tables (see --threads)
+#define BUILD_BLOCK_SIZE (1<<16)
+
+// largest number of positions the genome scan may hash ahead of the one
+// it is checking (see --prefetch-distance)
+#define MAX_PREFETCH_DISTANCE 64
 
 //#define DONT_SEARCH_REVERSE_STRAND
 
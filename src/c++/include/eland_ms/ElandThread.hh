@@ -30,183 +30,293 @@
 #include "OligoHashTable.hh"
 #include "ElandDefines.hh"
 
+#include <pthread.h>
+#include <sys/time.h>
+#include <deque>
+#include <cerrno>
+#include <cstring>
+#include <boost/format.hpp>
+#include "common/Exceptions.hh"
+
 namespace casava
 {
 namespace eland_ms
 {
-// code to scan multiple chromosomes using threads
-#if (NUM_THREADS>1)
-
-template <int PASS> void* scan( void* pv );
-//void* scan( void* pv );
-
-// ThreadInfo: contains data specific to an individual thread, plus
-// static functions & data to maintain a count of the total number of threads
 
-template<int PASS> struct ThreadInfo
+// ScanChunk: a piece of a valid region of one chromosome. Oligos starting
+// at region.start up to region.finish-oligoLength+1 are checked, so
+// consecutive chunks of the same region overlap by oligoLength-1 bases
+struct ScanChunk
+{
+  ScanChunk( const Word* pStart, const ValidRegion& region,
+             const MatchPosition currentBlock ) :
+    pStart_(pStart), region_(region), currentBlock_(currentBlock) {}
+  const Word* pStart_;
+  ValidRegion region_;
+  MatchPosition currentBlock_;
+}; // ~struct ScanChunk
+
+// ScanScheduler: scans a list of ScanChunks using several threads.
+//
+// Chunks are dealt out round robin to a queue per thread. Each thread
+// takes work from the front of its own queue and, once that is empty,
+// steals from the front of the other threads' queues, so that a thread
+// stuck on a repeat rich part of the genome doesn't hold up the others.
+//
+// The matches of each chunk are collected by the thread that scanned it
+// and then handed to the MatchTable strictly in chunk order by whichever
+// thread completes the next chunk due. The MatchTable therefore sees
+// exactly the same sequence of matches as in a single threaded scan and
+// needs no locking of its own.
+//
+// Only chunks less than SCAN_CHUNKS_AHEAD*numThreads ahead of the next
+// chunk due are handed out; a thread that finds none waits for the next
+// commit. This bounds the matches held back behind a slow chunk.
+template< int PASS, int OLIGO_LEN> class ScanScheduler
 {
-  ThreadInfo( OligoHashTable<PASS>* pHash,
-	      FileReader* pFile,
-	      MatchPosition currentBlock, const char* name ) :
-    pHash_(pHash), pFile_(pFile),
-    currentBlock_(currentBlock), name_(name) {}
+public:
+  ScanScheduler( OligoHashTable<PASS, OLIGO_LEN>& hashTable,
+                 const vector<ScanChunk>& chunks,
+                 const unsigned int numThreads ) :
+    hashTable_(hashTable),
+    chunks_(chunks),
+    numThreads_(numThreads),
+    queues_(numThreads),
+    queueLocks_(numThreads),
+    maxAhead_(SCAN_CHUNKS_AHEAD*numThreads),
+    pending_(chunks.size()),
+    ready_(chunks.size(), false),
+    nextCommit_(0),
+    committing_(false),
+    failed_(false)
+  {
+    assert(numThreads_>0);
+    for (unsigned int i(0);i<numThreads_;i++)
+    {
+      pthread_mutex_init(&queueLocks_[i], NULL);
+    } // ~for i
+    pthread_mutex_init(&commitLock_, NULL);
+    pthread_cond_init(&committed_, NULL);
+    for (unsigned int i(0);i<chunks_.size();i++)
+    {
+      queues_[i%numThreads_].push_back(i);
+    } // ~for i
+  } // ~ctor
 
-  ~ThreadInfo()
+  ~ScanScheduler()
   {
-    delete pFile_;
+    for (unsigned int i(0);i<numThreads_;i++)
+    {
+      pthread_mutex_destroy(&queueLocks_[i]);
+    } // ~for i
+    pthread_cond_destroy(&committed_);
+    pthread_mutex_destroy(&commitLock_);
   } // ~dtor
 
-  OligoHashTable<PASS>* pHash_;
-  FileReader* pFile_;
-  MatchPosition currentBlock_;
-  const char* name_;
-
-  static int threadCount_;
-  static pthread_mutex_t threadCountLock_;
-  static pthread_cond_t threadFreeSignal_;
-
-  // start thread, waiting for others to complete if necessary
-  static void startThread( ThreadInfo* pt )
+  // run: scan all the chunks, returns when all matches have been passed
+  // on to the MatchTable
+  void run( void )
   {
-    pthread_t p;
-    pthread_mutex_lock(&threadCountLock_);
-    while (threadCount_==NUM_THREADS)
+    vector<pthread_t> threads(numThreads_);
+    vector<WorkerInfo> info(numThreads_);
+    unsigned int numCreated(0);
+    int createError(0);
+    for (;numCreated<numThreads_;numCreated++)
     {
-      cout << "Waiting for thread to become free..." << endl;
-      pthread_cond_wait(&threadFreeSignal_, &threadCountLock_);
-    } // ~while
-    cout << "OK, got a free thread..." << endl;
-    ++threadCount_;
-    pthread_mutex_unlock(&threadCountLock_);
-    pthread_create(&p, NULL, scan<PASS>,  (void*) pt);
-    pthread_detach(p);
+      info[numCreated].pScheduler_=this;
+      info[numCreated].threadNum_=numCreated;
+      createError=pthread_create(&threads[numCreated], NULL, worker,
+                                 (void*) &info[numCreated]);
+      if (createError!=0) break;
+    } // ~for numCreated
+    // the threads already running must be finished with before we can
+    // give up, even if not all of them could be created
+    for (unsigned int i(0);i<numCreated;i++)
+    {
+      pthread_join(threads[i], NULL);
+    } // ~for i
 
-  } // ~startThread
+    if (createError!=0)
+    {
+      // pthread_create returns its error code rather than setting errno
+      BOOST_THROW_EXCEPTION(cc::CasavaException(createError,
+          (boost::format("Failed to create scan thread %d: %s")
+           % numCreated % strerror(createError)).str()));
+    } // ~if
 
-  // decrement thread count, and signal to say a thread is free
-  static void freeThread( void )
+    if (failed_)
+    {
+      BOOST_THROW_EXCEPTION(cc::CasavaException(EINVAL,
+          "Genome scan thread failed: "+error_));
+    } // ~if
+    assert(nextCommit_==chunks_.size());
+  } // ~run
+
+private:
+  struct WorkerInfo
   {
-    cout << "Freeing thread..."  << endl;
-    pthread_mutex_lock(&threadCountLock_);
-    --threadCount_;
-
-    pthread_cond_signal(&threadFreeSignal_);
-
-    pthread_mutex_unlock(&threadCountLock_);
+    ScanScheduler* pScheduler_;
+    unsigned int threadNum_;
+  }; // ~struct WorkerInfo
 
-  } // ~freeThread
+  static void* worker( void* pv )
+  {
+    WorkerInfo* pInfo((WorkerInfo*)pv);
+    pInfo->pScheduler_->work(pInfo->threadNum_);
+    return NULL;
+  } // ~worker
 
-  // wait for all outstanding threads to finish
-  static void waitForEnd( void )
+  void work( const unsigned int threadNum )
+  {
+    unsigned int chunkNum;
+    MatchCacheStore hits;
+    try
+    {
+      while (getChunk(threadNum, chunkNum))
+      {
+        const ScanChunk& chunk(chunks_[chunkNum]);
+        {
+          MatchCache cache(hits);
+          hashTable_.scanRegion(cache, chunk.pStart_, chunk.region_,
+                                chunk.currentBlock_);
+        } // ~scope of cache, flushes remaining matches to hits
+        commit(chunkNum, hits);
+        hits.clear();
+      } // ~while
+    } // ~try
+    catch (const std::exception& e)
+    {
+      // the chunk this thread held will never be committed, so wake
+      // up the threads waiting for it
+      pthread_mutex_lock(&commitLock_);
+      failed_=true;
+      error_=e.what();
+      pthread_cond_broadcast(&committed_);
+      pthread_mutex_unlock(&commitLock_);
+    } // ~catch
+  } // ~work
+
+  // getChunk: get next chunk to scan, first from this thread's own
+  // queue, then from the other threads' queues. Waits while none of the
+  // chunks left is within maxAhead_ of the next chunk due. Returns false
+  // if no work is left or another thread has failed
+  bool getChunk( const unsigned int threadNum, unsigned int& chunkNum )
   {
-    pthread_mutex_lock(&threadCountLock_);
-    while (threadCount_>0)
+    pthread_mutex_lock(&commitLock_);
+    while (!failed_)
     {
-      cout << "Waiting for " << threadCount_ << " threads to become free..." << endl;
-      pthread_cond_wait(&threadFreeSignal_, &threadCountLock_);
+      // the queues are in chunk order, so only their fronts need checking
+      const unsigned int nextCommit(nextCommit_);
+      pthread_mutex_unlock(&commitLock_);
+      bool isWorkLeft(false);
+      for (unsigned int i(0);i<numThreads_;i++)
+      {
+        const unsigned int q((threadNum+i)%numThreads_);
+        pthread_mutex_lock(&queueLocks_[q]);
+        if (!queues_[q].empty())
+        {
+          isWorkLeft=true;
+          if (queues_[q].front()<nextCommit+maxAhead_)
+          {
+            chunkNum=queues_[q].front();
+            queues_[q].pop_front();
+            pthread_mutex_unlock(&queueLocks_[q]);
+            return true;
+          } // ~if
+        } // ~if
+        pthread_mutex_unlock(&queueLocks_[q]);
+      } // ~for i
+      if (!isWorkLeft) return false;
+
+      // the chunk due is being scanned by another thread: wait until it
+      // has been committed
+      pthread_mutex_lock(&commitLock_);
+      while ((nextCommit_==nextCommit)&&(!failed_))
+      {
+        pthread_cond_wait(&committed_, &commitLock_);
+      } // ~while
     } // ~while
-    cout << "All threads done, OK to finish" << endl;
-    pthread_mutex_unlock(&threadCountLock_);
-  } // ~waitForEnd
-
-}; // ~struct ThreadInfo
-
-template<int PASS>
-int ThreadInfo<PASS>::threadCount_=0;
-
-template<int PASS>
-pthread_mutex_t ThreadInfo<PASS>::threadCountLock_ = PTHREAD_MUTEX_INITIALIZER;
-
-template<int PASS>
-pthread_cond_t ThreadInfo<PASS>::threadFreeSignal_ = PTHREAD_COND_INITIALIZER;
-
-template <int PASS> void* scan( void* pv )
-{
-  Timer t;
-  ThreadInfo<PASS>* pt((ThreadInfo<PASS>*)pv);
-  cerr << "Starting thread to scan " << pt->name_ << ": " << t << endl;
-  //  currentBlock = hashTable.scan(thisFile, currentBlock);
-  (pt->pHash_)->scan(*(pt->pFile_), pt->currentBlock_ );
-  cerr << "Finished thread to scan " << pt->name_ << ": " << t << endl;
-  ThreadInfo<PASS>::freeThread();
-  delete pt;
-  return NULL;
-} // ~scan
-
-// scanAll: complete a single pass through all the chromosomes
-template< int PASS > void  scanAll
-(
- OligoSource* pOligos,
- const string& directoryName,
- const vector<string>& chromNames,
- vector<MatchPosition>& blockStarts,
- OligoHashTable<PASS>& hashTable,
- Timer& timer,
- bool singleseed=true/*,
- bool firstRun=true*/
-)
+    pthread_mutex_unlock(&commitLock_);
+    return false;
+  } // ~getChunk
+
+  // commit: hand over the matches for chunkNum. If the next chunk due is
+  // ready and no other thread is committing, this thread passes on the
+  // matches of all ready chunks in order.
+  void commit( const unsigned int chunkNum, MatchCacheStore& hits )
+  {
+    MatchCacheStore batch;
+    pthread_mutex_lock(&commitLock_);
+    pending_[chunkNum].swap(hits);
+    ready_[chunkNum]=true;
+    if (!committing_)
+    {
+      committing_=true;
+      while ((nextCommit_<chunks_.size())&&(ready_[nextCommit_]))
+      {
+        batch.swap(pending_[nextCommit_++]);
+        pthread_cond_broadcast(&committed_);
+        pthread_mutex_unlock(&commitLock_);
+        hashTable_.getResults().addMatch(batch.begin(), batch.end());
+        MatchCacheStore().swap(batch);
+        pthread_mutex_lock(&commitLock_);
+      } // ~while
+      committing_=false;
+    } // ~if
+    pthread_mutex_unlock(&commitLock_);
+  } // ~commit
+
+  OligoHashTable<PASS, OLIGO_LEN>& hashTable_;
+  const vector<ScanChunk>& chunks_;
+  const unsigned int numThreads_;
+
+  vector<deque<unsigned int> > queues_;
+  vector<pthread_mutex_t> queueLocks_;
+  const unsigned int maxAhead_;
+
+  // everything below here is protected by commitLock_
+  pthread_mutex_t commitLock_;
+  pthread_cond_t committed_;
+  vector<MatchCacheStore> pending_;
+  vector<bool> ready_;
+  unsigned int nextCommit_;
+  bool committing_;
+  bool failed_;
+  string error_;
+}; // ~class ScanScheduler
+
+// ScanRate: counts the oligo positions checked during a scan and reports
+// them per second of wall clock time, for tuning --prefetch-distance and
+// --threads
+class ScanRate
 {
-  // reset block counter at start of each pass
-  MatchPosition currentBlock(blockSize);
-
-  string fullChromName;
-
-  ThreadInfo<PASS>* pThread;
-
-  if (PASS==0) {
-    blockStarts.push_back(currentBlock);
-  }
-  else {
-    assert(blockStarts[1]==currentBlock);
-  }
+public:
+  ScanRate( void ) : numPositions_(0) { gettimeofday(&start_, NULL); }
 
-  cerr << "About to build hash tables for pass " << PASS << ": " << timer << endl;
-
-  if (hashTable.buildTable( *pOligos,singleseed )==false)
+  // add: count the positions of the oligos lying wholly within region
+  void add( const ValidRegion& region, const int oligoLength )
   {
-    cerr << "No oligos to hash, returning" << endl;
-    return;
-  }
+    if ((((int)region.finish)-((int)region.start))+1>=oligoLength)
+      numPositions_+=region.finish-region.start+2-oligoLength;
+  } // ~add
 
-  cerr << "Built hash tables: " << timer << endl;
-
-  for (int j(1);j<chromNames.size();j++)
+  void print( ostream& os, const unsigned int prefetchDistance ) const
   {
-    //    if (PASS==0) blockStarts.push_back(currentBlock);
-
-    fullChromName = directoryName+chromNames[j];
-    cerr << "Scanning file " << fullChromName << ": " << timer << endl;
-
-    pThread = new ThreadInfo<PASS>(&hashTable, NULL, currentBlock, chromNames[j].c_str());
-
-    cerr << "Starting block: " << (currentBlock>>blockShift) << endl;
-
-    pThread->pFile_=new FileReader(fullChromName.c_str());
-
-    cerr << "Last valid base in file: " << pThread->pFile_->getLastValidBase() << endl;
-
-    currentBlock+=(((pThread->pFile_->getLastValidBase()>>blockShift)+1) <<blockShift);
-
-    if (PASS==0) {
-      blockStarts.push_back(currentBlock);
-    }
-    else {
-      assert(blockStarts[j+1]==currentBlock);
-    }
-
-    ThreadInfo<PASS>::startThread(pThread);
-
-    cerr << "Finishing block: " << (currentBlock>>blockShift) << endl;
-
-  }
-
-  ThreadInfo<PASS>::waitForEnd();
-    //  if (PASS==0) blockStarts.push_back(currentBlock);
-  assert(blockStarts.size()==chromNames.size()+1);
-} // ~scanAll
-
-// single threaded scanAll
-#else
+    timeval now;
+    gettimeofday(&now, NULL);
+    const double seconds((now.tv_sec-start_.tv_sec)
+                         +(now.tv_usec-start_.tv_usec)/1000000.0);
+    os << "Scanned " << numPositions_ << " positions in " << seconds
+       << " seconds: "
+       << ((seconds>0) ? (numPositions_/seconds/1000000.0) : 0.0)
+       << " million positions per second (prefetch distance "
+       << prefetchDistance << ")" << endl;
+  } // ~print
+
+private:
+  boost::uint64_t numPositions_;
+  timeval start_;
+}; // ~class ScanRate
 
 // scanAll: complete a single pass through all the chromosomes
 template< int PASS, int OLIGO_LEN> void  scanAll
@@ -216,8 +326,8 @@ template< int PASS, int OLIGO_LEN> void  scanAll
  vector<MatchPosition>& blockStarts,
  OligoHashTable<PASS, OLIGO_LEN>& hashTable,
  Timer& timer,
- bool singleseed=true/*,
- bool firstRun=true*/
+ bool singleseed=true,
+ const unsigned int numThreads=1
 )
 {
   // reset block counter at start of each pass
@@ -225,42 +335,99 @@ template< int PASS, int OLIGO_LEN> void  scanAll
 
   string fullChromName;
 
-  //  OligoHashTable hashTable(oligoLength, numBits, part1, part2, scoreTable, results);
-    // set base to extract
-  //  hashTable.setPass( i );
-
   cerr << "About to build hash tables for pass " << PASS << ": " << timer << endl;
 
-  if (hashTable.buildTable( *pOligos,singleseed )==false)
+  if (hashTable.buildTable( *pOligos,singleseed,numThreads )==false)
   {
     cerr << "No oligos to hash, returning" << endl;
     return;
   }
-  //  hashTable.buildTable( *pOligos );
 
   cerr << "Built hash tables: " << timer << endl;
 
-  for (uint j(1);j<chromNames.size();j++)
+  const int oligoLength(hashTable.getOligoLength());
+  if (numThreads<=1)
   {
-    if (PASS==0) blockStarts.push_back(currentBlock);
-
-
-    fullChromName = directoryName+chromNames[j];
-    cerr << "Scanning file " << fullChromName << ": " << timer << endl;
-
-    cerr << "Starting block: " << (currentBlock>>24) << endl;
-    FileReader thisFile(fullChromName.c_str());
+    ScanRate rate;
+    for (uint j(1);j<chromNames.size();j++)
+    {
+      if (PASS==0) blockStarts.push_back(currentBlock);
+
+      fullChromName = directoryName+chromNames[j];
+      cerr << "Scanning file " << fullChromName << ": " << timer << endl;
+
+      cerr << "Starting block: " << (currentBlock>>blockShift) << endl;
+      FileReader thisFile(fullChromName.c_str());
+      for (const ValidRegion* pValid(thisFile.getFirstValid());
+           pValid!=thisFile.getLastValid(); ++pValid)
+      {
+        rate.add(*pValid, oligoLength);
+      } // ~for pValid
+
+      currentBlock = hashTable.scan(thisFile, currentBlock);
+      cerr << "Finishing block: " << (currentBlock>>blockShift) << endl;
+
+      cerr << "... done " << timer << endl;
+    } // ~for j
+    rate.print(cerr, hashTable.getPrefetchDistance());
+  } // ~if
+  else
+  {
+    // map all the chromosomes, then split their valid regions into chunks
+    vector<FileReader*> files;
+    vector<ScanChunk> chunks;
+    for (uint j(1);j<chromNames.size();j++)
+    {
+      if (PASS==0) blockStarts.push_back(currentBlock);
+
+      fullChromName = directoryName+chromNames[j];
+      cerr << "Mapping file " << fullChromName << ": " << timer << endl;
+      files.push_back(new FileReader(fullChromName.c_str()));
+      const FileReader& thisFile(*files.back());
+
+      for (const ValidRegion* pValid(thisFile.getFirstValid());
+           pValid!=thisFile.getLastValid(); ++pValid)
+      {
+        if ((((int)pValid->finish)-((int)pValid->start))+1<oligoLength)
+          continue;
+        const uint lastOligoStart(pValid->finish-oligoLength+1);
+        for (uint first(pValid->start);first<=lastOligoStart;
+             first+=SCAN_CHUNK_SIZE)
+        {
+          const uint last(min(first+(SCAN_CHUNK_SIZE-1),lastOligoStart));
+          chunks.push_back(ScanChunk(thisFile.getSeqStart(),
+                                     ValidRegion(first,last+oligoLength-1),
+                                     currentBlock));
+          if (last==lastOligoStart) break;
+        } // ~for first
+      } // ~for pValid
+
+      cerr << "Starting block: " << (currentBlock>>blockShift) << endl;
+      currentBlock = hashTable.getNextBlock(thisFile, currentBlock);
+      cerr << "Finishing block: " << (currentBlock>>blockShift) << endl;
+    } // ~for j
+
+    cerr << "Scanning " << chunks.size() << " chunks using "
+         << numThreads << " threads: " << timer << endl;
+    ScanRate rate;
+    for (vector<ScanChunk>::const_iterator i(chunks.begin());i!=chunks.end();++i)
+    {
+      rate.add(i->region_, oligoLength);
+    } // ~for i
+    ScanScheduler<PASS, OLIGO_LEN> scheduler(hashTable, chunks, numThreads);
+    scheduler.run();
+    cerr << "... done " << timer << endl;
+    rate.print(cerr, hashTable.getPrefetchDistance());
 
-    currentBlock = hashTable.scan(thisFile, currentBlock);
-    cerr << "Finishing block: " << (currentBlock>>24) << endl;
+    for (vector<FileReader*>::iterator i(files.begin());i!=files.end();++i)
+    {
+      delete *i;
+    } // ~for i
+  } // ~else
 
-    cerr << "... done " << timer << endl;
-  } // ~for j
   if (PASS==0) blockStarts.push_back(currentBlock);
   assert(blockStarts.size()==chromNames.size()+1);
-}
-
-#endif
+} // ~scanAll
 
 
 } //namespace eland_ms
@@ -0,0 +1,166 @@
+/**
+ ** Copyright (c) 2007-2010 Illumina, Inc.
+ **
+ ** This software is covered by the "Illumina Genome Analyzer Software
+ ** License Agreement" and the "Illumina Source Code License Agreement",
+ ** and certain third party copyright/licenses, and any user of this
+ ** source file is bound by the terms therein (see accompanying files
+ ** Illumina_Genome_Analyzer_Software_License_Agreement.pdf and
+ ** Illumina_Source_Code_License_Agreement.pdf and third party
+ ** copyright/license notices).
+ **
+ ** This file is part of the Consensus Assessment of Sequence And VAriation
+ ** (CASAVA) software package.
+ **
+ ** \file eland_ms/HitStore.hh
+ **
+ ** \brief Part of ELAND
+ **
+ ** Holds the matches stored by a MatchTableMulti until they are output
+ **/
+
+#ifndef CASAVA_ELAND_MS_HIT_STORE_H
+#define CASAVA_ELAND_MS_HIT_STORE_H
+
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <boost/cstdint.hpp>
+
+#include "ElandConstants.hh"
+
+namespace casava
+{
+namespace eland_ms
+{
+
+// HitStore: the (match code, match position) pairs of a MatchTableMulti.
+// The match code holds the oligo number in its low 27 bits, see
+// MatchTableMulti::addMatch.
+//
+// Hits are appended to fixed size chunks in memory. Once the chunks hold
+// more than the memory limit, they are sorted by oligo number into a run
+// that is written to a temporary file with a single large write. rewind
+// sorts whatever is left in memory in the same way, after which getNext
+// merges the runs, so that the hits come back grouped by oligo number and,
+// for each oligo, in the order they were added.
+class HitStore
+{
+public:
+  HitStore( void );
+  ~HitStore();
+
+  // setMemoryLimit: number of bytes of hits held in memory before they
+  // are spilled to disk (0: no limit). Sorting a run needs about as much
+  // memory again
+  void setMemoryLimit( const size_t memoryLimit ) { memoryLimit_=memoryLimit; }
+
+  // setSpillFileName: spill to this file rather than to an anonymous
+  // temporary file. Must be called before the first hit is added
+  void setSpillFileName( const std::string& spillFileName )
+  { spillFileName_=spillFileName; }
+
+  void add( const boost::uint32_t code, const MatchPosition pos )
+  {
+    if (chunkUsed_==chunkSize)
+    {
+      if ((memoryLimit_!=0)&&(chunks_.size()*chunkSize*sizeof(Hit)>=memoryLimit_))
+        spill();
+      chunks_.push_back(new Hit[chunkSize]);
+      chunkUsed_=0;
+    } // ~if
+    Hit& hit(chunks_.back()[chunkUsed_++]);
+    hit.code_=code;
+    hit.pos_=pos;
+    const boost::uint32_t oligoNum(code&oligoMask);
+    if (oligoNum>maxOligo_) maxOligo_=oligoNum;
+    ++size_;
+  } // ~add
+
+  // size: number of hits added
+  boost::uint64_t size( void ) const { return size_; }
+
+  // getSpilledBytes: number of bytes of hits written to disk
+  boost::uint64_t getSpilledBytes( void ) const { return spilledBytes_; }
+
+  // rewind: start reading the hits from the first one. No more hits may
+  // be added after the first call
+  void rewind( void );
+
+  // getNext: next hit in order of oligo number, false if there are none
+  bool getNext( boost::uint32_t& code, MatchPosition& pos )
+  {
+    if ((current_==NULL)||(current_->next_==current_->end_)
+        ||((current_->next_->code_&oligoMask)!=currentOligo_))
+    {
+      if (!nextRun()) return false;
+    } // ~if
+    code=current_->next_->code_;
+    pos=current_->next_->pos_;
+    ++current_->next_;
+    return true;
+  } // ~getNext
+
+private:
+  struct Hit
+  {
+    MatchPosition pos_;
+    boost::uint32_t code_;
+  }; // ~struct Hit
+
+  // Run: a set of hits sorted by oligo number, either in memory or
+  // spilled to disk and read back a block at a time
+  struct Run
+  {
+    boost::uint64_t offset_;
+    boost::uint64_t size_;
+    // hits not yet read from disk
+    boost::uint64_t unread_;
+    std::vector<Hit> buf_;
+    const Hit* next_;
+    const Hit* end_;
+  }; // ~struct Run
+
+  enum { chunkSize = 1<<16 };
+  // hits read from a spilled run at a time
+  enum { readBlockSize = 1<<16 };
+  static const boost::uint32_t oligoMask = ((boost::uint32_t)~0)>>5;
+
+  HitStore( const HitStore& );
+  HitStore& operator=( const HitStore& );
+
+  // sortChunks: move the hits held in chunks_ into sorted, ordered by
+  // oligo number (a stable counting sort), freeing the chunks
+  void sortChunks( std::vector<Hit>& sorted );
+  void spill( void );
+  // getHead: oligo number of the next hit of run, reading the next
+  // block from disk if need be. False if the run has no hits left
+  bool getHead( Run& run, boost::uint32_t& oligoNum );
+  // nextRun: point current_ to the run holding the next hit due: the
+  // next run with hits for currentOligo_ or, if there is none, the first
+  // run with hits for the next oligo number
+  bool nextRun( void );
+  void freeChunks( void );
+
+  size_t memoryLimit_;
+  std::string spillFileName_;
+  FILE* pSpill_;
+
+  std::vector<Hit*> chunks_;
+  unsigned int chunkUsed_;
+  boost::uint32_t maxOligo_;
+  boost::uint64_t size_;
+  boost::uint64_t spilledBytes_;
+
+  bool isSorted_;
+  // the spilled runs in order, then the hits left in memory
+  std::vector<Run> runs_;
+  Run* current_;
+  boost::uint32_t currentOligo_;
+  std::vector<boost::uint32_t> count_;
+}; // ~class HitStore
+
+} //namespace eland_ms
+} //namespace casava
+
+#endif // CASAVA_ELAND_MS_HIT_STORE_H
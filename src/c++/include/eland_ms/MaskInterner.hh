@@ -0,0 +1,164 @@
+/**
+ ** copyright (c) 2007-2010 Illumina, Inc.
+ **
+ ** This software is covered by the "Illumina Genome Analyzer Software
+ ** License Agreement" and the "Illumina Source Code License Agreement",
+ ** and certain third party copyright/licenses, and any user of this
+ ** source file is bound by the terms therein (see accompanying files
+ ** Illumina_Genome_Analyzer_Software_License_Agreement.pdf and
+ ** Illumina_Source_Code_License_Agreement.pdf and third party
+ ** copyright/license notices).
+ **
+ ** This file is part of the Consensus Assessment of Sequence And VAriation
+ ** (CASAVA) software package.
+ **
+ ** \file eland_ms/MaskInterner.hh
+ **
+ ** \brief Part of ELAND
+ **
+ ** Numbers the distinct N masks of the suffixes in a partition hash table
+ **/
+
+#ifndef CASAVA_ELAND_MS_MASK_INTERNER_H
+#define CASAVA_ELAND_MS_MASK_INTERNER_H
+
+#include <algorithm>
+#include <vector>
+#include <boost/cstdint.hpp>
+
+#include "alignment/GlobalUtilities.hh"
+
+namespace casava
+{
+namespace eland_ms
+{
+
+// MaskInterner: gives each distinct suffix mask seen while counting the
+// oligos of a partition hash table a small number, so that table entries
+// can hold the number rather than the mask itself.
+//
+// Masks are kept in an open addressed table with linear probing. As nearly
+// all suffixes have no Ns, the mask 0 is not stored at all and is always
+// number 0. Used in three steps: insert every mask (count pass), number
+// them, then find the number of each mask (hash pass). Numbers are given
+// in increasing order of mask, as the std::map this replaces did.
+class MaskInterner
+{
+public:
+  MaskInterner( void ) { clear(); }
+
+  // insert: note that mask is used
+  void insert( const Word mask )
+  {
+    if (mask==0) return;
+    uint i(slot(mask));
+    for (; slots_[i].mask_!=0; i=(i+1)&(slots_.size()-1))
+    {
+      if (slots_[i].mask_==mask) return;
+    } // ~for i
+    slots_[i].mask_=mask;
+    if (2*(++numMasks_)>slots_.size()) resize(2*slots_.size());
+  } // ~insert
+
+  // insert: note that all the masks inserted into other are used
+  void insert( const MaskInterner& other )
+  {
+    for (vector<Slot>::const_iterator i(other.slots_.begin()); i!=other.slots_.end(); ++i)
+    {
+      if (i->mask_!=0) insert(i->mask_);
+    } // ~for i
+  } // ~insert
+
+  // size: number of distinct masks, including 0
+  uint size( void ) const { return numMasks_+1; }
+
+  // number: number the masks inserted in increasing order from 0 and
+  // fill maskTable with the masks by number. The table is resized to
+  // suit the final number of masks, so that find is as fast as possible
+  void number( vector<Word>& maskTable )
+  {
+    maskTable.clear();
+    maskTable.reserve(size());
+    maskTable.push_back(0);
+    for (vector<Slot>::const_iterator i(slots_.begin()); i!=slots_.end(); ++i)
+    {
+      if (i->mask_!=0) maskTable.push_back(i->mask_);
+    } // ~for i
+    std::sort(maskTable.begin(), maskTable.end());
+
+    uint numSlots(minSlots);
+    while (numSlots<2*size()) numSlots*=2;
+    slots_.assign(numSlots, Slot());
+    bits_=numBits(numSlots);
+    for (uint j(1); j<maskTable.size(); ++j)
+    {
+      uint i(slot(maskTable[j]));
+      while (slots_[i].mask_!=0) i=(i+1)&(slots_.size()-1);
+      slots_[i].mask_=maskTable[j];
+      slots_[i].number_=j;
+    } // ~for j
+  } // ~number
+
+  // find: number of a mask that was inserted before the call to number
+  uint find( const Word mask ) const
+  {
+    if (mask==0) return 0;
+    uint i(slot(mask));
+    while (slots_[i].mask_!=mask) i=(i+1)&(slots_.size()-1);
+    return slots_[i].number_;
+  } // ~find
+
+  void clear( void )
+  {
+    slots_.assign(minSlots, Slot());
+    bits_=numBits(minSlots);
+    numMasks_=0;
+  } // ~clear
+
+private:
+  struct Slot
+  {
+    Slot( void ) : mask_(0), number_(0) {}
+    Word mask_;
+    boost::uint32_t number_;
+  }; // ~struct Slot
+
+  enum { minSlots = 1024 };
+
+  static uint numBits( uint n )
+  {
+    uint bits(0);
+    for (; n>1; n>>=1) ++bits;
+    return bits;
+  } // ~numBits
+
+  // slot: home slot of mask, from the top bits of a multiplicative hash
+  uint slot( const Word mask ) const
+  {
+    return (uint)((((boost::uint32_t)mask)*2654435761U)>>(32-bits_));
+  } // ~slot
+
+  void resize( const uint numSlots )
+  {
+    vector<Slot> old(numSlots, Slot());
+    old.swap(slots_);
+    bits_=numBits(numSlots);
+    for (vector<Slot>::const_iterator j(old.begin()); j!=old.end(); ++j)
+    {
+      if (j->mask_==0) continue;
+      uint i(slot(j->mask_));
+      while (slots_[i].mask_!=0) i=(i+1)&(slots_.size()-1);
+      slots_[i]=*j;
+    } // ~for j
+  } // ~resize
+
+  vector<Slot> slots_;
+  uint bits_;
+  // number of distinct non-zero masks inserted
+  uint numMasks_;
+}; // ~class MaskInterner
+
+} //namespace eland_ms
+} //namespace casava
+
+#endif // CASAVA_ELAND_MS_MASK_INTERNER_H
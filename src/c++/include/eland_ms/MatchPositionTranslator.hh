@@ -45,7 +45,9 @@ public:
   MatchPositionTranslator( const vector<string>& chromNames,
                            const vector<MatchPosition>& blockStarts,
                            const string& directoryName ) :
-    chromNames_(chromNames)
+    chromNames_(chromNames),
+    chromTable_(getNumBlocks(blockStarts), 0),
+    subtractTable_(getNumBlocks(blockStarts), 0)
   {
     int thisChrom(0);
 
@@ -57,7 +59,7 @@ public:
       BOOST_ASSERT((thisChromStartBlock & blockPositionMask)==0 && "thisChromStartBlock must not have any position bits set");
       BOOST_ASSERT((nextChromStartBlock & blockPositionMask)==0 && "nextChromStartBlock must not have any position bits set");
       BOOST_ASSERT(thisChromStartBlock < nextChromStartBlock && "blockStarts starts must be ordered");
-      for ( uint j = thisChromStartBlock; j != nextChromStartBlock; j+=blockSize)
+      for ( MatchPosition j = thisChromStartBlock; j != nextChromStartBlock; j+=blockSize)
       {
           subtractTable_[j>>blockShift]=*i;
           chromTable_[j>>blockShift]=thisChrom;
@@ -97,11 +99,22 @@ public:
 	chromName=chromNames_[thisChrom].c_str();
 	contigName=chromName;
 	assert((uint)thisChrom<getContigName_.size());
-	(*getContigName_[thisChrom])( contigName, outputPos );
+	// positions within a chromosome always fit in 32 bits
+	uint contigPos(outputPos);
+	(*getContigName_[thisChrom])( contigName, contigPos );
+	outputPos=contigPos;
   } // ~operator()
  private:
-  typedef MatchPosition SubtractTable[numPossibleChars];
-  typedef int ChromTable[numPossibleChars];
+  // getNumBlocks: size of the lookup tables. Positions up to one block
+  // past the end of the last chromosome map to the null chromosome
+  static MatchPosition getNumBlocks( const vector<MatchPosition>& blockStarts )
+  {
+    return std::max((blockStarts.back()>>blockShift)+1, (MatchPosition)numPossibleChars);
+  } // ~getNumBlocks
+
+  // one entry per block
+  typedef vector<MatchPosition> SubtractTable;
+  typedef vector<int> ChromTable;
 
   const vector<string>& chromNames_;
   ChromTable chromTable_;
@@ -27,6 +27,8 @@
 #ifndef CASAVA_ELAND_MS_MATCH_REQUEST_H
 #define CASAVA_ELAND_MS_MATCH_REQUEST_H
 
+#include "alignment/GlobalUtilities.hh"
+
 namespace casava
 {
 namespace eland_ms
@@ -58,7 +60,14 @@ struct HitPosition {
 // markus todo
 // - add constructor
 struct MatchRequest {
+  MatchRequest() : pName_(NULL) {}
+
+  // the name of the read: header_, or if the oligo source provides
+  // ReadNames, nameFields_ printed with the prefix and read number of
+  // pName_, which all the reads of the source share
   string header_;
+  const ReadName* pName_;
+  ReadNameFields nameFields_;
   string read_;
   // 0 = QC , 1 = RM , 2 = RB (need to store another value) , 3 = full alignment
   short matchMode_;
@@ -70,8 +79,15 @@ struct MatchRequest {
   // print the information to out
     void print( ostream& out,vector<char*>& frags,int& frag_idx,const vector<int>& pos_correction_begin,const vector<int>& pos_correction_end )
     {
-        out << header_ << "\t"
-            << read_ << "\t";
+        if (pName_!=NULL)
+        {
+            pName_->print(out, nameFields_);
+        } // ~if
+        else
+        {
+            out << header_;
+        } // ~else
+        out << "\t" << read_ << "\t";
 
         switch( matchMode_ ) {
         case 0:
@@ -34,6 +34,7 @@
 #include "MultiMatch.hh"
 #include "TableEntry.hh"
 #include "ElandDefines.hh"
+#include "HitStore.hh"
 #include "common/StreamUtil.h"
 
 namespace casava
@@ -78,8 +79,12 @@ class MatchTable
 public:
     //  static MatchTable<OLIGO_LEN>* getMatchTable( const char* outputFileName );
 
-  MatchTable( const int OLIGO_LEN, const char* outputFileName,const bool& write_multi=false,const short& no_of_seeds=1 ) :
+  // firstOligo: number of oligos of the lane already output by earlier
+  // batches - if non-zero, output is appended to the existing files
+  MatchTable( const int OLIGO_LEN, const char* outputFileName,const bool& write_multi=false,const short& no_of_seeds=1,
+              const unsigned int firstOligo=0 ) :
     OLIGO_LEN_(OLIGO_LEN),
+    firstOligo_(firstOligo),
     no_of_seeds_(no_of_seeds),
     write_multi_(write_multi)
   {
@@ -87,12 +92,9 @@ public:
       read_length_ = 0;
       sensitive_ = false;
 
-#if (NUM_THREADS>1)
-    pthread_mutex_init(&mutex_, NULL);
-#endif
     if( write_multi == true )
     {
-        pOut_ = fopen( string(string(outputFileName)+".multi").c_str(), "w");
+        pOut_ = fopen( string(string(outputFileName)+".multi").c_str(), (firstOligo_ ? "a" : "w"));
     } else
     {
         // open /dev/null to avoid creating the file
@@ -218,6 +220,8 @@ public:
 
 protected:
   int OLIGO_LEN_;
+  // offset of oligo numbers within the lane, used for RB output
+  const unsigned int firstOligo_;
 
   vector<MatchPosition> matchPosition_;
   vector<MatchDescriptor> matchType_;
@@ -233,9 +237,6 @@ protected:
 
   bool write_multi_;
 
-#if (NUM_THREADS>1)
-  pthread_mutex_t mutex_;
-#endif
 
 }; // ~struct MatchTable
 
@@ -342,12 +343,14 @@ public:
 		   const int maxNumMatchesExact,
 		   const int maxNumMatchesOneError,
 		   const int maxNumMatchesTwoErrors,
-		   const char* tmpFilePrefix=NULL) :
-    MatchTable( OLIGO_LEN,outputFileName,write_multi ),
+		   const char* tmpFilePrefix=NULL,
+		   const unsigned int firstOligo=0) :
+    MatchTable( OLIGO_LEN,outputFileName,write_multi,1,firstOligo ),
     maxNumMatchesExact_(maxNumMatchesExact),
     maxNumMatchesOneError_(maxNumMatchesOneError),
     maxNumMatchesTwoErrors_(maxNumMatchesTwoErrors),
-    matchesStored_(0)
+    matchesStored_(0),
+    numThreads_(1)
   {
       initializeTmpFiles( tmpFilePrefix );
   } // ~ctor
@@ -362,7 +365,8 @@ public:
     maxNumMatchesExact_(maxNumMatchesDefault),
     maxNumMatchesOneError_(maxNumMatchesDefault),
     maxNumMatchesTwoErrors_(maxNumMatchesDefault),
-    matchesStored_(0)
+    matchesStored_(0),
+    numThreads_(1)
   {
       initializeTmpFiles( tmpFilePrefix );
   } // ~ctor
@@ -378,7 +382,8 @@ public:
     maxNumMatchesExact_(maxNumMatches),
     maxNumMatchesOneError_(maxNumMatches),
     maxNumMatchesTwoErrors_(maxNumMatches),
-    matchesStored_(0)
+    matchesStored_(0),
+    numThreads_(1)
   {
       initializeTmpFiles( tmpFilePrefix );
   } // ~ctor
@@ -410,7 +415,9 @@ public:
 
   virtual bool getUnmappedReads( vector<bool>& unmapped );
 
-    bool getMatchInformation( vector< vector<MultiMatch> >& multimatches,vector<MatchDescriptor>& matchdescriptor );
+    // getMatchInformation: hand the matches over to multimatches, leaving
+    // none in this table, and copy the match descriptors
+    bool getMatchInformation( MultiMatchTable& multimatches,vector<MatchDescriptor>& matchdescriptor );
     bool mergeTable( MatchTable* source,MatchPositionTranslator& getMatchPos );
   virtual  bool buildMatchTable( MatchPositionTranslator& getMatchPos );
     bool clear(void);
@@ -420,18 +427,29 @@ public:
   const int maxNumMatchesOneError_;
   const int maxNumMatchesTwoErrors_;
 
+  // setHitMemoryLimit: bytes of matches held in memory before they are
+  // spilled to the temporary file (0: no limit)
+  void setHitMemoryLimit( const size_t memoryLimit ) { hits_.setMemoryLimit(memoryLimit); }
+
+  // setNumThreads: threads used by printSquash for the gapped alignments
+  void setNumThreads( const unsigned int numThreads ) { numThreads_=(numThreads>0) ? numThreads : 1; }
+
   uint matchesStored_;
-  FILE* pOligoNum_;
-  FILE* pMatchType_;
-  string tmpFileNameOligoNum_;
-  string tmpFileNameMatchType_;
-  vector<vector<MultiMatch> > multiMatch_;
+  // matches stored by addMatch, read back grouped by oligo
+  HitStore hits_;
+  unsigned int numThreads_;
+  MultiMatchTable multiMatch_;
 
   vector<bool> hyperhyper_;
   vector<bool> unmapped_;
 
   //  vector<vector<MatchPosition> > multiPos_;
   //  vector<vector<uchar> > multiType_;
+protected:
+    // reportHitStorage: log the number of matches stored and the temp
+    // storage they used
+    void reportHitStorage( void ) const;
+
 private:
     // initialize does some setup that is common to all constructora
     void initializeTmpFiles( const char* tmpFilePrefix=NULL);
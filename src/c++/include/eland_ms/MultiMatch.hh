@@ -27,6 +27,13 @@
 #ifndef CASAVA_ELAND_MS_MULTI_MATCH_H
 #define CASAVA_ELAND_MS_MULTI_MATCH_H
 
+#include <algorithm>
+#include <cassert>
+#include <vector>
+#include <boost/cstdint.hpp>
+
+#include "ElandConstants.hh"
+
 namespace casava
 {
 namespace eland_ms
@@ -64,6 +71,112 @@ struct MultiMatch
 } __attribute__ ((packed)); // ~struct MultiMatch
 
 BOOST_STATIC_ASSERT(sizeof(MultiMatch)==sizeof(MatchPosition) + sizeof(uchar)); //only specializations are allowed to instantiate
+
+
+// MultiMatchTable: the MultiMatches of every oligo of a match table, held
+// one oligo after the other in a single array, along with the offset of the
+// first match of each oligo, rather than in a vector per oligo.
+//
+// The table is built in increasing oligo order, which is the order HitStore
+// returns the hits in: matches can only be added to the last oligo of the
+// table or to one after it, the oligos in between being left without any.
+class MultiMatchTable
+{
+public:
+  typedef std::vector<MultiMatch>::iterator iterator;
+  typedef std::vector<MultiMatch>::const_iterator const_iterator;
+
+  MultiMatchTable() : offsets_(1,0) {}
+
+  // size: number of oligos in the table
+  OligoNumber size( void ) const { return offsets_.size()-1; }
+  bool empty( void ) const { return (size()==0); }
+  // getNumMatches: number of matches of all the oligos
+  size_t getNumMatches( void ) const { return matches_.size(); }
+
+  // the matches of an oligo
+  iterator begin( const OligoNumber oligo ) { return matches_.begin()+offsets_[oligo]; }
+  iterator end( const OligoNumber oligo ) { return matches_.begin()+offsets_[oligo+1]; }
+  const_iterator begin( const OligoNumber oligo ) const { return matches_.begin()+offsets_[oligo]; }
+  const_iterator end( const OligoNumber oligo ) const { return matches_.begin()+offsets_[oligo+1]; }
+  size_t size( const OligoNumber oligo ) const { return offsets_[oligo+1]-offsets_[oligo]; }
+
+  // reserve: room for numMatches matches in all
+  void reserve( const size_t numMatches ) { matches_.reserve(numMatches); }
+
+  // resize: extend the table to numOligos oligos, without matches
+  void resize( const OligoNumber numOligos )
+  {
+    if (numOligos>size()) offsets_.resize(numOligos+1, matches_.size());
+  } // ~resize
+
+  // push_back: add a match to oligo, see above for which oligos are allowed
+  void push_back( const OligoNumber oligo, const MultiMatch& match )
+  {
+    resize(oligo+1);
+    assert(oligo+1==size());
+    matches_.push_back(match);
+    ++offsets_.back();
+  } // ~push_back
+
+  // insert: add the matches [first,last) to oligo, as push_back
+  template<class InputIterator>
+  void insert( const OligoNumber oligo, InputIterator first, InputIterator last )
+  {
+    resize(oligo+1);
+    assert(oligo+1==size());
+    matches_.insert(matches_.end(), first, last);
+    offsets_.back()=matches_.size();
+  } // ~insert
+
+  // merge: put the matches of each oligo of other after those of the same
+  // oligo in this table, leaving other empty
+  void merge( MultiMatchTable& other )
+  {
+    if (other.matches_.empty())
+    {
+      resize(other.size());
+    } // ~if
+    else if (matches_.empty())
+    {
+      other.resize(size());
+      swap(other);
+    } // ~else if
+    else
+    {
+      const OligoNumber numOligos(std::max(size(), other.size()));
+      MultiMatchTable merged;
+      merged.reserve(matches_.size()+other.matches_.size());
+      for (OligoNumber i(0); i<numOligos; ++i)
+      {
+        if (i<size()) merged.insert(i, begin(i), end(i));
+        if (i<other.size()) merged.insert(i, other.begin(i), other.end(i));
+      } // ~for i
+      merged.resize(numOligos);
+      swap(merged);
+    } // ~else
+    other.clear();
+  } // ~merge
+
+  // clear: remove all the oligos and free the memory
+  void clear( void )
+  {
+    MultiMatchTable empty;
+    swap(empty);
+  } // ~clear
+
+  void swap( MultiMatchTable& other )
+  {
+    offsets_.swap(other.offsets_);
+    matches_.swap(other.matches_);
+  } // ~swap
+
+private:
+  // the matches of oligo i are matches_[offsets_[i]] to matches_[offsets_[i+1]-1]
+  std::vector<boost::uint64_t> offsets_;
+  std::vector<MultiMatch> matches_;
+}; // ~class MultiMatchTable
+
 //static bool lessThanMultiMatch
 //( const MultiMatch& lhs, const MultiMatch& rhs )
 //{
@@ -150,6 +150,13 @@ public:
     ol.ui[0]&=(~ElandConstants<OLIGO_LEN>::suffixMask);
   } // ~shiftOligo
 
+  int getOligoLength( void ) const { return oligoLength_; }
+
+  unsigned int getPrefetchDistance( void ) const { return prefetchDistance_; }
+
+  // getResults: the MatchTable that matches found by scan are passed to
+  MatchTable& getResults( void ) { return results_; }
+
 private:
 
   // numOligos_: on pass 0, buildTable sets this to the number of oligos
@@ -179,6 +186,9 @@ private:
   // hasher - templatized
   Hasher<PASS, OLIGO_LEN> hash_;
 
+  // number of positions checkManyOligos hashes ahead of the one it checks
+  const unsigned int prefetchDistance_;
+
 public:
 
 OligoHashTable
@@ -187,7 +197,8 @@ OligoHashTable
   //  PartitionHashTable<useSplitPrefix>& table2,
   HashTableDataStore<ElandConstants<OLIGO_LEN>::useSplitPrefix>& htds1,
   HashTableDataStore<ElandConstants<OLIGO_LEN>::useSplitPrefix>& htds2,
-  const SuffixScoreTable& score, MatchTable& results ) :
+  const SuffixScoreTable& score, MatchTable& results,
+  const unsigned int prefetchDistance=0 ) :
   numOligos_(-1),
   oligoLength_(oligoLength),
   prefixLength_(oligoLength-16),
@@ -201,8 +212,10 @@ OligoHashTable
   results_(results),
   table1_(htds1, results),
   table2_(htds2, results),
-  hash_()
+  hash_(),
+  prefetchDistance_(prefetchDistance)
 {
+  assert(prefetchDistance_<=MAX_PREFETCH_DISTANCE);
   //  assert(oligoLength_>=16);
   //  assert(oligoLength_<=24);
 
@@ -235,7 +248,146 @@ bool hashThisOligo
 
 
 
-bool buildTable( OligoSource& oligos ,bool single )
+// OligoBlock: consecutive oligos read from the source, kept as null
+// terminated ASCII one after another so that several threads can count
+// or hash them into the tables at once
+struct OligoBlock
+{
+  void clear( void )
+  {
+    bases_.clear();
+    start_.clear();
+    oligoNum_.clear();
+  } // ~clear
+
+  void add( const char* pOligo, const OligoNumber oligoNum )
+  {
+    start_.push_back(bases_.size());
+    bases_.insert(bases_.end(), pOligo, pOligo+strlen(pOligo)+1);
+    oligoNum_.push_back(oligoNum);
+  } // ~add
+
+  unsigned int size( void ) const { return oligoNum_.size(); }
+  const char* getOligo( const unsigned int i ) const { return &bases_[start_[i]]; }
+
+  vector<char> bases_;
+  vector<unsigned int> start_;
+  vector<OligoNumber> oligoNum_;
+}; // ~struct OligoBlock
+
+// BuildSlice: working storage of the thread that deals with one slice of
+// each OligoBlock. While counting, the masks found and the number of
+// oligos to hash are collected here and merged afterwards
+struct BuildSlice
+{
+  BuildSlice( const MultiSeedQueryGenerator<OLIGO_LEN>& makeOligosFromASCII ) :
+    makeOligosFromASCII_(makeOligosFromASCII), oligosToHash_(0) {}
+
+  MultiSeedQueryGenerator<OLIGO_LEN> makeOligosFromASCII_;
+  vector<Oligo> queryOligo_, queryMask_;
+  vector<OligoNumber> queryOligoNum_;
+  vector<uint> queryCnt_;
+  MaskInterner maskMap1_, maskMap2_;
+  OligoNumber oligosToHash_;
+}; // ~struct BuildSlice
+
+// BuildTask: count or hash an OligoBlock, one slice per task. Counts if
+// pMaskMap1 and pMaskMap2 are NULL, else hashes using them
+struct BuildTask
+{
+  BuildTask( OligoHashTable& table, vector<BuildSlice>& slices, const OligoBlock& block,
+             const MaskInterner* pMaskMap1, const MaskInterner* pMaskMap2 ) :
+    table_(table), slices_(slices), block_(block),
+    pMaskMap1_(pMaskMap1), pMaskMap2_(pMaskMap2) {}
+
+  void operator()( const unsigned int i )
+  {
+    const unsigned int n(slices_.size());
+    table_.buildSlice(slices_[i], block_, (block_.size()*i)/n, (block_.size()*(i+1))/n,
+                      pMaskMap1_, pMaskMap2_, n>1);
+  } // ~operator()
+
+  OligoHashTable& table_;
+  vector<BuildSlice>& slices_;
+  const OligoBlock& block_;
+  const MaskInterner* pMaskMap1_;
+  const MaskInterner* pMaskMap2_;
+}; // ~struct BuildTask
+
+// buildSlice: count (if pMaskMap1 and pMaskMap2 are NULL) or hash oligos
+// first to last-1 of block. isShared must be set if other threads are
+// doing the same with other slices of the block
+void buildSlice( BuildSlice& slice, const OligoBlock& block,
+                 const unsigned int first, const unsigned int last,
+                 const MaskInterner* pMaskMap1, const MaskInterner* pMaskMap2,
+                 const bool isShared )
+{
+  const bool isCounting(pMaskMap1==NULL);
+  vector<Oligo>& queryOligo(slice.queryOligo_);
+  vector<Oligo>& queryMask(slice.queryMask_);
+  vector<OligoNumber>& queryOligoNum(slice.queryOligoNum_);
+  vector<uint>& queryCnt(slice.queryCnt_);
+  Oligo res, mask;
+
+  for (unsigned int n(first); n<last; ++n)
+  {
+    const OligoNumber oligoNum(block.oligoNum_[n]);
+    slice.makeOligosFromASCII_
+      ( block.getOligo(n), isCounting ? 0 : oligoNum,
+        queryOligo, queryMask, queryOligoNum, queryCnt );
+
+    // 29/04/09 markus :
+    //
+    // the problem here is that even if we have multiple seeds per
+    // read, we only take the oligosFound which is the oligoNum for
+    // the first seed. So, if we have multiple seeds and the first one
+    // is QC, then we do not report QC, but NM (since
+    // queryMask.size()>0, because the remaining seeds might not contain Ns)
+    //
+    // iterate over the vector queryMask and see if queryMask[q] is zero.
+    bool qc_flagged = false;
+    for( uint q(0);q<queryCnt.size();q++ ) {
+      if( queryCnt[q] == 0 ) {
+        qc_flagged = true; break;
+      }
+    }
+
+    if( qc_flagged == false )
+    {
+      if (hashThisOligo( oligoNum, queryMask )==true)
+      {
+        if (isCounting) ++slice.oligosToHash_;
+        for ( uint i(0) ; i<queryOligo.size(); i++)
+        {
+          hash_(queryMask[i],mask);
+          hash_(queryOligo[i],res);
+
+          if (isCounting)
+          {
+            table1_.sps_.countKey( slice.maskMap1_, res.ui[0], mask.ui[0], mask.ui[1], isShared );
+            table2_.sps_.countKey( slice.maskMap2_, res.ui[1], mask.ui[1], mask.ui[0], isShared );
+          } // ~if
+          else
+          {
+            table1_.sps_.hashEntry( *pMaskMap1, res.ui[0], mask.ui[0], res.ui[1], mask.ui[1], queryOligoNum[i], isShared );
+            table2_.sps_.hashEntry( *pMaskMap2, res.ui[1], mask.ui[1], res.ui[0], mask.ui[0], queryOligoNum[i], isShared );
+          } // ~else
+        } // ~for i
+      } // ~if
+    }
+    else
+    {
+      // QC flag this oligo
+      vector<Oligo> v_tmp;
+      hashThisOligo( oligoNum, v_tmp );
+    }
+  } // ~for n
+} // ~OligoHashTable::buildSlice
+
+// buildTable: read oligos from source and generate hash tables, using
+// numThreads threads. Return false if no oligos were hashed. The tables
+// built are the same whatever the number of threads
+bool buildTable( OligoSource& oligos ,bool single, const unsigned int numThreads=1 )
 {
   table1_.setTable( hash_.getLengthPart1(),
       hash_.getLowerFragSizePart2(),
@@ -253,8 +405,6 @@ bool buildTable( OligoSource& oligos ,bool single )
 
   const char* pOligo;
 
-  Oligo res, mask;
-
   //  table1_.pCount_ = &table1_.entryPointer_[2]; - now done in setTable
   //  table2_.pCount_ = &table2_.entryPointer_[2]; - now done in setTable
 
@@ -292,24 +442,26 @@ bool buildTable( OligoSource& oligos ,bool single )
   MultiSeedQueryGenerator<OLIGO_LEN> makeOligosFromASCII(single,seedOffsets);
   //QueryGenerator makeOligosFromASCII();
 
-  vector<Oligo> queryOligo, queryMask;
-  vector<OligoNumber> queryOligoNum;
-  vector<uint> queryCnt;
-  MaskMapType maskMap1,maskMap2;
+  MaskInterner maskMap1,maskMap2;
+
+  // oligos are read from the source a block at a time, and each block is
+  // split into one slice per thread
+  OligoBlock block;
+  vector<BuildSlice> slices(numThreads, BuildSlice(makeOligosFromASCII));
 
   cerr << "counting oligos" << endl;
 
   // count occurrences
   while (1)
   {
-    if ( (pOligo=oligos.getNextOligoSelect(false,false)) == NULL ) break;
-    //    ett.translate( pOligo, ol, rc );
-    ++oligosFound;
-
-    makeOligosFromASCII
-      ( pOligo, 0, queryOligo, queryMask, queryOligoNum, queryCnt );
-
-    //  printWord(ol.ui[1],16);cout <<'-';printWord(ol.ui[0],16); cout << endl;
+    block.clear();
+    while (block.size()<BUILD_BLOCK_SIZE)
+    {
+      if ( (pOligo=oligos.getNextOligoSelect(false,false)) == NULL ) break;
+      //    ett.translate( pOligo, ol, rc );
+      block.add(pOligo, ++oligosFound);
+    } // ~while
+    if (block.size()==0) break;
 
     // if more than 3 exact matches already found, don't search for any more
     //    if ( ( partitionNum_==0)
@@ -317,47 +469,19 @@ bool buildTable( OligoSource& oligos ,bool single )
     //      && ( ((matchType_[oligosFound].errorType&0x3)!=0)
     //	   || (matchType_[oligosFound].r[0]<=3) ) ) )
 
-
-    // 29/04/09 markus :
-    //
-    // the problem here is that even if we have multiple seeds per
-    // read, we only take the oligosFound which is the oligoNum for
-    // the first seed. So, if we have multiple seeds and the first one
-    // is QC, then we do not report QC, but NM (since
-    // queryMask.size()>0, because the remaining seeds might not contain Ns)
-    //
-    // iterate over the vector queryMask and see if queryMask[q] is zero.
-    bool qc_flagged = false;
-    for( uint q(0);q<queryCnt.size();q++ ) {
-      if( queryCnt[q] == 0 ) {
-	qc_flagged = true; break;
-      }
-    }
-
-    if( qc_flagged == false )
-      {
-	if (hashThisOligo( oligosFound, queryMask )==true)
-	  {
-
-	    ++oligosToHash;
-	    for ( uint i(0) ; i<queryOligo.size(); i++)
-	      {
-		hash_(queryMask[i],mask);
-		hash_(queryOligo[i],res);
-
-		table1_.sps_.countKey( maskMap1, res.ui[0], mask.ui[0], mask.ui[1] );
-		table2_.sps_.countKey( maskMap2, res.ui[1], mask.ui[1], mask.ui[0] );
-
-	      } // ~for
-	  } // ~if
-      } else
-	{
-	  vector<Oligo> tmp_v;
-	  hashThisOligo( oligosFound, tmp_v );
-	}
-
+    BuildTask task(*this, slices, block, NULL, NULL);
+    cc::parallelFor(task, numThreads, numThreads);
   } // ~while
 
+  for (typename vector<BuildSlice>::iterator i(slices.begin());i!=slices.end();++i)
+  {
+    maskMap1.insert(i->maskMap1_);
+    maskMap2.insert(i->maskMap2_);
+    i->maskMap1_.clear();
+    i->maskMap2_.clear();
+    oligosToHash+=i->oligosToHash_;
+  } // ~for i
+
   if (numOligos_==-1)
   {
     numOligos_=oligosFound;
@@ -405,8 +529,8 @@ bool buildTable( OligoSource& oligos ,bool single )
 
   cerr << "converting count values to pointer arrays" << endl;
 
-  table1_.makePointerArray(maskMap1);
-  table2_.makePointerArray(maskMap2);
+  table1_.makePointerArray(maskMap1, numThreads);
+  table2_.makePointerArray(maskMap2, numThreads);
 
   // rewind and fill in tables
 
@@ -419,52 +543,27 @@ bool buildTable( OligoSource& oligos ,bool single )
   int j=1;
   while( j<=numOligos_ )
   {
-    if ( (pOligo=oligos.getNextOligoSelect(false,false)) == NULL )
+    block.clear();
+    while ((j<=numOligos_)&&(block.size()<BUILD_BLOCK_SIZE))
     {
-      cerr << "Error: expecting " << numOligos_ << " oligos, only found "
-	   << j << endl;
-      exit (1);
-    } // ~if
+      if ( (pOligo=oligos.getNextOligoSelect(false,false)) == NULL )
+      {
+        cerr << "Error: expecting " << numOligos_ << " oligos, only found "
+             << j << endl;
+        exit (1);
+      } // ~if
 
 
 #ifdef NO_OF_SKIPPED_SEQUENCES
-    j+= oligos.getNoSkippedSequences();
+      j+= oligos.getNoSkippedSequences();
 #endif
 
+      block.add(pOligo, j);
+      j++; // two places to increase j: noOfSkippedSequences + regular increase
+    } // ~while
 
-    makeOligosFromASCII
-      ( pOligo, j, queryOligo, queryMask, queryOligoNum, queryCnt );
-
-    bool qc_flagged = false;
-    for( uint q(0);q<queryCnt.size();q++ ) {
-      if( queryCnt[q] == 0 ) {
-        qc_flagged = true; break;
-      }
-    }
-
-    if( qc_flagged == false )
-    {
-      if (hashThisOligo( j, queryMask) ==true )
-      {
-        for ( uint i(0) ; i<queryOligo.size(); i++)
-        {
-          assert(queryOligo.size()!=0);
-
-          hash_(queryMask[i],mask);
-          hash_(queryOligo[i],res);
-
-          table1_.sps_.hashEntry( maskMap1, res.ui[0], mask.ui[0], res.ui[1], mask.ui[1], queryOligoNum[i] );
-          table2_.sps_.hashEntry( maskMap2, res.ui[1], mask.ui[1], res.ui[0], mask.ui[0], queryOligoNum[i] );
-
-        } // ~for i
-      } // ~if
-    }
-    else {
-      // QC flag this oligo
-      vector<Oligo> v_tmp;
-      hashThisOligo( j,v_tmp );
-    }
-    j++; // two places to increase j: noOfSkippedSequences + regular increase
+    BuildTask task(*this, slices, block, &maskMap1, &maskMap2);
+    cc::parallelFor(task, numThreads, numThreads);
   } // ~while j
 
   maskMap1.clear();
@@ -479,8 +578,8 @@ bool buildTable( OligoSource& oligos ,bool single )
 
   //  table1_.removeRepeatedEntries( results_.matchPosition_ );
   //  table2_.removeRepeatedEntries( results_.matchPosition_ );
-  table1_.removeRepeatedEntries( results_ );
-  table2_.removeRepeatedEntries( results_ );
+  table1_.removeRepeatedEntries( results_, numThreads );
+  table2_.removeRepeatedEntries( results_, numThreads );
 
   cerr << "successful table build" << endl;
   return true;
@@ -495,10 +594,17 @@ void checkOligo
   Oligo res;
   hash_(ol, res);
 
+  checkHashedOligo( cache, res, sequencePos );
+} // ~OligoHashTable::checkOligo
+
+// checkHashedOligo: as checkOligo, for an oligo that has already been hashed
+void checkHashedOligo
+( MatchCache& cache, const Oligo& res, const MatchPosition sequencePos )
+{
   table1_.sps_.check( cache, res.ui[0], res.ui[1], sequencePos );
   //    ( res.ui[0], res.ui[1], sequencePos, partitionNum_ );
   table2_.sps_.check( cache, res.ui[1], res.ui[0], sequencePos );
-} // ~OligoHashTable::checkOligo
+} // ~OligoHashTable::checkHashedOligo
 
 bool lessThanF( const pair<Oligo, MatchPosition>& lhs,
                 const pair<Oligo, MatchPosition>& rhs )
@@ -662,6 +768,12 @@ MatchPosition checkManyOligos
 
   //  vector<MatchPosition> n;
 
+  if (prefetchDistance_!=0)
+  {
+    seqNum=checkManyOligosPrefetch(cache, ol, pWord, pLastWord, seqNum);
+    pWord=pLastWord;
+  } // ~if
+
   for ( ; pWord != pLastWord ; ++pWord )
   {
     thisWord = *pWord;
@@ -695,29 +807,71 @@ MatchPosition checkManyOligos
 
 } // ~int OligoHashTable::checkManyOligos
 
-
-MatchPosition scan( FileReader& file, const MatchPosition currentBlock )
+// checkManyOligosPrefetch: checkManyOligos for prefetchDistance_ > 0.
+// Nearly every position costs two dependent cache misses, one in the
+// bucket pointers and one in the bucket itself. So each oligo is hashed
+// prefetchDistance_ positions before it is checked, at which point its
+// bucket pointers are prefetched; half way down the pipeline, by which
+// time they should have arrived, the bucket entries are prefetched too.
+// Oligos are still checked one at a time in genome order, so the matches
+// found are exactly those of the plain loop.
+MatchPosition checkManyOligosPrefetch
+( MatchCache& cache, Oligo& ol, const Word* pWord, const Word* pLastWord, MatchPosition seqNum )
 {
+  const unsigned int distance(prefetchDistance_);
+  const unsigned int half(distance/2);
+  // hashed oligos waiting to be checked, the one at seqNum-numPending in
+  // pending[next] once the pipeline is full
+  Oligo pending[MAX_PREFETCH_DISTANCE];
+  unsigned int next(0), numPending(0);
+  Word thisWord;
 
-  // Delay creating MatchCache to this point so that the caches will still
-  // be compatible with the threading scheme.. even though this doesn't
-  // appear to be functional right now.
-  //
-  // If the multi-thread code is dismantled, this could be moved to
-  // member data of OligoHashTable
-  //
-  MatchCache cache(results_);
+  for ( ; pWord != pLastWord ; ++pWord )
+  {
+    thisWord = *pWord;
+    for (int i(0);i<16;i++, seqNum++)
+    {
+      shiftOligo( ol, thisWord );
+      if (numPending==distance)
+      {
+        checkHashedOligo( cache, pending[next], seqNum-distance );
+        --numPending;
+      } // ~if
 
-  MatchPosition seqNum(0), seqLast;
-  /* register */ Word thisWord = 0;
-  const ValidRegion *pValid(file.getFirstValid()), *pLastValid(file.getLastValid());
+      Oligo& res(pending[next]);
+      hash_(ol, res);
+      table1_.sps_.prefetchPointers(res.ui[0]);
+      table2_.sps_.prefetchPointers(res.ui[1]);
 
-  const Word *pWord, *pStart(file.getSeqStart());
+      if ((half!=0)&&(numPending>=half))
+      {
+        const Oligo& mid(pending[(next+distance-half)%distance]);
+        table1_.sps_.prefetchEntries(mid.ui[0]);
+        table2_.sps_.prefetchEntries(mid.ui[1]);
+      } // ~if
 
-  Oligo ol;
-#ifdef DEBUG_SCAN
-  cout << pLastValid-pValid+1 << " valid regions " << endl;
-#endif
+      ++numPending;
+      if (++next==distance) next=0;
+    } // ~for i
+  } // ~for pWord
+
+  // drain the pipeline
+  for (next=(next+distance-numPending)%distance; numPending!=0; --numPending)
+  {
+    checkHashedOligo( cache, pending[next], seqNum-numPending );
+    if (++next==distance) next=0;
+  } // ~for
+
+  return seqNum;
+} // ~OligoHashTable::checkManyOligosPrefetch
+
+
+// getNextBlock: work out the block at which the chromosome following
+// file will start, given that file starts at currentBlock
+MatchPosition getNextBlock( const FileReader& file, const MatchPosition currentBlock ) const
+{
+  MatchPosition seqNum(currentBlock);
+  const ValidRegion *pValid(file.getFirstValid()), *pLastValid(file.getLastValid());
 
   BOOST_ASSERT((currentBlock & blockPositionMask)==0 && "currentBlock must not have any position bits set");
 
@@ -725,9 +879,41 @@ MatchPosition scan( FileReader& file, const MatchPosition currentBlock )
   {
       // no valid regions found in the chromosome
       cerr << "No valid regions found in the current chromosome, updating seqNum with the currentBlock!" << endl;
-      seqNum += currentBlock;
   }
 
+  for ( ; pValid!=pLastValid; ++pValid )
+  {
+    if ((((int)pValid->finish)-((int)pValid->start))+1<oligoLength_) continue;
+
+    if (pValid->finish + currentBlock >= blockRepeat)
+    {
+        BOOST_THROW_EXCEPTION(
+            cc::PreConditionException(
+                (boost::format("Reference sequence requires more than %d blocks. "
+                               "If you are using multiple short reference files, you may get around "
+                               "this issue by concatenating them into a single large one. Otherwise, "
+                               "please reduce the length of your reference sequence, or rebuild "
+                               "with ELAND_64BIT_MATCH_POSITION defined in ElandDefines.hh."
+                               ) % (blockRepeat >> blockShift)).str())
+                );
+    }
+    seqNum = pValid->finish + 1 + currentBlock;
+  } // ~for pValid
+
+  return (((seqNum>>blockShift)+1)<<blockShift);
+} // ~getNextBlock
+
+MatchPosition scan( FileReader& file, const MatchPosition currentBlock )
+{
+  MatchCache cache(results_);
+
+  const ValidRegion *pValid(file.getFirstValid()), *pLastValid(file.getLastValid());
+
+#ifdef DEBUG_SCAN
+  cout << pLastValid-pValid+1 << " valid regions " << endl;
+#endif
+
+  const MatchPosition nextBlock(getNextBlock(file, currentBlock));
 
   for ( ; pValid!=pLastValid; ++pValid )
   {
@@ -742,21 +928,26 @@ MatchPosition scan( FileReader& file, const MatchPosition currentBlock )
 #endif
       continue;
     }
+    scanRegion(cache, file.getSeqStart(), *pValid, currentBlock);
+  } // ~for pValid
+
+  return nextBlock;
+} // ~scan
+
+// scanRegion: check every oligo lying wholly within region (which must be
+// at least oligoLength_ bases long) against the hash tables
+void scanRegion( MatchCache& cache, const Word* pStart,
+                 const ValidRegion& region, const MatchPosition currentBlock )
+{
+  const ValidRegion* pValid(&region);
+  MatchPosition seqNum, seqLast;
+  /* register */ Word thisWord = 0;
+  const Word *pWord;
+  Oligo ol;
 
     seqNum = pValid->start;
     pWord=pStart+(seqNum>>4);
     seqLast = pValid->finish + currentBlock;
-    if (seqLast >= blockRepeat)
-    {
-        BOOST_THROW_EXCEPTION(
-            cc::PreConditionException(
-                (boost::format("Reference sequence requires more than %d blocks. "
-                               "If you are using multiple short reference files, you may get around "
-                               "this issue by concatenating them into a single large one. Otherwise, "
-                               "please reduce the length of your reference sequence."
-                               ) % (blockRepeat >> blockShift)).str())
-                );
-    }
     //    seqNum += currentBlock;
     //   seqLast = pValid->finish + currentBlock;
 
@@ -829,7 +1020,7 @@ MatchPosition scan( FileReader& file, const MatchPosition currentBlock )
       // Bug fix: need to scan one more base if at a word boundary,
       // therefore do not exit loop iteration yet TC - 27.11.03
       //      continue;
-      if ((seqNum&0xF)!=0) continue;
+      if ((seqNum&0xF)!=0) return;
 
     }
     //    assert((seqNum&0xF)==0);
@@ -874,11 +1065,7 @@ MatchPosition scan( FileReader& file, const MatchPosition currentBlock )
 
     } // ~if basesInLast
 
-  } // ~for pValid
-
-  return (((seqNum>>blockShift)+1)<<blockShift);
-
-}
+} // ~scanRegion
 };
 
 } //namespace eland_ms
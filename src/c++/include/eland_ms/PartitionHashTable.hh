@@ -27,6 +27,7 @@
 #include <boost/format.hpp>
 
 #include "common/Exceptions.hh"
+#include "common/ParallelFor.hh"
 
 #include "pht/HelperFwd.hh"
 #include "pht/HelperRvrs.hh"
@@ -120,15 +121,56 @@ void setTable
 
 
 
-void makePointerArray(MaskMapType& maskMap)
+// PrefixSumTask: running totals of entryPointer_ in blocks, one block
+// per task. Pass 0 totals each block, pass 1 adds the total of all
+// preceding blocks to each entry of a block as it accumulates it
+struct PrefixSumTask
+{
+  PrefixSumTask( vector<TablePointer>& v, const unsigned int numBlocks ) :
+    v_(v), numBlocks_(numBlocks), offset_(numBlocks, 0), pass_(0) {}
+
+  size_t getBegin( const unsigned int block ) const
+  { return 2+((v_.size()-2)*block)/numBlocks_; }
+
+  void operator()( const unsigned int block )
+  {
+    const size_t begin(getBegin(block)), end(getBegin(block+1));
+    TablePointer sum(offset_[block]);
+    if (pass_==0)
+    {
+      for (size_t i(begin);i!=end;++i) sum+=v_[i];
+      offset_[block]=sum;
+    } // ~if
+    else
+    {
+      for (size_t i(begin);i!=end;++i) v_[i]=(sum+=v_[i]);
+    } // ~else
+  } // ~operator()
+
+  vector<TablePointer>& v_;
+  const unsigned int numBlocks_;
+  vector<TablePointer> offset_;
+  int pass_;
+}; // ~struct PrefixSumTask
+
+void makePointerArray(MaskInterner& maskMap, const unsigned int numThreads=1)
 {
   //
   // transform entryPointer table entries from individual to sub-total counts:
   //
   {
-    typedef std::vector<TablePointer>::iterator titer;
-    titer i(data_.entryPointer_.begin()+3), i_end(data_.entryPointer_.end());
-    for(;i!=i_end;++i) { *i += *(i-1); }
+    PrefixSumTask task(data_.entryPointer_, numThreads);
+    if (numThreads>1) cc::parallelFor(task, numThreads, numThreads);
+    // turn the block totals into the totals of all preceding blocks
+    TablePointer sum(0);
+    for (unsigned int b(0);b<numThreads;b++)
+    {
+      const TablePointer blockTotal(task.offset_[b]);
+      task.offset_[b]=sum;
+      sum+=blockTotal;
+    } // ~for b
+    task.pass_=1;
+    cc::parallelFor(task, numThreads, numThreads);
   }
   cerr << "will place " << data_.entryPointer_.back() << " entries in table"<< endl;
 
@@ -146,55 +188,95 @@ void makePointerArray(MaskMapType& maskMap)
   // take all of the masks found and put them into a faster look-up:
   //
 
-  // guard against the unlikely event that there were no unmasked suffices:
-  // (the 0 state is required for the current hash lup function to work correctly)
-  maskMap[0] = 0;
-
+  // (the 0 state is always present, even if there were no unmasked
+  // suffices, as the current hash lup function requires it)
   assert(maskMap.size()<65535);
-  sps_.maskTable_.reserve(maskMap.size());
-  {
-    MaskMapType::iterator i(maskMap.begin()), i_end(maskMap.end());
-    for(uint j(0); i!=i_end; ++i, ++j)
-    {
-      i->second=j;
-      sps_.maskTable_.push_back(i->first);
-    }
-  }
+  maskMap.number(sps_.maskTable_);
 } // ~void PartitionHashTable::makePointerArray( void )
 
-void removeRepeatedEntries ( MatchTable& results )
+// DedupTask: sort the entries of each bucket and remove repeats, for a
+// range of buckets per task. The entries kept are packed at the start of
+// the range's entries; moving them into place, and telling the MatchTable
+// which oligos are the same as which, is left to removeRepeatedEntries,
+// which does both in bucket order
+struct DedupTask
 {
-  sps_.pCount_--; // now sps_.pCount_ == data_.entryPointer_
+  DedupTask( PartitionHashTable& table, const uint32_t tableSize, const unsigned int numRanges ) :
+    table_(table), tableSize_(tableSize), numRanges_(numRanges),
+    begin_(numRanges+1), numKept_(numRanges), sameAs_(numRanges)
+  {
+    for (unsigned int r(0);r<=numRanges_;r++)
+    {
+      begin_[r]=table_.sps_.pCount_[getFirstBucket(r)];
+    } // ~for r
+  } // ~ctor
 
-  if (data_.hashRem_.empty()) {
-      // If there are no entries there can be no repeated entries.
-      // (Not bailing until after the pCount_ decrement.)
-      return;
-  }
+  uint32_t getFirstBucket( const unsigned int range ) const
+  { return (uint32_t)((((boost::uint64_t)tableSize_)*range)/numRanges_); }
 
-  int numSaved(0);
+  void operator()( const unsigned int range )
+  {
+    table_.removeRepeatedEntries(getFirstBucket(range), getFirstBucket(range+1),
+                                 begin_[range+1], numKept_[range], sameAs_[range]);
+  } // ~operator()
+
+  PartitionHashTable& table_;
+  const uint32_t tableSize_;
+  const unsigned int numRanges_;
+  // first entry of each range, as it was before any were removed
+  vector<TablePointer> begin_;
+  vector<TablePointer> numKept_;
+  // (new oligo, existing oligo) pairs to pass to MatchTable::setSameAs__
+  vector<vector<pair<OligoNumber, OligoNumber> > > sameAs_;
+}; // ~struct DedupTask
+
+// ShiftTask: move the bucket pointers of each range of a DedupTask back by
+// the number of entries removed from the preceding ranges
+struct ShiftTask
+{
+  ShiftTask( PartitionHashTable& table, const DedupTask& dedup, const vector<TablePointer>& shift ) :
+    table_(table), dedup_(dedup), shift_(shift) {}
 
+  void operator()( const unsigned int range )
+  {
+    for (uint32_t i(dedup_.getFirstBucket(range)); i!=dedup_.getFirstBucket(range+1); ++i)
+    {
+      table_.sps_.pCount_[i]-=shift_[range];
+    } // ~for i
+  } // ~operator()
+
+  PartitionHashTable& table_;
+  const DedupTask& dedup_;
+  const vector<TablePointer>& shift_;
+}; // ~struct ShiftTask
+
+// removeRepeatedEntries: sort the entries of buckets firstBucket to
+// lastBucket-1 into order then eliminate any repeats, packing the entries
+// kept from the first entry of firstBucket on. end is where the entries
+// of lastBucket-1 finish. The repeats found are appended to sameAs
+void removeRepeatedEntries ( const uint32_t firstBucket, const uint32_t lastBucket,
+                             const TablePointer end, TablePointer& numKept,
+                             vector<pair<OligoNumber, OligoNumber> >& sameAs )
+{
   TableEntry<useSplitPrefix> lastEntry;
   //  Word lastEntry;
 
-  uint k,l(0);
+  uint k,l(sps_.pCount_[firstBucket]);
+  const uint first(l);
   OligoNumber existingOligo, newOligo;
 
-  // remove repeats from table
-
-  // Sort entries for each hash value into order then eliminate any repeats.
   // This bit is based on code in IndexGenome.cpp
-
-  const uint32_t tableSize(1<<numBits_);
-  for ( uint32_t i(0) ; i < tableSize ; i++ )
+  for ( uint32_t i(firstBucket) ; i != lastBucket ; i++ )
   {
+    // the pointer to the next range may already have been changed
+    const uint bucketEnd((i+1==lastBucket) ? end : sps_.pCount_[i+1]);
 
     //    cerr << "A" << endl;
 
-    if (sps_.pCount_[i+1]-sps_.pCount_[i]>1)
+    if (bucketEnd-sps_.pCount_[i]>1)
     {
       //      cerr << "### " <<  (sps_.pCount_[i+1]-sps_.pCount_[i]) << endl;
-      sort( data_.hashRem_.begin()+sps_.pCount_[i], data_.hashRem_.begin() + sps_.pCount_[i+1] );
+      sort( data_.hashRem_.begin()+sps_.pCount_[i], data_.hashRem_.begin() + bucketEnd );
       //   mirrorSort( hashRem_.begin(),
       //	  hashRem_.begin()+pCount_[i],
       //	  hashRem_.begin() + pCount_[i+1],
@@ -205,29 +287,14 @@ void removeRepeatedEntries ( MatchTable& results )
     k = sps_.pCount_[i];
     sps_.pCount_[i] = l;
     //    cout << i << ": " << l << " from " << k << endl;
-    //    lastEntry = hashRem_[k].suffix.ui;
-    //   lastEntry ^= ~0; // ensures false on first iteration
-    if (k < data_.hashRem_.size())
-    {
-        lastEntry = data_.hashRem_[k];
-    }
-    else
-    {
-        using boost::format;
-        using casava::common::CasavaException;
-        const std::string message = (format("unexpected sps_.pCount[%i] == %i (data_.hashRem_.size() == %d)") % i % k % data_.hashRem_.size()).str();
-        //BOOST_THROW_EXCEPTION(CasavaException(EINVAL, message));
-        // get the last element of the table instead of reading past the end
-        //std::cerr << "WARNING: " << message << std::endl;
-        lastEntry = data_.hashRem_.back();
-    }
+    if (k==bucketEnd) continue;
 
+    lastEntry = data_.hashRem_[k];
     lastEntry.suffix.ui ^= ~0; // ensures false on first iteration
 
 
-    for ( ; k!= sps_.pCount_[i+1] ; k++ )
+    for ( ; k!= bucketEnd ; k++ )
     {
-      if (data_.hashRem_[k].mask==lastEntry.mask) numSaved++;
       if (data_.hashRem_[k] != lastEntry)
       { // no repeat, copy as normal
 	//	entry_[l]=entry_[k];
@@ -241,39 +308,19 @@ void removeRepeatedEntries ( MatchTable& results )
       { // repeat
 
 	--l; // shift back to first repeated entry
-	//	type_[l]=repeatInBatch;
-	//	entry_[l]=entry_[k];
-	//	entry_[l].position_ = repeatFlag + repeatInGenome + 1;
 	do
 	{
 
 	  // flag current entry as being same as that entry
-	  //	  oligos_.flagRepeat( oligoNum_[l]&(~reverseComplementFlag),
-	  //	      oligoNum_[k]&(~reverseComplementFlag));
-	  //cout<<((hashRem_[k].position&splitPrefixMaskLow)&(~isReverseOligo))
-	    //	       << ((hashRem_[k].position&isReverseOligo)?'R':'F')
-	  //   << " is the same as "
-	  // << ((hashRem_[l].position&splitPrefixMaskLow)&(~isReverseOligo))
-	  //   << ((hashRem_[l].position&isReverseOligo)?'R':'F')
-	  //   << endl;
 	  existingOligo
 	    = (data_.hashRem_[l].position)&(~isReverseOligo);
 	  newOligo
 	    = (data_.hashRem_[k].position)&(~isReverseOligo);
-          results.setSameAs__( newOligo, existingOligo );
-#ifdef ZZZZ
-	  if (  (matchPosition_[newOligo]<blockRepeat)
-		&& (matchPosition_[existingOligo]!=blockRepeat+newOligo) )
-	  {
-	    matchPosition_[newOligo] = blockRepeat+existingOligo;
-	  } // ~if
-#endif
-	    //	  matchPosition_[position_[k]&(~isReverseOligo)]
-	    //   =blockRepeat+(position_[l]&(~isReverseOligo));
+          sameAs.push_back(make_pair(newOligo, existingOligo));
 
 	  k++;
 	} // ~do
-	while( (data_.hashRem_[k]==lastEntry)&&(k!=sps_.pCount_[i+1]) );
+	while( (k!=bucketEnd)&&(data_.hashRem_[k]==lastEntry) );
 	k--; // need to look at next entry again
 	l++; // and shift destination pointer
       } // ~else
@@ -281,6 +328,55 @@ void removeRepeatedEntries ( MatchTable& results )
     } // ~if
   } // ~for i
 
+  numKept=l-first;
+} // ~removeRepeatedEntries
+
+void removeRepeatedEntries ( MatchTable& results, const unsigned int numThreads=1 )
+{
+  sps_.pCount_--; // now sps_.pCount_ == data_.entryPointer_
+
+  if (data_.hashRem_.empty()) {
+      // If there are no entries there can be no repeated entries.
+      // (Not bailing until after the pCount_ decrement.)
+      return;
+  }
+
+  // remove repeats from table
+
+  // Sort entries for each hash value into order then eliminate any
+  // repeats. Buckets are dealt with in ranges, several per thread to
+  // even out the work
+  const uint32_t tableSize(1<<numBits_);
+  const unsigned int numRanges((numThreads<=1) ? 1 : min<uint32_t>(tableSize, 16*numThreads));
+  DedupTask dedup(*this, tableSize, numRanges);
+  cc::parallelFor(dedup, numRanges, numThreads);
+
+  // pack the ranges together and report the repeats, in bucket order so
+  // that the MatchTable ends up exactly as if done by a single thread
+  uint l(0);
+  vector<TablePointer> shift(numRanges);
+  for (unsigned int r(0);r<numRanges;r++)
+  {
+    const vector<pair<OligoNumber, OligoNumber> >& sameAs(dedup.sameAs_[r]);
+    for (vector<pair<OligoNumber, OligoNumber> >::const_iterator i(sameAs.begin());
+         i!=sameAs.end(); ++i)
+    {
+      results.setSameAs__( i->first, i->second );
+    } // ~for i
+    shift[r]=dedup.begin_[r]-l;
+    if ((shift[r]!=0)&&(dedup.numKept_[r]!=0))
+    {
+      memmove(&data_.hashRem_[l], &data_.hashRem_[dedup.begin_[r]],
+              sizeof(TableEntry<useSplitPrefix>)*dedup.numKept_[r]);
+    } // ~if
+    l+=dedup.numKept_[r];
+  } // ~for r
+  if (numRanges>1)
+  {
+    ShiftTask task(*this, dedup, shift);
+    cc::parallelFor(task, numRanges, numThreads);
+  } // ~if
+
   cerr << sps_.pCount_[tableSize] << " entries reduced to " << l << " entries"
        << endl;
 
@@ -46,17 +46,21 @@ class StateMachine {
   // resize the state table; every read is associated with a certain
   // state according to the number of seeds that match
   void initialize( const OligoNumber&  s, const vector<int>& seedOffsets )
-      { states_.resize( s ); matchType_.resize( s ); seedOffsets_ = seedOffsets; }
+      { stateStarts_.reserve( s ); matchType_.resize( s ); seedOffsets_ = seedOffsets; }
 
   // update the status of a read
   bool updateStatus( const OligoNumber& oligo );
 
   // Insert pass hit, if routine returns true, then call fetchHits, do
-  // nothing otherwise
+  // nothing otherwise. The hits must come in increasing oligo order, as
+  // HitStore returns them
   bool insertSeedHit( const MatchPosition& thisPos, const MatchPosition& thisCode, int& update_cnt, MatchPositionTranslator& getMatchPos );
 
-  // Extract the hits for a specific oligo
-  list<MultiMatch> getHits( const OligoNumber& oligo, int maxItems, int seedNumberBase );
+  // Extract the hits for a specific oligo, adding them to hits
+  void getHits( const OligoNumber& oligo, int maxItems, int seedNumberBase, MultiMatchTable& hits );
+
+  // number of seed matches held for all the oligos
+  size_t getNumStates( void ) const { return states_.size(); }
 
   // stitching together the reads we built our own matchType_ array
   // incorporate now the counts from MatchTableMulti::matchType_
@@ -65,19 +69,24 @@ class StateMachine {
   // how often did we query the list of positions
   void outputAccessStatistics(void);
 
-  void clear( const OligoNumber& oligo );
-
   void clear( void );
 
   // keep track of your own MatchDescriptro vector
   vector< MatchDescriptor > matchType_;
 
  private:
-  vector< vector<SeedMatch> > states_;
+  // the seed matches of every oligo one after the other, those of oligo
+  // i starting at stateStarts_[i]. The oligos after the last one with a
+  // seed match have no start yet (see getStates)
+  vector<SeedMatch> states_;
+  vector<boost::uint64_t> stateStarts_;
   vector<int> seedOffsets_;
 
   bool compare_matches_( const SeedMatch& a,const SeedMatch& b );
 
+  // the seed matches of an oligo: states_[begin] to states_[end-1]
+  void getStates( const uint oligo, size_t& begin, size_t& end ) const;
+
   //  vector<int> no_of_inserted_seeds_;
   //  vector<int> no_of_accesses_;
 
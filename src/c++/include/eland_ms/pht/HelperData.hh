@@ -26,6 +26,8 @@
 
 #include <boost/static_assert.hpp>
 
+#include "eland_ms/MaskInterner.hh"
+
 namespace casava
 {
 namespace eland_ms
@@ -45,7 +47,18 @@ namespace eland_ms
 struct MatchCache {
 
     MatchCache(MatchTable& tab)
-        : tab_(tab)
+        : pTab_(&tab)
+        , pStore_(NULL)
+        , head_(0)
+        , cache_(cacheSize)
+    {}
+
+    // Collect the matches into store rather than passing them on to a
+    // MatchTable. Used by the threaded scan, where the matches of each
+    // chunk of the genome are handed over to the MatchTable in genome order
+    MatchCache(MatchCacheStore& store)
+        : pTab_(NULL)
+        , pStore_(&store)
         , head_(0)
         , cache_(cacheSize)
     {}
@@ -62,14 +75,19 @@ struct MatchCache {
 private:
     void
     processMatches() {
-        tab_.addMatch(cache_.begin(),cache_.begin()+head_);
+        if (pTab_) {
+            pTab_->addMatch(cache_.begin(),cache_.begin()+head_);
+        } else {
+            pStore_->insert(pStore_->end(),cache_.begin(),cache_.begin()+head_);
+        }
         head_=0;
     } 
 
 
     enum { cacheSize = 200 };
     
-    MatchTable& tab_;
+    MatchTable* pTab_;
+    MatchCacheStore* pStore_;
     unsigned head_;
     MatchCacheStore cache_;
 };
@@ -112,16 +130,52 @@ struct HashTableDataStore
 
 
 
-typedef std::map<Word,uint32_t> MaskMapType;
-
-
-
 template <bool useSplitPrefix>
 struct PHTHelperData
 {
   PHTHelperData( HashTableDataStore<useSplitPrefix>& data, MatchTable& results ) :
     data_(data), results_(results) {}
 
+  // checkEntry: score hashRem_[i] against suff, and pass it on to cache
+  // if child wants the match
+  template <class Child>
+  void checkEntry(const Child& child, MatchCache& cache, const uint i,
+                  const Word suff, const MatchPosition sequencePos ) const
+  {
+    register Word thisMatch,thisMask;
+    register FragmentErrorType errorLow,errorHigh;
+#ifdef DEBUG
+    printWord(data_.hashRem_[i].suffix.ui, maxBasesPerWord );
+    cout << " - ";
+    printWord(maskTable_[data_.hashRem_[i].mask],maxBasesPerWord);
+    cout << endl;
+#endif
+
+    thisMask=0;
+    thisMatch=(suff^data_.hashRem_[i].suffix.ui);
+    if(data_.hashRem_[i].mask){
+        thisMask=(maskTable_[data_.hashRem_[i].mask]);
+        thisMatch&=(~thisMask);
+    }
+
+    if (((errorLow=(lowerFragScore_[thisMatch&lowerFragMask_])) < moreThanTwoErrors__) &&
+         ((errorHigh=(upperFragScore_[thisMatch>>(numBitsPerBase*lowerFragSize_)])) < moreThanTwoErrors__))
+    {
+#ifdef DEBUG
+        cout << (data_.hashRem_[i].position&(~isReverseOligo)) << " "
+             << ((data_.hashRem_[i].position&isReverseOligo)?'R':'F') << " "
+             << sequencePos-blockSize << " ";
+        printWord(suff, 10);
+#endif
+        if (child.wantMatch(errorLow, errorHigh, thisMask))
+        {
+            cache.setNewMatch().set(data_.hashRem_[i].position,sequencePos,
+                                    ((errorLow>oneError__)+(errorLow>noErrors__)
+                                     +(errorHigh>oneError__)+(errorHigh>noErrors__)));
+        }
+    }
+  } // ~checkEntry
+
   HashTableDataStore<useSplitPrefix>& data_;
   TablePointer* pCount_;
   int lowerFragSize_;
@@ -143,10 +197,14 @@ public PHTHelperData<useSplitPrefix>
 
   BOOST_STATIC_ASSERT(useSplitPrefix==2); // allow speciallizations only
 
-  void countKey( MaskMapType& maskMap, const Word key, const Word prefixMask, const Word suffixMask);
+  // countKey, hashEntry: isShared must be set if other threads may be
+  // counting or hashing into the same table at the same time
+  void countKey( MaskInterner& maskMap, const Word key, const Word prefixMask, const Word suffixMask,
+                 const bool isShared=false );
 
-  void hashEntry( const MaskMapType& maskMap, Word key, const Word keyMask,
-                  const Word entry, const Word entryMask, OligoNumber oligoNum );
+  void hashEntry( const MaskInterner& maskMap, Word key, const Word keyMask,
+                  const Word entry, const Word entryMask, OligoNumber oligoNum,
+                  const bool isShared=false );
 
   void
   setTopPrefix(const uint32_t tableSize);
@@ -43,29 +43,31 @@ public PHTHelperData<true>
       , topMask_(~0)
   {}
 
-  void countKey( MaskMapType& maskMap, const Word key, const Word prefixMask, const Word suffixMask)
+  void countKey( MaskInterner& maskMap, const Word key, const Word prefixMask, const Word suffixMask,
+                 const bool isShared=false )
   {
     if (prefixMask==0)
     {
-      maskMap[suffixMask] = 0;
-      ++pCount_[key>>splitPrefixShift_];
+      maskMap.insert(suffixMask);
+      if (isShared) __sync_fetch_and_add(&pCount_[key>>splitPrefixShift_], 1);
+      else ++pCount_[key>>splitPrefixShift_];
     }
     //    pCount_[key>>splitPrefixShift_]+=(mask==0);
   }
 
-  void hashEntry( const MaskMapType& maskMap, Word key, const Word keyMask, const Word entry,
-                  const Word entryMask, OligoNumber oligoNum )
+  void hashEntry( const MaskInterner& maskMap, Word key, const Word keyMask, const Word entry,
+                  const Word entryMask, OligoNumber oligoNum, const bool isShared=false )
   {
     if (0 == keyMask)
     {
       //      oligoNum|=((key&splitPrefixMask_)<<MAX_HASH_BITS);
       PrefixType prefix((PrefixType)(key&splitPrefixMask_));
       key >>= splitPrefixShift_;
-      data_.hashRem_[pCount_[key]].prefix=prefix;
-      data_.hashRem_[pCount_[key]].suffix.ui=entry;
-      data_.hashRem_[pCount_[key]].mask=(maskMap.find(entryMask))->second;
-      data_.hashRem_[pCount_[key]].position=oligoNum;
-      pCount_[key]++;
+      const TablePointer i(isShared ? __sync_fetch_and_add(&pCount_[key], 1) : pCount_[key]++);
+      data_.hashRem_[i].prefix=prefix;
+      data_.hashRem_[i].suffix.ui=entry;
+      data_.hashRem_[i].mask=maskMap.find(entryMask);
+      data_.hashRem_[i].position=oligoNum;
     }
   }
 
@@ -111,11 +113,23 @@ public PHTHelperPreBase<true>
     PHTHelperPreBase<true>( data, results )
   {}
 
+  // prefetchPointers: start loading the bucket bounds for prefix
+  void prefetchPointers( const Word prefix ) const
+  {
+    __builtin_prefetch(pCount_+(prefix>>splitPrefixShift_));
+  }
+
+  // prefetchEntries: start loading the first entries of the bucket for
+  // prefix. Reads the bucket bounds, so should follow prefetchPointers
+  // by long enough for them to have arrived
+  void prefetchEntries( const Word prefix ) const
+  {
+    __builtin_prefetch(&data_.hashRem_[0]+(topMask_&pCount_[prefix>>splitPrefixShift_]));
+  }
+
   void check(MatchCache& cache, Word prefix, const Word suff, const MatchPosition sequencePos )
   {
     //    printWord( prefix, 12 ); cout << "****" << endl;
-    register Word thisMatch,thisMask;
-    register FragmentErrorType errorLow,errorHigh;
     const PrefixType thisSplitPrefix((PrefixType)(prefix&splitPrefixMask_));
     //    OligoNumber thisSplitPrefix((prefix&splitPrefixMask_)<<MAX_HASH_BITS);
     prefix>>=splitPrefixShift_;
@@ -145,22 +159,7 @@ public PHTHelperPreBase<true>
         break;
       }
 
-      thisMask=0;
-      thisMatch=(suff^data_.hashRem_[i].suffix.ui);
-      if(data_.hashRem_[i].mask){
-          thisMask=(maskTable_[data_.hashRem_[i].mask]);
-          thisMatch&=(~thisMask);
-       }
-      if (((errorLow=(lowerFragScore_[thisMatch&lowerFragMask_])) < moreThanTwoErrors__) && 
-           ((errorHigh=(upperFragScore_[thisMatch>>(numBitsPerBase*lowerFragSize_)])) < moreThanTwoErrors__))
-      {
-          if (static_cast<const Child*>(this)->wantMatch(errorLow, errorHigh, thisMask))
-          {
-              cache.setNewMatch().set(data_.hashRem_[i].position,sequencePos,
-                                      ((errorLow>oneError__)+(errorLow>noErrors__)
-                                       +(errorHigh>oneError__)+(errorHigh>noErrors__)));
-          }
-      }
+      checkEntry(*static_cast<const Child*>(this), cache, i, suff, sequencePos);
     }
   }
 
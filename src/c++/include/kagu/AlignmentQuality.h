@@ -53,10 +53,36 @@ private:
     // our look-up tables
     static double mLgPCorrect[100];
     static double mMismatchCorrection[100];
-    // retrieves a vector of mismatched base qualities
-    void GetMismatchBaseQualities(const std::string& qualities, const std::string& status, std::vector<uint8_t>& mismatchBaseQualities) const;
+    // retrieves the two lowest base qualities in the seed
+    static inline void GetWorstSeedQualities(const std::string& qualities, const uint32_t seedLength, uint8_t& worstQuality, uint8_t& secondWorstQuality);
 };
 
+// retrieves the two lowest base qualities in the seed
+inline void AlignmentQuality::GetWorstSeedQualities(const std::string& qualities, const uint32_t seedLength, uint8_t& worstQuality, uint8_t& secondWorstQuality) {
+
+    const uint8_t* pQualities = (const uint8_t*)qualities.data();
+
+    // a seed shorter than two bases is already sorted, so the second worst quality is simply the next base
+    if(seedLength < 2) {
+        worstQuality       = pQualities[0];
+        secondWorstQuality = pQualities[1];
+        return;
+    }
+
+    worstQuality       = std::min(pQualities[0], pQualities[1]);
+    secondWorstQuality = std::max(pQualities[0], pQualities[1]);
+
+    for(uint32_t i = 2; i < seedLength; ++i) {
+        const uint8_t q = pQualities[i];
+        if(q < worstQuality) {
+            secondWorstQuality = worstQuality;
+            worstQuality       = q;
+        } else if(q < secondWorstQuality) {
+            secondWorstQuality = q;
+        }
+    }
+}
+
 // modifies the neighborhood to contain at most one entry in the lowest error neighborhood class
 inline void AlignmentQuality::AdjustNeighborhood(uint32_t* const pSeedErrors) {
     if(pSeedErrors[0] > 0) {
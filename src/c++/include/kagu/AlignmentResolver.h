@@ -23,15 +23,20 @@
 
 #pragma once
 
+#include <boost/exception_ptr.hpp>
+#include <boost/filesystem.hpp>
 #include <boost/math/constants/constants.hpp>
 #include <boost/math/special_functions/erf.hpp>
 #include <boost/unordered_map.hpp>
 #include <algorithm>
 #include <cfloat>
 #include <cstdlib>
+#include <iomanip>
 #include <iostream>
+#include <memory>
 #include <sstream>
 #include <stdint.h>
+#include "common/ParallelFor.hh"
 #include "common/StringUtilities.hh"
 #include "kagu/AlignmentQuality.h"
 #include "kagu/AlignmentReader.h"
@@ -74,6 +79,28 @@ struct FragmentLengthStatistics {
     }
 };
 
+// stores everything phase 1 derives from the alignments (before the fragment length overrides)
+struct FragmentLengthModel {
+    FragmentLengthStatistics Statistics;
+    uint8_t AlignmentModel1;
+    uint8_t AlignmentModel2;
+    uint32_t ModelCounts[8];
+    uint32_t NumFragmentsUsed;
+    uint32_t NumTestedFragments;
+    uint32_t NumTestedUniqueFragments;
+
+    // constructor
+    FragmentLengthModel(void)
+        : AlignmentModel1(0)
+        , AlignmentModel2(0)
+        , NumFragmentsUsed(0)
+        , NumTestedFragments(0)
+        , NumTestedUniqueFragments(0)
+    {
+        std::uninitialized_fill(ModelCounts, ModelCounts + 8, 0);
+    }
+};
+
 struct SingleEndStatistics {
     uint32_t NumContaminants;
     uint32_t NumFailAQ;
@@ -155,6 +182,39 @@ enum SecondaryStatus {
 
 #define NUM_SECONDARY_STATUS 7
 
+// how a mate should be written to the export file
+enum ExportRecordType {
+    ER_Unaligned,
+    ER_Orphan,
+    ER_Mate,
+    ER_Fragment
+};
+
+// stores a read fragment and the outcome of its resolution
+struct ResolvedFragment {
+    casava::common::CasavaRead Mate1;
+    casava::common::CasavaRead Mate2;
+    ExportRecordType Mate1Record;
+    ExportRecordType Mate2Record;
+    uint32_t Mate1Alignment;
+    uint32_t Mate2Alignment;
+    bool IsAnomalous;
+
+    // constructor
+    ResolvedFragment(void)
+        : Mate1Record(ER_Unaligned)
+        , Mate2Record(ER_Unaligned)
+        , Mate1Alignment(0)
+        , Mate2Alignment(0)
+        , IsAnomalous(true)
+    {}
+};
+
+typedef std::vector<ResolvedFragment> ResolvedFragments;
+
+// the number of read fragments handed between the reader, resolvers, and writers at a time
+#define FRAGMENT_BATCH_SIZE 10000
+
 typedef std::vector<AlignmentModel> AlignmentModels;
 
 class AlignmentResolver {
@@ -191,20 +251,36 @@ private:
     static inline double CalculateRestOfGenomeCorrection(const uint32_t genomeLen, const uint32_t readLen);
     // displays the single-end statistics
     static void DisplaySingleEndStatistics(SingleEndStatistics& s);
+    // streams the mates until the fragment length distribution converges
+    void EstimateFragmentLengthModel(FragmentLengthModel& flm);
+    // writes the fragment length model and the parameters it was built with into an XML file
+    static void ExportFragmentLengthModel(const std::string& filename, const Attributes_t& parameters, const FragmentLengthModel& flm);
     // returns the alignment model associated with ordering and orientation of two mates
     inline uint8_t GetAlignmentModel(const uint32_t mate1Pos, const bool isMate1ReverseStrand, const uint32_t mate2Pos, const bool isMate2ReverseStrand, const bool useCircularAlignmentModel);
     // returns the alignment with the highest alignment quality
     static casava::common::CasavaAlignments::iterator GetBestAlignment(casava::common::CasavaRead& cr, const double baseLnPcorrect, const double rogCorrection, const AlignmentQuality& aq, const uint32_t seedLength, const uint32_t numAlignments);
+    // collects everything the fragment length model depends on
+    void GetFragmentLengthModelParameters(Attributes_t& parameters);
     // retrieves the reference sequence metadata
     inline void GetReferenceMetadata(const std::string& referenceName, ReferenceMetadata& metadata);
     // returns the aggregate length of the genome represented in the genome size XML file
     uint32_t GetReferenceSequenceLengths(const std::string& filename);
+    // reads a fragment length model written by ExportFragmentLengthModel. Returns false if it cannot be used.
+    static bool ImportFragmentLengthModel(const std::string& filename, const Attributes_t& parameters, FragmentLengthModel& flm);
     // parses the circular references command line option and marks each specified reference as being circular
     void MarkCircularReferences(void);
+    // reads the next batch of read fragments, counting them as they are read
+    void ReadFragments(ResolvedFragments& batch, uint32_t& numFragments);
+    // resolves a read fragment and records how each mate should be written
+    void ResolveFragment(ResolvedFragment& rf, const FragmentLengthStatistics& fls, const double rog_mate1, const double rog_mate2, const double rog_total, const AlignmentQuality& aq, Statistics& stats, std::string& refName, ReferenceMetadata& metadata);
     // updates the read fragment statistics
-    void UpdateReadFragmentStatistics(casava::common::CasavaRead& m1, casava::common::CasavaRead& m2, OutcomeStatus outcomeStatus, SecondaryStatus secondaryStatus, bool updateResolvedStats);
+    static void UpdateReadFragmentStatistics(Statistics& stats, casava::common::CasavaRead& m1, casava::common::CasavaRead& m2, OutcomeStatus outcomeStatus, SecondaryStatus secondaryStatus, bool updateResolvedStats);
     // updates the alignment model and fragment length statistics. Returns true if the mates are resolved.
     bool UpdateAlignmentModelFragmentLengthStatistics(casava::common::CasavaAlignments::const_iterator& m1It, casava::common::CasavaAlignments::const_iterator& m2It, const FragmentLengthStatistics& fls, const bool m1Unique, const bool m2Unique, const bool m1FailedFilter, const bool m2FailedFilter, bool& usedCircularReference);
+    // writes a resolved mate to the export file
+    static void WriteExportRecord(ExportWriter& writer, const casava::common::CasavaRead& cr, const ExportRecordType recordType, const uint32_t alignment, const casava::common::CasavaRead& mate, const uint32_t mateAlignment);
+    // reads, resolves, and writes the read fragments in batches
+    struct FragmentPipeline;
     // our alignment parser object
     AlignmentReader mMate1Reader;
     AlignmentReader mMate2Reader;
@@ -0,0 +1,100 @@
+/**
+ ** Copyright (c) 2007-2010 Illumina, Inc.
+ **
+ ** This software is covered by the "Illumina Genome Analyzer Software
+ ** License Agreement" and the "Illumina Source Code License Agreement",
+ ** and certain third party copyright/licenses, and any user of this
+ ** source file is bound by the terms therein (see accompanying files
+ ** Illumina_Genome_Analyzer_Software_License_Agreement.pdf and
+ ** Illumina_Source_Code_License_Agreement.pdf and third party
+ ** copyright/license notices).
+ **
+ ** This file is part of the Consensus Assessment of Sequence And VAriation
+ ** (CASAVA) software package.
+ **
+ ** @file BgzfWriter.h
+ **
+ ** @brief This class writes block gzip (BGZF) files. Blocks are compressed
+ **        on several threads and a .gzi index of the block offsets is
+ **        written next to the file.
+ **/
+
+#pragma once
+
+#include <boost/exception/all.hpp>
+#include <boost/format.hpp>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <stdint.h>
+#include <vector>
+#include <zlib.h>
+#include "common/Exceptions.hh"
+
+// the maximum number of uncompressed bytes in a block (as in samtools bgzf.c)
+#define BGZF_BLOCK_SIZE        0xff00
+#define BGZF_HEADER_SIZE       18
+#define BGZF_FOOTER_SIZE       8
+#define BGZF_COMPRESSION_LEVEL 1
+// the number of blocks each thread compresses before they are written
+#define BGZF_BLOCKS_PER_THREAD 4
+
+namespace casava {
+namespace kagu {
+
+// stores a block before and after compression
+struct BgzfBlock {
+    std::string Data;
+    std::vector<char> Compressed;
+    uint32_t CompressedSize;
+    z_stream Stream;
+    bool IsStreamInitialized;
+
+    // constructor
+    BgzfBlock(void)
+        : CompressedSize(0)
+        , IsStreamInitialized(false)
+    {}
+};
+
+class BgzfWriter {
+public:
+    // constructor
+    BgzfWriter(void);
+    // destructor
+    ~BgzfWriter(void);
+    // flushes the remaining blocks, writes the EOF block and the index, and closes the file
+    void Close(void);
+    // opens the BGZF file and compresses the blocks on the specified number of threads
+    void Open(const std::string& filename, const uint32_t numThreads);
+    // adds a record. Records only span blocks when they are longer than a block.
+    void Write(const char* s, const uint32_t len);
+
+private:
+    // compresses the filled blocks and writes them to disk
+    void FlushBlocks(void);
+    // writes the .gzi index file
+    void WriteIndex(void);
+    // toggles the state of the writer
+    bool mIsOpen;
+    // our output stream
+    FILE* mOutStream;
+    // our BGZF filename
+    std::string mFilename;
+    // the number of threads used to compress the blocks
+    uint32_t mNumThreads;
+    // our blocks and the index of the block currently being filled
+    std::vector<BgzfBlock> mBlocks;
+    uint32_t mCurrentBlock;
+    // the compressed and uncompressed offsets of the next block
+    uint64_t mCompressedOffset;
+    uint64_t mUncompressedOffset;
+    // the compressed and uncompressed offsets of every block but the first
+    std::vector<std::pair<uint64_t, uint64_t> > mIndex;
+};
+
+}
+}
@@ -31,6 +31,7 @@
 #define DEFAULT_MIN_FRAGMENT_ALIGNMENT_QUALITY 4
 #define DEFAULT_MIN_MATE_ALIGNMENT_QUALITY     4
 #define DEFAULT_ELAND_SEED_LENGTH              32
+#define DEFAULT_NUM_THREADS                    1
 
 namespace casava {
 namespace kagu {
@@ -40,6 +41,7 @@ typedef std::vector<std::string> Filenames_t;
 struct ConfigurationSettings_t {
     std::string AnomalyFilename;
     std::string ContaminationAlignmentFilename;
+    std::string FragmentLengthModelFilename;
     std::string ReferenceSequenceSizeFilename;
     std::string SpliceAlignmentFilename;
     std::string StatisticsFilename;
@@ -96,6 +98,9 @@ struct ConfigurationSettings_t {
     // unique pair percentage
     double ConsistentPairsPercent;
     double UniquePairPercent;
+
+    // the number of threads used to resolve the read fragments and compress the export files
+    uint32_t NumThreads;
 };
 
 extern ConfigurationSettings_t ConfigSettings;
@@ -26,9 +26,10 @@
 #include <cstdlib>
 #include <iostream>
 #include <string>
-#include <zlib.h>
 #include "common/CasavaRead.hh"
 #include "common/Exceptions.hh"
+#include "common/FastIo.hh"
+#include "kagu/BgzfWriter.h"
 
 namespace casava {
 namespace kagu {
@@ -41,8 +42,8 @@ public:
     ~ExportWriter(void);
     // closes the file stream
     void Close();
-    // opens the export file for the associated mate
-    void Open(const std::string& filename);
+    // opens the export file for the associated mate and compresses it on the specified number of threads
+    void Open(const std::string& filename, const uint32_t numThreads);
     // writes a resolved fragment entry to disk
     void WriteFragment(const casava::common::CasavaRead& cr, casava::common::CasavaAlignments::const_iterator& alIt, casava::common::CasavaAlignments::const_iterator& mateIt);
     // writes a mate entry to disk
@@ -58,11 +59,17 @@ private:
     // toggles the state of the writer
     bool mIsOpen;
     // our output streams
-    gzFile mOutStream;
-    // our export filename
-    std::string mFilename;
+    BgzfWriter mOutStream;
+    // the record currently being formatted
+    std::string mRecord;
     // check that we have opened the output file stream
     inline void CheckOpen(void) const;
+    // appends an integer to the current record
+    inline void AppendInteger(const int64_t num);
+    // appends an unsigned integer to the current record
+    inline void AppendUInteger(const uint32_t num);
+    // writes the current record to the export file
+    inline void WriteRecord(void);
     // writes the alignment info for the current entry
     void WriteAlignmentInfo(const casava::common::CasavaRead& cr, casava::common::CasavaAlignments::const_iterator& alIt);
     // writes the header info for the current entry
@@ -76,5 +83,23 @@ inline void ExportWriter::CheckOpen(void) const {
     }
 }
 
+// appends an integer to the current record
+inline void ExportWriter::AppendInteger(const int64_t num) {
+    char buffer[24];
+    mRecord.append(buffer, casava::common::sprintInteger<int64_t>(buffer, num));
+}
+
+// appends an unsigned integer to the current record
+inline void ExportWriter::AppendUInteger(const uint32_t num) {
+    char buffer[16];
+    mRecord.append(buffer, casava::common::sprintUnsignedInteger<uint32_t>(buffer, num));
+}
+
+// writes the current record to the export file
+inline void ExportWriter::WriteRecord(void) {
+    mOutStream.Write(mRecord.data(), (uint32_t)mRecord.size());
+    mRecord.clear();
+}
+
 }
 }
@@ -105,6 +105,32 @@ struct Statistics {
     {
         std::uninitialized_fill(NumUniqueFragmentsOnSameRefPerAlignmentModel, NumUniqueFragmentsOnSameRefPerAlignmentModel + 8, 0);
     }
+
+    // adds the read fragment statistics collected while resolving a subset of the fragments
+    void AddFragmentStatistics(const Statistics& s) {
+        NumFragments                      += s.NumFragments;
+        NumUniqueFragmentsPassedFiltering += s.NumUniqueFragmentsPassedFiltering;
+        NumOrphans                        += s.NumOrphans;
+        NumResolvedFragments              += s.NumResolvedFragments;
+        NumUnresolvedFragments            += s.NumUnresolvedFragments;
+        for(uint32_t i = 0; i < 8; ++i) NumUniqueFragmentsOnSameRefPerAlignmentModel[i] += s.NumUniqueFragmentsOnSameRefPerAlignmentModel[i];
+
+        NumNominalUniqueFragments         += s.NumNominalUniqueFragments;
+        NumNominalLargeFragmentLengths    += s.NumNominalLargeFragmentLengths;
+        NumNominalSmallFragmentLengths    += s.NumNominalSmallFragmentLengths;
+
+        NumUU                             += s.NumUU;
+        NumUM                             += s.NumUM;
+        NumMM                             += s.NumMM;
+        NumUUResolved                     += s.NumUUResolved;
+        NumUMResolved                     += s.NumUMResolved;
+        NumMMResolved                     += s.NumMMResolved;
+
+        NumCircularResolved               += s.NumCircularResolved;
+
+        CountingMap::const_iterator countIter;
+        for(countIter = s.Counts.begin(); countIter != s.Counts.end(); ++countIter) Counts[countIter->first] += countIter->second;
+    }
 };
 
 // our xml entry data struct
@@ -23,6 +23,8 @@
 #include <cstring>
 #include <cstdlib>
 #include <algorithm>
+#include <fcntl.h>
+#include <unistd.h>
 #include <boost/format.hpp>
 #include <boost/foreach.hpp>
 
@@ -37,20 +39,97 @@ namespace alignment
 
 namespace cc = casava::common;
 
+namespace
+{
+
+/// bytes of BCL read per block, all the cycle files together
+const size_t bclBlockSize = 1 << 22;
+/// clusters transposed at a time, small enough for their bases to stay in cache across all the cycles
+const size_t transposeTileSize = 32;
+/// offset of the first cluster in a BCL file
+const off_t bclHeaderSize = 4;
+
+/**
+ ** \brief Base and quality of each of the 256 BCL byte values.
+ **
+ ** The two low bits are the base, the six others the quality. A quality
+ ** of 0 is a no-call.
+ **/
+struct BclDecoder
+{
+    char bases[256];
+    char qualities[256];
+    BclDecoder()
+    {
+        static const char BaseUpperCase[4] = { 'A', 'C', 'G', 'T'};
+        for (unsigned int c = 0; 256 > c; ++c)
+        {
+            const unsigned int quality = ((c & 0xfc) >> 2);
+            bases[c] = quality ? BaseUpperCase[c & 0x3] : 'N';
+            qualities[c] = quality ? quality + 64 : 66;
+        }
+    }
+};
+
+const BclDecoder bclDecoder;
+
+/**
+ ** \brief pread all of size bytes unless the end of the file or an error comes first.
+ **
+ ** \return the number of bytes read, or -1 if the read failed
+ **/
+ssize_t preadFully(const int fd, unsigned char *buffer, const size_t size, off_t offset)
+{
+    size_t done = 0;
+    while (size != done)
+    {
+        const ssize_t bytesRead = pread(fd, buffer + done, size - done, offset + done);
+        if (0 > bytesRead && EINTR == errno)
+        {
+            continue;
+        }
+        if (0 > bytesRead)
+        {
+            return -1;
+        }
+        if (0 == bytesRead)
+        {
+            break;
+        }
+        done += bytesRead;
+    }
+    return done;
+}
+
+} // namespace
+
 BclReader::BclReader(const std::vector<fs::path> &pathList, const bool ignoreMissingBcl)
     : pathList_(pathList)
     , ignoreMissingBcl_(ignoreMissingBcl)
     , clusterCount_(readClusterCount())
     , currentCluster_(0)
+    , blockBegin_(0)
+    , blockEnd_(0)
 {
 
 }
 
+BclReader::~BclReader()
+{
+    BOOST_FOREACH(const int fd, fileDescriptors_)
+    {
+        if (-1 != fd)
+        {
+            close(fd);
+        }
+    }
+}
+
 unsigned int BclReader::readClusterCount(const size_t index)
 {
-    std::istream &is = at(index);
-    const unsigned int clusterCount = cc::readUnsignedInteger<4>(is);
-    if (!is)
+    unsigned char header[bclHeaderSize];
+    const int fd = fileDescriptors_[index];
+    if (-1 == fd || bclHeaderSize != preadFully(fd, header, bclHeaderSize, 0))
     {
         using boost::format;
         const fs::path &path = pathList_[index];
@@ -63,7 +142,8 @@ unsigned int BclReader::readClusterCount(const size_t index)
             BOOST_THROW_EXCEPTION(cc::IoException(errno, message.str()));
         }
     }
-    return clusterCount;
+    // 4 bytes little endian
+    return header[0] | (header[1] << 8) | (header[2] << 16) | ((unsigned int)header[3] << 24);
 }
 
 unsigned int BclReader::readClusterCount()
@@ -86,8 +166,8 @@ unsigned int BclReader::readClusterCount()
                 BOOST_THROW_EXCEPTION(cc::IoException(errno, message.str()));
             }
         }
-        push_back(new std::ifstream(path.string().c_str()));
-        if (!back())
+        fileDescriptors_.push_back(open(path.string().c_str(), O_RDONLY));
+        if (-1 == fileDescriptors_.back())
         {
             const format message = format("Couldn't open BCL file %s.") % path;
             if (ignoreMissingBcl_)
@@ -100,7 +180,7 @@ unsigned int BclReader::readClusterCount()
     }
     size_t current = 0;
     const unsigned int clusterCount = readClusterCount(current);
-    while (size() != ++current)
+    while (fileDescriptors_.size() != ++current)
     {
         const unsigned int n = readClusterCount(current);
         if (clusterCount != n)
@@ -119,11 +199,59 @@ unsigned int BclReader::readClusterCount()
     return clusterCount;
 }
 
-unsigned char BclReader::decode(const size_t value) const
+void BclReader::readBlock()
 {
-    static const unsigned char BaseUpperCase[4] = { 'A', 'C', 'G', 'T'};
-    assert(4 > value);
-    return BaseUpperCase[value];
+    const size_t cycleCount = fileDescriptors_.size();
+    const size_t blockClusterCount = std::max<size_t>(1, bclBlockSize / std::max<size_t>(1, cycleCount));
+    blockBegin_ = currentCluster_;
+    blockEnd_ = std::min<size_t>(clusterCount_, blockBegin_ + blockClusterCount);
+    const size_t clusters = blockEnd_ - blockBegin_;
+
+    // one read per cycle file, the block ending before the first cluster
+    // missing from one of them
+    blockBcl_.resize(clusters * cycleCount);
+    size_t readClusters = clusters;
+    for (size_t cycle = 0; cycleCount > cycle; ++cycle)
+    {
+        unsigned char * const bcl = &blockBcl_[cycle * clusters];
+        const int fd = fileDescriptors_[cycle];
+        const ssize_t bytesRead = (-1 == fd) ? -1 : preadFully(fd, bcl, clusters, bclHeaderSize + blockBegin_);
+        if (clusters != (size_t)bytesRead)
+        {
+            if (ignoreMissingBcl_)
+            {
+                std::fill(bcl + std::max<ssize_t>(0, bytesRead), bcl + clusters, 0);
+            }
+            else if (0 < bytesRead)
+            {
+                readClusters = std::min<size_t>(readClusters, bytesRead);
+            }
+            else
+            {
+                using boost::format;
+                const format message = format("Failed to read BCL file %s.") % pathList_[cycle];
+                BOOST_THROW_EXCEPTION(cc::IoException(0 > bytesRead ? errno : EINVAL, message.str()));
+            }
+        }
+    }
+    blockEnd_ = blockBegin_ + readClusters;
+
+    // transpose into clusters while decoding
+    blockBases_.resize(readClusters * cycleCount);
+    blockQualities_.resize(readClusters * cycleCount);
+    for (size_t tileBegin = 0; readClusters > tileBegin; tileBegin += transposeTileSize)
+    {
+        const size_t tileEnd = std::min(readClusters, tileBegin + transposeTileSize);
+        for (size_t cycle = 0; cycleCount > cycle; ++cycle)
+        {
+            const unsigned char * const bcl = &blockBcl_[cycle * clusters];
+            for (size_t cluster = tileBegin; tileEnd > cluster; ++cluster)
+            {
+                blockBases_[cluster * cycleCount + cycle] = bclDecoder.bases[bcl[cluster]];
+                blockQualities_[cluster * cycleCount + cycle] = bclDecoder.qualities[bcl[cluster]];
+            }
+        }
+    }
 }
 
 void BclReader::getCluster(std::string &bases, std::string &qualities)
@@ -134,34 +262,15 @@ void BclReader::getCluster(std::string &bases, std::string &qualities)
         const format message = format("Method 'getCluster' called more than %d times") % clusterCount_;
         BOOST_THROW_EXCEPTION(cc::PreConditionException(message.str()));
     }
-    ++currentCluster_;
-    bases.clear();
-    qualities.clear();
-    for(boost::ptr_vector<std::ifstream>::iterator is = begin(); end() != is; ++is)
+    if (blockEnd_ <= currentCluster_)
     {
-        int c = is->get();
-        if (is->fail())
-        {
-            const format message = format("Failed to read BCL file %s.") % pathList_[is - begin()];
-            if (!ignoreMissingBcl_)
-            {
-                BOOST_THROW_EXCEPTION(cc::IoException(errno, message.str()));
-            }
-            c = 0;
-        }
-        if (is->eof())
-        {
-            const format message = format("Unexpected EOF for BCL file %s") % pathList_[is - begin()];
-            if (!ignoreMissingBcl_)
-            {
-                BOOST_THROW_EXCEPTION(cc::IoException(EINVAL, message.str()));
-            }
-            c = 0;
-        }
-        const unsigned int quality = ((c & 0xfc) >> 2);
-        bases.push_back(quality ? decode(c & 0x3) : 'N');
-        qualities.push_back(quality ? quality + 64 : 66);
+        readBlock();
     }
+    const size_t cycleCount = fileDescriptors_.size();
+    const size_t offset = (currentCluster_ - blockBegin_) * cycleCount;
+    ++currentCluster_;
+    bases.assign(blockBases_.begin() + offset, blockBases_.begin() + offset + cycleCount);
+    qualities.assign(blockQualities_.begin() + offset, blockQualities_.begin() + offset + cycleCount);
 }
 
 /**
@@ -172,7 +281,8 @@ class FiltersReaderImpl_8bits : public FiltersReader::FiltersReaderImpl, boost::
 {
 private:
     virtual unsigned int doReadClusterCount(std::istream &is);
-    virtual unsigned int doGetNextFilter(std::istream& is);
+    virtual unsigned int doGetFilterSize() const;
+    virtual unsigned int doDecodeFilter(const unsigned char *filter) const;
 };
 
 unsigned int FiltersReaderImpl_8bits::doReadClusterCount(std::istream &is)
@@ -209,14 +319,15 @@ unsigned int FiltersReaderImpl_8bits::doReadClusterCount(std::istream &is)
     return clusterCount;
 }
 
-unsigned int FiltersReaderImpl_8bits::doGetNextFilter(std::istream &is)
+unsigned int FiltersReaderImpl_8bits::doGetFilterSize() const
 {
     // 1 byte per cluster
-    const unsigned int filter = static_cast<unsigned int>(is.get());
-    if (!is) {
-        BOOST_THROW_EXCEPTION(cc::IoException(errno, "Failed to read filter value."));
-    }
-    return filter;
+    return 1;
+}
+
+unsigned int FiltersReaderImpl_8bits::doDecodeFilter(const unsigned char *filter) const
+{
+    return filter[0];
 }
 
 
@@ -227,7 +338,8 @@ class FiltersReaderImpl_16bits : public FiltersReader::FiltersReaderImpl, boost:
 {
 private:
     virtual unsigned int doReadClusterCount(std::istream &is);
-    virtual unsigned int doGetNextFilter(std::istream& is);
+    virtual unsigned int doGetFilterSize() const;
+    virtual unsigned int doDecodeFilter(const unsigned char *filter) const;
 };
 
 unsigned int FiltersReaderImpl_16bits::doReadClusterCount(std::istream &is)
@@ -264,14 +376,16 @@ unsigned int FiltersReaderImpl_16bits::doReadClusterCount(std::istream &is)
 }
 
 
-unsigned int FiltersReaderImpl_16bits::doGetNextFilter(std::istream &is)
+unsigned int FiltersReaderImpl_16bits::doGetFilterSize() const
 {
     // 2 bytes per cluster
-    const unsigned int filter = cc::readUnsignedInteger<2>(is);
-    if (!is) {
-        BOOST_THROW_EXCEPTION(cc::IoException(errno, "Failed to read filter value."));
-    }
-    return filter;
+    return 2;
+}
+
+unsigned int FiltersReaderImpl_16bits::doDecodeFilter(const unsigned char *filter) const
+{
+    // little endian
+    return filter[0] | (filter[1] << 8);
 }
 
 
@@ -287,7 +401,29 @@ FiltersReader::FiltersReader(const fs::path &filePath, bool ctrlIncluded)
                             boost::bind(&FiltersReaderImpl::doReadClusterCount, readerImplPtr_, boost::ref(is_)) )
                    )
     , currentCluster_(0)
+    , loadedClusterCount_(0)
 {
+    loadFilters();
+}
+
+void FiltersReader::loadFilters()
+{
+    const unsigned int filterSize = readerImplPtr_->doGetFilterSize();
+    filters_.resize(size_t(clusterCount_) * filterSize);
+    if (!filters_.empty())
+    {
+        is_.read(reinterpret_cast<char *>(&filters_[0]), filters_.size());
+        loadedClusterCount_ = is_.gcount() / filterSize;
+    }
+}
+
+unsigned int FiltersReader::getLoadedFilter() const
+{
+    if (loadedClusterCount_ < currentCluster_)
+    {
+        BOOST_THROW_EXCEPTION(cc::IoException(EINVAL, "Failed to read filter value."));
+    }
+    return readerImplPtr_->doDecodeFilter(&filters_[size_t(currentCluster_ - 1) * readerImplPtr_->doGetFilterSize()]);
 }
 
 
@@ -316,10 +452,38 @@ PositionsReader *PositionsReader::create(const fs::path &filePath, unsigned int
     return result;
 }
 
+void PositionsReader::loadData()
+{
+    const std::streampos begin = is_.tellg();
+    is_.seekg(0, std::ios_base::end);
+    const std::streampos end = is_.tellg();
+    is_.seekg(begin);
+    if (!is_ || end <= begin)
+    {
+        return;
+    }
+    data_.resize(end - begin);
+    is_.read(&data_[0], data_.size());
+    data_.resize(is_.gcount());
+}
+
+bool PositionsReader::readData(char *whereTo, const size_t size)
+{
+    if (data_.size() - dataOffset_ < size)
+    {
+        dataOffset_ = data_.size();
+        return false;
+    }
+    std::copy(data_.begin() + dataOffset_, data_.begin() + dataOffset_ + size, whereTo);
+    dataOffset_ += size;
+    return true;
+}
+
 PositionsReaderBinary::PositionsReaderBinary(const fs::path &filePath)
     : PositionsReader(filePath, std::ios_base::in | std::ios_base::binary)
     , clusterCount_(readClusterCount())
 {
+    loadData();
 }
 
 unsigned int PositionsReaderBinary::readClusterCount()
@@ -342,8 +506,13 @@ PositionsReader::FloatPosition &PositionsReaderBinary::doGetFloatPosition(FloatP
     float *f[] = {&whereTo.first, &whereTo.second};
     for (unsigned int i = 0; 2 > i; ++i)
     {
-        *(f[i]) = cc::readDecimalNumber<4>(is_);
-        if (!is_)
+        char buffer[sizeof(float)];
+        if (readData(buffer, sizeof(buffer)))
+        {
+            std::copy(buffer, buffer + sizeof(buffer), reinterpret_cast<char *>(f[i]));
+            cc::reorderBytes<sizeof(float)>(reinterpret_cast<char *>(f[i]));
+        }
+        else
         {
             using boost::format;
             static const char coordinates[] = {'X', 'Y'};
@@ -393,8 +562,8 @@ PositionsReaderCompressed::PositionsReaderCompressed(const fs::path &filePath, u
         BOOST_THROW_EXCEPTION(cc::IoException(errno, "Failed to read number of tiles from clocs file " + filePath_.string()));
     }
 
-    currentBlockUnreadClusters_ = cc::readUnsignedInteger<1>(is_);
-    if (is_.fail()) {
+    loadData();
+    if (!readData(reinterpret_cast<char *>(&currentBlockUnreadClusters_), 1)) {
         BOOST_THROW_EXCEPTION(cc::IoException(errno,
                 (boost::format("Failed to read number of tile fist clusters from clocs file %s."
                                "total tiles: %d" ) % filePath_.string() % blocksCount_).str()));
@@ -414,18 +583,19 @@ PositionsReader::FloatPosition &PositionsReaderCompressed::doGetFloatPosition(Fl
                                  % filePath_.string() % currentCluster_ % blocksCount_).str()));
         }
 
-        currentBlockUnreadClusters_ = cc::readUnsignedInteger<1>(is_);
-        if (is_.fail()) {
+        if (!readData(reinterpret_cast<char *>(&currentBlockUnreadClusters_), 1)) {
             BOOST_THROW_EXCEPTION(cc::IoException(errno,
                     (boost::format("Failed to read number of tile clusters from clocs file %s."
                                    "Current/total tile: %d/%d" ) % filePath_.string() % currentBlock_ % blocksCount_).str()));
         }
     }
 
-    unsigned char dx = cc::readUnsignedInteger<1>(is_);
-    unsigned char dy = cc::readUnsignedInteger<1>(is_);
+    unsigned char dxy[2];
+    const bool isRead = readData(reinterpret_cast<char *>(dxy), 2);
+    const unsigned char dx = dxy[0];
+    const unsigned char dy = dxy[1];
 
-    if (is_.fail()) {
+    if (!isRead) {
         BOOST_THROW_EXCEPTION(cc::IoException(errno, "Failed to read position from clocs file " + filePath_.string()));
     }
 
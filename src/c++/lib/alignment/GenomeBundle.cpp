@@ -0,0 +1,458 @@
+/**
+ ** Copyright (c) 2007-2010 Illumina, Inc.
+ **
+ ** This software is covered by the "Illumina Genome Analyzer Software
+ ** License Agreement" and the "Illumina Source Code License Agreement",
+ ** and certain third party copyright/licenses, and any user of this
+ ** source file is bound by the terms therein (see accompanying files
+ ** Illumina_Genome_Analyzer_Software_License_Agreement.pdf and
+ ** Illumina_Source_Code_License_Agreement.pdf and third party
+ ** copyright/license notices).
+ **
+ ** This file is part of the Consensus Assessment of Sequence And VAriation
+ ** (CASAVA) software package.
+ **
+ ** \file GenomeBundle.cpp
+ **
+ ** \brief All the squashed files of a genome directory in a single file.
+ **/
+
+#include <algorithm>
+#include <cassert>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <vector>
+#include <dirent.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "alignment/GenomeBundle.hh"
+#include "common/Exceptions.hh"
+
+namespace casava
+{
+namespace alignment
+{
+
+namespace cc = casava::common;
+using std::cerr;
+using std::endl;
+using std::string;
+using std::vector;
+
+namespace
+{
+const boost::uint64_t pageSize(4096);
+const boost::uint64_t wordSize(8);
+const size_t copyBufferSize(1<<20);
+
+pthread_mutex_t bundlesLock = PTHREAD_MUTEX_INITIALIZER;
+
+boost::uint64_t roundUp( const boost::uint64_t offset, const boost::uint64_t alignment )
+{
+    return ((offset+alignment-1)/alignment)*alignment;
+} // ~roundUp
+
+// stripDirectory: directory name without trailing '/', so that all the
+// spellings of a directory find the same bundle
+string stripDirectory( const string& directoryName )
+{
+    string::size_type last(directoryName.find_last_not_of('/'));
+    if (last==string::npos)
+        return directoryName.empty() ? "." : "/";
+    return directoryName.substr(0, last+1);
+} // ~stripDirectory
+
+// getFileSize: size of a file, or -1 if it does not exist
+off_t getFileSize( const string& fileName )
+{
+    struct stat s;
+    return (0==stat(fileName.c_str(), &s)) ? s.st_size : -1;
+} // ~getFileSize
+
+// getFileMtime: modification time of a file, or -1 if it does not exist
+boost::int64_t getFileMtime( const string& fileName )
+{
+    struct stat s;
+    return (0==stat(fileName.c_str(), &s)) ? s.st_mtime : -1;
+} // ~getFileMtime
+
+// isFileChanged: true if the file exists and its size or modification time
+// is not the one recorded
+bool isFileChanged( const string& fileName, const boost::uint64_t size, const boost::int64_t mtime )
+{
+    struct stat s;
+    if (0!=stat(fileName.c_str(), &s)) return false;
+    return ((boost::uint64_t)s.st_size!=size) || ((boost::int64_t)s.st_mtime!=mtime);
+} // ~isFileChanged
+
+// listChromNames: the names of the squashed chromosomes of a directory, that
+// is of its .2bpb files without the suffix, sorted
+void listChromNames( const string& dir, vector<string>& chromNames )
+{
+    const string suffix(".2bpb");
+    DIR* pDir(opendir(dir.c_str()));
+    if (pDir==NULL)
+    {
+        BOOST_THROW_EXCEPTION(cc::IoException(errno, "Could not open directory " + dir));
+    } // ~if
+    chromNames.clear();
+    while (const dirent* pEntry = readdir(pDir))
+    {
+        const string name(pEntry->d_name);
+        if (name.size()>suffix.size()
+            && 0==name.compare(name.size()-suffix.size(), suffix.size(), suffix))
+        {
+            chromNames.push_back(name.substr(0, name.size()-suffix.size()));
+        } // ~if
+    } // ~while
+    closedir(pDir);
+    std::sort(chromNames.begin(), chromNames.end());
+} // ~listChromNames
+
+// BundleWriter: writes the bundle sequentially, keeping track of the offset
+class BundleWriter
+{
+public:
+    BundleWriter( const string& fileName ) : fileName_(fileName), offset_(0)
+    {
+        if ((pFile_=fopen(fileName_.c_str(), "wb"))==NULL)
+        {
+            BOOST_THROW_EXCEPTION(cc::IoException(errno, "Could not open genome bundle " + fileName_));
+        } // ~if
+    } // ~ctor
+    ~BundleWriter()
+    {
+        if (pFile_!=NULL) fclose(pFile_);
+    } // ~dtor
+
+    void write( const void* pData, const size_t size )
+    {
+        if (size!=0 && 1!=fwrite(pData, size, 1, pFile_))
+        {
+            BOOST_THROW_EXCEPTION(cc::IoException(errno, "Could not write genome bundle " + fileName_));
+        } // ~if
+        offset_+=size;
+    } // ~write
+
+    void pad( const boost::uint64_t offset )
+    {
+        const char zero[wordSize]={0};
+        assert(offset>=offset_);
+        while (offset_<offset)
+            write(zero, std::min(offset-offset_, wordSize));
+    } // ~pad
+
+    // copy: append the contents of a file of a known size
+    void copy( const string& fileName, const boost::uint64_t size )
+    {
+        FILE* pIn(fopen(fileName.c_str(), "rb"));
+        if (pIn==NULL)
+        {
+            BOOST_THROW_EXCEPTION(cc::IoException(errno, "Could not open " + fileName));
+        } // ~if
+        vector<char> buf(copyBufferSize);
+        for (boost::uint64_t left(size); left!=0;)
+        {
+            const size_t toRead(std::min<boost::uint64_t>(left, copyBufferSize));
+            if (1!=fread(&buf[0], toRead, 1, pIn))
+            {
+                fclose(pIn);
+                BOOST_THROW_EXCEPTION(cc::IoException(errno, "Could not read " + fileName));
+            } // ~if
+            write(&buf[0], toRead);
+            left-=toRead;
+        } // ~for
+        fclose(pIn);
+    } // ~copy
+
+    void close( void )
+    {
+        if (0!=fclose(pFile_))
+        {
+            pFile_=NULL;
+            BOOST_THROW_EXCEPTION(cc::IoException(errno, "Could not close genome bundle " + fileName_));
+        } // ~if
+        pFile_=NULL;
+    } // ~close
+
+    boost::uint64_t getOffset( void ) const { return offset_; }
+private:
+    const string fileName_;
+    FILE* pFile_;
+    boost::uint64_t offset_;
+}; // ~class BundleWriter
+
+} // anonymous namespace
+
+const char* const GenomeBundle::fileName("genome.bundle");
+const char GenomeBundle::magic[8] = { 'E', 'L', 'A', 'N', 'D', 'G', 'B', '\n' };
+const boost::uint32_t GenomeBundle::version(2);
+std::map<string, GenomeBundle*> GenomeBundle::bundles_;
+bool GenomeBundle::populate_(false);
+
+/*****************************************************************************/
+// get
+const GenomeBundle* GenomeBundle::get( const string& directoryName )
+{
+    const string dir(stripDirectory(directoryName));
+    pthread_mutex_lock(&bundlesLock);
+    std::map<string, GenomeBundle*>::iterator i(bundles_.find(dir));
+    if (i==bundles_.end())
+    {
+        const string bundleName(dir + '/' + fileName);
+        GenomeBundle* pBundle(NULL);
+        try
+        {
+            if (-1!=getFileSize(bundleName))
+                pBundle = new GenomeBundle(bundleName, populate_);
+            string reason;
+            if (pBundle!=NULL && !pBundle->isCurrent(dir, reason))
+            {
+                cerr << "WARNING: ignoring genome bundle " << bundleName << ": " << reason
+                     << ". Reading the squashed files instead; rebuild it with squashGenome --bundle"
+                     << endl;
+                delete pBundle;
+                pBundle = NULL;
+            } // ~if
+        }
+        catch (...)
+        {
+            pthread_mutex_unlock(&bundlesLock);
+            throw;
+        }
+        i=bundles_.insert(std::make_pair(dir, pBundle)).first;
+    } // ~if
+    pthread_mutex_unlock(&bundlesLock);
+    return i->second;
+} // ~GenomeBundle::get
+
+void GenomeBundle::setPopulate( const bool populate )
+{
+    populate_ = populate;
+} // ~GenomeBundle::setPopulate
+
+/*****************************************************************************/
+// find
+const GenomeBundle* GenomeBundle::find( const string& chromPath, unsigned int& chromNum )
+{
+    const string::size_type slash(chromPath.rfind('/'));
+    const GenomeBundle* pBundle(get((slash==string::npos) ? "." : chromPath.substr(0, slash)));
+    if (pBundle==NULL) return NULL;
+
+    const int i(pBundle->findChrom((slash==string::npos) ? chromPath : chromPath.substr(slash+1)));
+    if (i<0) return NULL;
+    chromNum=i;
+    return pBundle;
+} // ~GenomeBundle::find
+
+/*****************************************************************************/
+// openIndex
+FILE* GenomeBundle::openIndex( const string& chromPath )
+{
+    unsigned int chromNum(0);
+    const GenomeBundle* pBundle(find(chromPath, chromNum));
+    if (pBundle==NULL)
+        return fopen((chromPath + ".idx").c_str(), "r");
+    if (pBundle->getIdxSize(chromNum)==0)
+        return NULL;
+    return fmemopen(const_cast<char*>(pBundle->getIdx(chromNum)),
+                    pBundle->getIdxSize(chromNum), "r");
+} // ~GenomeBundle::openIndex
+
+/*****************************************************************************/
+// findChrom: binary search of the entries, which are sorted by name
+int GenomeBundle::findChrom( const string& chromName ) const
+{
+    int lo(0), hi(getNumChroms());
+    while (lo<hi)
+    {
+        const int mid((lo+hi)/2);
+        const int cmp(strcmp(getChromName(mid), chromName.c_str()));
+        if (cmp==0) return mid;
+        if (cmp<0) lo=mid+1;
+        else hi=mid;
+    } // ~while
+    return -1;
+} // ~GenomeBundle::findChrom
+
+/*****************************************************************************/
+// build
+void GenomeBundle::build( const string& directoryName, const int logLevel )
+{
+    const string dir(stripDirectory(directoryName));
+    vector<string> chromNames;
+    listChromNames(dir, chromNames);
+
+    if (logLevel > 0) cerr << "INFO: bundling " << chromNames.size()
+                           << " squashed files of " << dir << endl;
+
+    Header header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic_, magic, sizeof(magic));
+    header.version_ = version;
+    header.numChroms_ = chromNames.size();
+
+    // lay the file out
+    vector<Entry> entries(chromNames.size());
+    boost::uint64_t offset(sizeof(Header) + entries.size()*sizeof(Entry));
+    for (unsigned int i(0); i<chromNames.size(); ++i)
+    {
+        entries[i].nameOffset_ = offset;
+        offset += chromNames[i].size()+1;
+    } // ~for i
+    for (unsigned int i(0); i<chromNames.size(); ++i)
+    {
+        const string chromPath(dir + '/' + chromNames[i]);
+        const off_t seqSize(getFileSize(chromPath + ".2bpb"));
+        const off_t vldSize(getFileSize(chromPath + ".vld"));
+        const off_t idxSize(getFileSize(chromPath + ".idx"));
+        if (seqSize==-1 || vldSize==-1)
+        {
+            BOOST_THROW_EXCEPTION(cc::IoException(ENOENT,
+                "Could not find the .2bpb and .vld files of " + chromPath));
+        } // ~if
+        offset = roundUp(offset, pageSize);
+        entries[i].seqOffset_ = offset;
+        entries[i].seqSize_ = seqSize;
+        offset = roundUp(offset + seqSize, wordSize);
+        entries[i].vldOffset_ = offset;
+        entries[i].vldSize_ = vldSize;
+        offset = roundUp(offset + vldSize, wordSize);
+        entries[i].idxOffset_ = offset;
+        entries[i].idxSize_ = (idxSize==-1) ? 0 : idxSize;
+        entries[i].seqMtime_ = getFileMtime(chromPath + ".2bpb");
+        entries[i].vldMtime_ = getFileMtime(chromPath + ".vld");
+        entries[i].idxMtime_ = getFileMtime(chromPath + ".idx");
+        offset += entries[i].idxSize_;
+    } // ~for i
+    header.fileSize_ = offset;
+
+    // write to a temporary file, then rename it, so that a process
+    // starting meanwhile never maps a partial bundle
+    const string bundleName(dir + '/' + fileName);
+    const string tmpName(bundleName + ".tmp");
+    BundleWriter out(tmpName);
+    out.write(&header, sizeof(header));
+    if (!entries.empty())
+        out.write(&entries[0], entries.size()*sizeof(Entry));
+    for (unsigned int i(0); i<chromNames.size(); ++i)
+    {
+        out.write(chromNames[i].c_str(), chromNames[i].size()+1);
+    } // ~for i
+    for (unsigned int i(0); i<chromNames.size(); ++i)
+    {
+        const string chromPath(dir + '/' + chromNames[i]);
+        if (logLevel > 1) cerr << "Bundling " << chromPath << endl;
+        out.pad(entries[i].seqOffset_);
+        out.copy(chromPath + ".2bpb", entries[i].seqSize_);
+        out.pad(entries[i].vldOffset_);
+        out.copy(chromPath + ".vld", entries[i].vldSize_);
+        out.pad(entries[i].idxOffset_);
+        if (entries[i].idxSize_!=0)
+            out.copy(chromPath + ".idx", entries[i].idxSize_);
+    } // ~for i
+    assert(out.getOffset()==header.fileSize_);
+    out.close();
+
+    if (0!=rename(tmpName.c_str(), bundleName.c_str()))
+    {
+        BOOST_THROW_EXCEPTION(cc::IoException(errno, "Could not rename " + tmpName + " to " + bundleName));
+    } // ~if
+    if (logLevel > 0) cerr << "INFO: wrote " << header.fileSize_
+                           << " bytes to " << bundleName << endl;
+} // ~GenomeBundle::build
+
+/*****************************************************************************/
+// isCurrent
+bool GenomeBundle::isCurrent( const string& directoryName, string& reason ) const
+{
+    for (unsigned int i(0); i<getNumChroms(); ++i)
+    {
+        const string chromPath(directoryName + '/' + getChromName(i));
+        const Entry& entry(pEntries_[i]);
+        // an index that was not there when the bundle was built is a change
+        if (isFileChanged(chromPath + ".2bpb", entry.seqSize_, entry.seqMtime_)
+            || isFileChanged(chromPath + ".vld", entry.vldSize_, entry.vldMtime_)
+            || ((entry.idxMtime_==-1) ? (-1!=getFileSize(chromPath + ".idx"))
+                                      : isFileChanged(chromPath + ".idx", entry.idxSize_, entry.idxMtime_)))
+        {
+            reason = "the squashed files of " + chromPath + " have changed since it was built";
+            return false;
+        } // ~if
+    } // ~for i
+
+    vector<string> chromNames;
+    listChromNames(directoryName, chromNames);
+    for (vector<string>::const_iterator name(chromNames.begin()); name!=chromNames.end(); ++name)
+    {
+        if (findChrom(*name)<0)
+        {
+            reason = directoryName + '/' + *name + " was squashed since it was built";
+            return false;
+        } // ~if
+    } // ~for name
+    reason.clear();
+    return true;
+} // ~GenomeBundle::isCurrent
+
+/*****************************************************************************/
+// remove
+void GenomeBundle::remove( const string& directoryName, const int logLevel )
+{
+    const string bundleName(stripDirectory(directoryName) + '/' + fileName);
+    if (0==unlink(bundleName.c_str()))
+    {
+        if (logLevel > 0) cerr << "INFO: removed out of date " << bundleName << endl;
+    } // ~if
+} // ~GenomeBundle::remove
+
+/*****************************************************************************/
+// ctor
+GenomeBundle::GenomeBundle( const string& bundleName, const bool populate )
+    : bundleName_(bundleName)
+    , mapSize_(0)
+    , pMap_(MAP_FAILED)
+{
+    const int fd(open(bundleName_.c_str(), O_RDONLY));
+    if (fd==-1)
+    {
+        BOOST_THROW_EXCEPTION(cc::IoException(errno, "Could not open genome bundle " + bundleName_));
+    } // ~if
+    mapSize_ = lseek(fd, 0, SEEK_END);
+    if (mapSize_>=sizeof(Header))
+        pMap_ = mmap(0, mapSize_, PROT_READ, MAP_SHARED | (populate ? MAP_POPULATE : 0), fd, 0);
+    const int mmapErrno(errno);
+    close(fd);
+    if (pMap_==MAP_FAILED)
+    {
+        BOOST_THROW_EXCEPTION(cc::IoException(mmapErrno, "Could not memory map genome bundle " + bundleName_));
+    } // ~if
+
+    pBase_ = (const char*) pMap_;
+    pHeader_ = (const Header*) pBase_;
+    pEntries_ = (const Entry*) (pBase_ + sizeof(Header));
+    if (0!=memcmp(pHeader_->magic_, magic, sizeof(magic))
+        || pHeader_->version_!=version
+        || pHeader_->fileSize_!=mapSize_)
+    {
+        munmap(pMap_, mapSize_);
+        BOOST_THROW_EXCEPTION(cc::IoException(EINVAL,
+            "Genome bundle " + bundleName_ + " is corrupt or was written by another version, please rebuild it"));
+    } // ~if
+
+    cerr << "GenomeBundle: mapped " << getNumChroms() << " chromosomes, "
+         << mapSize_ << " bytes from " << bundleName_ << endl;
+} // ~ctor
+
+GenomeBundle::~GenomeBundle()
+{
+    munmap(pMap_, mapSize_);
+} // ~dtor
+
+} //namespace alignment
+} //namespace casava
@@ -25,7 +25,9 @@
 #include <boost/foreach.hpp>
 #include <boost/format.hpp>
 
+#include "alignment/GenomeBundle.hh"
 #include "alignment/GlobalUtilities.hh"
+#include "common/FastIo.hh"
 #include "eland_ms/ElandConstants.hh"
 
 void printWord(Word w, int l)
@@ -185,7 +187,8 @@ void ExpandedTranslationTable::translate(const char* buf, Oligo& ol, Oligo& rc)
 /*****************************************************************************/
 
 FileReader::FileReader(const char* fileName) :
-    seqFileName_(fileName), vldFileName_(fileName)
+    seqFileName_(fileName), vldFileName_(fileName),
+    seqFileSize_(0), vldFileSize_(0), pMapSeq_(NULL), pMapVld_(NULL)
 {
     seqFileName_ += (string) ".2bpb";
     vldFileName_ += (string) ".vld";
@@ -194,6 +197,23 @@ FileReader::FileReader(const char* fileName) :
 
     char* pChar;
 
+    // use the genome bundle of the directory if there is one - it is
+    // already mapped, and stays so after the FileReader is gone
+    unsigned int chromNum(0);
+    const casava::alignment::GenomeBundle* pBundle
+        (casava::alignment::GenomeBundle::find(fileName, chromNum));
+    if (pBundle != NULL)
+    {
+        cerr << "FileReader: using " << fileName << " from genome bundle" << endl;
+        pStart_ = (Word*) pBundle->getSeq(chromNum);
+        pEnd_ = (Word*) (pBundle->getSeq(chromNum) + pBundle->getSeqSize(chromNum));
+        pChar = (char*) pBundle->getVld(chromNum);
+        pLastValid_ = (ValidRegion*) (pChar + pBundle->getVldSize(chromNum));
+        while (*pChar++ != '\n') ;
+        pValid_ = (ValidRegion*) pChar;
+        return;
+    } // ~if
+
     // memory map sequence file
     fd = open(seqFileName_.c_str(), O_RDONLY, S_IRUSR);
     if (fd == -1)
@@ -272,6 +292,9 @@ FileReader::FileReader(const char* fileName) :
 
 FileReader::~FileReader(void)
 {
+    // nothing to unmap if reading from a genome bundle
+    if (pMapSeq_ == NULL) return;
+
     cerr << "FileReader: unmapping " << seqFileSize_ << " bytes of memory"
             << endl;
     munmap(pMapSeq_, seqFileSize_);
@@ -282,6 +305,68 @@ FileReader::~FileReader(void)
 } // ~FileReader::~FileReader
 
 
+/*****************************************************************************/
+// ReadName::setPrefix: ">machine_run:lane:"
+void ReadName::setPrefix( const std::string& machineName,
+                          const unsigned int runNumber,
+                          const unsigned int lane )
+{
+    prefix_ = (boost::format(">%s_%04u:%u:") % machineName % runNumber % lane).str();
+} // ~ReadName::setPrefix
+
+/*****************************************************************************/
+// the "tile:x:y#" and "/read" parts of a read name, formatted with the
+// FastIo integer formatters, boost::format being far too slow to be called
+// for every read
+static const unsigned int readNameBufferSize(3*(std::numeric_limits<unsigned int>::digits10+3));
+
+static unsigned int formatReadNamePosition( char* buf, const ReadNameFields& fields )
+{
+    char* p(buf);
+    p += cc::sprintUnsignedInteger(p, fields.tile_);
+    *p++ = ':';
+    p += cc::sprintInteger(p, fields.x_);
+    *p++ = ':';
+    p += cc::sprintInteger(p, fields.y_);
+    *p++ = '#';
+    return p-buf;
+} // ~formatReadNamePosition
+
+static unsigned int formatReadNameNumber( char* buf, const unsigned int readNumber )
+{
+    buf[0] = '/';
+    return 1+cc::sprintUnsignedInteger(buf+1, readNumber);
+} // ~formatReadNameNumber
+
+/*****************************************************************************/
+// ReadName::print
+void ReadName::print( std::string& whereTo ) const
+{
+    char buf[readNameBufferSize];
+    whereTo.assign(prefix_);
+    whereTo.append(buf, formatReadNamePosition(buf, *this));
+    whereTo.append(index_);
+    whereTo.append(buf, formatReadNameNumber(buf, readNumber_));
+} // ~ReadName::print
+
+void ReadName::print( FILE* pOut, const ReadNameFields& fields ) const
+{
+    char buf[readNameBufferSize];
+    fwrite(prefix_.data(), 1, prefix_.size(), pOut);
+    fwrite(buf, 1, formatReadNamePosition(buf, fields), pOut);
+    fwrite(fields.index_.data(), 1, fields.index_.size(), pOut);
+    fwrite(buf, 1, formatReadNameNumber(buf, readNumber_), pOut);
+} // ~ReadName::print
+
+void ReadName::print( std::ostream& out, const ReadNameFields& fields ) const
+{
+    char buf[readNameBufferSize];
+    out << prefix_;
+    out.write(buf, formatReadNamePosition(buf, fields));
+    out << fields.index_;
+    out.write(buf, formatReadNameNumber(buf, readNumber_));
+} // ~ReadName::print
+
 /*****************************************************************************/
 // getOligoSource: given the name of a file of oligo data, returns a pointer
 // to an instance of the appropriate subclass of OligoSource.
@@ -69,6 +69,8 @@ OligoSourceBcl::OligoSourceBcl(const std::vector<fs::path> &bclDirectoryList,
     sequence_.setRunNumber(runNumber);
     sequence_.setLaneNumber(lane);
     sequence_.setReadNumber(readNumber);
+    readName_.setPrefix(machineName, runNumber, lane);
+    readName_.readNumber_ = readNumber;
     sequence_.getIndex().reserve(barcodeDirectoryList_.size());
     sequence_.getIndex().push_back('0');
     sequence_.getData().reserve(bclDirectoryList_.size());
@@ -154,19 +156,20 @@ const char *OligoSourceBcl::getLastName()
 {
     if (sequenceName_.empty())
     {
-        sequenceName_ = (boost::format(">%s_%04u:%u:%u:%d:%d#%s/%u")
-                       % sequence_.getSpot().getTile().getMachineName()
-                       % sequence_.getSpot().getTile().getRunNumber()
-                       % sequence_.getSpot().getTile().getLaneNumber()
-                       % sequence_.getSpot().getTile().getTileNumber()
-                       % sequence_.getSpot().getX()
-                       % sequence_.getSpot().getY()
-                       % sequence_.getIndex()
-                       % sequence_.getReadNumber()).str();
+        getLastReadName()->print(sequenceName_);
     }
     return sequenceName_.c_str();
 }
 
+const ReadName *OligoSourceBcl::getLastReadName()
+{
+    readName_.tile_ = sequence_.getSpot().getTile().getTileNumber();
+    readName_.x_ = sequence_.getSpot().getX();
+    readName_.y_ = sequence_.getSpot().getY();
+    readName_.index_ = sequence_.getIndex();
+    return &readName_;
+}
+
 void OligoSourceBcl::initializeNewTile()
 {
     using namespace std;
@@ -0,0 +1,323 @@
+/**
+ ** Copyright (c) 2007-2010 Illumina, Inc.
+ **
+ ** This software is covered by the "Illumina Genome Analyzer Software
+ ** License Agreement" and the "Illumina Source Code License Agreement",
+ ** and certain third party copyright/licenses, and any user of this
+ ** source file is bound by the terms therein (see accompanying files
+ ** Illumina_Genome_Analyzer_Software_License_Agreement.pdf and
+ ** Illumina_Source_Code_License_Agreement.pdf and third party
+ ** copyright/license notices).
+ **
+ ** This file is part of the Consensus Assessment of Sequence And VAriation
+ ** (CASAVA) software package.
+ **
+ ** \file OligoSourceCached.cpp
+ **
+ ** \brief Keeps all the reads of another OligoSource in memory.
+ **/
+
+#include <cerrno>
+
+#include "alignment/OligoSourceCached.hh"
+#include "common/Exceptions.hh"
+
+namespace casava
+{
+namespace alignment
+{
+
+namespace
+{
+const char baseChar[] = { 'A', 'C', 'G', 'T' };
+const unsigned int nMaskBitsPerWord(sizeof(Word)*8);
+// set in length_ for the oligos that have an N mask
+const unsigned short hasNMask(0x8000);
+
+// trim: give back the spare capacity a vector grew while being filled
+template <class T> void trim( std::vector<T>& v )
+{
+    std::vector<T>(v).swap(v);
+} // ~trim
+} // anonymous namespace
+
+/*****************************************************************************/
+// ctor
+OligoSourceCached::OligoSourceCached( OligoSource* pRaw, const unsigned int batchSize,
+                                      const bool isCachingQualities )
+    : pRaw_(pRaw)
+    , batchSize_(batchSize)
+    , isCachingQualities_(isCachingQualities)
+    , isRawExhausted_(false)
+    , hasNames_(false)
+    , hasQualities_(false)
+    , hasReadNames_(false)
+    , current_(0)
+    , baseCursor_(0)
+    , nMaskCursor_(0)
+    , nameCursor_(0)
+    , qualityCursor_(0)
+    , lastName_(0)
+    , skippedSequences_(0)
+    , sequenceIsValid_(false)
+{
+    assert(pRaw_ != NULL);
+    pRaw_->rewind();
+    fill();
+} // ~ctor
+
+OligoSourceCached::~OligoSourceCached()
+{
+    delete pRaw_;
+} // ~dtor
+
+/*****************************************************************************/
+// nextBatch
+bool OligoSourceCached::nextBatch( void )
+{
+    if (isRawExhausted_) return false;
+
+    bases_.clear();
+    nMask_.clear();
+    length_.clear();
+    irregular_.clear();
+    names_.clear();
+    nameFields_.clear();
+    qualities_.clear();
+    rewind();
+
+    fill();
+    return !length_.empty();
+} // ~OligoSourceCached::nextBatch
+
+/*****************************************************************************/
+// fill
+void OligoSourceCached::fill( void )
+{
+    Timer timer;
+    cerr << "Caching oligos in memory... ";
+
+    bool isValid(false);
+    while ((batchSize_ == 0) || (length_.size() < batchSize_))
+    {
+        const casava::common::Sequence& seq(pRaw_->getNextSequenceSelect(isValid, true, isCachingQualities_));
+        if (!isValid)
+        {
+            isRawExhausted_ = true;
+            break;
+        } // ~if
+        const ReadName* pReadName(pRaw_->getLastReadName());
+        const char* pName((pReadName != NULL) ? NULL : pRaw_->getLastName());
+        if (length_.empty())
+        {
+            hasReadNames_ = (pReadName != NULL);
+            hasNames_ = (hasReadNames_ || (pName != NULL));
+            if (hasReadNames_)
+            {
+                readName_ = *pReadName;
+            } // ~if
+        } // ~if
+        if (hasReadNames_
+            && ((pReadName == NULL)
+                || (pReadName->prefix_ != readName_.prefix_)
+                || (pReadName->readNumber_ != readName_.readNumber_)))
+        {
+            BOOST_THROW_EXCEPTION(cc::CasavaException(EINVAL,
+                (boost::format("Oligo %u does not have the run, lane and read of the first one") % (length_.size()+1)).str()));
+        } // ~if
+        store(seq.getData(), seq.getQuality(), pName, pReadName);
+    } // ~while
+
+    trim(bases_);
+    trim(nMask_);
+    trim(length_);
+    trim(names_);
+    trim(nameFields_);
+    trim(qualities_);
+
+    cerr << length_.size() << " oligos, "
+         << (bases_.size()+nMask_.size())*sizeof(Word)
+            + length_.size()*sizeof(unsigned short)
+            + nameFields_.size()*sizeof(int)
+            + names_.size() + qualities_.size()
+         << " bytes: " << timer << endl;
+} // ~OligoSourceCached::fill
+
+/*****************************************************************************/
+// store: append an oligo to the cache
+void OligoSourceCached::store( const std::string& data, const std::string& quality,
+                               const char* pName, const ReadName* pReadName )
+{
+    const unsigned int oligoNum(length_.size());
+    const unsigned int len(data.size());
+    if (len >= hasNMask)
+    {
+        BOOST_THROW_EXCEPTION(cc::CasavaException(EINVAL,
+            (boost::format("Oligo %u is too long to cache (%u bases)") % (oligoNum+1) % len).str()));
+    } // ~if
+
+    // the N mask is added for every oligo, and dropped again if it has no Ns
+    const size_t baseStart(bases_.size()), nMaskStart(nMask_.size());
+    bases_.resize(baseStart + (len+maxBasesPerWord-1)/maxBasesPerWord, 0);
+    nMask_.resize(nMaskStart + (len+nMaskBitsPerWord-1)/nMaskBitsPerWord, 0);
+
+    Word* pBases(&bases_[0] + baseStart);
+    Word* pMask(&nMask_[0] + nMaskStart);
+    bool hasN(false), isIrregular(false);
+    for (unsigned int i(0); i < len; ++i)
+    {
+        Word code;
+        switch (data[i])
+        {
+        case 'A': code = 0; break;
+        case 'C': code = 1; break;
+        case 'G': code = 2; break;
+        case 'T': code = 3; break;
+        default:
+            code = 0;
+            pMask[i/nMaskBitsPerWord] |= (((Word)1) << (i%nMaskBitsPerWord));
+            hasN = true;
+            isIrregular |= (data[i] != 'N');
+        } // ~switch
+        pBases[i/maxBasesPerWord] |= (code << (numBitsPerBase*(i%maxBasesPerWord)));
+    } // ~for i
+
+    if (!hasN)
+    {
+        nMask_.resize(nMaskStart);
+    } // ~if
+    length_.push_back(hasN ? (len | hasNMask) : len);
+
+    if (isIrregular)
+    {
+        irregular_[oligoNum] = data;
+    } // ~if
+
+    if (pReadName != NULL)
+    {
+        nameFields_.push_back(pReadName->tile_);
+        nameFields_.push_back(pReadName->x_);
+        nameFields_.push_back(pReadName->y_);
+        names_.insert(names_.end(), pReadName->index_.begin(), pReadName->index_.end());
+    } // ~if
+    else if (pName != NULL)
+    {
+        names_.insert(names_.end(), pName, pName + strlen(pName));
+    } // ~else if
+    names_.push_back('\0');
+
+    if (isCachingQualities_)
+    {
+        qualities_.insert(qualities_.end(), quality.begin(), quality.end());
+        qualities_.push_back('\0');
+        hasQualities_ |= !quality.empty();
+    } // ~if
+} // ~OligoSourceCached::store
+
+/*****************************************************************************/
+// getLastName
+const char* OligoSourceCached::getLastName( void )
+{
+    if (!sequenceIsValid_ || !hasNames_) return NULL;
+    if (!hasReadNames_) return &names_[lastName_];
+
+    getLastReadName()->print(name_);
+    return name_.c_str();
+} // ~OligoSourceCached::getLastName
+
+/*****************************************************************************/
+// getLastReadName
+const ReadName* OligoSourceCached::getLastReadName( void )
+{
+    if (!sequenceIsValid_ || !hasReadNames_) return NULL;
+
+    const unsigned int oligoNum(current_-1);
+    readName_.tile_ = nameFields_[3*oligoNum];
+    readName_.x_ = nameFields_[3*oligoNum+1];
+    readName_.y_ = nameFields_[3*oligoNum+2];
+    readName_.index_.assign(&names_[lastName_]);
+    return &readName_;
+} // ~OligoSourceCached::getLastReadName
+
+/*****************************************************************************/
+// skip
+void OligoSourceCached::skip( void )
+{
+    const unsigned int len(length_[current_] & ~hasNMask);
+    baseCursor_ += (len+maxBasesPerWord-1)/maxBasesPerWord;
+    if (length_[current_] & hasNMask)
+    {
+        nMaskCursor_ += (len+nMaskBitsPerWord-1)/nMaskBitsPerWord;
+    } // ~if
+    nameCursor_ += strlen(&names_[nameCursor_]) + 1;
+    if (isCachingQualities_)
+    {
+        qualityCursor_ += strlen(&qualities_[qualityCursor_]) + 1;
+    } // ~if
+    ++current_;
+} // ~OligoSourceCached::skip
+
+/*****************************************************************************/
+// unpack: regenerate the ASCII sequence of an oligo, which starts at the
+// cursors, into sequence_
+void OligoSourceCached::unpack( const unsigned int oligoNum )
+{
+    std::string& data(sequence_.getData());
+    const std::map<unsigned int, std::string>::const_iterator irregular(irregular_.find(oligoNum));
+    if (irregular != irregular_.end())
+    {
+        data = irregular->second;
+        return;
+    } // ~if
+
+    const unsigned int len(length_[oligoNum] & ~hasNMask);
+    const Word* pBases(&bases_[0] + baseCursor_);
+    data.resize(len);
+    for (unsigned int i(0); i < len; ++i)
+    {
+        data[i] = baseChar[(pBases[i/maxBasesPerWord] >> (numBitsPerBase*(i%maxBasesPerWord))) & 0x3];
+    } // ~for i
+    if (length_[oligoNum] & hasNMask)
+    {
+        const Word* pMask(&nMask_[0] + nMaskCursor_);
+        for (unsigned int i(0); i < len; ++i)
+        {
+            if (pMask[i/nMaskBitsPerWord] & (((Word)1) << (i%nMaskBitsPerWord))) data[i] = 'N';
+        } // ~for i
+    } // ~if
+} // ~OligoSourceCached::unpack
+
+/*****************************************************************************/
+// getNextSequenceSelect: step past any oligos excluded by the mask, then
+// unpack the next one
+const casava::common::Sequence& OligoSourceCached::getNextSequenceSelect(bool& isValid,
+                                                                         const bool,
+                                                                         const bool isProvideQualities)
+{
+    skippedSequences_ = 0;
+    // oligo numbers in the mask start from 1
+    while ((current_ < length_.size())
+           && !(isNoMask_ || ((current_+1 < mask_.size()) && mask_[current_+1])))
+    {
+        skip();
+        ++skippedSequences_;
+    } // ~while
+
+    sequenceIsValid_ = (current_ < length_.size());
+    if (sequenceIsValid_)
+    {
+        unpack(current_);
+        if (isProvideQualities && hasQualities_)
+        {
+            sequence_.setQuality(&qualities_[qualityCursor_]);
+        } // ~if
+        lastName_ = nameCursor_;
+        skip();
+    } // ~if
+
+    isValid = sequenceIsValid_;
+    return sequence_;
+} // ~OligoSourceCached::getNextSequenceSelect
+
+} //namespace alignment
+} //namespace casava
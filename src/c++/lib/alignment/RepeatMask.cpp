@@ -0,0 +1,531 @@
+/**
+ ** Copyright (c) 2007-2010 Illumina, Inc.
+ **
+ ** This software is covered by the "Illumina Genome Analyzer Software
+ ** License Agreement" and the "Illumina Source Code License Agreement",
+ ** and certain third party copyright/licenses, and any user of this
+ ** source file is bound by the terms therein (see accompanying files
+ ** Illumina_Genome_Analyzer_Software_License_Agreement.pdf and
+ ** Illumina_Source_Code_License_Agreement.pdf and third party
+ ** copyright/license notices).
+ **
+ ** This file is part of the Consensus Assessment of Sequence And VAriation
+ ** (CASAVA) software package.
+ **
+ ** \file RepeatMask.cpp
+ **
+ ** \brief The high copy oligos of a squashed genome, for eland_ms to mask
+ ** repeat reads with.
+ **/
+
+#include <algorithm>
+#include <cassert>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <new>
+#include <vector>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "alignment/GlobalUtilities.hh"
+#include "alignment/RepeatMask.hh"
+#include "common/Exceptions.hh"
+#include "common/ParallelFor.hh"
+
+namespace casava
+{
+namespace alignment
+{
+
+namespace cc = casava::common;
+using std::cerr;
+using std::endl;
+using std::string;
+using std::vector;
+
+namespace
+{
+const boost::uint64_t wordSize(8);
+// more bucket bits than this would make the directory bigger than the oligos
+const boost::uint32_t maxBucketBits(30);
+
+boost::uint64_t roundUp( const boost::uint64_t offset, const boost::uint64_t alignment )
+{
+    return ((offset+alignment-1)/alignment)*alignment;
+} // ~roundUp
+
+// stripDirectory: directory name without trailing '/'
+string stripDirectory( const string& directoryName )
+{
+    string::size_type last(directoryName.find_last_not_of('/'));
+    if (last==string::npos)
+        return directoryName.empty() ? "." : "/";
+    return directoryName.substr(0, last+1);
+} // ~stripDirectory
+
+// hashOligo: spreads the oligos, which are far from uniform, over the
+// buckets and the counting partitions (Fibonacci hashing)
+inline boost::uint64_t hashOligo( const boost::uint64_t oligo )
+{
+    return oligo * 0x9E3779B97F4A7C15ULL;
+} // ~hashOligo
+
+inline boost::uint32_t getBucket( const boost::uint64_t oligo, const boost::uint32_t bucketBits )
+{
+    return bucketBits ? (boost::uint32_t)(hashOligo(oligo)>>(64-bucketBits)) : 0;
+} // ~getBucket
+
+// IsBucketLess: orders the oligos by bucket then value
+struct IsBucketLess
+{
+    IsBucketLess( const boost::uint32_t bucketBits ) : bucketBits_(bucketBits) {}
+    bool operator()( const boost::uint64_t a, const boost::uint64_t b ) const
+    {
+        const boost::uint32_t bucketA(getBucket(a, bucketBits_)), bucketB(getBucket(b, bucketBits_));
+        return bucketA<bucketB || (bucketA==bucketB && a<b);
+    } // ~operator()
+    const boost::uint32_t bucketBits_;
+}; // ~struct IsBucketLess
+
+// SquashedGenome: the .2bpb files of a directory, memory mapped, with the
+// valid regions of their .vld files
+class SquashedGenome
+{
+public:
+    struct Chrom
+    {
+        Chrom() : pWords_(NULL), mapSize_(0) {}
+        const Word* pWords_;
+        size_t mapSize_;
+        vector<ValidRegion> valids_;
+    }; // ~struct Chrom
+
+    SquashedGenome( const string& dir, const vector<string>& chromNames ) :
+        chroms_(chromNames.size())
+    {
+        for (unsigned int i(0); i<chromNames.size(); ++i)
+        {
+            load(dir + '/' + chromNames[i], chroms_[i]);
+        } // ~for i
+    } // ~ctor
+
+    ~SquashedGenome()
+    {
+        for (unsigned int i(0); i<chroms_.size(); ++i)
+        {
+            if (chroms_[i].mapSize_!=0) munmap((void*)chroms_[i].pWords_, chroms_[i].mapSize_);
+        } // ~for i
+    } // ~dtor
+
+    // countOligoPositions: number of oligos of the given length lying
+    // entirely within a valid region
+    boost::uint64_t countOligoPositions( const unsigned int oligoLength ) const
+    {
+        boost::uint64_t numPositions(0);
+        for (unsigned int i(0); i<chroms_.size(); ++i)
+        {
+            for (unsigned int j(0); j<chroms_[i].valids_.size(); ++j)
+            {
+                const boost::uint64_t regionLength((boost::uint64_t)chroms_[i].valids_[j].finish+1
+                                                   -chroms_[i].valids_[j].start);
+                if (regionLength>=oligoLength) numPositions += regionLength-oligoLength+1;
+            } // ~for j
+        } // ~for i
+        return numPositions;
+    } // ~countOligoPositions
+
+    const vector<Chrom>& getChroms( void ) const { return chroms_; }
+
+private:
+    SquashedGenome( const SquashedGenome& );
+    SquashedGenome& operator=( const SquashedGenome& );
+
+    static void load( const string& chromPath, Chrom& chrom )
+    {
+        const string seqFileName(chromPath + ".2bpb");
+        const int fd(::open(seqFileName.c_str(), O_RDONLY));
+        if (fd==-1)
+        {
+            BOOST_THROW_EXCEPTION(cc::IoException(errno, "Could not open " + seqFileName));
+        } // ~if
+        const off_t seqSize(lseek(fd, 0, SEEK_END));
+        if (seqSize>0)
+        {
+            void* pMap(mmap(0, seqSize, PROT_READ, MAP_SHARED, fd, 0));
+            if (pMap==MAP_FAILED)
+            {
+                const int mmapErrno(errno);
+                close(fd);
+                BOOST_THROW_EXCEPTION(cc::IoException(mmapErrno, "Could not memory map " + seqFileName));
+            } // ~if
+            chrom.pWords_ = (const Word*) pMap;
+            chrom.mapSize_ = seqSize;
+        } // ~if
+        close(fd);
+
+        // skip the fasta header line, then read the regions, leaving out
+        // the empty ones that stand for contigs ending with non ACGT bases
+        const string vldFileName(chromPath + ".vld");
+        FILE* pVld(fopen(vldFileName.c_str(), "rb"));
+        if (pVld==NULL)
+        {
+            BOOST_THROW_EXCEPTION(cc::IoException(errno, "Could not open " + vldFileName));
+        } // ~if
+        int ch;
+        while ((ch=fgetc(pVld))!=EOF && ch!='\n') ;
+        ValidRegion validRegion;
+        while (1==fread(&validRegion, sizeof(validRegion), 1, pVld))
+        {
+            if (validRegion.finish+1==validRegion.start) continue;
+            if (validRegion.finish<validRegion.start
+                || (boost::uint64_t)validRegion.finish+1 > (boost::uint64_t)seqSize*maxBasesPerWord/sizeof(Word))
+            {
+                fclose(pVld);
+                BOOST_THROW_EXCEPTION(cc::IoException(EINVAL,
+                    "The .vld file of " + chromPath + " does not match its .2bpb file, please squash it again"));
+            } // ~if
+            chrom.valids_.push_back(validRegion);
+        } // ~while
+        fclose(pVld);
+    } // ~load
+
+    vector<Chrom> chroms_;
+}; // ~class SquashedGenome
+
+// OligoCounter: task i finds the high copy oligos of the i-th partition of
+// the genome's oligos, partitions being made by hash so that each holds a
+// similar share of them. The genome is read once per partition, the price
+// of sorting only one partition's oligos at a time
+class OligoCounter
+{
+public:
+    OligoCounter( const SquashedGenome& genome,
+                  const unsigned int oligoLength,
+                  const unsigned int minCount,
+                  const unsigned int numPartitions,
+                  const boost::uint64_t partitionSize ) :
+        genome_(genome), oligoLength_(oligoLength), minCount_(minCount),
+        numPartitions_(numPartitions), partitionSize_(partitionSize),
+        repeats_(numPartitions), numFailed_(0)
+    {
+    } // ~ctor
+
+    void operator()( const unsigned int partition )
+    {
+        try
+        {
+            vector<boost::uint64_t> oligos;
+            oligos.reserve(partitionSize_);
+            getOligos(partition, oligos);
+            std::sort(oligos.begin(), oligos.end());
+
+            vector<boost::uint64_t>& repeats(repeats_[partition]);
+            for (vector<boost::uint64_t>::const_iterator i(oligos.begin()); i!=oligos.end();)
+            {
+                const vector<boost::uint64_t>::const_iterator first(i);
+                while (++i!=oligos.end() && *i==*first) ;
+                if ((boost::uint64_t)(i-first)>=minCount_) repeats.push_back(*first);
+            } // ~for i
+        } // ~try
+        catch (const std::bad_alloc&)
+        {
+            __sync_fetch_and_add(&numFailed_, 1);
+        } // ~catch
+    } // ~operator()
+
+    unsigned int getNumFailed( void ) const { return numFailed_; }
+
+    // getRepeats: the repeats of all the partitions
+    void getRepeats( vector<boost::uint64_t>& repeats ) const
+    {
+        for (unsigned int i(0); i<repeats_.size(); ++i)
+        {
+            repeats.insert(repeats.end(), repeats_[i].begin(), repeats_[i].end());
+        } // ~for i
+    } // ~getRepeats
+
+private:
+    // getOligos: the oligos of the partition lying within a valid region,
+    // each as the smaller of itself and its reverse complement
+    void getOligos( const unsigned int partition, vector<boost::uint64_t>& oligos ) const
+    {
+        const boost::uint64_t oligoMask((oligoLength_==32) ? ~(boost::uint64_t)0
+                                        : (((boost::uint64_t)1)<<(2*oligoLength_))-1);
+        const unsigned int rcShift(2*(oligoLength_-1));
+        const vector<SquashedGenome::Chrom>& chroms(genome_.getChroms());
+
+        for (unsigned int i(0); i<chroms.size(); ++i)
+        {
+            const Word* pWords(chroms[i].pWords_);
+            for (unsigned int j(0); j<chroms[i].valids_.size(); ++j)
+            {
+                const boost::uint64_t start(chroms[i].valids_[j].start);
+                const boost::uint64_t end((boost::uint64_t)chroms[i].valids_[j].finish+1);
+                if (end<start+oligoLength_) continue;
+
+                boost::uint64_t forward(0), reverse(0);
+                for (boost::uint64_t pos(start); pos<end; ++pos)
+                {
+                    const boost::uint64_t base((pWords[pos>>4]>>(2*((pos&0xF)^0xF)))&0x3);
+                    forward = ((forward<<2)|base)&oligoMask;
+                    reverse = (reverse>>2)|((3-base)<<rcShift);
+                    if (pos+1<start+oligoLength_) continue;
+
+                    const boost::uint64_t oligo(std::min(forward, reverse));
+                    if ((hashOligo(oligo)>>32)%numPartitions_==partition) oligos.push_back(oligo);
+                } // ~for pos
+            } // ~for j
+        } // ~for i
+    } // ~getOligos
+
+    const SquashedGenome& genome_;
+    const unsigned int oligoLength_;
+    const unsigned int minCount_;
+    const unsigned int numPartitions_;
+    const boost::uint64_t partitionSize_;
+    vector<vector<boost::uint64_t> > repeats_;
+    volatile unsigned int numFailed_;
+}; // ~class OligoCounter
+
+// writeMask: fwrite that throws
+void writeMask( const void* pData, const size_t size, FILE* pFile, const string& fileName )
+{
+    if (size!=0 && 1!=fwrite(pData, size, 1, pFile))
+    {
+        BOOST_THROW_EXCEPTION(cc::IoException(errno, "Could not write repeat mask " + fileName));
+    } // ~if
+} // ~writeMask
+
+} // anonymous namespace
+
+const char* const RepeatMask::fileName("repeat.mask");
+const char RepeatMask::magic[8] = { 'E', 'L', 'A', 'N', 'D', 'R', 'M', '\n' };
+const boost::uint32_t RepeatMask::version(1);
+
+/*****************************************************************************/
+/*****************************************************************************/
+// open
+RepeatMask* RepeatMask::open( const string& directoryName )
+{
+    const string maskName(stripDirectory(directoryName) + '/' + fileName);
+    struct stat s;
+    return (0==stat(maskName.c_str(), &s)) ? new RepeatMask(maskName) : NULL;
+} // ~RepeatMask::open
+
+/*****************************************************************************/
+// build
+void RepeatMask::build( const string& directoryName,
+                        const unsigned int oligoLength,
+                        const unsigned int minCount,
+                        const unsigned int numThreads,
+                        const boost::uint64_t memoryLimit,
+                        const int logLevel )
+{
+    if (oligoLength<1 || oligoLength>32)
+    {
+        BOOST_THROW_EXCEPTION(cc::InvalidParameterException("The repeat mask oligo length must be in [1-32]"));
+    } // ~if
+
+    const string dir(stripDirectory(directoryName));
+    const string suffix(".2bpb");
+
+    DIR* pDir(opendir(dir.c_str()));
+    if (pDir==NULL)
+    {
+        BOOST_THROW_EXCEPTION(cc::IoException(errno, "Could not open directory " + dir));
+    } // ~if
+    vector<string> chromNames;
+    while (const dirent* pEntry = readdir(pDir))
+    {
+        const string name(pEntry->d_name);
+        if (name.size()>suffix.size()
+            && 0==name.compare(name.size()-suffix.size(), suffix.size(), suffix))
+        {
+            chromNames.push_back(name.substr(0, name.size()-suffix.size()));
+        } // ~if
+    } // ~while
+    closedir(pDir);
+    std::sort(chromNames.begin(), chromNames.end());
+
+    const SquashedGenome genome(dir, chromNames);
+    const boost::uint64_t numPositions(genome.countOligoPositions(oligoLength));
+
+    // as many partitions as it takes for one per thread to fit in memory
+    const unsigned int threads(std::max(numThreads, 1u));
+    const boost::uint64_t partitionLimit(std::max<boost::uint64_t>(memoryLimit/threads/sizeof(boost::uint64_t), 1));
+    const unsigned int numPartitions(std::max<boost::uint64_t>((numPositions+partitionLimit-1)/partitionLimit, threads));
+    // hashing spreads the oligos evenly, leave some room for the odd one out
+    const boost::uint64_t partitionSize(numPositions/numPartitions + numPositions/numPartitions/16 + 1);
+
+    if (logLevel > 0) cerr << "INFO: counting the " << numPositions << " oligos of length " << oligoLength
+                           << " of " << chromNames.size() << " squashed files of " << dir
+                           << " in " << numPartitions << " partitions" << endl;
+
+    OligoCounter counter(genome, oligoLength, minCount, numPartitions, partitionSize);
+    cc::parallelFor(counter, numPartitions, threads);
+    if (counter.getNumFailed()!=0)
+    {
+        BOOST_THROW_EXCEPTION(cc::IoException(ENOMEM,
+            "Not enough memory to count the oligos of " + dir + ", please lower the repeat mask memory"));
+    } // ~if
+
+    vector<boost::uint64_t> repeats;
+    counter.getRepeats(repeats);
+    if (repeats.size()>=0xFFFFFFFFU)
+    {
+        BOOST_THROW_EXCEPTION(cc::IoException(EINVAL,
+            "Too many repeats in " + dir + ", please raise the repeat mask minimum count"));
+    } // ~if
+
+    // about one oligo per bucket
+    boost::uint32_t bucketBits(0);
+    while (bucketBits<maxBucketBits && (((boost::uint64_t)1)<<bucketBits)<repeats.size()) ++bucketBits;
+    const boost::uint64_t numBuckets(((boost::uint64_t)1)<<bucketBits);
+    std::sort(repeats.begin(), repeats.end(), IsBucketLess(bucketBits));
+
+    vector<boost::uint32_t> bucketStarts(numBuckets+1, 0);
+    for (unsigned int i(0); i<repeats.size(); ++i)
+    {
+        ++bucketStarts[getBucket(repeats[i], bucketBits)+1];
+    } // ~for i
+    for (boost::uint64_t i(0); i<numBuckets; ++i)
+    {
+        bucketStarts[i+1] += bucketStarts[i];
+    } // ~for i
+
+    Header header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic_, magic, sizeof(magic));
+    header.version_ = version;
+    header.oligoLength_ = oligoLength;
+    header.minCount_ = minCount;
+    header.bucketBits_ = bucketBits;
+    header.numOligos_ = repeats.size();
+    const boost::uint64_t oligoOffset(roundUp(sizeof(Header) + bucketStarts.size()*sizeof(boost::uint32_t), wordSize));
+    header.fileSize_ = oligoOffset + repeats.size()*sizeof(boost::uint64_t);
+
+    // write to a temporary file, then rename it, so that a process
+    // starting meanwhile never maps a partial mask
+    const string maskName(dir + '/' + fileName);
+    const string tmpName(maskName + ".tmp");
+    FILE* pFile(fopen(tmpName.c_str(), "wb"));
+    if (pFile==NULL)
+    {
+        BOOST_THROW_EXCEPTION(cc::IoException(errno, "Could not open repeat mask " + tmpName));
+    } // ~if
+    try
+    {
+        const char zero[wordSize]={0};
+        writeMask(&header, sizeof(header), pFile, tmpName);
+        writeMask(&bucketStarts[0], bucketStarts.size()*sizeof(boost::uint32_t), pFile, tmpName);
+        writeMask(zero, oligoOffset - sizeof(Header) - bucketStarts.size()*sizeof(boost::uint32_t), pFile, tmpName);
+        if (!repeats.empty())
+            writeMask(&repeats[0], repeats.size()*sizeof(boost::uint64_t), pFile, tmpName);
+    } // ~try
+    catch (...)
+    {
+        fclose(pFile);
+        throw;
+    } // ~catch
+    if (0!=fclose(pFile))
+    {
+        BOOST_THROW_EXCEPTION(cc::IoException(errno, "Could not close repeat mask " + tmpName));
+    } // ~if
+
+    if (0!=rename(tmpName.c_str(), maskName.c_str()))
+    {
+        BOOST_THROW_EXCEPTION(cc::IoException(errno, "Could not rename " + tmpName + " to " + maskName));
+    } // ~if
+    if (logLevel > 0) cerr << "INFO: wrote " << repeats.size() << " oligos found at least "
+                           << minCount << " times to " << maskName << endl;
+} // ~RepeatMask::build
+
+/*****************************************************************************/
+// remove
+void RepeatMask::remove( const string& directoryName, const int logLevel )
+{
+    const string maskName(stripDirectory(directoryName) + '/' + fileName);
+    if (0==unlink(maskName.c_str()))
+    {
+        if (logLevel > 0) cerr << "INFO: removed out of date " << maskName << endl;
+    } // ~if
+} // ~RepeatMask::remove
+
+/*****************************************************************************/
+// isRepeat
+bool RepeatMask::isRepeat( const char* pRead ) const
+{
+    const unsigned int oligoLength(pHeader_->oligoLength_);
+    boost::uint64_t forward(0), reverse(0);
+    for (unsigned int i(0); i<oligoLength; ++i)
+    {
+        // the terminating null is not a base either
+        const Word base(whichBase[(unsigned char)pRead[i]]);
+        if (base==nv) return false;
+        forward = (forward<<2)|base;
+        reverse |= ((boost::uint64_t)(3-base))<<(2*i);
+    } // ~for i
+
+    const boost::uint64_t oligo(std::min(forward, reverse));
+    const boost::uint32_t bucket(getBucket(oligo, pHeader_->bucketBits_));
+    const boost::uint64_t* pEnd(pOligos_ + pBucketStarts_[bucket+1]);
+    for (const boost::uint64_t* p(pOligos_ + pBucketStarts_[bucket]); p!=pEnd; ++p)
+    {
+        if (*p==oligo) return true;
+    } // ~for p
+    return false;
+} // ~RepeatMask::isRepeat
+
+/*****************************************************************************/
+// ctor
+RepeatMask::RepeatMask( const string& maskName )
+    : maskName_(maskName)
+    , mapSize_(0)
+    , pMap_(MAP_FAILED)
+{
+    const int fd(::open(maskName_.c_str(), O_RDONLY));
+    if (fd==-1)
+    {
+        BOOST_THROW_EXCEPTION(cc::IoException(errno, "Could not open repeat mask " + maskName_));
+    } // ~if
+    mapSize_ = lseek(fd, 0, SEEK_END);
+    if (mapSize_>=sizeof(Header))
+        pMap_ = mmap(0, mapSize_, PROT_READ, MAP_SHARED, fd, 0);
+    const int mmapErrno(errno);
+    close(fd);
+    if (pMap_==MAP_FAILED)
+    {
+        BOOST_THROW_EXCEPTION(cc::IoException(mmapErrno, "Could not memory map repeat mask " + maskName_));
+    } // ~if
+
+    pHeader_ = (const Header*) pMap_;
+    const boost::uint64_t numBuckets(((boost::uint64_t)1)<<std::min(pHeader_->bucketBits_, maxBucketBits));
+    const boost::uint64_t oligoOffset(roundUp(sizeof(Header) + (numBuckets+1)*sizeof(boost::uint32_t), wordSize));
+    if (0!=memcmp(pHeader_->magic_, magic, sizeof(magic))
+        || pHeader_->version_!=version
+        || pHeader_->fileSize_!=mapSize_
+        || pHeader_->bucketBits_>maxBucketBits
+        || oligoOffset + pHeader_->numOligos_*sizeof(boost::uint64_t)!=mapSize_)
+    {
+        munmap(pMap_, mapSize_);
+        BOOST_THROW_EXCEPTION(cc::IoException(EINVAL,
+            "Repeat mask " + maskName_ + " is corrupt or was written by another version, please rebuild it"));
+    } // ~if
+    pBucketStarts_ = (const boost::uint32_t*) ((const char*)pMap_ + sizeof(Header));
+    pOligos_ = (const boost::uint64_t*) ((const char*)pMap_ + oligoOffset);
+
+    cerr << "RepeatMask: mapped " << getNumOligos() << " oligos of length " << getOligoLength()
+         << " found at least " << getMinCount() << " times from " << maskName_ << endl;
+} // ~ctor
+
+RepeatMask::~RepeatMask()
+{
+    munmap(pMap_, mapSize_);
+} // ~dtor
+
+} //namespace alignment
+} //namespace casava
@@ -21,12 +21,16 @@
  **/
 
 #include <dirent.h>
+#include <cerrno>
 #include <set>
+#include <sstream>
 #include <string>
 
 #include "alignment/GlobalUtilities.hh"
 
 #include "alignment/ELAND_unsquash.h"
+#include "alignment/GenomeBundle.hh"
+#include "alignment/RepeatMask.hh"
 
 // SquashGenome.cpp
 // Takes a set of DNA sequence files in ASCII format and squashes them
@@ -45,7 +49,11 @@ namespace alignment
 
 enum
 {
-  seqLineLength = 60
+  seqLineLength = 60,
+  // bytes of fasta read at a time by squash
+  fastaBlockSize = 4 * 1024 * 1024,
+  // full words squash keeps before writing them out
+  squashWordBufferSize = 1024 * 1024
 };
 
 
@@ -305,6 +313,99 @@ void unsquash( const char* squashName , int logLevel)
 
 } // ~unsquash
 
+// class FastaBuffer
+// reads a fasta file in large blocks so that squash can scan the
+// bytes in place instead of extracting them one at a time
+class FastaBuffer
+{
+public:
+  FastaBuffer( const char* fileName ) :
+      fd_(open(fileName, O_RDONLY)), bad_(false), buffer_(fastaBlockSize), pBegin_(0), pEnd_(0)
+  {
+  } // ~ctor
+
+  ~FastaBuffer()
+  {
+    if (-1 != fd_) close(fd_);
+  } // ~dtor
+
+  bool fail( void ) const { return -1 == fd_; }
+  bool bad( void ) const { return bad_; }
+
+  // unread bytes of the current block
+  const char* begin( void ) const { return pBegin_; }
+  const char* end( void ) const { return pEnd_; }
+  void consume( const char* pNext ) { pBegin_ = pNext; }
+
+  // reads the next block once the current one is used up.
+  // Returns false at the end of the file or on a read error
+  bool fill( void )
+  {
+    if (pBegin_ != pEnd_) return true;
+    ssize_t bytesRead;
+    while (-1 == (bytesRead = read(fd_, &buffer_[0], buffer_.size())) && EINTR == errno) ;
+    if (-1 == bytesRead)
+    {
+      bad_ = true;
+      bytesRead = 0;
+    } // ~if
+    pBegin_ = &buffer_[0];
+    pEnd_ = pBegin_ + bytesRead;
+    return pBegin_ != pEnd_;
+  } // ~fill
+
+  // same as istream::get
+  bool get( char& ch )
+  {
+    if (!fill()) return false;
+    ch = *pBegin_++;
+    return true;
+  } // ~get
+
+  // same as std::getline: fails only if nothing at all was left to read
+  bool getline( std::string& line )
+  {
+    line.clear();
+    bool gotChars(false);
+    while (fill())
+    {
+      const char* pNewline((const char*)memchr(pBegin_, '\n', pEnd_ - pBegin_));
+      if (pNewline)
+      {
+        line.append(pBegin_, pNewline);
+        pBegin_ = pNewline + 1;
+        return true;
+      } // ~if
+      line.append(pBegin_, pEnd_);
+      pBegin_ = pEnd_;
+      gotChars = true;
+    } // ~while
+    return gotChars;
+  } // ~getline
+
+private:
+  const int fd_;
+  bool bad_;
+  std::vector<char> buffer_;
+  const char* pBegin_;
+  const char* pEnd_;
+};
+
+// the characters operator>> skips in the "C" locale
+inline bool isFastaSpace( const char ch )
+{
+  return ' ' == ch || ('\t' <= ch && '\r' >= ch);
+}
+
+void writeWords( std::ofstream& seqFile, std::vector<Word>& words, const string& seqFileName, int logLevel )
+{
+  if (!words.empty() && !seqFile.write( (const char*)&words[0], words.size()*sizeof(Word))) {
+      if (logLevel > 0) cerr << "ERROR: could not store squashed sequence in" << seqFileName << "\n";
+      exit (2);
+  }
+  words.clear();
+} // ~writeWords
+
 void squash( const char* directoryName, const char* fileName, bool validateNames, bool allowManyContigs, int logLevel)
 {
   // make file names
@@ -333,6 +434,10 @@ void squash( const char* directoryName, const char* fileName, bool validateNames
 
   if (logLevel > 1) cerr << seqFileName << " " << vldFileName << endl;
 
+  // any bundle or repeat mask of the directory no longer matches its files
+  GenomeBundle::remove(directoryName, logLevel);
+  RepeatMask::remove(directoryName, logLevel);
+
   // open output files
   ofstream seqFile(seqFileName.c_str());
   if (seqFile.fail())
@@ -348,8 +453,8 @@ void squash( const char* directoryName, const char* fileName, bool validateNames
     exit (1);
   } // ~if
 
-  // memory map input file
-  std::ifstream reference( fileName );
+  // open input file
+  FastaBuffer reference( fileName );
 
   if (reference.fail())
   {
@@ -359,7 +464,7 @@ void squash( const char* directoryName, const char* fileName, bool validateNames
 
   char ch(0);
   std::string lastHeader;
-  if (!reference.get(ch) || '>' != ch || !std::getline(reference, lastHeader))
+  if (!reference.get(ch) || '>' != ch || !reference.getline(lastHeader))
   {
     if (logLevel > 0) cerr << "ERROR: Error in squash: could not read fasta header " << fileName << endl;
     exit (1);
@@ -371,78 +476,102 @@ void squash( const char* directoryName, const char* fileName, bool validateNames
   vector<Word> words;
   vector<ValidRegion> valids;
   bool inValidRegion(false);
-  Word thisBase;
+  Word thisBase, thisWord(0);
+
+  // full words go to the sequence file in batches rather than all at the end
+  words.reserve(squashWordBufferSize);
 
   IndexBuilder indexBuilder(idxFileName, validateNames, logLevel);
   indexBuilder.addEntry(lastHeader, thisPos );
 
 
-  while(reference >> ch)
+  while (reference.fill())
   {
-    if ('\n' == ch) continue;
+    const char* pChar(reference.begin());
+    const char* const pEnd(reference.end());
 
-    if ('>' == ch)
+    for (; pChar != pEnd; ++pChar)
     {
-      if (!allowManyContigs)
-      {
-          if (logLevel > 0) cerr << "ERROR: Error in squash: multiple contigs are not allowed in: " << fileName << "\n";
-          exit (1);
-      }
+      thisBase = whichBase[(unsigned char)*pChar];
 
-      if (inValidRegion==true)
+      if (thisBase!=nv)
       {
-        valids.back().finish=thisPos-1;
-        totalValid+=valids.back().finish-valids.back().start+1;
-        inValidRegion=false;
-      } // #if
+        if (inValidRegion==false)
+        {
+          valids.push_back(ValidRegion());
+          valids.back().start=thisPos;
+          inValidRegion=true;
+        } // ~if
+      } // ~if
       else
       {
-          // when the chromosome ends with non ACGT characters, the length does not include those.
-          // add empty region to compensate for it
-          valids.push_back(ValidRegion(thisPos, thisPos - 1));
-      }
-      if (logLevel > 2) cerr << valids.back().start << "\t" << valids.back().finish << "\t>" << lastHeader << '\n';
-      if (!std::getline(reference, lastHeader))
+        // skip whitespace the way operator>> does and stop at the next header
+        if (isFastaSpace(*pChar)) continue;
+        if ('>' == *pChar) break;
+
+        thisBase=0; // codes for A
+        if (inValidRegion==true)
+        {
+          valids.back().finish=thisPos-1;
+          if (logLevel > 2) cerr << valids.back().start << "\t" << valids.back().finish << "\t>" << lastHeader << '\n';
+          totalValid+=valids.back().finish-valids.back().start+1;
+          inValidRegion=false;
+        } // #if
+      } // ~else
+
+      thisWord = (thisWord << numBitsPerBase) | thisBase;
+      if ((++thisPos%maxBasesPerWord)==0)
       {
-        if (logLevel > 0) cerr << "ERROR: Error in squash: empty '>' line found in fasta file " << fileName << endl;
-        exit (1);
-      }
-      indexBuilder.addEntry( lastHeader, thisPos );
-    }
-    else
-    {
-        if ((thisPos%maxBasesPerWord)==0)
+        words.push_back(thisWord);
+        thisWord = 0;
+        if (words.size() == squashWordBufferSize)
         {
-          words.push_back(0);
+          writeWords(seqFile, words, seqFileName, logLevel);
         } // ~if
+      } // ~if
+    } // ~for
 
-        thisBase = whichBase[(unsigned int)ch];
+    if (pChar == pEnd)
+    {
+      reference.consume(pEnd);
+      continue;
+    } // ~if
 
-        if (thisBase!=nv)
-        {
-          if (inValidRegion==false)
-          {
-        valids.push_back(ValidRegion());
-        valids.back().start=thisPos;
-        inValidRegion=true;
-          } // ~if
-        } // ~if
-        else
-        {
-          thisBase=0; // codes for A
-          if (inValidRegion==true)
-          {
-        valids.back().finish=thisPos-1;
-        if (logLevel > 2) cerr << valids.back().start << "\t" << valids.back().finish << "\t>" << lastHeader << '\n';
-        totalValid+=valids.back().finish-valids.back().start+1;
-        inValidRegion=false;
-          } // #if
-        } // ~else
-        words.back() <<= numBitsPerBase;
-        words.back() |= thisBase;
-        ++thisPos;
+    // pChar points at a '>'
+    reference.consume(pChar + 1);
+
+    if (!allowManyContigs)
+    {
+        if (logLevel > 0) cerr << "ERROR: Error in squash: multiple contigs are not allowed in: " << fileName << "\n";
+        exit (1);
     }
-  }
+
+    if (inValidRegion==true)
+    {
+      valids.back().finish=thisPos-1;
+      totalValid+=valids.back().finish-valids.back().start+1;
+      inValidRegion=false;
+    } // #if
+    else
+    {
+        // when the chromosome ends with non ACGT characters, the length does not include those.
+        // add empty region to compensate for it
+        valids.push_back(ValidRegion(thisPos, thisPos - 1));
+    }
+    if (logLevel > 2) cerr << valids.back().start << "\t" << valids.back().finish << "\t>" << lastHeader << '\n';
+    if (!reference.getline(lastHeader))
+    {
+      if (logLevel > 0) cerr << "ERROR: Error in squash: empty '>' line found in fasta file " << fileName << endl;
+      exit (1);
+    }
+    indexBuilder.addEntry( lastHeader, thisPos );
+  } // ~while
+
+  if (reference.bad())
+  {
+    if (logLevel > 0) cerr << "ERROR: Error in squash: could not read file " << fileName << ": " << strerror(errno) << endl;
+    exit (1);
+  } // ~if
 
   if (inValidRegion==true)
   {
@@ -457,13 +586,15 @@ void squash( const char* directoryName, const char* fileName, bool validateNames
   }
 
   if (logLevel > 2) cerr << valids.back().start << "\t" << valids.back().finish << "\t>" << lastHeader << "\n";
-  words.back() <<= 2*(16-thisPos%maxBasesPerWord);
+
+  // left-align the bases of the last, partially filled word
+  if ((thisPos%maxBasesPerWord)!=0)
+  {
+    words.push_back(thisWord << 2*(16-thisPos%maxBasesPerWord));
+  } // ~if
 
   // write sequence file
-  if (!seqFile.write( (const char*)&words[0], words.size()*sizeof(Word))) {
-      if (logLevel > 0) cerr << "ERROR: could not store squashed sequence in" << seqFileName << "\n";
-      exit (2);
-  }
+  writeWords(seqFile, words, seqFileName, logLevel);
 
   // write validFile
   if (!vldFile.write( (const char*)&valids[0], valids.size()*sizeof(ValidRegion))) {
@@ -471,12 +602,18 @@ void squash( const char* directoryName, const char* fileName, bool validateNames
       exit (2);
   }
 
-  if (logLevel > 0) cerr << "INFO: finished file " << fileName << endl
+  // files may be squashed in parallel, so the summary goes out in one piece
+  if (logLevel > 0)
+  {
+    std::ostringstream info;
+    info << "INFO: finished file " << fileName << endl
        << thisPos << " bases" << endl
        << totalValid << " valid bases ("
        << (100.*totalValid/thisPos) << "\045)" << endl
        << valids.size() << " valid regions" << endl
        << indexBuilder.getNumEntries() << " entries" << endl;
+    cerr << info.str() << std::flush;
+  } // ~if
 }
 
 } //namespace alignment
@@ -22,6 +22,12 @@
 #include <fstream>
 #include <sstream>
 #include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 using namespace std;
 
@@ -38,6 +44,85 @@ typedef unsigned int uint;
 namespace ga { namespace alignment {
 
 
+    // DP_BORDER: score of the row 0 and column 0 cells that start no
+    // alignment
+    static const DPScore DP_BORDER = -10000*SCORE_SCALE;
+
+    static inline DPScore toDPScore( const ScoreType s )
+    {
+        return static_cast<DPScore>(floor(s*SCORE_SCALE+0.5));
+    } // ~toDPScore
+
+    // max3: the largest of v0, v1 and v2, and which of them it is; ties go
+    // to v0 if forward, else to v2
+    static inline void max3( DPScore& max, int& which,
+                             const DPScore v0,
+                             const DPScore v1,
+                             const DPScore v2,
+                             const bool forward )
+    {
+        if( forward == true )
+        {
+            max=v0; which=0;
+            if ( v1>max ) { max=v1; which=1; }
+            if ( v2>max ) { max=v2; which=2; }
+        }
+        else
+        {
+            max=v2; which=2;
+            if ( v1>max ) { max=v1; which=1; }
+            if ( v0>max ) { max=v0; which=0; }
+        }
+    } // ~max3
+
+#ifdef __SSE2__
+    static inline __m128i select( const __m128i mask, const __m128i a, const __m128i b )
+    {
+        return _mm_or_si128(_mm_and_si128(mask,a),_mm_andnot_si128(mask,b));
+    } // ~select
+
+    // max3: as above, for four cells at once
+    static inline __m128i max3( __m128i& which,
+                                const __m128i v0,
+                                const __m128i v1,
+                                const __m128i v2,
+                                const bool forward )
+    {
+        const __m128i one(_mm_set1_epi32(1));
+        __m128i max,isGreater;
+        if( forward == true )
+        {
+            max=v0;
+            isGreater=_mm_cmpgt_epi32(v1,max);
+            max=select(isGreater,v1,max);
+            which=_mm_and_si128(isGreater,one);
+            isGreater=_mm_cmpgt_epi32(v2,max);
+            max=select(isGreater,v2,max);
+            which=select(isGreater,_mm_set1_epi32(2),which);
+        }
+        else
+        {
+            max=v2;
+            which=_mm_set1_epi32(2);
+            isGreater=_mm_cmpgt_epi32(v1,max);
+            max=select(isGreater,v1,max);
+            which=select(isGreater,one,which);
+            isGreater=_mm_cmpgt_epi32(v0,max);
+            max=select(isGreater,v0,max);
+            which=_mm_andnot_si128(isGreater,which);
+        }
+        return max;
+    } // ~max3
+#endif
+
+
+    // Aligner::operator(): fills the band i<=j<=i+2*width_ of the G (match),
+    // E (gap in x) and F (gap in y) matrices a row at a time. Cells outside
+    // the band are never filled and read as 0 with a G traceback, and row 0
+    // and column 0 hold the DP_BORDER start scores.
+    // With SSE2, G and F, which only depend on the row above, are done
+    // four cells at a time; E depends on the cell to its left, so follows
+    // cell by cell
     int Aligner::operator()
         ( const char* qvals_, const char* x, const char* y, const int x_size, const int y_size,const bool& flag )
     {
@@ -48,12 +133,11 @@ namespace ga { namespace alignment {
         }
 
 
-        //  const ScoreType w_match(3),w_mismatch(1),w_open(2),w_extend(2);
-        ScoreType max = -1;
-        ScoreType whichMatrix = -1;
-        ScoreType thisMax = -1;
-        ScoreType thisMatrix = -1;
-        ScoreType nextMatrix = -1;
+        DPScore max = -1;
+        int whichMatrix = -1;
+        DPScore thisMax = -1;
+        int thisMatrix = -1;
+        int nextMatrix = -1;
 
         xt_="";
         yt_="";
@@ -62,128 +146,228 @@ namespace ga { namespace alignment {
         int ii = -1;
         int jj = -1;
 
-        for (int i(0);i<=x_size;i++)
-        {
-            //E_[i][0]=-w_open_-(i*w_extend_);
-            E_[i][0]=0;
-            F_[i][0]=-10000;
-            G_[i][0]=-10000;
-        }
+        const DPScore w_open(toDPScore(w_open_));
+        const DPScore w_extend(toDPScore(w_extend_));
 
-        for (int j(0);j<=y_size;j++)
+        // band cells per row, also rounded up to a whole number of vectors
+        const int bandSize( min(2*width_,y_size)+1 );
+        const int bandPad( (bandSize+3)&~3 );
+        const int stride( bandPad+4 );
+
+        matchScore_.resize(x_size);
+        mismatchScore_.resize(x_size);
+        for (int i(0);i<x_size;i++)
         {
-            E_[0][j]=-10000;
-            //F_[0][j]=-w_open_-(j*w_extend_);
-            F_[0][j]=0;
-            G_[0][j]=-10000;
+            // incorporate quality values
+            matchScore_[i]=toDPScore(w_match_*(qvals_[i]-64)*QUALSCALE);
+            mismatchScore_[i]=toDPScore(w_mismatch_*(qvals_[i]-64)*QUALSCALE);
         }
 
+        yPad_.assign(y,y_size);
+        yPad_.append(bandPad+4,'\0');
 
+        rows_.resize(6*stride);
+        DPScore* prevG(&rows_[0]);
+        DPScore* prevE(prevG+stride);
+        DPScore* prevF(prevE+stride);
+        DPScore* curG(prevF+stride);
+        DPScore* curE(curG+stride);
+        DPScore* curF(curE+stride);
+        trace_.resize((x_size+1)*bandPad);
+        lastCol_.resize(3*(x_size+1));
+
+        // row 0
+        fill(prevG,prevG+stride,DP_BORDER);
+        fill(prevE,prevE+stride,DP_BORDER);
+        fill(prevF,prevF+stride,0);
 
         for (int i(1);i<=x_size;i++)
         {
-#ifdef DEBUG
-            cout << i << ": ";
-#endif
-            //      int startIdx = ( (i-width_)< 1 )? 1:(i-width_);
-            //      int endIdx = ( (i+width_)> y_size )? y_size:(i+width_);
-
-//	int startIdx = ( (i-width_)< 1 )? 1:(i-width_);
-//	int endIdx = ( (i+width_)> y_size )? y_size:(i+width_);
-
-            // we are shifting the DP band to the right 
-            int startIdx = i;
-            int endIdx = ( (i+2*width_)> y_size )? y_size:(i+2*width_);
+            // cells of the band that are also inside the matrix
+            const int rowSize( min(bandSize,y_size-i+1) );
+            if (rowSize<=0) break;
+
+            uchar* trace(&trace_[i*bandPad]);
+            const char* yRow(yPad_.data()+i-1);
+            int which;
+
+#ifdef __SSE2__
+            const __m128i zero(_mm_setzero_si128());
+            const __m128i xv(_mm_set1_epi32((uchar)x[i-1]));
+            const __m128i matchv(_mm_set1_epi32(matchScore_[i-1]));
+            const __m128i mismatchv(_mm_set1_epi32(mismatchScore_[i-1]));
+            const __m128i openv(_mm_set1_epi32(w_open));
+            const __m128i extendv(_mm_set1_epi32(w_extend));
+            for (int k(0);k<rowSize;k+=4)
+            {
+                __m128i whichG,whichF;
+                int yBases;
+                memcpy(&yBases,yRow+k,sizeof(yBases));
+                __m128i yv(_mm_cvtsi32_si128(yBases));
+                yv=_mm_unpacklo_epi16(_mm_unpacklo_epi8(yv,zero),zero);
 
+                // update G_
+                __m128i g(max3(whichG,
+                               _mm_loadu_si128((const __m128i*)(prevG+k)),
+                               _mm_loadu_si128((const __m128i*)(prevE+k)),
+                               _mm_loadu_si128((const __m128i*)(prevF+k)),
+                               flag));
+                g=_mm_add_epi32(g,select(_mm_cmpeq_epi32(yv,xv),matchv,mismatchv));
+                _mm_storeu_si128((__m128i*)(curG+k),g);
 
-            for (int j(startIdx);j<=endIdx;j++)
+                // update F_
+                __m128i f(max3(whichF,
+                               _mm_sub_epi32(_mm_loadu_si128((const __m128i*)(prevG+k+1)),openv),
+                               _mm_sub_epi32(_mm_loadu_si128((const __m128i*)(prevE+k+1)),openv),
+                               _mm_sub_epi32(_mm_loadu_si128((const __m128i*)(prevF+k+1)),extendv),
+                               flag));
+                _mm_storeu_si128((__m128i*)(curF+k),f);
+
+                __m128i t(_mm_or_si128(whichG,_mm_slli_epi32(whichF,4)));
+                t=_mm_packus_epi16(_mm_packs_epi32(t,t),t);
+                const int traceBytes(_mm_cvtsi128_si32(t));
+                memcpy(trace+k,&traceBytes,sizeof(traceBytes));
+            } // ~for k
+#else
+            for (int k(0);k<rowSize;k++)
             {
-#ifdef DEBUG
-                cout << "i/j" << i << "/" << j << endl;
-#endif
+                int whichG,whichF;
                 // update G_
-                max3(G_[i][j],TG_[i][j],
-                     G_[i-1][j-1],E_[i-1][j-1],F_[i-1][j-1],flag);
-
-                //      G_[i][j]=V_[i-1][j-1];
-                if (x[i-1]==y[j-1])
-                {
-                    //	G_[i][j]+=w_match_;
-
-                    // changed to incorporate quality scores
-                    G_[i][j]+=(w_match_*(qvals_[i-1]-64)*QUALSCALE);
-                }
-                else
-                {
-                    //	G_[i][j]-=w_mismatch_;
-                    //	G_[i][j]+=w_mismatch_;
-
-                    // incorporate quality values
-                    G_[i][j]+=(w_mismatch_*(qvals_[i-1]-64)*QUALSCALE);
-                }
-                //      max =G_[i][j];
-                //      dir=0;
-
-                // update E_
-                max3(E_[i][j],TE_[i][j],
-                     G_[i][j-1]-w_open_,
-                     E_[i][j-1]-w_extend_,
-                     F_[i][j-1]-w_open_,
-                     flag );
-
-                //      E_[i][j]-=w_extend_;
-
+                max3(curG[k],whichG,prevG[k],prevE[k],prevF[k],flag);
+                curG[k]+=((x[i-1]==yRow[k])?matchScore_[i-1]:mismatchScore_[i-1]);
                 // update F_
-                max3(F_[i][j],TF_[i][j],
-                     G_[i-1][j]-w_open_,
-                     E_[i-1][j]-w_open_,
-                     F_[i-1][j]-w_extend_,
-                     flag );
+                max3(curF[k],whichF,
+                     prevG[k+1]-w_open,prevE[k+1]-w_open,prevF[k+1]-w_extend,
+                     flag);
+                trace[k]=whichG|(whichF<<4);
+            } // ~for k
+#endif
 
-                //      F_[i][j]-=w_extend_;
+            // update E_, starting from column 0 or the unfilled cell to the
+            // left of the band
+            DPScore leftG((i==1)?DP_BORDER:0);
+            DPScore leftE(0);
+            DPScore leftF((i==1)?DP_BORDER:0);
+            for (int k(0);k<rowSize;k++)
+            {
+                max3(curE[k],which,
+                     leftG-w_open,leftE-w_extend,leftF-w_open,flag);
+                trace[k]|=(which<<2);
+                leftG=curG[k];
+                leftE=curE[k];
+                leftF=curF[k];
+            } // ~for k
+
+            // the cell to the right of the band
+            curG[bandSize]=curE[bandSize]=curF[bandSize]=0;
+
+            if (y_size-i<bandSize)
+            {
+                lastCol_[3*i]=curG[y_size-i];
+                lastCol_[3*i+1]=curE[y_size-i];
+                lastCol_[3*i+2]=curF[y_size-i];
+            } // ~if
 
-#ifdef DEBUG
-                cout << i << " " << j << " => ";
-                cout << G_[i][j] << " " << E_[i][j] << " "
-                     << F_[i][j] << " " << TG_[i][j] << " "
-                     << TE_[i][j] << " " << TF_[i][j] << endl;
-#endif
-            } // ~for j
-#ifdef DEBUG
-            cout << endl;
-#endif
+            swap(prevG,curG);
+            swap(prevE,curE);
+            swap(prevF,curF);
         } // ~for i
 
-        max=-10000;
+        max=DP_BORDER;
+        ties_.clear();
         for (int i(0);i<=x_size;i++)
         {
-            max3( thisMax, thisMatrix,
-                  G_[i][y_size], E_[i][y_size], F_[i][y_size],flag );
+            if (i==0)
+            {
+                max3( thisMax, thisMatrix, DP_BORDER, DP_BORDER, 0, flag );
+            }
+            else if (y_size==0)
+            {
+                max3( thisMax, thisMatrix, DP_BORDER, 0, DP_BORDER, flag );
+            }
+            else if ((i<=y_size)&&(y_size-i<=2*width_))
+            {
+                max3( thisMax, thisMatrix,
+                      lastCol_[3*i], lastCol_[3*i+1], lastCol_[3*i+2], flag );
+            }
+            else
+            {
+                max3( thisMax, thisMatrix, 0, 0, 0, flag );
+            }
             if (thisMax>max)
             {
                 max=thisMax;
                 ii=i;
                 jj=y_size;
                 whichMatrix=thisMatrix;
+                ties_.clear();
+            } // ~if
+            if (thisMax==max)
+            {
+                ties_.push_back(i);
+                ties_.push_back(y_size);
+                ties_.push_back(thisMatrix);
             } // ~if
 
         } // ~for i
 
+        // prevG, prevE and prevF now hold row x_size, if it has band cells
         for (int j(0);j<=y_size;j++)
         {
-            max3( thisMax, thisMatrix,
-                  G_[x_size][j], E_[x_size][j], F_[x_size][j],flag );
+            if (x_size==0)
+            {
+                max3( thisMax, thisMatrix, DP_BORDER, DP_BORDER, 0, flag );
+            }
+            else if (j==0)
+            {
+                max3( thisMax, thisMatrix, DP_BORDER, 0, DP_BORDER, flag );
+            }
+            else if ((x_size<=j)&&(j-x_size<=2*width_))
+            {
+                max3( thisMax, thisMatrix,
+                      prevG[j-x_size], prevE[j-x_size], prevF[j-x_size], flag );
+            }
+            else
+            {
+                max3( thisMax, thisMatrix, 0, 0, 0, flag );
+            }
             if (thisMax>max)
             {
                 max=thisMax;
                 ii=x_size;
                 jj=j;
                 whichMatrix=thisMatrix;
+                ties_.clear();
+            } // ~if
+            if (thisMax==max)
+            {
+                ties_.push_back(x_size);
+                ties_.push_back(j);
+                ties_.push_back(thisMatrix);
             } // ~if
 
         }
 
-        score_=max;
+        // the double precision DP this replaced told end cells that tie
+        // exactly apart by rounding: keep the first one that it would have
+        // scored highest, so that the alignments do not change
+        if (ties_.size()>3)
+        {
+            ScoreType best(0);
+            for (unsigned int t(0);t<ties_.size();t+=3)
+            {
+                const ScoreType score(replayScore(qvals_,x,y,ties_[t],ties_[t+1],ties_[t+2],bandPad));
+                if ((t==0)||(score>best))
+                {
+                    best=score;
+                    ii=ties_[t];
+                    jj=ties_[t+1];
+                    whichMatrix=ties_[t+2];
+                } // ~if
+            } // ~for t
+        } // ~if
+
+        score_=static_cast<ScoreType>(max)/SCORE_SCALE;
 #ifdef DEBUG
         cout << "start cell = " << ii << " " << jj << " " << whichMatrix << endl;
 #endif
@@ -209,83 +393,18 @@ namespace ga { namespace alignment {
         // ================== end ==================
 
 
-        // check if this is a repeat candidate!
-
-#ifdef ACTIVATE_REPEAT_DETECTION
-        // in the case of negative scores, we have to make sure that we take the absolute value!
-        ScoreType repeatThreshold = (max-( abs(max)*MIN_REPEAT_THRESHOLD));
-
-#ifdef DEBUG
-        cerr << "settting the repeat threshold = " << repeatThreshold << endl;
-#endif
-
-        bool repeat_found = false;
-        for (int i(x_size);i<=x_size;i++)
-        {
-            int startIdx = ( (i-width_)< 1 )? 1:(i-width_);
-            int endIdx = ( (i+width_)> y_size )? y_size:(i+width_);
-          
-            for (int j(startIdx);j<=endIdx;j++)
-            {
-                if( ( ( repeatThreshold < G_[i][j] ) ||
-                      ( repeatThreshold < E_[i][j] ) ||
-                      ( repeatThreshold < F_[i][j] )
-                        )
-                    && 
-                    ( abs(j-jj)>(x_size/2) ) 
-                    )
-                {
-                    if( repeat_found == false )
-                    {
-                        repeat_found = true;
-
-#ifdef DEBUG
-                        cerr << "G comparison    = " << ( repeatThreshold < G_[i][j] ) << "\t" << repeatThreshold << "\t" << G_[i][j] << endl
-                             << "E comparison    = " << ( repeatThreshold < E_[i][j] ) << endl
-                             << "F comparison    = " << ( repeatThreshold < F_[i][j] ) << endl
-                             << "coordinate diff = " << ( abs(j-jj)>(x_size/2) ) << endl;
-                      
-                        cerr << "POTENTIAL REPEAT CANDIDATE" << endl;
-                        cerr << "ii/jj/max = " << ii << "\t" << jj << "\t" << max << endl
-                             << "i/j/G/E/F = " << i << "\t" << j << "\t" << G_[i][j] << "\t" << E_[i][j] << "\t" << F_[i][j] << endl;
-#endif
-                        break;
-                    }
-                }
-            }
-        }
-
-#endif // END_OF_REPEAT_DETECTION
-
-
-        DPMatrix* pT_ =&TE_;
-
-
         while ((ii>0)&&(jj>0))
         {
-            if (whichMatrix==0)
-            {
-                pT_=&TG_;
-            }
-            else if (whichMatrix==1)
-            {
-                pT_=&TE_;
-            }
-            else
-            {
-                assert(whichMatrix==2);
-                pT_=&TF_;
-            }
-            //  cout << TG_[6][7] << " " << TE_[6][7] << " " << TF_[6][7] << endl;
+            assert((whichMatrix>=0)&&(whichMatrix<=2));
+            // cells outside the band were never filled, so lead back to G
+            const uchar trace( ((jj>=ii)&&(jj-ii<=2*width_))
+                               ? trace_[ii*bandPad+jj-ii] : 0 );
 
 #ifdef DEBUG
             cout << ii << " " << jj << " " << whichMatrix << " ";
-            cout << " "<< G_[ii][jj]<< ":"<< E_[ii][jj] << ":" << F_[ii][jj];
-            cout << "/";
-            cout << " "<< TG_[ii][jj]<< ":"<< TE_[ii][jj] << ":" << TF_[ii][jj];
-            cout << " - " << (*pT_)[ii][jj] << endl;
+            cout << " - " << (int)trace << endl;
 #endif
-            nextMatrix=(*pT_)[ii][jj];
+            nextMatrix=(trace>>(2*whichMatrix))&0x3;
             if (whichMatrix==0)
             {
                 xt_+=x[ii-1];
@@ -358,6 +477,50 @@ namespace ga { namespace alignment {
 
 
 
+    // replayScore: the score the double precision DP would have given cell
+    // (i,j) of matrix m, the scores along its traceback path added up in
+    // doubles in the order that DP did. Row 0 and column 0 hold its start
+    // scores, and the cells outside the band the 0 it never overwrote
+    ScoreType Aligner::replayScore( const char* qvals_, const char* x, const char* y,
+                                    int i, int j, int m, const int bandPad ) const
+    {
+        vector<int> path;
+        ScoreType score(0);
+        while (true)
+        {
+            if (i==0) { score=((m==2)?0:-10000); break; }
+            if (j==0) { score=((m==1)?0:-10000); break; }
+            if ((j<i)||(j-i>2*width_)) { score=0; break; }
+            path.push_back(i);
+            path.push_back(j);
+            path.push_back(m);
+            const int next((trace_[i*bandPad+j-i]>>(2*m))&0x3);
+            if (m==0) { i--; j--; }
+            else if (m==1) j--;
+            else i--;
+            m=next;
+        } // ~while
+
+        for (int k(path.size()-3);k>=0;k-=3)
+        {
+            const int ci(path[k]), cj(path[k+1]), cm(path[k+2]);
+            if (cm==0)
+            {
+                if (x[ci-1]==y[cj-1])
+                    score+=(w_match_*(qvals_[ci-1]-64)*QUALSCALE);
+                else
+                    score+=(w_mismatch_*(qvals_[ci-1]-64)*QUALSCALE);
+            } // ~if
+            else
+            {
+                score-=((cm==m) ? w_extend_ : w_open_);
+            } // ~else
+            m=cm;
+        } // ~for k
+        return score;
+    } // ~Aligner::replayScore
+
+
     // readAlignScoreFile: fn specifies the filename of the scoring file
     // the scoring files essentially contains 4 values for match/mismatch
     // and gap open and gap extend, lines beginning with "#" are ignored
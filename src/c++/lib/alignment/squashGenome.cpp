@@ -21,10 +21,14 @@
  **/
 
 #include <dirent.h>
+#include <set>
 #include <boost/filesystem.hpp>
 #include <boost/foreach.hpp>
 
+#include "alignment/GenomeBundle.hh"
+#include "alignment/RepeatMask.hh"
 #include "alignment/SquashGenome.hh"
+#include "common/ParallelFor.hh"
 #include "common/Program.hh"
 
 namespace casava
@@ -41,11 +45,17 @@ public:
     SquashGenomeOptions();
     bool validateChromNames;
     bool allowManyContigs;
+    bool bundle;
+    bool repeatMask;
+    unsigned int repeatMaskOligoLength;
+    unsigned int repeatMaskMinCount;
+    unsigned int repeatMaskMemory;
     std::string chromNameSource;
     std::vector<boost::filesystem::path> filesToSquash;
     boost::filesystem::path fileToUnsquash;
     boost::filesystem::path squashDirectory;
     boost::filesystem::path squashedFileOrDirectory;
+    unsigned int numThreads;
     int logLevel;
 private:
     std::string usagePrefix() const {
@@ -55,7 +65,13 @@ private:
         "squashGenome [options] <squashDirectory>\n"
         "  - print xml containing contig size information of squashed files to standard output\n"
         "squashGenome [options] <targetDirectory> <fileToSquash1> <fileToSquash2> ...\n"
-        "  - squash files and place the results in <targetDirectory>";
+        "  - squash files and place the results in <targetDirectory>\n"
+        "squashGenome --bundle [options] <squashDirectory> [<fileToSquash1> ...]\n"
+        "  - squash any files given, then pack all the squashed files of <squashDirectory>\n"
+        "    into a single genome bundle that eland_ms maps in one go\n"
+        "squashGenome --repeat-mask [options] <squashDirectory> [<fileToSquash1> ...]\n"
+        "  - squash any files given, then write the oligos found many times in the squashed\n"
+        "    files of <squashDirectory> to a repeat mask that eland_ms --repeat-mask masks repeat reads with";
     }
     void postProcess(boost::program_options::variables_map &vm);
 };
@@ -64,6 +80,12 @@ private:
 SquashGenomeOptions::SquashGenomeOptions()
     : validateChromNames(true)
     , allowManyContigs(false)
+    , bundle(false)
+    , repeatMask(false)
+    , repeatMaskOligoLength(32)
+    , repeatMaskMinCount(1000)
+    , repeatMaskMemory(2048)
+    , numThreads(1)
     , logLevel(1)
 {
     // short namespaces
@@ -77,6 +99,18 @@ SquashGenomeOptions::SquashGenomeOptions()
                                "\nOn by default if --chrom-name-source is contigName. (Squash only)").c_str())
         ("chrom-name-source" , po::value< std::string >(&chromNameSource)->default_value("fileName"),
                                "Valid options are: contigName or fileName. Required for validations. (Squash only)")
+        ("bundle"            , po::value< bool >(&bundle)->zero_tokens(),
+                               "Pack the squashed files of the directory into a genome bundle")
+        ("repeat-mask"       , po::value< bool >(&repeatMask)->zero_tokens(),
+                               "Write the oligos found many times in the squashed files of the directory to a repeat mask")
+        ("repeat-mask-oligo-length", po::value< unsigned int >(&repeatMaskOligoLength)->default_value(32),
+                               "Length of the oligos of the repeat mask: the seed length of the eland_ms runs using it [8-32]")
+        ("repeat-mask-min-count", po::value< unsigned int >(&repeatMaskMinCount)->default_value(1000),
+                               "Number of times an oligo must be found, counting both strands, to go into the repeat mask")
+        ("repeat-mask-memory", po::value< unsigned int >(&repeatMaskMemory)->default_value(2048),
+                               "Memory in MB used to count the oligos for the repeat mask. Less memory means more passes over the genome")
+        ("threads"           , po::value< unsigned int >(&numThreads)->default_value(1),
+                               "number of files squashed at a time, and of threads counting the oligos for the repeat mask")
         ("verbose-level,v" ,   po::value< int >(&logLevel)->default_value(1),
                                "Valid options are: 0 - no logging, 1 - user-level information and critical messages. 2 and above - debug loggging")
                                ;
@@ -104,7 +138,7 @@ void SquashGenomeOptions::postProcess(boost::program_options::variables_map &vm)
         BOOST_THROW_EXCEPTION(InvalidOptionException("\n   *** no parameters given ***\n"));
     }
 
-    if ( filesToSquash.empty() && !fs::is_directory(squashedFileOrDirectory) )
+    if ( filesToSquash.empty() && !bundle && !repeatMask && !fs::is_directory(squashedFileOrDirectory) )
     {
         fileToUnsquash = squashedFileOrDirectory;
     }
@@ -118,6 +152,11 @@ void SquashGenomeOptions::postProcess(boost::program_options::variables_map &vm)
         BOOST_THROW_EXCEPTION(InvalidOptionException("\n   *** the --chrom-name-source must be fileName or contigName ***\n"));
     }
 
+    if (repeatMask && (8 > repeatMaskOligoLength || 32 < repeatMaskOligoLength))
+    {
+        BOOST_THROW_EXCEPTION(InvalidOptionException("\n   *** the --repeat-mask-oligo-length must be in [8-32] ***\n"));
+    }
+
     if (!vm.count("validate-names") && "fileName" == chromNameSource)
     {
         validateChromNames = false;
@@ -129,6 +168,19 @@ void SquashGenomeOptions::postProcess(boost::program_options::variables_map &vm)
     }
 }
 
+// SquashTask: squashes the i-th file given on the command line
+struct SquashTask
+{
+    SquashTask(const SquashGenomeOptions &options) : options_(options) {}
+    void operator()(const unsigned int i)
+    {
+        squash(options_.squashDirectory.string().c_str(), options_.filesToSquash[i].string().c_str(),
+               options_.validateChromNames, options_.allowManyContigs, options_.logLevel);
+    }
+private:
+    const SquashGenomeOptions &options_;
+};
+
 void squashGenome(const SquashGenomeOptions &options)
 {
     if (!options.fileToUnsquash.empty())
@@ -137,7 +189,7 @@ void squashGenome(const SquashGenomeOptions &options)
     }
     else
     {
-        if (options.filesToSquash.empty())
+        if (options.filesToSquash.empty() && !options.bundle && !options.repeatMask)
         {
             std::cerr << "INFO: Trying to open directory " << options.squashDirectory << " ...\n";
             DIR* pDir = opendir(options.squashDirectory.string().c_str());
@@ -155,10 +207,28 @@ void squashGenome(const SquashGenomeOptions &options)
         }
         else
         {
+            // files that share a name squash into the same outputs, where the last one wins,
+            // so they have to be squashed one after the other
+            std::set<std::string> fileNames;
             BOOST_FOREACH(const fs::path &fileToSquash, options.filesToSquash)
             {
-                squash(options.squashDirectory.string().c_str(), fileToSquash.string().c_str(),
-                       options.validateChromNames, options.allowManyContigs, options.logLevel);
+                const std::string path(fileToSquash.string());
+                fileNames.insert(path.substr(path.find_last_of('/') + 1));
+            }
+            const unsigned int numThreads =
+                fileNames.size() == options.filesToSquash.size() ? options.numThreads : 1;
+
+            SquashTask task(options);
+            casava::common::parallelFor(task, options.filesToSquash.size(), numThreads);
+            if (options.bundle)
+            {
+                GenomeBundle::build(options.squashDirectory.string(), options.logLevel);
+            }
+            if (options.repeatMask)
+            {
+                RepeatMask::build(options.squashDirectory.string(), options.repeatMaskOligoLength,
+                                  options.repeatMaskMinCount, options.numThreads,
+                                  (boost::uint64_t)options.repeatMaskMemory<<20, options.logLevel);
             }
         }
     }
@@ -29,8 +29,55 @@ namespace ck = casava::kagu;
 namespace casava {
 namespace common {
 
-// regex that captures information from a VMF file
-const boost::regex ElandExtendedReader::mPositionsRegex("^(-?\\d+)(F|R)(\\S+)$");
+// returns true if c is a whitespace character (as matched by \s)
+static inline bool IsSpace(const char c) {
+    return ((c == ' ') || ((c >= '\t') && (c <= '\r')));
+}
+
+// walks the comma delimited positions in place. Mirrors
+// StringUtilities::Split: when the positions end with a comma, the last
+// position is returned a second time with the comma included
+class PositionTokenizer {
+public:
+    PositionTokenizer(const char* pBegin, const char* pEnd)
+        : mCurrent(pBegin)
+        , mEnd(pEnd)
+        , mRepeat(NULL)
+    {}
+
+    // points to the next position, returns false if there are none left
+    bool GetNextPosition(const char*& pBegin, const char*& pEnd) {
+
+        if(mRepeat) {
+            pBegin   = mRepeat;
+            pEnd     = mEnd;
+            mRepeat  = NULL;
+            mCurrent = mEnd;
+            return true;
+        }
+
+        if(mCurrent == mEnd) return false;
+
+        const char* pComma = (const char*)memchr(mCurrent, ',', mEnd - mCurrent);
+        pBegin = mCurrent;
+
+        if(!pComma) {
+            pEnd     = mEnd;
+            mCurrent = mEnd;
+            return true;
+        }
+
+        pEnd = pComma;
+        if(pComma + 1 == mEnd) mRepeat = pBegin;
+        mCurrent = pComma + 1;
+        return true;
+    }
+
+private:
+    const char* mCurrent;
+    const char* mEnd;
+    const char* mRepeat;
+};
 
 // constructor
 ElandExtendedReader::ElandExtendedReader(void)
@@ -95,22 +142,55 @@ void ElandExtendedReader::ExtractReadName(CasavaRead& cr, const char* pBegin, co
     StringUtilities::CopyString(cr.ReadNumber, pSlash + 1,      pEnd);
 }
 
+// parses a single position ("-?\d+(F|R)\S+") into the supplied alignment
+void ElandExtendedReader::ParsePosition(CasavaAlignment& ca, const char* pBegin, const char* pEnd) {
+
+    const char* p = pBegin;
+    if((p != pEnd) && (*p == '-')) ++p;
+
+    const char* pDigits = p;
+    while((p != pEnd) && (*p >= '0') && (*p <= '9')) ++p;
+
+    bool foundError = ((p == pDigits) || (p == pEnd) || ((*p != 'F') && (*p != 'R')));
+
+    const char* pStrand = p;
+    if(!foundError) {
+        ++p;
+        if(p == pEnd) foundError = true;
+        for(const char* q = p; !foundError && (q != pEnd); ++q) {
+            if(IsSpace(*q)) foundError = true;
+        }
+    }
+
+    if(foundError) {
+        const string position(pBegin, pEnd);
+        BOOST_THROW_EXCEPTION(CasavaException(EINVAL, (boost::format("Regular expression (mPositionsRegex) could not applied to the following line: [%s]") % position).str()));
+    }
+
+    ca.IsReverseStrand   = (*pStrand == 'R' ? true : false);
+    ca.MatchDescriptor.assign(p, pEnd);
+    ca.ReferencePosition = atoi(pBegin);
+}
+
 // returns true if there is another read available
+//
+// the fields are parsed in place in the LineReader buffer, and the strings
+// of the supplied read and its alignments are assigned rather than
+// rebuilt, so reusing the read for the next line needs no allocations
 bool ElandExtendedReader::GetNextRead(CasavaRead& cr) {
 
     // return false if our file stream is closed
     if(!mIsOpen) return false;
 
     // get the next line from the alignment and base quality files
-    string line;
-    if(!GetNextLine(line)) return false;
+    const char* pBuffer = NULL;
+    const char* pEnd    = NULL;
+    if(!GetNextLine(pBuffer, pEnd)) return false;
 
     // extract the VMF fields
     //
     // using memchr & CopyString instead of boost::regex sped up kagu 12 %
-    const uint32_t BUFFER_SIZE = (uint32_t)line.size();
-    const char* pBuffer = line.data();
-    const char* pEnd    = pBuffer + BUFFER_SIZE;
+    const uint32_t BUFFER_SIZE = (uint32_t)(pEnd - pBuffer);
 
     bool foundError = false;
 
@@ -129,6 +209,7 @@ bool ElandExtendedReader::GetNextRead(CasavaRead& cr) {
     if(!pTab3) foundError = true;
 
     if(foundError) {
+        const string line(pBuffer, pEnd);
         BOOST_THROW_EXCEPTION(CasavaException(EINVAL, (boost::format("Tab-delimited splitting could not applied to the following line: [%s]") % line).str()));
     }
 
@@ -156,10 +237,11 @@ bool ElandExtendedReader::GetNextRead(CasavaRead& cr) {
             BOOST_THROW_EXCEPTION(CasavaException(EINVAL, (boost::format("Unable to find the second colon in the neighborhood string: [%s]") % cr.Status).str()));
         }
 
-        // extract the three strings
-        cr.SeedErrors[0] = atoi(cr.Status.substr(0, colonPos).c_str());
-        cr.SeedErrors[1] = atoi(cr.Status.substr(colonPos + 1, secondColon - colonPos - 1).c_str());
-        cr.SeedErrors[2] = atoi(cr.Status.substr(secondColon + 1).c_str());
+        // extract the three numbers (atoi stops at the colons)
+        const char* pStatus = cr.Status.c_str();
+        cr.SeedErrors[0] = atoi(pStatus);
+        cr.SeedErrors[1] = atoi(pStatus + colonPos + 1);
+        cr.SeedErrors[2] = atoi(pStatus + secondColon + 1);
 
         if(hasTooManyMatches) {
             cr.IsTmm   = true;
@@ -186,58 +268,62 @@ bool ElandExtendedReader::GetNextRead(CasavaRead& cr) {
     // extract the positions
     if(isAligned) {
 
-        // split and assign the comma delimited positions
-        vector<string> posVector;
-        StringUtilities::Split(cr.Positions, ',', posVector);
+        const char* pPositions = pTab3 + 1;
+        const char* pPositionBegin = NULL;
+        const char* pPositionEnd   = NULL;
+
+        // count the comma delimited positions
+        uint32_t numPositions = 0;
+        PositionTokenizer counter(pPositions, pEnd);
+        while(counter.GetNextPosition(pPositionBegin, pPositionEnd)) ++numPositions;
 
-        if(posVector.size() == 1) {
+        if(numPositions == 1) {
             cr.MStatus = MS_SingleAlignmentFound;
         } else {
             cr.MStatus = MS_ManyAlignmentsFound;
         }
 
-        cr.Alignments.resize(posVector.size());
+        cr.Alignments.resize(numPositions);
         CasavaAlignments::iterator caIter = cr.Alignments.begin();
 
-        string currentReferenceName;
-        string currentContigName;
-        boost::smatch positionsResults;
-        vector<string>::iterator sIter;
-        for(sIter = posVector.begin(); sIter != posVector.end(); ++sIter, ++caIter) {
+        // the reference and contig names carry over to positions without one
+        const char* pReferenceBegin = pPositions;
+        const char* pReferenceEnd   = pPositions;
+        const char* pContigBegin    = pPositions;
+        const char* pContigEnd      = pPositions;
+
+        PositionTokenizer tokenizer(pPositions, pEnd);
+        for(; tokenizer.GetNextPosition(pPositionBegin, pPositionEnd); ++caIter) {
 
             // find the colon delimiter (if present)
-            string::size_type colonPos = sIter->find(':');
-            if(colonPos != string::npos) {
+            const char* pColon = (const char*)memchr(pPositionBegin, ':', pPositionEnd - pPositionBegin);
+            if(pColon) {
 
                 // find the forward slash contig name delimiter
-                currentReferenceName = sIter->substr(0, colonPos);
-                currentContigName.clear();
+                pReferenceBegin = pPositionBegin;
+                pReferenceEnd   = pColon;
+                pContigBegin    = pContigEnd = pColon;
 
-                string::size_type slashPos = currentReferenceName.find('/');
+                const char* pSlash = (const char*)memchr(pPositionBegin, '/', pColon - pPositionBegin);
 
-                if(slashPos != string::npos) {
+                if(pSlash) {
                     if(mUseContigNames) {
-                        currentReferenceName = currentReferenceName.substr(slashPos + 1);
+                        pReferenceBegin = pSlash + 1;
                     } else if(mUseReferenceNames) {
-                        currentReferenceName = currentReferenceName.substr(0, slashPos);
+                        pReferenceEnd   = pSlash;
                     } else {
-                        currentContigName    = currentReferenceName.substr(slashPos + 1);
-                        currentReferenceName = currentReferenceName.substr(0, slashPos);
+                        pContigBegin    = pSlash + 1;
+                        pContigEnd      = pColon;
+                        pReferenceEnd   = pSlash;
                     }
                 }
 
-                *sIter = sIter->substr(colonPos + 1);
-            }
-
-            if(!boost::regex_search(*sIter, positionsResults, mPositionsRegex)) {
-                BOOST_THROW_EXCEPTION(CasavaException(EINVAL, (boost::format("Regular expression (mPositionsRegex) could not applied to the following line: [%s]") % *sIter).str()));
+                pPositionBegin = pColon + 1;
             }
 
-            caIter->ReferenceName     = currentReferenceName;
-            caIter->ContigName        = currentContigName;
-            caIter->IsReverseStrand   = (positionsResults[2].str()[0] == 'R' ? true : false);
-            caIter->MatchDescriptor   = positionsResults[3].str();
-            caIter->ReferencePosition = atoi(positionsResults[1].str().c_str());
+            ParsePosition(*caIter, pPositionBegin, pPositionEnd);
+            caIter->ReferenceName.assign(pReferenceBegin, pReferenceEnd);
+            caIter->ContigName.assign(pContigBegin, pContigEnd);
         }
 
     } else cr.Alignments.clear();
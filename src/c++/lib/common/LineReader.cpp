@@ -56,13 +56,25 @@ void LineReader::Close(void) {
 // extracts another line from our memory buffer
 bool LineReader::GetNextLine(string& s) {
 
+    const char* pBegin = NULL;
+    const char* pEnd   = NULL;
+    if(!GetNextLine(pBegin, pEnd)) return false;
+
+    StringUtilities::CopyString(s, pBegin, pEnd);
+    return true;
+}
+
+// points to the next line in our memory buffer (without the newline)
+bool LineReader::GetNextLine(const char*& pBegin, const char*& pEnd) {
+
     // skip if the file is not currently open or if we don't have any data in the buffer
     if(!mIsOpen || (mBytesRead <= 0)) return false;
 
     char* p = NULL;
     if((p = (char*)memchr(mCurrentBuffer, '\n', (mStartBuffer + mBytesRead) - mCurrentBuffer))) {
 
-        StringUtilities::CopyString(s, mCurrentBuffer, p);
+        pBegin = mCurrentBuffer;
+        pEnd   = p;
         mCurrentBuffer = p + 1;
 
     } else {
@@ -83,7 +95,8 @@ bool LineReader::GetNextLine(string& s) {
 
         // if we can find any newlines after fetching new data, give up
         if((p = (char*)memchr(mCurrentBuffer, '\n', (mStartBuffer + mBytesRead) - mCurrentBuffer))) {
-            StringUtilities::CopyString(s, mCurrentBuffer, p);
+            pBegin = mCurrentBuffer;
+            pEnd   = p;
             mCurrentBuffer = p + 1;
         } else return false;
     }
@@ -31,6 +31,7 @@ agreement and bound by the terms therein.
 */
 
 #include "alignment/ELAND_unsquash.h"
+#include "alignment/GenomeBundle.hh"
 #include "eland_ms/ContigNameFinder.hh"
 
 namespace casava
@@ -46,7 +47,7 @@ ContigNameFinder* ContigNameFinder::getContigNameFinder
 {
   string indexName=directoryName+chromName+(string)".idx";
   cerr << "Will look for index file " << indexName << endl;
-  FILE* pIndex=fopen(indexName.c_str(),"r");
+  FILE* pIndex=casava::alignment::GenomeBundle::openIndex(directoryName+chromName);
   if (pIndex==NULL)
   {
     cerr << "... not found, will not index" << endl;
@@ -29,6 +29,7 @@
 #include <boost/tokenizer.hpp>
 
 #include "eland_ms/ELAND_options_ms.hh"
+#include "eland_ms/ElandDefines.hh"
 #include "common/Exceptions.hh"
 
 namespace casava
@@ -43,11 +44,17 @@ namespace eland_ms
       , singleseed_(false)
       , debug_(false)
       , sensitive_(false)
+      , populateGenome_(false)
+      , repeatMask_(false)
       , useBases_()
       , lane_(0)  // no default
       , read_(0)  // no default
       , inputDirectory_(".")
       , oligoLength_(0)
+      , numThreads_(1)
+      , batchSize_(0)
+      , prefetchDistance_(32)
+      , matchMemory_(1024)
     {
       msg.push_back("[=N0[,N1,N2]]\n");
       msg[0] += "Output multiple hits per read. ";
@@ -74,6 +81,8 @@ namespace eland_ms
                     msg[0].c_str())
           ("repeat-file", po::value< fs::path >(&repeatFile_),
                     "if given, points to a file containing the list of repeats to exclude (must be ASCII and in alphabetical order)")
+          ("repeat-mask", po::value< bool >(&repeatMask_)->zero_tokens(),
+                    "mark as repeats, rather than align, the reads whose first seed is in the repeat mask of the genome directory (written by squashGenome --repeat-mask). Without this switch any repeat mask there is ignored")
           ("ungapped", po::value< bool >(&ungapped_)->zero_tokens(),
                     "output ungapped alignments instead of gapped")
           ("singleseed", po::value< bool >(&singleseed_)->zero_tokens(),
@@ -82,6 +91,8 @@ namespace eland_ms
                     "write the multi files")
           ("sensitive", po::value< bool >(&sensitive_)->zero_tokens(),
                     "increase sensitivity")
+          ("populate-genome", po::value< bool >(&populateGenome_)->zero_tokens(),
+                    "read the whole genome bundle into memory when mapping it (MAP_POPULATE), if the genome directory has one")
           ("lane", po::value< unsigned int >(&lane_),
                     "lane number (only used when reading qseq or bcl files)")
           ("read", po::value< unsigned int >(&read_),
@@ -121,6 +132,14 @@ namespace eland_ms
           ("qseq-mask", po::value< std::string >(&useBases_),
                     "conversion mask - 'Y' (or 'y'), 'N' (or 'n') for 'use' or 'discard' respectively (only used when reading qseq files)")
           ("oligo-length", po::value< unsigned int >(&oligoLength_), "Seed length. Valid range is [8-32]")
+          ("threads", po::value< unsigned int >(&numThreads_)->default_value(1),
+                    "number of threads used to build the hash tables, scan the genome and run the gapped alignments")
+          ("batch-size", po::value< unsigned int >(&batchSize_)->default_value(0),
+                    "number of reads aligned at a time (0: all the reads of the lane at once)")
+          ("prefetch-distance", po::value< unsigned int >(&prefetchDistance_)->default_value(32),
+                    "number of genome positions hashed ahead of the one being checked, so that their hash table lookups are prefetched (0: no prefetching)")
+          ("match-memory", po::value< unsigned int >(&matchMemory_)->default_value(1024),
+                    "megabytes of matches each match table holds in memory before spilling them to temporary files (0: no limit)")
           ;
 
       //argsH_.resize(2);
@@ -182,6 +201,14 @@ namespace eland_ms
           BOOST_THROW_EXCEPTION(InvalidOptionException("\n   *** Problem parsing '--oligo-length' CLI argument. Please provide value in range [8-32] ***\n"));
         }
 
+        if (0 == numThreads_) {
+          BOOST_THROW_EXCEPTION(InvalidOptionException("\n   *** Problem parsing '--threads' CLI argument. Please provide a value of at least 1 ***\n"));
+        }
+
+        if (MAX_PREFETCH_DISTANCE < prefetchDistance_) {
+          BOOST_THROW_EXCEPTION(InvalidOptionException((boost::format("\n   *** Problem parsing '--prefetch-distance' CLI argument. Please provide value in range [0-%u] ***\n") % MAX_PREFETCH_DISTANCE).str()));
+        }
+
         // positional arguments interpretation depends on qseq-mode of operation
         //std::vector<std::string> tmp;
         //if (vm.count("reminder"))
@@ -0,0 +1,216 @@
+/**
+ ** Copyright (c) 2007-2010 Illumina, Inc.
+ **
+ ** This software is covered by the "Illumina Genome Analyzer Software
+ ** License Agreement" and the "Illumina Source Code License Agreement",
+ ** and certain third party copyright/licenses, and any user of this
+ ** source file is bound by the terms therein (see accompanying files
+ ** Illumina_Genome_Analyzer_Software_License_Agreement.pdf and
+ ** Illumina_Source_Code_License_Agreement.pdf and third party
+ ** copyright/license notices).
+ **
+ ** This file is part of the Consensus Assessment of Sequence And VAriation
+ ** (CASAVA) software package.
+ **
+ ** \file eland_ms/HitStore.cpp
+ **
+ ** \brief Part of ELAND
+ **
+ ** Holds the matches stored by a MatchTableMulti until they are output
+ **/
+
+#include <cassert>
+#include <cerrno>
+#include <cstdio>
+#include <sys/types.h>
+
+#include "eland_ms/HitStore.hh"
+#include "common/Exceptions.hh"
+#include "common/StreamUtil.h"
+
+namespace casava
+{
+namespace eland_ms
+{
+
+namespace cc = casava::common;
+using std::vector;
+
+HitStore::HitStore( void ) :
+  memoryLimit_(0),
+  pSpill_(NULL),
+  chunkUsed_(chunkSize),
+  maxOligo_(0),
+  size_(0),
+  spilledBytes_(0),
+  isSorted_(false),
+  current_(NULL),
+  currentOligo_(0)
+{
+} // ~ctor
+
+HitStore::~HitStore()
+{
+  freeChunks();
+  if (pSpill_!=NULL)
+  {
+    fclose(pSpill_);
+    if (!spillFileName_.empty()) remove(spillFileName_.c_str());
+  } // ~if
+} // ~dtor
+
+void HitStore::freeChunks( void )
+{
+  for (vector<Hit*>::iterator i(chunks_.begin()); i!=chunks_.end(); ++i)
+  {
+    delete [] *i;
+  } // ~for i
+  chunks_.clear();
+  chunkUsed_=chunkSize;
+} // ~freeChunks
+
+void HitStore::sortChunks( vector<Hit>& sorted )
+{
+  count_.assign(maxOligo_+2, 0);
+  for (unsigned int i(0); i<chunks_.size(); ++i)
+  {
+    const Hit* p(chunks_[i]);
+    const Hit* pEnd(p+((i+1==chunks_.size()) ? chunkUsed_ : chunkSize));
+    for (; p!=pEnd; ++p) ++count_[(p->code_&oligoMask)+1];
+  } // ~for i
+  for (unsigned int i(1); i<count_.size(); ++i) count_[i]+=count_[i-1];
+
+  sorted.resize(count_.back());
+  for (unsigned int i(0); i<chunks_.size(); ++i)
+  {
+    const Hit* p(chunks_[i]);
+    const Hit* pEnd(p+((i+1==chunks_.size()) ? chunkUsed_ : chunkSize));
+    for (; p!=pEnd; ++p) sorted[count_[p->code_&oligoMask]++]=*p;
+    delete [] chunks_[i];
+    chunks_[i]=NULL;
+  } // ~for i
+  chunks_.clear();
+  chunkUsed_=chunkSize;
+} // ~sortChunks
+
+void HitStore::spill( void )
+{
+  if (pSpill_==NULL)
+  {
+    if (spillFileName_.empty())
+    {
+      if ((pSpill_=casava_tmpfile())==NULL)
+      {
+        BOOST_THROW_EXCEPTION(cc::IoException(errno, "HitStore could not open temp file."));
+      }
+    }
+    else if ((pSpill_=fopen(spillFileName_.c_str(), "w+b"))==NULL)
+    {
+      BOOST_THROW_EXCEPTION(cc::IoException(errno, "HitStore could not open temp file " + spillFileName_));
+    }
+  } // ~if
+
+  vector<Hit> sorted;
+  sortChunks(sorted);
+
+  runs_.push_back(Run());
+  Run& run(runs_.back());
+  run.offset_=spilledBytes_;
+  run.size_=sorted.size();
+  run.unread_=sorted.size();
+  run.next_=run.end_=NULL;
+
+  if (fseeko(pSpill_, (off_t)spilledBytes_, SEEK_SET)!=0
+      ||sorted.size()!=fwrite(&sorted[0], sizeof(Hit), sorted.size(), pSpill_))
+  {
+    BOOST_THROW_EXCEPTION(cc::IoException(errno, "HitStore could not write matches to temp file."));
+  }
+  spilledBytes_+=sorted.size()*sizeof(Hit);
+} // ~spill
+
+void HitStore::rewind( void )
+{
+  if (!isSorted_)
+  {
+    // the hits left in memory make up the last run
+    runs_.push_back(Run());
+    sortChunks(runs_.back().buf_);
+    runs_.back().size_=runs_.back().buf_.size();
+    runs_.back().unread_=0;
+    runs_.back().offset_=0;
+    if (pSpill_!=NULL) fflush(pSpill_);
+    isSorted_=true;
+  } // ~if
+
+  for (vector<Run>::iterator i(runs_.begin()); i!=runs_.end(); ++i)
+  {
+    if (i+1==runs_.end())
+    {
+      // in memory
+      i->next_=(i->buf_.empty() ? NULL : &i->buf_[0]);
+      i->end_=i->next_+i->buf_.size();
+    }
+    else
+    {
+      i->unread_=i->size_;
+      i->next_=i->end_=NULL;
+    } // ~else
+  } // ~for i
+  current_=NULL;
+  currentOligo_=0;
+} // ~rewind
+
+bool HitStore::getHead( Run& run, boost::uint32_t& oligoNum )
+{
+  if (run.next_==run.end_)
+  {
+    if (run.unread_==0) return false;
+    const boost::uint64_t toRead((run.unread_<readBlockSize) ? run.unread_ : readBlockSize);
+    run.buf_.resize(toRead);
+    const boost::uint64_t firstHit(run.size_-run.unread_);
+    if (fseeko(pSpill_, (off_t)(run.offset_+firstHit*sizeof(Hit)), SEEK_SET)!=0
+        ||toRead!=fread(&run.buf_[0], sizeof(Hit), toRead, pSpill_))
+    {
+      BOOST_THROW_EXCEPTION(cc::IoException(errno, "HitStore could not read matches from temp file."));
+    }
+    run.unread_-=toRead;
+    run.next_=&run.buf_[0];
+    run.end_=run.next_+toRead;
+  } // ~if
+  oligoNum=run.next_->code_&oligoMask;
+  return true;
+} // ~getHead
+
+bool HitStore::nextRun( void )
+{
+  assert(isSorted_);
+  boost::uint32_t oligoNum;
+
+  // carry on with the hits for currentOligo_, in order of run
+  if (current_!=NULL)
+  {
+    for (Run* pRun(current_); pRun!=&runs_[0]+runs_.size(); ++pRun)
+    {
+      if (getHead(*pRun, oligoNum)&&(oligoNum==currentOligo_))
+      {
+        current_=pRun;
+        return true;
+      } // ~if
+    } // ~for pRun
+  } // ~if
+
+  // move on to the lowest oligo number left
+  current_=NULL;
+  for (vector<Run>::iterator i(runs_.begin()); i!=runs_.end(); ++i)
+  {
+    if (getHead(*i, oligoNum)&&((current_==NULL)||(oligoNum<currentOligo_)))
+    {
+      current_=&*i;
+      currentOligo_=oligoNum;
+    } // ~if
+  } // ~for i
+  return (current_!=NULL);
+} // ~nextRun
+
+} //namespace eland_ms
+} //namespace casava
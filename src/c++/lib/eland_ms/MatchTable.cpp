@@ -30,6 +30,9 @@
 #include "eland_ms/StateMachine.hh"
 
 #include "eland_ms/ElandDefines.hh"
+#include "common/ParallelFor.hh"
+
+#include <sys/time.h>
 
 namespace casava
 {
@@ -51,96 +54,97 @@ namespace eland_ms
 
 
 
-// PULLING OUT FRAGMENTS
-// method for pulling out the genomic regions of interest
-bool unsquashRequests( uint request_cnt,
-                       ofstream& out,
-                       FragmentFinder& getFragments,
-                       const bool& align,
-                       StringIndex& files,
-                       vector<MatchRequest>& matches,
-                       vector<SeqRequest>& frag_requests,
-                       vector<char*>& reads,
-                       const int& readLength,
-                       const int& fragmentLength
-                       )
+// GappedAligner: works out the alignment descriptors of a batch of
+// fragment requests for unsquashRequests. Task t of numTasks takes every
+// numTasks-th request with its own copy of the Aligner, and writes its
+// results to the slots of those requests, so the output is the same
+// whatever the number of threads
+struct GappedAligner
 {
-
-  // set up a Q30 quality string
-  boost::scoped_array<char> q30_qual_string(new char[readLength+1]);
-  for( int q=0;q<readLength;q++ ) {
-    q30_qual_string[q] = (char)94;
-  }
-  q30_qual_string[readLength] = '\0';
-
-  // setting up the Hamming distance object
-  Hamming h_dist;
-
-
-  // setting up the gap settings for ELAND
-  ifstream align_score(".align.scores");
-  // the actual score values
-  ga::alignment::ScoreType match     = 2;
-  ga::alignment::ScoreType mismatch  = -1;
-  ga::alignment::ScoreType gapopen   = 15;
-  ga::alignment::ScoreType gapextend = 3;
-
-  ga::alignment::Aligner aligner(match,mismatch,gapopen,gapextend,(ALIGN_DP_BAND/2),0,0 );
-  aligner.init( readLength,fragmentLength,0,0 );
-  aligner.allowInserts( 1 );
-  aligner.allowDeletions( 1 );
-
-#ifdef READ_PARAMETERS
-  if( !align_score ) {
-    if( aligner.readAlignScoreFile(align_score,match,mismatch,gapopen,gapextend) == true )
-      {
-        cerr << "read .align.scores, setting alignment scores to match=" << match
-             << ",mismatch=" << mismatch
-             << ",gapopen=" << gapopen
-             << ",gapextend=" << gapextend << endl;
-      }
-  } // ~if(!align.score)
-#endif
-
-
-
-  // print the fragments that we still hold in the bufffer
-  vector<char*> tmp_frags;
-  vector<char*> frags;
-  tmp_frags.resize( request_cnt );
-  for (vector<char*>::iterator i(tmp_frags.begin());i!=tmp_frags.end();i++)
-    {
-      *i=new char[fragmentLength+1];
-    } // ~for
-  frags.resize( request_cnt );
-  for (vector<char*>::iterator i(frags.begin());i!=frags.end();i++)
-    {
-      *i=new char[fragmentLength+1];
-    } // ~for
-
-  vector<char*> frags_cigar;
-  frags_cigar.resize( request_cnt );
-  for (vector<char*>::iterator i(frags_cigar.begin());i!=frags_cigar.end();i++)
+  GappedAligner( const ga::alignment::Aligner& aligner,
+                 const unsigned int numTasks,
+                 const bool align,
+                 const uint request_cnt,
+                 const vector<SeqRequest>& frag_requests,
+                 const vector<char*>& reads,
+                 const vector<char*>& frags,
+                 vector<char*>& tmp_frags,
+                 vector<char*>& frags_cigar,
+                 vector<int>& pos_correction_begin,
+                 vector<int>& pos_correction_end,
+                 const char* qualities,
+                 const int readLength,
+                 const int fragmentLength ) :
+    aligners_(numTasks, aligner),
+    numAligned_(numTasks, 0),
+    numGapped_(numTasks, 0),
+    seconds_(numTasks, 0.0),
+    numTasks_(numTasks),
+    align_(align),
+    request_cnt_(request_cnt),
+    frag_requests_(frag_requests),
+    reads_(reads),
+    frags_(frags),
+    tmp_frags_(tmp_frags),
+    frags_cigar_(frags_cigar),
+    pos_correction_begin_(pos_correction_begin),
+    pos_correction_end_(pos_correction_end),
+    qualities_(qualities),
+    readLength_(readLength),
+    fragmentLength_(fragmentLength) {}
+
+  void operator()( const unsigned int taskNum );
+
+  // printRates: requests and full alignments done by each task, and how
+  // many of them per second of wall clock time
+  void printRates( ostream& os ) const
+  {
+    for (unsigned int i(0);i<numTasks_;i++)
     {
-      *i=new char[2*fragmentLength+1];
-    } // ~for
-
-
-  // think of a more elegant way to accomplish this
-  vector<int> pos_correction_begin;
-  vector<int> pos_correction_end;
-  pos_correction_begin.resize( request_cnt );
-  pos_correction_end.resize( request_cnt );
-
-
-  getFragments(frag_requests, reads, frags, files);//,(ALIGN_DP_BAND/2));
-
-  Timer aligner_timer;
-
-
-  if( align == false )
+      os << "alignment thread " << i << ": " << numAligned_[i]
+         << " requests (" << numGapped_[i] << " gapped) in "
+         << seconds_[i] << " seconds: "
+         << ((seconds_[i]>0) ? (numAligned_[i]/seconds_[i]) : 0.0)
+         << " per second" << endl;
+    } // ~for i
+  } // ~printRates
+
+private:
+  vector<ga::alignment::Aligner> aligners_;
+  vector<uint> numAligned_;
+  vector<uint> numGapped_;
+  vector<double> seconds_;
+  const unsigned int numTasks_;
+  const bool align_;
+  const uint request_cnt_;
+  const vector<SeqRequest>& frag_requests_;
+  const vector<char*>& reads_;
+  const vector<char*>& frags_;
+  vector<char*>& tmp_frags_;
+  vector<char*>& frags_cigar_;
+  vector<int>& pos_correction_begin_;
+  vector<int>& pos_correction_end_;
+  const char* qualities_;
+  const int readLength_;
+  const int fragmentLength_;
+}; // ~struct GappedAligner
+
+void GappedAligner::operator()( const unsigned int taskNum )
+{
+  ga::alignment::Aligner& aligner(aligners_[taskNum]);
+  timeval start,finish;
+  gettimeofday(&start, NULL);
+
+  const vector<SeqRequest>& frag_requests(frag_requests_);
+  const vector<char*>& reads(reads_);
+  const vector<char*>& frags(frags_);
+  const int readLength(readLength_);
+  const int fragmentLength(fragmentLength_);
+  const uint request_cnt(request_cnt_);
+
+  if( align_ == false )
     {
-      for( uint align_cnt=0;align_cnt<request_cnt;align_cnt++ )
+      for( uint align_cnt=taskNum;align_cnt<request_cnt;align_cnt+=numTasks_ )
         {
           int no_mismatches = 0;
           string alignment_descriptor = aligner.convertToAlignmentDescriptor( reads[ frag_requests[align_cnt].readNum_ ],
@@ -148,14 +152,14 @@ bool unsquashRequests( uint request_cnt,
                                                                               no_mismatches);
 
           // copy over to frags
-          strncpy( tmp_frags[ frag_requests[align_cnt].requestNum_ ],alignment_descriptor.c_str(),alignment_descriptor.size() );
-          tmp_frags[ frag_requests[align_cnt].requestNum_ ][alignment_descriptor.size()] = '\0';
+          strncpy( tmp_frags_[ frag_requests[align_cnt].requestNum_ ],alignment_descriptor.c_str(),alignment_descriptor.size() );
+          tmp_frags_[ frag_requests[align_cnt].requestNum_ ][alignment_descriptor.size()] = '\0';
         }// for(uint align_cnt...)
     }
   else
     {
 
-      for( uint align_cnt=0;align_cnt<request_cnt;align_cnt++ )
+      for( uint align_cnt=taskNum;align_cnt<request_cnt;align_cnt+=numTasks_ )
         {
           string cut_fragment = string(frags[ frag_requests[align_cnt].requestNum_ ]).substr( (ALIGN_DP_BAND/2),readLength );
           int no_old_ad_mismatches = 0;
@@ -169,15 +173,16 @@ bool unsquashRequests( uint request_cnt,
           if( no_old_ad_mismatches < MIN_HAMMING_DISTANCE )
             {
               // do nothing
-              strncpy( frags_cigar[ frag_requests[align_cnt].requestNum_ ],alignment_descriptor.c_str(),alignment_descriptor.size() );
-              frags_cigar[ frag_requests[align_cnt].requestNum_ ][alignment_descriptor.size()] = '\0';
+              strncpy( frags_cigar_[ frag_requests[align_cnt].requestNum_ ],alignment_descriptor.c_str(),alignment_descriptor.size() );
+              frags_cigar_[ frag_requests[align_cnt].requestNum_ ][alignment_descriptor.size()] = '\0';
             }
           else
             {
               // do the full monty alignment
+              numGapped_[taskNum]++;
 
               // perform the alignment
-              aligner(q30_qual_string.get(),reads[ frag_requests[align_cnt].readNum_ ],frags[ frag_requests[align_cnt].requestNum_ ],readLength,fragmentLength,(frag_requests[align_cnt].strand_=='F') );
+              aligner(qualities_,reads[ frag_requests[align_cnt].readNum_ ],frags[ frag_requests[align_cnt].requestNum_ ],readLength,fragmentLength,(frag_requests[align_cnt].strand_=='F') );
 
 
 
@@ -224,29 +229,133 @@ bool unsquashRequests( uint request_cnt,
               // if we are fine with the old descriptor, then copy it over
               if( old_descriptor == true ) {
                 new_alignment_descriptor = alignment_descriptor;
-                pos_correction_begin[ frag_requests[align_cnt].requestNum_ ] = 0;
-                pos_correction_end[ frag_requests[align_cnt].requestNum_ ] = 0;
+                pos_correction_begin_[ frag_requests[align_cnt].requestNum_ ] = 0;
+                pos_correction_end_[ frag_requests[align_cnt].requestNum_ ] = 0;
               } else
                 {
                   // if we chose the new alignment descriptor, we perhaps
                   // have to adjust the match position
-                  pos_correction_begin[ frag_requests[align_cnt].requestNum_ ] = ((ALIGN_DP_BAND/2)-offset_begin_indel);
-                  pos_correction_end[ frag_requests[align_cnt].requestNum_ ] = ((ALIGN_DP_BAND/2)-offset_end_indel);
+                  pos_correction_begin_[ frag_requests[align_cnt].requestNum_ ] = ((ALIGN_DP_BAND/2)-offset_begin_indel);
+                  pos_correction_end_[ frag_requests[align_cnt].requestNum_ ] = ((ALIGN_DP_BAND/2)-offset_end_indel);
 
                 }
 
 
 
               // copy over to frags
-              strncpy( frags_cigar[ frag_requests[align_cnt].requestNum_ ],new_alignment_descriptor.c_str(),new_alignment_descriptor.size() );
-              frags_cigar[ frag_requests[align_cnt].requestNum_ ][new_alignment_descriptor.size()] = '\0';
+              strncpy( frags_cigar_[ frag_requests[align_cnt].requestNum_ ],new_alignment_descriptor.c_str(),new_alignment_descriptor.size() );
+              frags_cigar_[ frag_requests[align_cnt].requestNum_ ][new_alignment_descriptor.size()] = '\0';
 
             } // ~else( full_monty_alignment)
 
         } //~for loop
     } // ~align
 
+  gettimeofday(&finish, NULL);
+  numAligned_[taskNum]=(request_cnt+numTasks_-1-taskNum)/numTasks_;
+  seconds_[taskNum]=(finish.tv_sec-start.tv_sec)
+    +(finish.tv_usec-start.tv_usec)/1000000.0;
+} // ~GappedAligner::operator()
+
+
+
+// PULLING OUT FRAGMENTS
+// method for pulling out the genomic regions of interest
+bool unsquashRequests( uint request_cnt,
+                       ofstream& out,
+                       FragmentFinder& getFragments,
+                       const bool& align,
+                       StringIndex& files,
+                       vector<MatchRequest>& matches,
+                       vector<SeqRequest>& frag_requests,
+                       vector<char*>& reads,
+                       const int& readLength,
+                       const int& fragmentLength,
+                       const unsigned int numThreads
+                       )
+{
+
+  // set up a Q30 quality string
+  boost::scoped_array<char> q30_qual_string(new char[readLength+1]);
+  for( int q=0;q<readLength;q++ ) {
+    q30_qual_string[q] = (char)94;
+  }
+  q30_qual_string[readLength] = '\0';
+
+  // setting up the Hamming distance object
+  Hamming h_dist;
+
+
+  // setting up the gap settings for ELAND
+  ifstream align_score(".align.scores");
+  // the actual score values
+  ga::alignment::ScoreType match     = 2;
+  ga::alignment::ScoreType mismatch  = -1;
+  ga::alignment::ScoreType gapopen   = 15;
+  ga::alignment::ScoreType gapextend = 3;
+
+  ga::alignment::Aligner aligner(match,mismatch,gapopen,gapextend,(ALIGN_DP_BAND/2),0,0 );
+  aligner.init( readLength,fragmentLength,0,0 );
+  aligner.allowInserts( 1 );
+  aligner.allowDeletions( 1 );
+
+#ifdef READ_PARAMETERS
+  if( !align_score ) {
+    if( aligner.readAlignScoreFile(align_score,match,mismatch,gapopen,gapextend) == true )
+      {
+        cerr << "read .align.scores, setting alignment scores to match=" << match
+             << ",mismatch=" << mismatch
+             << ",gapopen=" << gapopen
+             << ",gapextend=" << gapextend << endl;
+      }
+  } // ~if(!align.score)
+#endif
+
+
+
+  // print the fragments that we still hold in the bufffer
+  vector<char*> tmp_frags;
+  vector<char*> frags;
+  tmp_frags.resize( request_cnt );
+  for (vector<char*>::iterator i(tmp_frags.begin());i!=tmp_frags.end();i++)
+    {
+      *i=new char[fragmentLength+1];
+    } // ~for
+  frags.resize( request_cnt );
+  for (vector<char*>::iterator i(frags.begin());i!=frags.end();i++)
+    {
+      *i=new char[fragmentLength+1];
+    } // ~for
+
+  vector<char*> frags_cigar;
+  frags_cigar.resize( request_cnt );
+  for (vector<char*>::iterator i(frags_cigar.begin());i!=frags_cigar.end();i++)
+    {
+      *i=new char[2*fragmentLength+1];
+    } // ~for
+
+
+  // think of a more elegant way to accomplish this
+  vector<int> pos_correction_begin;
+  vector<int> pos_correction_end;
+  pos_correction_begin.resize( request_cnt );
+  pos_correction_end.resize( request_cnt );
+
+
+  getFragments(frag_requests, reads, frags, files);//,(ALIGN_DP_BAND/2));
+
+  Timer aligner_timer;
+
+  GappedAligner alignRequests(aligner, numThreads, align, request_cnt,
+                              frag_requests, reads, frags,
+                              tmp_frags, frags_cigar,
+                              pos_correction_begin, pos_correction_end,
+                              q30_qual_string.get(),
+                              readLength, fragmentLength);
+  cc::parallelFor(alignRequests, numThreads, numThreads);
+
   cerr << "alignment done for the moment " << aligner_timer << endl;
+  alignRequests.printRates(cerr);
 
   // print the match requests together with the fragment
   int frag_idx = 0;
@@ -404,9 +513,6 @@ void MatchTable::addMatch( const TableEntryData& entry,
 
     //    if (this->matchPosition_[oligoNum] != matchPos )
     //    {
-#if (NUM_THREADS>1)
-  pthread_mutex_lock(&mutex_);
-#endif
       if (    ( numErrors < (matchType_[oligoNum].errorType&0x3))
 	    || (this->matchPosition_[oligoNum]==noMatch))
       {
@@ -514,9 +620,6 @@ void MatchTable::addMatch( const TableEntryData& entry,
       } // ~else
 
   //  cout << this->matchPosition_[oligoNum]-16777216 << " " << (uint) matchType_[oligoNum].errorType << " " << (uint) matchType_[oligoNum].r[0] << " "  << (uint) matchType_[oligoNum].r[1] << " " << (uint) matchType_[oligoNum].r[2] << endl;
-#if (NUM_THREADS>1)
-      pthread_mutex_unlock(&mutex_);
-#endif
 } // ~void MatchTable::addMatch( uint oligoNum, MatchPosition oligoPos )
 #endif
 
@@ -587,10 +690,10 @@ void MatchTableVerbose::print( OligoSource& oligos,
 {
   //  ErrorPositionMapper mapErrors(scoreTable, oligoLength);
 
-  MatchPosition subtractTable[256];
-  int chromTable[256];
+  vector<MatchPosition> subtractTable(blockStarts.back()>>blockShift);
+  vector<int> chromTable(blockStarts.back()>>blockShift);
   int thisChrom(0);
-  uint j;
+  MatchPosition j;
   uint errorPos1, errorPos2;
 
   //  bool isUniqueExact, isUniqueError;
@@ -639,7 +742,7 @@ void MatchTableVerbose::print( OligoSource& oligos,
       else if (this->matchPosition_[i]==repeatMasked)
 	fprintf( this->pOut_,"RM");
       else
-	fprintf( this->pOut_,"RB\t%u", this->matchPosition_[i]-blockRepeat);
+	fprintf( this->pOut_,"RB\t%u", (uint)(this->matchPosition_[i]-blockRepeat+this->firstOligo_));
     } // ~if
     else if (this->matchPosition_[i]==noMatch)
       fprintf( this->pOut_,"NM\t0\t0\t0");
@@ -709,7 +812,7 @@ void MatchTableVerbose::print( OligoSource& oligos,
           ( this->pOut_,"\t%s%s\t%u\t%c\t%c%c",
             extractedChromName,
             extractedContigName,
-            extractedMatchPos,
+            (uint)extractedMatchPos,
             dirChar,
             firstN,
             secondN );
@@ -720,7 +823,7 @@ void MatchTableVerbose::print( OligoSource& oligos,
 	fprintf
           ( this->pOut_,"\t%s\t%u\t%c\t%c%c",
             chromNames[chromTable[thisBlock]].c_str(),
-            matchPos,//this->matchPosition_[i]-subtractTable[thisBlock],
+            (uint)matchPos,//this->matchPosition_[i]-subtractTable[thisBlock],
             dirChar,
             firstN,
             secondN );
@@ -803,10 +906,10 @@ void MatchTableAssembly::print( OligoSource& oligos,
   //  MatchPositionTranslator getMatchPos( chromNames, blockStarts );
 
 
-  MatchPosition subtractTable[256];
-  int chromTable[256];
+  vector<MatchPosition> subtractTable(blockStarts.back()>>blockShift);
+  vector<int> chromTable(blockStarts.back()>>blockShift);
   int thisChrom(0);
-  uint j;
+  MatchPosition j;
   uint errorPos1, errorPos2;
   uchar shouldBe1, shouldBe2;
 
@@ -856,7 +959,7 @@ void MatchTableAssembly::print( OligoSource& oligos,
       else if (this->matchPosition_[i]==repeatMasked)
 	fprintf( this->pOut_,"RM");
       else
-	fprintf( this->pOut_,"RB\t%u", this->matchPosition_[i]-blockRepeat);
+	fprintf( this->pOut_,"RB\t%u", (uint)(this->matchPosition_[i]-blockRepeat+this->firstOligo_));
     } // ~if
     else if (this->matchPosition_[i]==noMatch)
       fprintf( this->pOut_,"NM\t0\t0\t0");
@@ -925,7 +1028,7 @@ void MatchTableAssembly::print( OligoSource& oligos,
 	fprintf( this->pOut_,"\t%s%s\t%u\t%c\t%c%c",
 		 extractedChromName,
 		 extractedContigName,
-		 extractedMatchPos,
+		 (uint)extractedMatchPos,
 		 dirChar,
 		 firstN,
 		 secondN );
@@ -935,7 +1038,7 @@ void MatchTableAssembly::print( OligoSource& oligos,
 
 	fprintf( this->pOut_,"\t%s\t%u\t%c\t%c%c",
 		 chromNames[chromTable[thisBlock]].c_str(),
-		 matchPos,//this->matchPosition_[i]-subtractTable[thisBlock],
+		 (uint)matchPos,//this->matchPosition_[i]-subtractTable[thisBlock],
 		 dirChar,
 		 firstN,
 		 secondN
@@ -985,33 +1088,9 @@ void MatchTableAssembly::print( OligoSource& oligos,
 void MatchTableMulti::initializeTmpFiles
 ( const char* tmpFilePrefix )
 {
-  std::string tmpFilePrefixString, tmpFileName;
-  if (tmpFilePrefix==NULL)
-  {
-    if ((pOligoNum_=casava_tmpfile())==NULL)
-    {
-      BOOST_THROW_EXCEPTION(cc::IoException(errno, "MatchTableMulti could not open oligo num temp file."));
-    }
-    if ((pMatchType_=casava_tmpfile())==NULL)
-    {
-      BOOST_THROW_EXCEPTION(cc::IoException(errno, "MatchTableMulti could not open match type temp file."));
-    }
-  }
-  else
+  if (tmpFilePrefix!=NULL)
   {
-    tmpFilePrefixString=tmpFilePrefix;
-    tmpFileNameOligoNum_=tmpFilePrefixString + ".num";
-    if ((pOligoNum_=fopen(tmpFileNameOligoNum_.c_str(), "w+b"))==NULL)
-    {
-      BOOST_THROW_EXCEPTION(cc::IoException(errno, "MatchTableMulti could not open oligo num temp file" + tmpFileNameOligoNum_));
-    }
-
-    tmpFileNameMatchType_=tmpFilePrefixString + ".type";
-    if ((pMatchType_=fopen(tmpFileNameMatchType_.c_str(), "w+b"))==NULL)
-    {
-      BOOST_THROW_EXCEPTION(cc::IoException(errno, "MatchTableMulti could not open match type temp file" + tmpFileNameMatchType_));
-    }
-
+    hits_.setSpillFileName(std::string(tmpFilePrefix) + ".hits");
   }
 
   std::cerr << "Built MatchTableMulti: will store at most "
@@ -1023,10 +1102,17 @@ void MatchTableMulti::initializeTmpFiles
 
 MatchTableMulti::~MatchTableMulti()
 {
-  fclose (pOligoNum_);
-  fclose (pMatchType_);
 } // MatchTableMulti::~MatchTableMulti
 
+void MatchTableMulti::reportHitStorage( void ) const
+{
+  cerr << "Info: " << matchesStored_
+       << " matches were stored" << endl;
+  cerr << "Info: " << hits_.getSpilledBytes()
+       << " bytes of temp storage used for matches"
+       << endl;
+} // ~MatchTableMulti::reportHitStorage
+
 
 
 // For each sequence check if there is at least one match position found
@@ -1037,26 +1123,14 @@ bool MatchTableMulti::getUnmappedReads( vector<bool>& unmapped )
   unmapped.resize(this->matchPosition_.size(),true);
   hyperhyper_.resize(this->matchPosition_.size(),false);
 
-  fseek( pOligoNum_, 0, SEEK_SET);
+  hits_.rewind();
 
   uint thisCode;
   uint thisOligo;
+  MatchPosition thisPos;
 
-  while (1)
+  while (hits_.getNext(thisCode, thisPos))
   {
-    if (1 != fread( &thisCode, sizeof(uint), 1, pOligoNum_))
-    {
-        const int currentError = errno;
-        if (feof(pOligoNum_)!=0)
-        {
-            break;
-        }
-        else
-        {
-            BOOST_THROW_EXCEPTION(cc::IoException(currentError, "failed to read Oligo Num"));
-        }
-    }
-
     thisOligo=thisCode&(((uint)~0)>>5);
     //    cout << thisCode << " " << thisOligo << " " << (int)reverseFlag << " "<< thisPos << " " << numErrors << endl;
     assert(thisOligo<this->matchPosition_.size());
@@ -1168,29 +1242,15 @@ addMatch(MatchIter i, const MatchIter i_end)
                    &&(this->matchType_[oligoNum].r[1]<=maxNumMatchesOneError_)
                    &&(this->matchType_[oligoNum].r[2]<=maxNumMatchesTwoErrors_)))
             {
-                // TBD: cache then bulk write
                 const uint32_t matchCode=((static_cast<uint32_t>(i->numErrors)<<30)|
                            (((i->position&isReverseOligo)!=0)<<29)|
                            (((i->position&(~isReverseOligo))>>29)<<27)|oligoNum);
                 ++matchesStored_;
-
-                if( 1 != fwrite (&matchCode,sizeof(uint),1,pOligoNum_) )
-                    {
-                        cerr << "ERROR: couldn't write match code to temp file: " << strerror(errno) << endl;
-                        exit(2);
-                    }
-                if( 1 != fwrite (&(i->matchPos),sizeof(MatchPosition),1,pMatchType_) )
-                    {
-                        cerr << "ERROR: couldn't write match pos to temp file: " << strerror(errno) << endl;
-                        exit(2);
-                    }
+                hits_.add(matchCode,i->matchPos);
             }
     }
 
 
-#if (NUM_THREADS>1)
-      pthread_mutex_unlock(&mutex_);
-#endif
 } // ~void MatchTableMulti::addMatch( uint oligoNum, MatchPosition oligoPos )
 //#endif // MODIFIED_MULTISEED_CODE
 
@@ -1202,39 +1262,14 @@ void MatchTableMulti::print( OligoSource& oligos,
 				const SuffixScoreTable& ,
 				int )
 {
-  cerr << "Info: " << matchesStored_
-       << " matches were stored" << endl;
-  cerr << "Info: " << ftell(pOligoNum_)
-       << " bytes of temp storage used for oligo numbers"
-       << endl;
-  cerr << "Info: " << ftell(pMatchType_)
-       << " bytes of temp storage used for match positions"
-       << endl;
+  reportHitStorage();
 
-  fseek( pOligoNum_, 0, SEEK_SET);
-  fseek( pMatchType_, 0, SEEK_SET);
+  hits_.rewind();
   //  multiPos_.resize(this->matchPosition_.size());
   //  multiType_.resize(this->matchPosition_.size());
-  multiMatch_.resize(this->matchPosition_.size());
-
-  //  fclose(pOligoNum_);
-  //  fclose(pMatchType_);
-
-
-  //  if ((pOligoNum_=fopen(tmpFileNameOligoNum_.c_str(), "r"))==NULL)
-  //  {
-  //   cerr << "Error in MatchTableMulti: could not open file "
-  //	 << tmpFileNameOligoNum_ << endl;
-  //  exit (1);
-  // }
-
-  //  if ((pMatchType_=fopen(tmpFileNameMatchType_.c_str(), "r"))==NULL)
-  // {
-  //  cerr << "Error in MatchTableMulti: could not open file "
-  //	 << tmpFileNameMatchType_ << endl;
-  //  exit (1);
-  // }
-
+  // the hits come grouped by oligo, so the table fills in oligo order
+  MultiMatchTable multiMatch;
+  multiMatch.reserve(hits_.size());
 
 
   uint thisOligo;
@@ -1243,31 +1278,13 @@ void MatchTableMulti::print( OligoSource& oligos,
   uint numErrors;
   bool reverseFlag;
 
-  while (1)
+  while (hits_.getNext(thisCode, thisPos))
   {
-    if (1 != fread( &thisCode, sizeof(uint), 1, pOligoNum_))
-    {
-        const int currentError = errno;
-        if (feof(pOligoNum_)!=0)
-        {
-            break;
-        }
-        else
-        {
-            BOOST_THROW_EXCEPTION(cc::IoException(currentError, "failed to read Oligo Num"));
-        }
-    }
-
-    if (1 != fread( &thisPos, sizeof(MatchPosition), 1, pMatchType_))
-    {
-        BOOST_THROW_EXCEPTION(cc::IoException(errno, "failed to read Match Type"));
-    }
-
     numErrors=(thisCode>>30)&0x3;
     reverseFlag=(((thisCode>>29)&0x1)!=0);
     thisOligo=thisCode&(((uint)~0)>>3);
     //    cout << thisCode << " " << thisOligo << " " << (int)reverseFlag << " "<< thisPos << " " << numErrors << endl;
-    assert(thisOligo<multiMatch_.size());
+    assert(thisOligo<this->matchPosition_.size());
 
   if (   ((numErrors==0)
 	  &&(this->matchType_[thisOligo].r[0]<=maxNumMatchesExact_))
@@ -1279,7 +1296,7 @@ void MatchTableMulti::print( OligoSource& oligos,
 	  &&(this->matchType_[thisOligo].r[1]<=maxNumMatchesOneError_)
 	  &&(this->matchType_[thisOligo].r[2]<=maxNumMatchesTwoErrors_)))
     {
-      multiMatch_[thisOligo].push_back( MultiMatch( thisPos, numErrors, 0, reverseFlag) );
+      multiMatch.push_back( thisOligo, MultiMatch( thisPos, numErrors, 0, reverseFlag) );
     } // ~if
     //    multiMatch_[thisOligo].back().pos_=thisPos;
     //  multiMatch_[thisOligo].back().type_=thisType;
@@ -1287,12 +1304,14 @@ void MatchTableMulti::print( OligoSource& oligos,
     //    multiPos_[thisOligo].push_back(thisPos);
     //  multiType_[thisOligo].push_back(thisType);
   } // ~while
+  multiMatch_.merge(multiMatch);
+  multiMatch_.resize(this->matchPosition_.size());
   //  cout << "READ in " << zz << endl;
   //MatchPosition subtractTable[256];
-  int chromTable[256];
+  vector<int> chromTable(blockStarts.back()>>blockShift);
   int thisChrom(0);
   //int lastChrom;
-  uint j;
+  MatchPosition j;
   uint nbors0,nbors1,nbors2;
 
   //  uint errorPos1, errorPos2;
@@ -1346,7 +1365,7 @@ void MatchTableMulti::print( OligoSource& oligos,
       else if (this->matchPosition_[i]==repeatMasked)
 	fprintf( this->pOut_,"RM");
       else
-	fprintf( this->pOut_,"RB\t%u", this->matchPosition_[i]-blockRepeat);
+	fprintf( this->pOut_,"RB\t%u", (uint)(this->matchPosition_[i]-blockRepeat+this->firstOligo_));
     } // ~if
     else
     {
@@ -1367,20 +1386,21 @@ void MatchTableMulti::print( OligoSource& oligos,
       //	     ((numErrors==0)?((uint)matchType_[i].r[0]):0),
       //	     ((numErrors<=1)?((uint)matchType_[i].r[1]):0),
       //	     (uint)matchType_[i].r[2] );
-      sort(multiMatch_[i].begin(),multiMatch_[i].end());
+      const MultiMatchTable::iterator pMatches(multiMatch_.begin(i));
+      sort(pMatches,multiMatch_.end(i));
 
       //lastChrom=-1;
       previousChromName=NULL;
 
-      for (uint j(0); j<multiMatch_[i].size(); ++j)
+      for (uint j(0); j<multiMatch_.size(i); ++j)
       {
-          dirChar = multiMatch_[i][j].reverse_ ? 'R' : 'F';
-          numErrors = multiMatch_[i][j].errors_;
-          thisBlock = multiMatch_[i][j].pos_ >> blockShift;
-          //matchPos=multiMatch_[i][j].pos_-subtractTable[thisBlock];
+          dirChar = pMatches[j].reverse_ ? 'R' : 'F';
+          numErrors = pMatches[j].errors_;
+          thisBlock = pMatches[j].pos_ >> blockShift;
+          //matchPos=pMatches[j].pos_-subtractTable[thisBlock];
           thisChrom=chromTable[thisBlock];
 
-        getMatchPos( multiMatch_[i][j].pos_,
+        getMatchPos( pMatches[j].pos_,
 		     extractedChromName,
 		     extractedContigName,
 		     extractedMatchPos);
@@ -1416,7 +1436,7 @@ void MatchTableMulti::print( OligoSource& oligos,
 	//	adjustMatchPos( pOligo, dirChar, firstN, secondN, matchPos );
 
 	fprintf( this->pOut_,"%u%c%u",
-		 extractedMatchPos,
+		 (uint)extractedMatchPos,
 		 dirChar,
 		 numErrors );
 	//	fprintf( this->pOut_,"%u%c%u",
@@ -1439,18 +1459,10 @@ void MatchTableMulti::print( OligoSource& oligos,
 /// Building up multiMatch_, code moved from printSquash
 bool MatchTableMulti::buildMatchTable(MatchPositionTranslator& getMatchPos)
 {
-  cerr << "Info: " << matchesStored_
-       << " matches were stored" << endl;
-  cerr << "Info: " << ftell(pOligoNum_)
-       << " bytes of temp storage used for oligo numbers"
-       << endl;
-  cerr << "Info: " << ftell(pMatchType_)
-       << " bytes of temp storage used for match positions"
-       << endl;
+  Timer buildTimer;
+  reportHitStorage();
 
-
-  fseek( pOligoNum_, 0, SEEK_SET);
-  fseek( pMatchType_, 0, SEEK_SET);
+  hits_.rewind();
 
   // firing up the state machinery
   uint table_size = this->matchPosition_.size();
@@ -1491,29 +1503,13 @@ bool MatchTableMulti::buildMatchTable(MatchPositionTranslator& getMatchPos)
 
   int update_cnt = 0;
 
-  vector< vector<bool> > touched( 3, vector<bool>( table_size,false ) );
+  // bit n set for the oligos with n-error hits inserted
+  vector<unsigned char> touched( table_size,0 );
 
 
-  while (1)
+  while (hits_.getNext(thisCode, thisPos))
   {
       oligonums_read++;
-      if (1 != fread( &thisCode, sizeof(uint), 1, pOligoNum_))
-      {
-          const int currentError = errno;
-          if (feof(pOligoNum_)!=0)
-          {
-              break;
-          }
-          else
-          {
-              BOOST_THROW_EXCEPTION(cc::IoException(currentError, "failed to read Oligo Num"));
-          }
-      }
-
-      if (1 != fread( &thisPos, sizeof(MatchPosition), 1, pMatchType_))
-      {
-          BOOST_THROW_EXCEPTION(cc::IoException(errno, "failed to read Match Type"));
-      }
 
       numErrors=(thisCode>>30)&0x3;
       //reverseFlag=(((thisCode>>29)&0x1)!=0);
@@ -1554,37 +1550,36 @@ bool MatchTableMulti::buildMatchTable(MatchPositionTranslator& getMatchPos)
       {
           //      multiMatch_[thisOligo].push_back( MultiMatch( thisPos, thisType ) );
           seedsToMatch.insertSeedHit( thisPos,thisCode,update_cnt,getMatchPos );
-          touched[numErrors][thisOligo] = true;
+          touched[thisOligo] |= (1<<numErrors);
       }
   } // ~while
 
-  // resize the multiMatch_ table
-  if( multiMatch_.size() == 0 )
-      multiMatch_.resize( table_size );
-
-  // building up the multiMatch table
-  for( uint i=1;i<table_size;i++ )
+  // building up the multiMatch table, after the matches it already holds
   {
-      //      list<MultiMatch> l = seedsToMatch.getHits(i,maxNumMatchesExact_);
-      list<MultiMatch> l = seedsToMatch.getHits(i,100, this->hyperhyper_.empty()); // 100 is only an arbitrary high value such that we do not cut any (had the check above)
-
-      if( l.size()>0 )
+      MultiMatchTable hits;
+      hits.reserve( seedsToMatch.getNumStates() );
+      for( uint i=1;i<table_size;i++ )
       {
-          multiMatch_[i].insert( multiMatch_[i].end(), l.begin(),l.end() );
-          seedsToMatch.clear(i);
+          //      seedsToMatch.getHits(i,maxNumMatchesExact_,hits);
+          seedsToMatch.getHits(i,100, this->hyperhyper_.empty(), hits); // 100 is only an arbitrary high value such that we do not cut any (had the check above)
       }
+      multiMatch_.merge( hits );
+      multiMatch_.resize( table_size );
+  }
 
+  for( uint i=1;i<table_size;i++ )
+  {
       seedsToMatch.matchType_[i].errorType = this->matchType_[i].errorType;
 
-      if( touched[0][i] == false )
+      if( (touched[i]&1) == 0 )
       {
           seedsToMatch.matchType_[i].r[0] = this->matchType_[i].r[0];
       }
-      if( touched[1][i] == false )
+      if( (touched[i]&2) == 0 )
       {
           seedsToMatch.matchType_[i].r[1] = this->matchType_[i].r[1];
       }
-      if( touched[2][i] == false )
+      if( (touched[i]&4) == 0 )
       {
           seedsToMatch.matchType_[i].r[2] = this->matchType_[i].r[2];
       }
@@ -1621,7 +1616,7 @@ bool MatchTableMulti::buildMatchTable(MatchPositionTranslator& getMatchPos)
           (this->matchType_[i].r[2]==0) )
       {
 
-          assert(multiMatch_[i].size()==0);
+          assert(multiMatch_.size(i)==0);
       }
 
   }
@@ -1632,6 +1627,7 @@ bool MatchTableMulti::buildMatchTable(MatchPositionTranslator& getMatchPos)
 
 
 
+  cerr << "buildMatchTable: " << buildTimer << endl;
   return true;
 }
 
@@ -1645,7 +1641,8 @@ void MatchTableMulti::printSquash( OligoSource& oligos,
 				   const string& directoryName,
 				   const bool& align )
 {
-  ofstream match_out( this->outputFileName_.c_str() );
+  ofstream match_out( this->outputFileName_.c_str(),
+                      (this->firstOligo_ ? (ios_base::out|ios_base::app) : ios_base::out) );
   oligos.rewind();
   const char* strlen_oligo;
   // first, deduce the oligo length (nb: the parameter oligoLength contains the length of the seed)
@@ -1713,6 +1710,9 @@ void MatchTableMulti::printSquash( OligoSource& oligos,
 
   oligos.rewind();
 
+  // the prefix and read number of the read names, when the oligo source
+  // provides ReadNames: see MatchRequest
+  ReadName sourceName;
   vector< MatchRequest > matches;
   vector<SeqRequest> frag_requests;
   vector<char*> reads;
@@ -1749,7 +1749,8 @@ void MatchTableMulti::printSquash( OligoSource& oligos,
 			      frag_requests,
 			      reads,
 			      readLength,
-			      fragmentLength
+			      fragmentLength,
+			      numThreads_
 			      ) == false )
 	  {
 	    // do nothing for the moment
@@ -1781,15 +1782,33 @@ void MatchTableMulti::printSquash( OligoSource& oligos,
 
     MatchRequest cur_mr;
 
-    cur_mr.header_ = string(oligos.getLastName());
-    cur_mr.read_   = string(pOligo);
+    // names given as ReadNames are written from their fields and only
+    // formatted when the request is printed
+    const ReadName* pReadName(oligos.getLastReadName());
+    if (pReadName!=NULL)
+    {
+      if (sourceName.prefix_.empty())
+      {
+        sourceName.prefix_=pReadName->prefix_;
+        sourceName.readNumber_=pReadName->readNumber_;
+      } // ~if
+      cur_mr.pName_=&sourceName;
+      cur_mr.nameFields_=*pReadName;
+      sourceName.print(this->pOut_, cur_mr.nameFields_);
+    } // ~if
+    else
+    {
+      cur_mr.header_.assign(oligos.getLastName());
+      fputs(cur_mr.header_.c_str(), this->pOut_);
+    } // ~else
+    cur_mr.read_.assign(pOligo);
     cur_mr.matchMode_ = -1;
 
     reads.push_back( new char[readLength+1] );
     strncpy( reads[ reads.size()-1 ],pOligo,readLength );
     reads[ reads.size()-1 ][readLength] = '\0';
 
-    fprintf( this->pOut_, "%s\t%s\t", oligos.getLastName(), pOligo );
+    fprintf( this->pOut_, "\t%s\t", pOligo );
 
     if (this->matchPosition_[i]>=blockRepeat)
     {
@@ -1806,8 +1825,8 @@ void MatchTableMulti::printSquash( OligoSource& oligos,
         else
         {
             cur_mr.matchMode_ = 2;
-            cur_mr.rb_position_ = this->matchPosition_[i]-blockRepeat;
-            fprintf( this->pOut_,"RB\t%u", this->matchPosition_[i]-blockRepeat);
+            cur_mr.rb_position_ = this->matchPosition_[i]-blockRepeat+this->firstOligo_;
+            fprintf( this->pOut_,"RB\t%u", (uint)(this->matchPosition_[i]-blockRepeat+this->firstOligo_));
         }
     }
     else
@@ -1822,7 +1841,7 @@ void MatchTableMulti::printSquash( OligoSource& oligos,
 
         if( (nbors0==0)&&(nbors1==0)&&(nbors2==0) )
         {
-            assert(multiMatch_[i].size()==0);
+            assert(multiMatch_.size(i)==0);
         }
 
         if ((nbors0==0)&&(nbors1==0)&&(nbors2==0))
@@ -1846,18 +1865,19 @@ void MatchTableMulti::printSquash( OligoSource& oligos,
         //	     ((numErrors==0)?((uint)this->matchType_[i].r[0]):0),
         //	     ((numErrors<=1)?((uint)this->matchType_[i].r[1]):0),
         //	     (uint)this->matchType_[i].r[2] );
-        sort(multiMatch_[i].begin(),multiMatch_[i].end());
+        const MultiMatchTable::iterator pMatches(multiMatch_.begin(i));
+        sort(pMatches,multiMatch_.end(i));
 
         previousChromName=NULL;
 
  
-        for (uint j(0); j<multiMatch_[i].size(); ++j)
+        for (uint j(0); j<multiMatch_.size(i); ++j)
         {
-            const char dirChar=multiMatch_[i][j].reverse_ ? 'R':'F';
+            const char dirChar=pMatches[j].reverse_ ? 'R':'F';
 
             // offset of the matched seed from the seed 0
-            const MatchPosition seedOffset = allSeedOffsets[multiMatch_[i][j].lastSeed_];
-            MatchPosition seedPos(multiMatch_[i][j].pos_);
+            const MatchPosition seedOffset = allSeedOffsets[pMatches[j].lastSeed_];
+            MatchPosition seedPos(pMatches[j].pos_);
 
             // determine the number of leading Ns that overlap the first seed
             unsigned int noLeadingNs = 0;
@@ -1866,7 +1886,7 @@ void MatchTableMulti::printSquash( OligoSource& oligos,
                 noLeadingNs++;
             }
 
-            if (multiMatch_[i][j].reverse_)
+            if (pMatches[j].reverse_)
             {
                 seedPos -= seedOffset;
             }
@@ -1874,17 +1894,17 @@ void MatchTableMulti::printSquash( OligoSource& oligos,
             {
                 seedPos += seedOffset;
             }
-//            std::cerr << "extracting " << seedPos << " seed " << (int)multiMatch_[i][j].lastSeed_
+//            std::cerr << "extracting " << seedPos << " seed " << (int)pMatches[j].lastSeed_
 //                << " seedOffset " << (int)seedOffset
-//                << " reverse " << (int)multiMatch_[i][j].reverse_
-//                << " errors " << (int)multiMatch_[i][j].errors_
+//                << " reverse " << (int)pMatches[j].reverse_
+//                << " errors " << (int)pMatches[j].errors_
 //                << " read " << cur_mr.read_ << std::endl;
             getMatchPos( seedPos, extractedChromName, extractedContigName, extractedMatchPos);
 //            std::cerr << "extracted " << seedPos << " " << extractedChromName
 //                << " " << extractedContigName << " " <<extractedMatchPos << std::endl;
             // now the extractedMatchPos contains the position of the matched seed in the
             // corresponding contig. Adjust it back to be in respect to the seed 0 position
-            if (multiMatch_[i][j].reverse_)
+            if (pMatches[j].reverse_)
             {
                 extractedMatchPos += seedOffset;
             }
@@ -1958,7 +1978,7 @@ void MatchTableMulti::printSquash( OligoSource& oligos,
                                    );
 
             fprintf( this->pOut_,"%u%c%u",
-                     extractedMatchPos,
+                     (uint)extractedMatchPos,
                      dirChar,
                      numErrors );
             request_cnt++;
@@ -1987,7 +2007,8 @@ void MatchTableMulti::printSquash( OligoSource& oligos,
 			frag_requests,
 			reads,
 			readLength,
-			fragmentLength
+			fragmentLength,
+			numThreads_
 			) == false )
     {
       // do nothing for the moment
@@ -2001,13 +2022,11 @@ void MatchTableMulti::printSquash( OligoSource& oligos,
 bool MatchTableMulti::clear(void)
 {
     // clearing vectors
-    vector< vector<MultiMatch> > tmp_mm;
     vector<MatchDescriptor> tmp_md;
 
     multiMatch_.clear();
     this->matchType_.clear();
 
-    this->multiMatch_.swap(tmp_mm);
     this->matchType_.swap(tmp_md);
 
     return true;
@@ -2021,7 +2040,7 @@ bool MatchTableMulti::mergeTable( MatchTable* source,MatchPositionTranslator& ge
 {
     MatchTableMultiSquareSeed* source_multi = static_cast<MatchTableMultiSquareSeed*>(source);
 
-    vector< vector<MultiMatch> > multimatches_second_tier;
+    MultiMatchTable multimatches_second_tier;
     vector<MatchDescriptor> matchdescriptor_second_tier;
 
     // build up the match table
@@ -2040,22 +2059,26 @@ bool MatchTableMulti::mergeTable( MatchTable* source,MatchPositionTranslator& ge
         if( multiMatch_.size()==0 )
             multiMatch_.resize( this->matchPosition_.size());
 
-        // merge the information obtained from the multiseed pass into the current object
+        // merge the information obtained from the multiseed pass into the
+        // current object; translator_ is increasing, so the translated
+        // matches fill their table in oligo order
+        MultiMatchTable translated;
+        translated.reserve( multimatches_second_tier.getNumMatches() );
         for( uint i=1;i<multimatches_second_tier.size();i++ )
         {
             if( matchdescriptor_second_tier[i].r[0] == 0 &&
                 matchdescriptor_second_tier[i].r[1] == 0 &&
                 matchdescriptor_second_tier[i].r[2] == 0 )
             {
-                assert( multimatches_second_tier[i].size() == 0 );
+                assert( multimatches_second_tier.size(i) == 0 );
             }
 
 
-            if( multimatches_second_tier[i].size() > 0 )
+            if( multimatches_second_tier.size(i) > 0 )
             {
-                this->multiMatch_[ this->translator_[i] ].insert( this->multiMatch_[this->translator_[i]].end(),
-                                                      multimatches_second_tier[i].begin(),
-                                                      multimatches_second_tier[i].end() );
+                translated.insert( this->translator_[i],
+                                   multimatches_second_tier.begin(i),
+                                   multimatches_second_tier.end(i) );
             }
             this->matchType_[ this->translator_[i] ].errorType = matchdescriptor_second_tier[i].errorType;
             this->matchType_[ this->translator_[i] ].r[0] = matchdescriptor_second_tier[i].r[0];
@@ -2066,15 +2089,17 @@ bool MatchTableMulti::mergeTable( MatchTable* source,MatchPositionTranslator& ge
                 this->matchType_[this->translator_[i]].r[1] == 0 &&
                 this->matchType_[this->translator_[i]].r[2] == 0 )
             {
-                assert( this->multiMatch_[this->translator_[i]].size() == 0 );
+                assert( this->multiMatch_.size(this->translator_[i])
+                        + multimatches_second_tier.size(i) == 0 );
             }
 
         }
+        this->multiMatch_.merge( translated );
+        this->multiMatch_.resize( this->matchPosition_.size() );
 
     }
 
     // clearing vectors
-    vector< vector<MultiMatch> > tmp_mm;
     vector<MatchDescriptor> tmp_md;
     vector<uint> tmp_translator;
 
@@ -2082,7 +2107,6 @@ bool MatchTableMulti::mergeTable( MatchTable* source,MatchPositionTranslator& ge
     matchdescriptor_second_tier.clear();
     this->translator_.clear();
 
-    multimatches_second_tier.swap(tmp_mm);
     matchdescriptor_second_tier.swap(tmp_md);
     this->translator_.swap(tmp_translator);
 
@@ -2093,10 +2117,11 @@ bool MatchTableMulti::mergeTable( MatchTable* source,MatchPositionTranslator& ge
 
 // retrieve the match information from the second pass to merge it
 // with the MatchTableMulti object of the singleseed run
-bool MatchTableMulti::getMatchInformation( vector< vector<MultiMatch> >& multimatches,vector<MatchDescriptor>& matchdescriptor )
+bool MatchTableMulti::getMatchInformation( MultiMatchTable& multimatches,vector<MatchDescriptor>& matchdescriptor )
 {
-    // fill the return objects
-    multimatches = multiMatch_;
+    // fill the return objects; the matches are handed over rather than copied
+    multimatches.clear();
+    multimatches.swap(multiMatch_);
     matchdescriptor = this->matchType_;
 //    matchdescriptor = seedsToMatch.matchType_;
 
@@ -2129,26 +2154,14 @@ addMatch(MatchIter i, const MatchIter i_end)
 
 
       if( checkNumberOfHits( oligoNum,seedNo,i->numErrors ) ) {
-          // TBD: cache then bulk write
           const uint32_t matchCode((i->numErrors<<30)|
                      (((i->position&isReverseOligo)!=0)<<29)|
                      (seedNo<<27)|oligoNum);
           ++this->matchesStored_;
-
-          if( 1 != fwrite (&matchCode,sizeof(uint),1,this->pOligoNum_) )
-          {
-              cerr << "error writing match code to temp file." << endl;
-          }
-          if( 1 != fwrite (&(i->matchPos),sizeof(MatchPosition),1,this->pMatchType_) )
-          {
-              cerr << "error writing match pos to temp file." << endl;
-          }
+          this->hits_.add(matchCode,i->matchPos);
       }
   }
 
-#if (NUM_THREADS>1)
-      pthread_mutex_unlock(&mutex_);
-#endif
 }
 
 //void MatchTableMultiSquareSeed::print( OligoSource& oligos,
@@ -2187,7 +2200,7 @@ bool MatchTableMultiSquareSeed::mergeTable( MatchTable* source,MatchPositionTran
 {
     MatchTableMultiSquareSeed* source_multiseed = static_cast<MatchTableMultiSquareSeed*>(source);
 
-    vector< vector<MultiMatch> > multimatches_second_tier;
+    MultiMatchTable multimatches_second_tier;
     vector<MatchDescriptor> matchdescriptor_second_tier;
 
     // build up the match table
@@ -2206,22 +2219,26 @@ bool MatchTableMultiSquareSeed::mergeTable( MatchTable* source,MatchPositionTran
         if( this->multiMatch_.size()==0 )
           this->multiMatch_.resize( this->matchPosition_.size());
 
-        // merge the information obtained from the multiseed pass into the current object
+        // merge the information obtained from the multiseed pass into the
+        // current object; translator_ is increasing, so the translated
+        // matches fill their table in oligo order
+        MultiMatchTable translated;
+        translated.reserve( multimatches_second_tier.getNumMatches() );
         for( uint i=1;i<multimatches_second_tier.size();i++ )
         {
             if( matchdescriptor_second_tier[i].r[0] == 0 &&
                 matchdescriptor_second_tier[i].r[1] == 0 &&
                 matchdescriptor_second_tier[i].r[2] == 0 )
             {
-                assert( multimatches_second_tier[i].size() == 0 );
+                assert( multimatches_second_tier.size(i) == 0 );
             }
 
 
-            if( multimatches_second_tier[i].size() > 0 )
+            if( multimatches_second_tier.size(i) > 0 )
             {
-                this->multiMatch_[ this->translator_[i] ].insert( this->multiMatch_[this->translator_[i]].end(),
-                                                      multimatches_second_tier[i].begin(),
-                                                      multimatches_second_tier[i].end() );
+                translated.insert( this->translator_[i],
+                                   multimatches_second_tier.begin(i),
+                                   multimatches_second_tier.end(i) );
             }
             this->matchType_[ this->translator_[i] ].errorType = matchdescriptor_second_tier[i].errorType;
             this->matchType_[ this->translator_[i] ].r[0] = matchdescriptor_second_tier[i].r[0];
@@ -2232,15 +2249,17 @@ bool MatchTableMultiSquareSeed::mergeTable( MatchTable* source,MatchPositionTran
                 this->matchType_[this->translator_[i]].r[1] == 0 &&
                 this->matchType_[this->translator_[i]].r[2] == 0 )
             {
-                assert( this->multiMatch_[this->translator_[i]].size() == 0 );
+                assert( this->multiMatch_.size(this->translator_[i])
+                        + multimatches_second_tier.size(i) == 0 );
             }
 
         }
+        this->multiMatch_.merge( translated );
+        this->multiMatch_.resize( this->matchPosition_.size() );
 
     }
 
     // clearing vectors
-    vector< vector<MultiMatch> > tmp_mm;
     vector<MatchDescriptor> tmp_md;
     vector<uint> tmp_translator;
 
@@ -2248,7 +2267,6 @@ bool MatchTableMultiSquareSeed::mergeTable( MatchTable* source,MatchPositionTran
     matchdescriptor_second_tier.clear();
     this->translator_.clear();
 
-    multimatches_second_tier.swap(tmp_mm);
     matchdescriptor_second_tier.swap(tmp_md);
     this->translator_.swap(tmp_translator);
 
@@ -2258,22 +2276,15 @@ bool MatchTableMultiSquareSeed::mergeTable( MatchTable* source,MatchPositionTran
 
 bool MatchTableMultiSquareSeed::buildMatchTable( MatchPositionTranslator& getMatchPos )
 {
-  cerr << "Info: " << this->matchesStored_
-       << " matches were stored" << endl;
-  cerr << "Info: " << ftell(this->pOligoNum_)
-       << " bytes of temp storage used for oligo numbers"
-       << endl;
-  cerr << "Info: " << ftell(this->pMatchType_)
-       << " bytes of temp storage used for match positions"
-       << endl;
+  Timer buildTimer;
+  this->reportHitStorage();
 
   if (!this->matchesStored_)
   {
       return false;
   }
 
-  fseek( this->pOligoNum_, 0, SEEK_SET);
-  fseek( this->pMatchType_, 0, SEEK_SET);
+  this->hits_.rewind();
 
   // firing up the state machinery
   uint table_size = this->matchPosition_.size();
@@ -2304,29 +2315,13 @@ bool MatchTableMultiSquareSeed::buildMatchTable( MatchPositionTranslator& getMat
 
   int update_cnt = 0;
 
-  vector< vector< vector<bool> > > touched( table_size,vector< vector<bool> >( this->no_of_seeds_, vector<bool>(3,false ) ) );
+  // bit n set for the oligos with n-error hits inserted, whatever the seed
+  vector<unsigned char> touched( table_size,0 );
 
 
-  while (1)
+  while (this->hits_.getNext(thisCode, thisPos))
   {
       oligonums_read++;
-      if (1 != fread( &thisCode, sizeof(uint), 1, this->pOligoNum_))
-      {
-          const int currentError = errno;
-          if (feof(this->pOligoNum_)!=0)
-          {
-              break;
-          }
-          else
-          {
-              BOOST_THROW_EXCEPTION(cc::IoException(currentError, "failed to read Oligo Num"));
-          }
-      }
-
-      if (1 != fread( &thisPos, sizeof(MatchPosition), 1, this->pMatchType_))
-      {
-          BOOST_THROW_EXCEPTION(cc::IoException(errno, "failed to read Match Type"));
-      }
 
       numErrors=(thisCode>>30)&0x3;
       //reverseFlag=(((thisCode>>29)&0x1)!=0);
@@ -2359,43 +2354,36 @@ bool MatchTableMultiSquareSeed::buildMatchTable( MatchPositionTranslator& getMat
       {
           //      this->multiMatch_[thisOligo].push_back( MultiMatch( thisPos, thisType ) );
           seedsToMatch.insertSeedHit( thisPos,thisCode,update_cnt,getMatchPos );
-          touched[thisOligo][seedNo][numErrors] = true;
+          touched[thisOligo] |= (1<<numErrors);
       }
   } // ~while
 
-  // resize the this->multiMatch_ table
-  if( this->multiMatch_.size() == 0 )
-      this->multiMatch_.resize( table_size );
-
-  // building up the multiMatch table
-  for( uint i=1;i<table_size;i++ )
+  // building up the this->multiMatch_ table, after the matches it already holds
   {
-      //      list<MultiMatch> l = seedsToMatch.getHits(i,maxNumMatchesExact_);
-      list<MultiMatch> l = seedsToMatch.getHits(i,10000, this->hyperhyper_.empty()); // 10000 is only an arbitrary high value such that we do not cut any (had the check above)
-
-      // TODO: MB 09/11/12
-      //
-      // parse the hits, if all the hits have the same number of seed
-      // hits, then check if the number of hits < default_number; if
-      // some hits have more seed matches than the others, only take
-      // the hits having showing the most seed hits
-      if( l.size()>0 )
+      MultiMatchTable hits;
+      hits.reserve( seedsToMatch.getNumStates() );
+      for( uint i=1;i<table_size;i++ )
       {
-          this->multiMatch_[i].insert( this->multiMatch_[i].end(), l.begin(),l.end() );
-          seedsToMatch.clear(i);
+          //      seedsToMatch.getHits(i,maxNumMatchesExact_,hits);
+          seedsToMatch.getHits(i,10000, this->hyperhyper_.empty(), hits); // 10000 is only an arbitrary high value such that we do not cut any (had the check above)
+
+          // TODO: MB 09/11/12
+          //
+          // parse the hits, if all the hits have the same number of seed
+          // hits, then check if the number of hits < default_number; if
+          // some hits have more seed matches than the others, only take
+          // the hits having showing the most seed hits
       }
+      this->multiMatch_.merge( hits );
+      this->multiMatch_.resize( table_size );
+  }
 
+  for( uint i=1;i<table_size;i++ )
+  {
       seedsToMatch.matchType_[i].errorType = ms_matchType_[i].errorType;
 
-      // iterate over touched, because now we have it various
-      vector<bool> cumulative_touched(3,false);
-
-      for( short j=0;j<3;j++ )
-          for( short k=0;k<this->no_of_seeds_;k++ )
-          {
-              // cumulative touch for 0/1/2 error matches
-              cumulative_touched[j] = ( cumulative_touched[j] || touched[i][k][j] );
-          }
+      // touched sums up the seeds already, for 0/1/2 error matches
+      const bool cumulative_touched[3] = { (touched[i]&1)!=0, (touched[i]&2)!=0, (touched[i]&4)!=0 };
 
       if( cumulative_touched[0] == false )
       {
@@ -2440,7 +2428,7 @@ bool MatchTableMultiSquareSeed::buildMatchTable( MatchPositionTranslator& getMat
           (this->matchType_[i].r[2]==0) )
       {
 
-          assert(this->multiMatch_[i].size()==0);
+          assert(this->multiMatch_.size(i)==0);
       }
 
   }
@@ -2451,6 +2439,7 @@ bool MatchTableMultiSquareSeed::buildMatchTable( MatchPositionTranslator& getMat
 
 
 
+  cerr << "buildMatchTable: " << buildTimer << endl;
   return true;
 }
 
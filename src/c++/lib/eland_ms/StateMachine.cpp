@@ -43,7 +43,7 @@ bool StateMachine::insertSeedHit( const MatchPosition& thisPos, const MatchPosit
   uchar seedNo=(thisCode>>27)&0x3;
   uint thisOligo=thisCode&(((uint)~0)>>5);
 
-  assert( thisOligo < states_.size() );
+  assert( thisOligo < matchType_.size() );
 
   // check if the position allows for the seed extension
   MatchPosition corrected_pos(0);
@@ -56,7 +56,7 @@ bool StateMachine::insertSeedHit( const MatchPosition& thisPos, const MatchPosit
                corrected_pos );
 
   // correct for the offset within the
-  uint adapted_position = 0;
+  MatchPosition adapted_position = 0;
   if( reverseFlag == 0 )
   {
       if( corrected_pos <= (MatchPosition)(seedOffsets_[seedNo]) )
@@ -84,11 +84,16 @@ bool StateMachine::insertSeedHit( const MatchPosition& thisPos, const MatchPosit
       }
   }
 
-  int existing_idx = -1;
-  for( int i=states_[thisOligo].size()-1;i>=0;i-- )
+  // start the seed matches of this oligo at the end of the table
+  assert( thisOligo+1 >= stateStarts_.size() );
+  stateStarts_.resize( thisOligo+1, states_.size() );
+  const long stateBegin( stateStarts_[thisOligo] );
+
+  long existing_idx = -1;
+  for( long i=states_.size()-1;i>=stateBegin;i-- )
   {
-      if( ( abs( (int)(states_[thisOligo][i].pos_ - adapted_position) ) <= seedNo*SEED_DEVIATION ) &&
-              states_[thisOligo][i].reverse_ == reverseFlag )
+      if( ( abs( (MatchPositionDifference)(states_[i].pos_ - adapted_position) ) <= seedNo*SEED_DEVIATION ) &&
+              states_[i].reverse_ == reverseFlag )
       {
           // also check if we have the hits are on the same strand
           // we found a hit that is being extended
@@ -102,11 +107,11 @@ bool StateMachine::insertSeedHit( const MatchPosition& thisPos, const MatchPosit
       // update matchType_.r[numError] correspondingly
       matchType_[thisOligo].r[numErrors]++;
       // insert the actual hit
-      states_[thisOligo].push_back( SeedMatch(adapted_position, numErrors, reverseFlag, seedNo) );
+      states_.push_back( SeedMatch(adapted_position, numErrors, reverseFlag, seedNo) );
 //      std::cerr << "new seed match added " << thisOligo << " pos " << adapted_position
-//               << " idx " << (int)states_[thisOligo].size()-1
+//               << " idx " << (int)(states_.size()-stateBegin-1)
 //               << " errors " << (int)numErrors
-//               << " new errors " << (int)states_[thisOligo].back().errors_
+//               << " new errors " << (int)states_.back().errors_
 //               << " reverse " << (int)reverseFlag
 //               << " seed " << (int)seedNo
 //               << std::endl;
@@ -114,7 +119,7 @@ bool StateMachine::insertSeedHit( const MatchPosition& thisPos, const MatchPosit
   else
   {
       // update the hit that we found
-      SeedMatch & tmp_type(states_[thisOligo][existing_idx]);
+      SeedMatch & tmp_type(states_[existing_idx]);
 
       // if the new seed hit has a lower number of errors, then update
       // the matchType_ entry, otherwise do nothing (if the number of
@@ -122,7 +127,7 @@ bool StateMachine::insertSeedHit( const MatchPosition& thisPos, const MatchPosit
       if( numErrors < tmp_type.errors_ )
       {
 //          std::cerr << "seed match extended " << thisOligo << " pos "  << adapted_position
-//                   << " ori pos " << (int)states_[thisOligo][existing_idx].pos_
+//                   << " ori pos " << (int)states_[existing_idx].pos_
 //                   << " idx " << (int)existing_idx
 //                   << " errors " << (int)numErrors
 //                   << " old errors " << (int)tmp_type.errors_
@@ -140,7 +145,7 @@ bool StateMachine::insertSeedHit( const MatchPosition& thisPos, const MatchPosit
       else
       {
 //          std::cerr << "seed match not extended " << thisOligo << " pos "  << adapted_position
-//                   << " ori pos " << (int)states_[thisOligo][existing_idx].pos_
+//                   << " ori pos " << (int)states_[existing_idx].pos_
 //                   << " idx " << (int)existing_idx
 //                   << " errors " << (int)numErrors
 //                   << " old errors " << (int)tmp_type.errors_
@@ -159,50 +164,53 @@ bool StateMachine::insertSeedHit( const MatchPosition& thisPos, const MatchPosit
 }
 
 
-void StateMachine::clear( const OligoNumber& oligo )
+void StateMachine::clear( void )
 {
   vector<SeedMatch> tmp;
-  states_[oligo].swap(tmp);
+  states_.swap( tmp );
+  vector<boost::uint64_t> tmpStarts;
+  stateStarts_.swap( tmpStarts );
 }
 
 
-void StateMachine::clear( void )
+void StateMachine::getStates( const uint oligo, size_t& begin, size_t& end ) const
 {
-  vector< vector<SeedMatch> > tmp;
-  states_.swap( tmp );
+  begin = ( oligo < stateStarts_.size() ) ? stateStarts_[oligo] : states_.size();
+  end = ( oligo+1 < stateStarts_.size() ) ? stateStarts_[oligo+1] : states_.size();
 }
 
 
-list<MultiMatch> StateMachine::getHits( const OligoNumber& oligo, int maxItems, int seedNumberBase)
+void StateMachine::getHits( const OligoNumber& oligo, int maxItems, int seedNumberBase, MultiMatchTable& hits )
 {
   // mask the upper five bits (encode R/F/seed/errors)
   uint thisOligo=oligo&(((uint)~0)>>5);
 
-  list<MultiMatch> l;
-
-  // sort the hits that we found by some criterion, output the first x hits
-  sort( states_[thisOligo].begin(),states_[thisOligo].end() );
+  size_t stateBegin, stateEnd;
+  getStates( thisOligo, stateBegin, stateEnd );
 
   // exit if there's nothing to return
-  if( states_[thisOligo].empty() )
-	return l;
+  if( stateBegin == stateEnd )
+	return;
+
+  // sort the hits that we found by some criterion, output the first x hits
+  const vector<SeedMatch>::iterator first( states_.begin()+stateBegin );
+  const vector<SeedMatch>::iterator last( states_.begin()+stateEnd );
+  sort( first,last );
 
   // detect the maximal number of seed hits
-  const unsigned int maxNumSeeds( states_[thisOligo].back().seeds_);
+  const unsigned int maxNumSeeds( (last-1)->seeds_);
 //  std::cerr << "max num seeds: " << maxNumSeeds << " oligo " << thisOligo << std::endl;
 
-  for( vector<SeedMatch>::const_reverse_iterator rit = states_[thisOligo].rbegin();
-      rit != states_[thisOligo].rend() && rit->seeds_ >= maxNumSeeds && maxItems;
+  for( vector<SeedMatch>::const_reverse_iterator rit( last ), rend( first );
+      rit != rend && rit->seeds_ >= maxNumSeeds && maxItems;
       ++rit, --maxItems )
   {
 //      std::cerr << " pushing " << rit->pos_
 //                << " errors " << (int)rit->errors_ << " lastSeed " << (int)rit->lastSeed_ + seedNumberBase
 //                << " reverse " << (int)rit->reverse_ << std::endl;
       // add 1 to our seed number as multiseed numbers begin from 1 (0 is reserved for singleseed matches)
-      l.push_back( MultiMatch(rit->pos_,rit->errors_, rit->lastSeed_ + seedNumberBase, rit->reverse_) );
+      hits.push_back( thisOligo, MultiMatch(rit->pos_,rit->errors_, rit->lastSeed_ + seedNumberBase, rit->reverse_) );
   }
-
-  return l;
 }
 
 
@@ -57,7 +57,7 @@ uint16_t AlignmentQuality::CalculateAlignmentQualityFromNeighbors(const string&
     // subtract the # of matched fragments from the neighbor counts
     uint32_t currentError = 0;
     while((numAlignments > 0) && (currentError < 3)) {
-        while((errorCounts[currentError] == 0) && (currentError < 3)) ++currentError;
+        while((currentError < 3) && (errorCounts[currentError] == 0)) ++currentError;
         if(currentError < 3) {
             --errorCounts[currentError];
             --numAlignments;
@@ -66,13 +66,12 @@ uint16_t AlignmentQuality::CalculateAlignmentQualityFromNeighbors(const string&
 
     // use the two worst base qualities in the seed and the seed error counts
     // to normalize the alignment quality
-    string qualitiesCopy = qualities.c_str();
     if((errorCounts[0] + errorCounts[1] + errorCounts[2]) > 0) {
 
-        unsigned char* pQualities = (unsigned char*)qualitiesCopy.data();
-        sort(pQualities, pQualities + seedLength);
+        uint8_t worstQuality, secondWorstQuality;
+        GetWorstSeedQualities(qualities, seedLength, worstQuality, secondWorstQuality);
 
-        double worstPcorrect[3] = { 0, mMismatchCorrection[pQualities[0] - PHRED_BQ_OFFSET], mMismatchCorrection[pQualities[1] - PHRED_BQ_OFFSET] };
+        double worstPcorrect[3] = { 0, mMismatchCorrection[worstQuality - PHRED_BQ_OFFSET], mMismatchCorrection[secondWorstQuality - PHRED_BQ_OFFSET] };
 
         for(uint8_t i = 0; i < 3; ++i) {
             baseLnPcorrect += worstPcorrect[i];
@@ -95,78 +94,44 @@ double AlignmentQuality::GetBaseLnPcorrect(const string& qualities) const {
     return baseLnPcorrect;
 }
 
-// retrieves a vector of mismatched base qualities
-void AlignmentQuality::GetMismatchBaseQualities(const string& qualities, const string& status, vector<uint8_t>& mismatchBaseQualities) const {
+// updates ln(Pcorrect) to account for mismatched bases
+double AlignmentQuality::UpdateLnPcorrect(const string& qualities, const string& status, const double baseLnPcorrect) const {
 
-    // initialize
-    uint32_t currentPos = 0;
-    uint32_t num;
-    string match;
-    string::const_iterator sEnd;
-    const char* pQualities = qualities.data();
+    double lnPcorrect = baseLnPcorrect;
 
-    // clear the mismatch vector
-    mismatchBaseQualities.clear();
+    // walk through the match descriptor and apply the mismatch correction to each mismatched base
+    uint32_t currentPos = 0;
+    const uint8_t* pQualities = (const uint8_t*)qualities.data();
+    const char* pStatus       = status.data();
+    const char* pStatusEnd    = pStatus + status.size();
 
-    for(string::const_iterator sIter = status.begin(); sIter != status.end(); ++sIter) {
+    while(pStatus != pStatusEnd) {
 
-        if(*sIter == '^') {
+        if(*pStatus == '^') {
 
             // skip over the INDELs
-            ++sIter;
-            if(isdigit(*sIter)) {
-                sEnd = sIter;
-                while((sEnd != status.end()) && (*sEnd != '$')) ++sEnd;
-                match = string(sIter, sEnd);
-                num = (uint32_t)atoi(match.c_str());
-                currentPos += num;
-                sIter = sEnd;
-            } else {
-                sEnd = sIter;
-                while((sEnd != status.end()) && (*sEnd != '$')) ++sEnd;
-                match = string(sIter, sEnd);
-                sIter = sEnd;
-            }
-
-        } else if(isdigit(*sIter)) {
+            ++pStatus;
+            uint32_t num = 0;
+            while((pStatus != pStatusEnd) && isdigit(*pStatus)) num = num * 10 + (*pStatus++ - '0');
+            currentPos += num;
+            while((pStatus != pStatusEnd) && (*pStatus != '$')) ++pStatus;
+            if(pStatus != pStatusEnd) ++pStatus;
+
+        } else if(isdigit(*pStatus)) {
 
             // handle digits
-            sEnd = sIter;
-            while((sEnd != status.end()) && isdigit(*sEnd)) ++sEnd;
-            match = string(sIter, sEnd);
-            num = (uint32_t)atoi(match.c_str());
+            uint32_t num = 0;
+            while((pStatus != pStatusEnd) && isdigit(*pStatus)) num = num * 10 + (*pStatus++ - '0');
             currentPos += num;
-            sIter = sEnd - 1;
 
-        } else {
+        } else if(isalpha(*pStatus)) {
 
             // handle characters
-            sEnd = sIter;
-            while((sEnd != status.end()) && isalpha(*sEnd)) ++sEnd;
-            match = string(sIter, sEnd);
-            for(uint32_t i = 0; i < (uint32_t)match.size(); ++i, ++currentPos) {
-                if(match[i] != 'N') {
-                    mismatchBaseQualities.push_back(pQualities[currentPos]);
-                }
-            }
-            sIter = sEnd - 1;
-        }
-    }
-}
-
-// updates ln(Pcorrect) to account for mismatched bases
-double AlignmentQuality::UpdateLnPcorrect(const string& qualities, const string& status, const double baseLnPcorrect) const {
-
-    double lnPcorrect = baseLnPcorrect;
-
-    // grab all of the mismatched base qualities
-    vector<uint8_t> mismatchBaseQualities;
-    GetMismatchBaseQualities(qualities, status, mismatchBaseQualities);
+            if(*pStatus != 'N') lnPcorrect += mMismatchCorrection[pQualities[currentPos] - PHRED_BQ_OFFSET];
+            ++currentPos;
+            ++pStatus;
 
-    // apply the mismatch correction
-    vector<uint8_t>::const_iterator mmbqIt;
-    for(mmbqIt = mismatchBaseQualities.begin(); mmbqIt != mismatchBaseQualities.end(); ++mmbqIt) {
-        lnPcorrect += mMismatchCorrection[*mmbqIt - PHRED_BQ_OFFSET];
+        } else ++pStatus;
     }
 
     return lnPcorrect;
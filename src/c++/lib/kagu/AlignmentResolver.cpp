@@ -194,58 +194,8 @@ void AlignmentResolver::DisplaySingleEndStatistics(SingleEndStatistics& s) {
         << totalReads << endl;
 }
 
-// returns the alignment with the highest alignment quality
-cc::CasavaAlignments::iterator AlignmentResolver::GetBestAlignment(cc::CasavaRead& cr, const double baseLnPcorrect, const double rogCorrection, const AlignmentQuality& aq, const uint32_t seedLength, const uint32_t numAlignments) {
-
-    // initialize
-    cc::CasavaAlignments::iterator alIter, bestIter;
-    double totalPcorrect  = rogCorrection;
-    double bestLnPcorrect = -DBL_MAX;
-    const uint32_t totalAlignments = (uint32_t)cr.Alignments.size(); // this is in contrast to numAlignments which might be spliced or genomic
-
-    // find the alignment with the highest ln(Pcorrect)
-    if(totalAlignments == 1) {
-
-        bestIter       = cr.Alignments.begin();
-        bestLnPcorrect = aq.UpdateLnPcorrect(cr.Qualities, bestIter->MatchDescriptor, baseLnPcorrect);
-
-    } else {
-
-        // store all of our scores
-        vector<double> lnPcorrectScores;
-        lnPcorrectScores.resize(totalAlignments);
-        vector<double>::iterator dIt          = lnPcorrectScores.begin();
-        vector<double>::const_iterator bestIt = dIt;
-
-        for(alIter = cr.Alignments.begin(); alIter != cr.Alignments.end(); ++alIter, ++dIt) {
-
-            *dIt = aq.UpdateLnPcorrect(cr.Qualities, alIter->MatchDescriptor, baseLnPcorrect);
-
-            if(*dIt > bestLnPcorrect) {
-                bestIter       = alIter;
-                bestIt         = dIt;
-                bestLnPcorrect = *dIt;
-            }
-        }
-
-        // add all of the non-best scores
-        // N.B. tried simply subtracting the bestLnPcorrect from the total, but rounding errors proved problematic
-        for(dIt = lnPcorrectScores.begin(); dIt != lnPcorrectScores.end(); ++dIt) {
-            if(dIt != bestIt) totalPcorrect += exp(*dIt);
-        }
-    }
-
-    // calculate the mate alignment quality for that alignment
-    cr.MateAlignmentQuality = aq.CalculateAlignmentQualityFromNeighbors(cr.Qualities, cr.SeedErrors, exp(bestLnPcorrect), totalPcorrect, numAlignments, baseLnPcorrect, seedLength);
-
-    // return the iterator to the best alignment
-    return bestIter;
-}
-
-// assigns the lower and upper bounds for the desired fragment length confidence interval
-void AlignmentResolver::GetFragmentLengthStatistics(FragmentLengthStatistics& fls) {
-
-    const double confidenceInterval = CalculateConfidenceIntervalPercentages();
+// streams the mates until the fragment length distribution converges
+void AlignmentResolver::EstimateFragmentLengthModel(FragmentLengthModel& flm) {
 
     // initialize the histograms (we have 8 possible ways of changing mate orientations and ordering)
     AlignmentModelHistograms histograms;
@@ -276,6 +226,7 @@ void AlignmentResolver::GetFragmentLengthStatistics(FragmentLengthStatistics& fl
     ReferenceMetadata metadata;
 
     bool initializedFragmentLengthStatistics = false;
+    FragmentLengthStatistics fls;
 
     while(mMate1Reader.GetNextRead(m1)) {
 
@@ -384,12 +335,147 @@ void AlignmentResolver::GetFragmentLengthStatistics(FragmentLengthStatistics& fl
     }
     cout << "finished (" << fixed << setprecision(1) << flsBenchmark.GetElapsedWallTime() << " s)." << endl << endl;
 
+    // store the fragment length model
+    flm.Statistics               = fls;
+    flm.AlignmentModel1          = ConfigSettings.AlignmentModel1;
+    flm.AlignmentModel2          = ConfigSettings.AlignmentModel2;
+    flm.NumFragmentsUsed         = (uint32_t)histograms[ConfigSettings.AlignmentModel1].size() + (uint32_t)histograms[ConfigSettings.AlignmentModel2].size();
+    flm.NumTestedFragments       = numTestedFragments;
+    flm.NumTestedUniqueFragments = numTestedUniqueFragments;
+    for(uint8_t i = 0; i < 8; ++i) flm.ModelCounts[i] = models[i].Count;
+}
+
+// writes the fragment length model and the parameters it was built with into an XML file
+void AlignmentResolver::ExportFragmentLengthModel(const string& filename, const Attributes_t& parameters, const FragmentLengthModel& flm) {
+
+    XmlTree out;
+
+    for(Attributes_t::const_iterator paramIter = parameters.begin(); paramIter != parameters.end(); ++paramIter) {
+        out.AddStr("FragmentLengthModel.Parameters." + paramIter->Name, paramIter->Value);
+    }
+
+    out.AddUInt("FragmentLengthModel.InsertSize.HighSD", flm.Statistics.HighStdDev);
+    out.AddUInt("FragmentLengthModel.InsertSize.LowSD", flm.Statistics.LowStdDev);
+    out.AddUInt("FragmentLengthModel.InsertSize.Max", flm.Statistics.Max);
+    out.AddUInt("FragmentLengthModel.InsertSize.Median", flm.Statistics.Median);
+    out.AddUInt("FragmentLengthModel.InsertSize.Min", flm.Statistics.Min);
+
+    out.AddUInt("FragmentLengthModel.AlignmentModels.Model1", flm.AlignmentModel1);
+    out.AddUInt("FragmentLengthModel.AlignmentModels.Model2", flm.AlignmentModel2);
+    for(uint8_t i = 0; i < 8; ++i) {
+        out.AddUInt((boost::format("FragmentLengthModel.AlignmentModels.Count%u") % (uint32_t)i).str(), flm.ModelCounts[i]);
+    }
+
+    out.AddUInt("FragmentLengthModel.Fragments.Tested", flm.NumTestedFragments);
+    out.AddUInt("FragmentLengthModel.Fragments.TestedUnique", flm.NumTestedUniqueFragments);
+    out.AddUInt("FragmentLengthModel.Fragments.Used", flm.NumFragmentsUsed);
+
+    out.Write(filename);
+}
+
+// collects everything the fragment length model depends on
+void AlignmentResolver::GetFragmentLengthModelParameters(Attributes_t& parameters) {
+
+    parameters.clear();
+    KeyValue kv;
+
+    // identify the ELAND extended files by their name, size and modification time
+    const string* alignmentFilenames[2] = { &ConfigSettings.Mate1AlignmentFilename, &ConfigSettings.Mate2AlignmentFilename };
+    for(uint32_t i = 0; i < 2; ++i) {
+        const string prefix = (boost::format("Mate%uAlignmentFile") % (i + 1)).str();
+        kv.Name = prefix;          kv.Value = *alignmentFilenames[i];                                                                 parameters.push_back(kv);
+        kv.Name = prefix + "Size"; kv.Value = boost::lexical_cast<string>(boost::filesystem::file_size(*alignmentFilenames[i]));       parameters.push_back(kv);
+        kv.Name = prefix + "Time"; kv.Value = boost::lexical_cast<string>(boost::filesystem::last_write_time(*alignmentFilenames[i])); parameters.push_back(kv);
+    }
+
+    ostringstream sb;
+    sb << setprecision(17) << ConfigSettings.NumStandardDeviations << ' ' << ConfigSettings.ConsistentPairsPercent;
+
+    kv.Name = "CircularReferences";      kv.Value = ConfigSettings.CircularReferences;                                          parameters.push_back(kv);
+    kv.Name = "FragmentLengthThreshold"; kv.Value = boost::lexical_cast<string>(ConfigSettings.FragmentLengthThreshold);        parameters.push_back(kv);
+    kv.Name = "Mate1ReadLength";         kv.Value = boost::lexical_cast<string>(mStatistics.Mate1ReadLength);                   parameters.push_back(kv);
+    kv.Name = "Mate2ReadLength";         kv.Value = boost::lexical_cast<string>(mStatistics.Mate2ReadLength);                   parameters.push_back(kv);
+    kv.Name = "ReferenceRenaming";       kv.Value = boost::lexical_cast<string>((int)ConfigSettings.ReferenceRenamingStrategy); parameters.push_back(kv);
+    kv.Name = "ReferenceSizeFile";       kv.Value = ConfigSettings.ReferenceSequenceSizeFilename;                               parameters.push_back(kv);
+    kv.Name = "StdDevsConsistentPairs";  kv.Value = sb.str();                                                                   parameters.push_back(kv);
+}
+
+// returns the alignment with the highest alignment quality
+cc::CasavaAlignments::iterator AlignmentResolver::GetBestAlignment(cc::CasavaRead& cr, const double baseLnPcorrect, const double rogCorrection, const AlignmentQuality& aq, const uint32_t seedLength, const uint32_t numAlignments) {
+
+    // initialize
+    cc::CasavaAlignments::iterator alIter, bestIter;
+    double totalPcorrect  = rogCorrection;
+    double bestLnPcorrect = -DBL_MAX;
+    const uint32_t totalAlignments = (uint32_t)cr.Alignments.size(); // this is in contrast to numAlignments which might be spliced or genomic
+
+    // find the alignment with the highest ln(Pcorrect)
+    if(totalAlignments == 1) {
+
+        bestIter       = cr.Alignments.begin();
+        bestLnPcorrect = aq.UpdateLnPcorrect(cr.Qualities, bestIter->MatchDescriptor, baseLnPcorrect);
+
+    } else {
+
+        // store all of our scores
+        vector<double> lnPcorrectScores;
+        lnPcorrectScores.resize(totalAlignments);
+        vector<double>::iterator dIt          = lnPcorrectScores.begin();
+        vector<double>::const_iterator bestIt = dIt;
+
+        for(alIter = cr.Alignments.begin(); alIter != cr.Alignments.end(); ++alIter, ++dIt) {
+
+            *dIt = aq.UpdateLnPcorrect(cr.Qualities, alIter->MatchDescriptor, baseLnPcorrect);
+
+            if(*dIt > bestLnPcorrect) {
+                bestIter       = alIter;
+                bestIt         = dIt;
+                bestLnPcorrect = *dIt;
+            }
+        }
+
+        // add all of the non-best scores
+        // N.B. tried simply subtracting the bestLnPcorrect from the total, but rounding errors proved problematic
+        for(dIt = lnPcorrectScores.begin(); dIt != lnPcorrectScores.end(); ++dIt) {
+            if(dIt != bestIt) totalPcorrect += exp(*dIt);
+        }
+    }
+
+    // calculate the mate alignment quality for that alignment
+    cr.MateAlignmentQuality = aq.CalculateAlignmentQualityFromNeighbors(cr.Qualities, cr.SeedErrors, exp(bestLnPcorrect), totalPcorrect, numAlignments, baseLnPcorrect, seedLength);
+
+    // return the iterator to the best alignment
+    return bestIter;
+}
+
+// assigns the lower and upper bounds for the desired fragment length confidence interval
+void AlignmentResolver::GetFragmentLengthStatistics(FragmentLengthStatistics& fls) {
+
+    const double confidenceInterval = CalculateConfidenceIntervalPercentages();
+
+    // use the cached fragment length model if it was built from the same inputs
+    FragmentLengthModel flm;
+    const string& modelFilename = ConfigSettings.FragmentLengthModelFilename;
+    Attributes_t parameters;
+    if(!modelFilename.empty()) GetFragmentLengthModelParameters(parameters);
+
+    if(!modelFilename.empty() && ImportFragmentLengthModel(modelFilename, parameters, flm)) {
+        cout << "- phase 1 of 2: using the fragment length distribution from " << modelFilename << "." << endl << endl;
+        ConfigSettings.AlignmentModel1 = flm.AlignmentModel1;
+        ConfigSettings.AlignmentModel2 = flm.AlignmentModel2;
+    } else {
+        EstimateFragmentLengthModel(flm);
+        if(!modelFilename.empty()) ExportFragmentLengthModel(modelFilename, parameters, flm);
+    }
+
+    fls = flm.Statistics;
+
     // apply the overrides
     if(ConfigSettings.ForceMinFragmentLength) fls.Min = ConfigSettings.MinFragmentLength;
     if(ConfigSettings.ForceMaxFragmentLength) fls.Max = ConfigSettings.MaxFragmentLength;
 
     // sanity check: did we have any reads?
-    if(numTestedFragments == 0) return;
+    if(flm.NumTestedFragments == 0) return;
 
     // display some statistics
     cout << "Fragment length statistics:" << endl;
@@ -399,15 +485,14 @@ void AlignmentResolver::GetFragmentLengthStatistics(FragmentLengthStatistics& fl
     cout << "Median:              " << fls.Median << " bp" << endl;
     cout << "Upper bound:         " << fls.Max    << " bp" << endl << endl;
 
-    mStatistics.NumFragmentsUsedInFragmentLengthDist = (uint32_t)histograms[ConfigSettings.AlignmentModel1].size()
-        + (uint32_t)histograms[ConfigSettings.AlignmentModel2].size();
+    mStatistics.NumFragmentsUsedInFragmentLengthDist = flm.NumFragmentsUsed;
 
     // --------------------------------------------------------
     // determine if we should use single-end resolution instead
     // --------------------------------------------------------
 
     // calculate the fraction of read fragments that are unique vs unique
-    const double numUniquePercentage = (double)numTestedUniqueFragments / (double)numTestedFragments;
+    const double numUniquePercentage = (double)flm.NumTestedUniqueFragments / (double)flm.NumTestedFragments;
     if(numUniquePercentage < ConfigSettings.UniquePairPercent) {
         cout << "- the unique read fragment percentage (" << fixed << setprecision(1)
             << numUniquePercentage * 100.0 << " %) was lower than the configured\n  threshold ("
@@ -422,9 +507,9 @@ void AlignmentResolver::GetFragmentLengthStatistics(FragmentLengthStatistics& fl
     uint32_t modelSum       = 0;
     for(uint8_t i = 0; i < 8; ++i) {
         if((i == ConfigSettings.AlignmentModel1) || (i == ConfigSettings.AlignmentModel2)) {
-            chosenModelSum += models[i].Count;
+            chosenModelSum += flm.ModelCounts[i];
         }
-        modelSum += models[i].Count;
+        modelSum += flm.ModelCounts[i];
     }
 
     const double consistentPairsPercentage = (double)chosenModelSum / (double)modelSum;
@@ -518,6 +603,67 @@ uint32_t AlignmentResolver::GetReferenceSequenceLengths(const string& filename)
     return aggregateLength;
 }
 
+// retrieves an unsigned integer from the XML tree. Returns false if the element is missing or malformed.
+static bool GetXmlUInt(XmlTree& xt, const string& key, uint32_t& value) {
+    Entries_t entries;
+    xt.GetElements(key, entries);
+    if(entries.size() != 1) return false;
+
+    try {
+        value = boost::lexical_cast<uint32_t>(entries[0].Value);
+    } catch(boost::bad_lexical_cast&) {
+        return false;
+    }
+
+    return true;
+}
+
+// reads a fragment length model written by ExportFragmentLengthModel. Returns false if the file
+// does not exist, is incomplete, or was built with different parameters.
+bool AlignmentResolver::ImportFragmentLengthModel(const string& filename, const Attributes_t& parameters, FragmentLengthModel& flm) {
+
+    if(!boost::filesystem::exists(filename)) return false;
+
+    XmlTree xt;
+    xt.Import(filename);
+
+    // make sure the model was built from the same inputs
+    Entries_t entries;
+    for(Attributes_t::const_iterator paramIter = parameters.begin(); paramIter != parameters.end(); ++paramIter) {
+        xt.GetElements("FragmentLengthModel.Parameters." + paramIter->Name, entries);
+        if((entries.size() != 1) || (entries[0].Value != paramIter->Value)) {
+            cout << "- the fragment length distribution in " << filename << " was built from different inputs and will be rebuilt." << endl;
+            return false;
+        }
+    }
+
+    uint32_t model1 = 0, model2 = 0;
+    bool isComplete = GetXmlUInt(xt, "FragmentLengthModel.InsertSize.HighSD", flm.Statistics.HighStdDev)
+        && GetXmlUInt(xt, "FragmentLengthModel.InsertSize.LowSD", flm.Statistics.LowStdDev)
+        && GetXmlUInt(xt, "FragmentLengthModel.InsertSize.Max", flm.Statistics.Max)
+        && GetXmlUInt(xt, "FragmentLengthModel.InsertSize.Median", flm.Statistics.Median)
+        && GetXmlUInt(xt, "FragmentLengthModel.InsertSize.Min", flm.Statistics.Min)
+        && GetXmlUInt(xt, "FragmentLengthModel.AlignmentModels.Model1", model1)
+        && GetXmlUInt(xt, "FragmentLengthModel.AlignmentModels.Model2", model2)
+        && GetXmlUInt(xt, "FragmentLengthModel.Fragments.Tested", flm.NumTestedFragments)
+        && GetXmlUInt(xt, "FragmentLengthModel.Fragments.TestedUnique", flm.NumTestedUniqueFragments)
+        && GetXmlUInt(xt, "FragmentLengthModel.Fragments.Used", flm.NumFragmentsUsed);
+
+    for(uint8_t i = 0; isComplete && (i < 8); ++i) {
+        isComplete = GetXmlUInt(xt, (boost::format("FragmentLengthModel.AlignmentModels.Count%u") % (uint32_t)i).str(), flm.ModelCounts[i]);
+    }
+
+    if(!isComplete || (model1 > 7) || (model2 > 7)) {
+        cout << "- the fragment length distribution in " << filename << " is incomplete and will be rebuilt." << endl;
+        return false;
+    }
+
+    flm.AlignmentModel1 = (uint8_t)model1;
+    flm.AlignmentModel2 = (uint8_t)model2;
+
+    return true;
+}
+
 // parses the circular references command line option and marks each specified reference as being circular
 void AlignmentResolver::MarkCircularReferences(void) {
 
@@ -609,47 +755,193 @@ bool AlignmentResolver::OpenAlignmentReaders(void) {
     return containsReads;
 }
 
-// resolves the mate-pair or paired-end reads
-void AlignmentResolver::ResolveFragments(const FragmentLengthStatistics& fls) {
+// reads, resolves, and writes the read fragments in batches. In each step, task 0 reads the next
+// batch, tasks 1 and 2 write the mate 1 and mate 2 records of the previous batch, and the remaining
+// tasks resolve slices of the current batch. Each batch is only touched by one stage per step.
+struct AlignmentResolver::FragmentPipeline {
+    AlignmentResolver& Resolver;
+    const FragmentLengthStatistics& FLS;
+    const AlignmentQuality& AQ;
+    ExportWriter& Mate1Writer;
+    ExportWriter& Mate2Writer;
+    AnomalyWriter* pAnomalyWriter;
+    const uint32_t NumSlices;
+
+    // the rest-of-genome corrections
+    const double Mate1Rog;
+    const double Mate2Rog;
+    const double TotalRog;
+
+    // our three batches, their position in the input and the roles they play in the current step
+    ResolvedFragments Batches[3];
+    uint32_t NumFragments[3];
+    uint64_t BatchIndices[3];
+    uint32_t ReadBatch;
+    uint32_t ResolveBatch;
+    uint32_t WriteBatch;
+    uint64_t NumBatchesRead;
+    bool IsInputDone;
+
+    // each resolver slice keeps its own statistics and reference lookup
+    vector<Statistics> SliceStatistics;
+    vector<string> SliceRefNames;
+    vector<ReferenceMetadata> SliceMetadata;
+
+    // the exception thrown for the earliest batch in the input
+    bool HasException;
+    uint32_t NumExceptions;
+    uint64_t ExceptionBatchIndex;
+    boost::exception_ptr Exception;
+    pthread_mutex_t ExceptionLock;
+
+    // constructor
+    FragmentPipeline(AlignmentResolver& resolver, const FragmentLengthStatistics& fls, const AlignmentQuality& aq,
+        ExportWriter& m1Writer, ExportWriter& m2Writer, AnomalyWriter* pAnomWriter, const uint32_t numSlices)
+        : Resolver(resolver)
+        , FLS(fls)
+        , AQ(aq)
+        , Mate1Writer(m1Writer)
+        , Mate2Writer(m2Writer)
+        , pAnomalyWriter(pAnomWriter)
+        , NumSlices(numSlices)
+        , Mate1Rog(CalculateRestOfGenomeCorrection(resolver.mStatistics.GenomeLength, resolver.mStatistics.Mate1ReadLength))
+        , Mate2Rog(CalculateRestOfGenomeCorrection(resolver.mStatistics.GenomeLength, resolver.mStatistics.Mate2ReadLength))
+        , TotalRog(CalculateRestOfGenomeCorrection(resolver.mStatistics.GenomeLength, resolver.mStatistics.Mate1ReadLength + resolver.mStatistics.Mate2ReadLength))
+        , ReadBatch(0)
+        , ResolveBatch(2)
+        , WriteBatch(1)
+        , NumBatchesRead(0)
+        , IsInputDone(false)
+        , SliceStatistics(numSlices)
+        , SliceRefNames(numSlices)
+        , SliceMetadata(numSlices)
+        , HasException(false)
+        , NumExceptions(0)
+        , ExceptionBatchIndex(0)
+    {
+        uninitialized_fill(NumFragments, NumFragments + 3, 0);
+        uninitialized_fill(BatchIndices, BatchIndices + 3, 0);
+        for(uint32_t i = 0; i < 3; ++i) Batches[i].resize(FRAGMENT_BATCH_SIZE);
+        pthread_mutex_init(&ExceptionLock, NULL);
+    }
 
-    // calculate the rest-of-genome correction
-    const double rog_mate1 = CalculateRestOfGenomeCorrection(mStatistics.GenomeLength, mStatistics.Mate1ReadLength);
-    const double rog_mate2 = CalculateRestOfGenomeCorrection(mStatistics.GenomeLength, mStatistics.Mate2ReadLength);
-    const double rog_total = CalculateRestOfGenomeCorrection(mStatistics.GenomeLength, mStatistics.Mate1ReadLength + mStatistics.Mate2ReadLength);
+    // destructor
+    ~FragmentPipeline(void) {
+        pthread_mutex_destroy(&ExceptionLock);
+    }
 
-    cout << "- phase 2 of 2: resolving read fragments... ";
-    cout.flush();
-    Timer resolveBenchmark;
+    // returns the number of tasks in each step
+    uint32_t GetNumTasks(void) const {
+        return 3 + NumSlices;
+    }
 
-    // open the export writers
-    ExportWriter m1Writer, m2Writer;
-    m1Writer.Open(ConfigSettings.Mate1ExportFilename);
-    m2Writer.Open(ConfigSettings.Mate2ExportFilename);
+    // returns true while there are fragments left to resolve or write
+    bool HasWork(void) const {
+        return (NumFragments[ResolveBatch] > 0) || (NumFragments[WriteBatch] > 0) || !IsInputDone;
+    }
 
-    // open the anomaly writer
-    const bool writeAnomalies = !ConfigSettings.AnomalyFilename.empty();
-    AnomalyWriter anomWriter;
-    if(writeAnomalies) anomWriter.Open(ConfigSettings.AnomalyFilename);
+    // rotates the batches: the one just read is resolved next, the one just resolved is written next
+    void Advance(void) {
 
-    // rewind both readers to the beginning
-    mMate1Reader.Rewind();
-    mMate2Reader.Rewind();
-    mMate1Reader.ProvideBaseQualities(true);
-    mMate2Reader.ProvideBaseQualities(true);
+        if(HasException) {
 
-    // set the discordance flag
-    const bool useDiscordantFragmentStrategy = ConfigSettings.UseDiscordantFragmentStrategy;
+            // if only reading failed, the batch that was just resolved is complete: write it
+            // out before giving up, so that the export files hold every fragment before the error
+            if((NumFragments[ResolveBatch] > 0) && (ExceptionBatchIndex > BatchIndices[ResolveBatch])) {
+                WriteBatch = ResolveBatch;
+                (*this)(1);
+                (*this)(2);
+            }
 
-    // create an instance of our alignment quality calculator
-    AlignmentQuality aq;
+            // if reading failed, the fragments read before the error are still complete:
+            // resolve and write them as well, unless that fails too
+            if((NumFragments[ReadBatch] > 0) && (ExceptionBatchIndex == BatchIndices[ReadBatch])) {
+                const uint32_t numExceptions = NumExceptions;
+                ResolveBatch = ReadBatch;
+                for(uint32_t task = 3; task < GetNumTasks(); ++task) (*this)(task);
+
+                if(NumExceptions == numExceptions) {
+                    WriteBatch = ReadBatch;
+                    (*this)(1);
+                    (*this)(2);
+                }
+            }
 
-    string refName;
-    ReferenceMetadata metadata;
+            // rethrow the exception of the earliest batch on the calling thread
+            boost::rethrow_exception(Exception);
+        }
 
-    cc::CasavaRead m1, m2;
-    cc::CasavaAlignments::const_iterator m1Iter, m2Iter, m1ResIter, m2ResIter;
+        NumFragments[WriteBatch] = 0;
+        const uint32_t readBatch = ReadBatch;
+        ReadBatch    = WriteBatch;
+        WriteBatch   = ResolveBatch;
+        ResolveBatch = readBatch;
+    }
 
-    while(mMate1Reader.GetNextRead(m1)) {
+    // executes a task
+    void operator()(const unsigned int task) {
+        try {
+            if(task == 0) {
+
+                if(!IsInputDone) {
+                    BatchIndices[ReadBatch] = NumBatchesRead++;
+                    Resolver.ReadFragments(Batches[ReadBatch], NumFragments[ReadBatch]);
+                    if(NumFragments[ReadBatch] < FRAGMENT_BATCH_SIZE) IsInputDone = true;
+                }
+
+            } else if(task == 1) {
+
+                const ResolvedFragments& batch = Batches[WriteBatch];
+                for(uint32_t i = 0; i < NumFragments[WriteBatch]; ++i) {
+                    WriteExportRecord(Mate1Writer, batch[i].Mate1, batch[i].Mate1Record, batch[i].Mate1Alignment, batch[i].Mate2, batch[i].Mate2Alignment);
+                }
+
+            } else if(task == 2) {
+
+                const ResolvedFragments& batch = Batches[WriteBatch];
+                for(uint32_t i = 0; i < NumFragments[WriteBatch]; ++i) {
+                    WriteExportRecord(Mate2Writer, batch[i].Mate2, batch[i].Mate2Record, batch[i].Mate2Alignment, batch[i].Mate1, batch[i].Mate1Alignment);
+                    if(pAnomalyWriter) pAnomalyWriter->WriteRead(batch[i].Mate1, batch[i].Mate2, batch[i].IsAnomalous);
+                }
+
+            } else {
+
+                const uint32_t slice = task - 3;
+                const uint32_t numFragments = NumFragments[ResolveBatch];
+                const uint32_t begin = (uint32_t)((uint64_t)numFragments * slice / NumSlices);
+                const uint32_t end   = (uint32_t)((uint64_t)numFragments * (slice + 1) / NumSlices);
+
+                ResolvedFragments& batch = Batches[ResolveBatch];
+                for(uint32_t i = begin; i < end; ++i) {
+                    Resolver.ResolveFragment(batch[i], FLS, Mate1Rog, Mate2Rog, TotalRog, AQ, SliceStatistics[slice], SliceRefNames[slice], SliceMetadata[slice]);
+                }
+            }
+        } catch(...) {
+
+            // keep the exception of the earliest batch: the reader task works on the latest
+            // batch, the writer tasks on the earliest one and the resolver tasks on the one between
+            const uint64_t batchIndex = BatchIndices[task == 0 ? ReadBatch : (task <= 2 ? WriteBatch : ResolveBatch)];
+
+            pthread_mutex_lock(&ExceptionLock);
+            ++NumExceptions;
+            if(!HasException || (batchIndex < ExceptionBatchIndex)) {
+                HasException        = true;
+                ExceptionBatchIndex = batchIndex;
+                Exception           = boost::current_exception();
+            }
+            pthread_mutex_unlock(&ExceptionLock);
+        }
+    }
+};
+
+// reads the next batch of read fragments, counting them as they are read
+void AlignmentResolver::ReadFragments(ResolvedFragments& batch, uint32_t& numFragments) {
+
+    numFragments = 0;
+    while((numFragments < batch.size()) && mMate1Reader.GetNextRead(batch[numFragments].Mate1)) {
+
+        cc::CasavaRead& m1 = batch[numFragments].Mate1;
+        cc::CasavaRead& m2 = batch[numFragments].Mate2;
 
         // make sure we also get the next mate 2 read
         if(!mMate2Reader.GetNextRead(m2)) {
@@ -662,299 +954,341 @@ void AlignmentResolver::ResolveFragments(const FragmentLengthStatistics& fls) {
                 % cc::StringUtilities::GetReadName(m1) % cc::StringUtilities::GetReadName(m2)).str()));
         }
 
-        // update read statistics
-        ++mStatistics.NumFragments;
-        if(!m1.FailedFilters && !m2.FailedFilters) ++mStatistics.NumUniqueFragmentsPassedFiltering;
+        ++numFragments;
+    }
+}
 
-        // initialize
-        double bestMate1LnPcorrect    = -DBL_MAX;
-        double bestMate2LnPcorrect    = -DBL_MAX;
-        double bestFragmentLnPcorrect = -DBL_MAX;
-        double totalFragmentPcorrect  = rog_total;
+// resolves a read fragment and records how each mate should be written
+void AlignmentResolver::ResolveFragment(ResolvedFragment& rf, const FragmentLengthStatistics& fls, const double rog_mate1, const double rog_mate2, const double rog_total, const AlignmentQuality& aq, Statistics& stats, string& refName, ReferenceMetadata& metadata) {
 
-        bool bestUseCircular = false;
+    cc::CasavaRead& m1 = rf.Mate1;
+    cc::CasavaRead& m2 = rf.Mate2;
+    cc::CasavaAlignments::const_iterator m1Iter, m2Iter, m1ResIter, m2ResIter;
 
-        // figure out which mates are unique or orphaned
-        const bool m1Unique = (m1.Alignments.size() == 1 ? true : false);
-        const bool m2Unique = (m2.Alignments.size() == 1 ? true : false);
+    // update read statistics
+    ++stats.NumFragments;
+    if(!m1.FailedFilters && !m2.FailedFilters) ++stats.NumUniqueFragmentsPassedFiltering;
 
-        const bool m1Empty = m1.Alignments.empty();
-        const bool m2Empty = m2.Alignments.empty();
+    // initialize
+    double bestMate1LnPcorrect    = -DBL_MAX;
+    double bestMate2LnPcorrect    = -DBL_MAX;
+    double bestFragmentLnPcorrect = -DBL_MAX;
+    double totalFragmentPcorrect  = rog_total;
+
+    bool bestUseCircular = false;
+
+    rf.Mate1Record = ER_Unaligned;
+    rf.Mate2Record = ER_Unaligned;
+    rf.IsAnomalous = true;
+
+    // figure out which mates are unique or orphaned
+    const bool m1Unique = (m1.Alignments.size() == 1 ? true : false);
+    const bool m2Unique = (m2.Alignments.size() == 1 ? true : false);
+
+    const bool m1Empty = m1.Alignments.empty();
+    const bool m2Empty = m2.Alignments.empty();
+
+    // calculate the base ln(Pcorrect) for both mates with the assumption
+    // that every base matches the reference
+    const double m1BaseLnPcorrect = aq.GetBaseLnPcorrect(m1.Qualities);
+    const double m2BaseLnPcorrect = aq.GetBaseLnPcorrect(m2.Qualities);
+
+    // update our fragment type statistics
+    if(!m1Empty && !m2Empty) {
+        if(m1Unique && m2Unique)        ++stats.NumUU;
+        else if(!m1Unique && !m2Unique) ++stats.NumMM;
+        else                            ++stats.NumUM;
+    } else if(m1Empty || m2Empty) {
+        ++stats.NumOrphans;
+    }
 
-        // calculate the base ln(Pcorrect) for both mates with the assumption
-        // that every base matches the reference
-        const double m1BaseLnPcorrect = aq.GetBaseLnPcorrect(m1.Qualities);
-        const double m2BaseLnPcorrect = aq.GetBaseLnPcorrect(m2.Qualities);
+    // ===========================
+    // handle discordant data sets
+    // ===========================
 
-        // update our fragment type statistics
-        if(!m1Empty && !m2Empty) {
-            if(m1Unique && m2Unique)        ++mStatistics.NumUU;
-            else if(!m1Unique && !m2Unique) ++mStatistics.NumMM;
-            else                            ++mStatistics.NumUM;
-        } else if(m1Empty || m2Empty) {
-            ++mStatistics.NumOrphans;
-        }
+    if(ConfigSettings.UseDiscordantFragmentStrategy) {
 
-        // ===========================
-        // handle discordant data sets
-        // ===========================
+        // choose the best alignment for each mate
+        bool isMate1Good = false, isMate2Good = false;
 
-        if(useDiscordantFragmentStrategy) {
+        if(!m1Empty) {
+            m1ResIter = GetBestAlignment(m1, m1BaseLnPcorrect, rog_mate1, aq, ConfigSettings.Mate1SeedLength, (uint32_t)m1.Alignments.size());
+            isMate1Good = m1.MateAlignmentQuality >= ConfigSettings.MinMateAlignmentQuality;
+            rf.Mate1Alignment = (uint32_t)(m1ResIter - m1.Alignments.begin());
+        }
 
-            // choose the best alignment for each mate
-            bool isMate1Good = false, isMate2Good = false;
+        if(!m2Empty) {
+            m2ResIter = GetBestAlignment(m2, m2BaseLnPcorrect, rog_mate2, aq, ConfigSettings.Mate2SeedLength, (uint32_t)m2.Alignments.size());
+            isMate2Good = m2.MateAlignmentQuality >= ConfigSettings.MinMateAlignmentQuality;
+            rf.Mate2Alignment = (uint32_t)(m2ResIter - m2.Alignments.begin());
+        }
 
-            if(!m1Empty) {
-                m1ResIter = GetBestAlignment(m1, m1BaseLnPcorrect, rog_mate1, aq, ConfigSettings.Mate1SeedLength, (uint32_t)m1.Alignments.size());
-                isMate1Good = m1.MateAlignmentQuality >= ConfigSettings.MinMateAlignmentQuality;
-            }
+        // update the orientation statistics
+        if(!m1Empty && !m2Empty) {
+            const bool isOnSameRef = (m1ResIter->ReferenceName == m2ResIter->ReferenceName);
+            const uint8_t currentModel = GetAlignmentModel(m1ResIter->ReferencePosition, m1ResIter->IsReverseStrand, m2ResIter->ReferencePosition, m2ResIter->IsReverseStrand, false);
 
-            if(!m2Empty) {
-                m2ResIter = GetBestAlignment(m2, m2BaseLnPcorrect, rog_mate2, aq, ConfigSettings.Mate2SeedLength, (uint32_t)m2.Alignments.size());
-                isMate2Good = m2.MateAlignmentQuality >= ConfigSettings.MinMateAlignmentQuality;
+            if(m1Unique && m2Unique && isOnSameRef && !m1.FailedFilters && !m2.FailedFilters) {
+                ++stats.NumUniqueFragmentsOnSameRefPerAlignmentModel[currentModel];
             }
+        }
 
-            // update the orientation statistics
-            if(!m1Empty && !m2Empty) {
-                const bool isOnSameRef = (m1ResIter->ReferenceName == m2ResIter->ReferenceName);
-                const uint8_t currentModel = GetAlignmentModel(m1ResIter->ReferencePosition, m1ResIter->IsReverseStrand, m2ResIter->ReferencePosition, m2ResIter->IsReverseStrand, false);
+        // record the results
+        if(isMate1Good) {
 
-                if(m1Unique && m2Unique && isOnSameRef && !m1.FailedFilters && !m2.FailedFilters) {
-                    ++mStatistics.NumUniqueFragmentsOnSameRefPerAlignmentModel[currentModel];
-                }
-            }
+            if(isMate2Good) {
 
-            // write the results
-            if(isMate1Good) {
+                // both mates are good
+                rf.Mate1Record = ER_Mate;
+                rf.Mate2Record = ER_Mate;
+                UpdateReadFragmentStatistics(stats, m1, m2, OS_NoPairedAlignmentDone, SS_BothAlignmentsOK, true);
 
-                if(isMate2Good) {
+            } else {
 
-                    // both mates are good
-                    m1Writer.WriteMate(m1, m1ResIter, m2ResIter);
-                    m2Writer.WriteMate(m2, m2ResIter, m1ResIter);
-                    UpdateReadFragmentStatistics(m1, m2, OS_NoPairedAlignmentDone, SS_BothAlignmentsOK, true);
+                // only mate 1 is good (treat as orphaned mate 1)
+                rf.Mate1Record = ER_Orphan;
+                UpdateReadFragmentStatistics(stats, m1, m2, OS_NoPairedAlignmentDone, SS_Read2Poor, false);
+            }
 
-                } else {
+        } else if(isMate2Good) {
 
-                    // only mate 1 is good (treat as orphaned mate 1)
-                    m1Writer.WriteOrphan(m1, m1ResIter);
-                    m2Writer.WriteUnaligned(m2);
-                    UpdateReadFragmentStatistics(m1, m2, OS_NoPairedAlignmentDone, SS_Read2Poor, false);
-                }
+            // only mate 2 is good (treat as orphaned mate 2)
+            rf.Mate2Record = ER_Orphan;
+            UpdateReadFragmentStatistics(stats, m1, m2, OS_NoPairedAlignmentDone, SS_Read1Poor, false);
 
-            } else if(isMate2Good) {
+        } else {
 
-                // only mate 2 is good (treat as orphaned mate 2)
-                m1Writer.WriteUnaligned(m1);
-                m2Writer.WriteOrphan(m2, m2ResIter);
-                UpdateReadFragmentStatistics(m1, m2, OS_NoPairedAlignmentDone, SS_Read1Poor, false);
+            // neither of the mates is good
+            UpdateReadFragmentStatistics(stats, m1, m2, OS_BothAlignButNoFeasiblePair, SS_NoPairedAlignmentDone, false);
+        }
 
-            } else {
+        return;
+    }
 
-                // neither of the mates is good
-                m1Writer.WriteUnaligned(m1);
-                m2Writer.WriteUnaligned(m2);
-                UpdateReadFragmentStatistics(m1, m2, OS_BothAlignButNoFeasiblePair, SS_NoPairedAlignmentDone, false);
-            }
+    // =====================
+    // handle orphaned reads
+    // =====================
 
-            if(writeAnomalies) anomWriter.WriteRead(m1, m2, true);
-            continue;
-        }
+    if(m1Empty || m2Empty) {
 
-        // =====================
-        // handle orphaned reads
-        // =====================
+        if(m1Empty && m2Empty) {
 
-        if(m1Empty || m2Empty) {
+            // neither of the mates is good
+            UpdateReadFragmentStatistics(stats, m1, m2, OS_NoMatchToEither, SS_None, false);
 
-            if(m1Empty && m2Empty) {
+        } else if(m1Empty) {
 
-                // neither of the mates is good
-                m1Writer.WriteUnaligned(m1);
-                m2Writer.WriteUnaligned(m2);
-                UpdateReadFragmentStatistics(m1, m2, OS_NoMatchToEither, SS_None, false);
+            // orphaned mate 2
+            m2ResIter = GetBestAlignment(m2, m2BaseLnPcorrect, rog_mate2, aq, ConfigSettings.Mate2SeedLength, (uint32_t)m2.Alignments.size());
+            rf.Mate2Alignment = (uint32_t)(m2ResIter - m2.Alignments.begin());
 
-            } else if(m1Empty) {
+            // check if the read meets the minimum mate alignment quality
+            if(m2.MateAlignmentQuality < ConfigSettings.MinMateAlignmentQuality) {
+                UpdateReadFragmentStatistics(stats, m1, m2, OS_SingletonRead2, SS_AlignmentPoor, false);
+            } else {
+                rf.Mate2Record = ER_Orphan;
+                UpdateReadFragmentStatistics(stats, m1, m2, OS_SingletonRead2, SS_AlignmentOK, false);
+            }
 
-                // orphaned mate 2
-                m2ResIter = GetBestAlignment(m2, m2BaseLnPcorrect, rog_mate2, aq, ConfigSettings.Mate2SeedLength, (uint32_t)m2.Alignments.size());
-                m1Writer.WriteUnaligned(m1);
+        } else {
 
-                // check if the read meets the minimum mate alignment quality
-                if(m2.MateAlignmentQuality < ConfigSettings.MinMateAlignmentQuality) {
-                    m2Writer.WriteUnaligned(m2);
-                    UpdateReadFragmentStatistics(m1, m2, OS_SingletonRead2, SS_AlignmentPoor, false);
-                } else {
-                    m2Writer.WriteOrphan(m2, m2ResIter);
-                    UpdateReadFragmentStatistics(m1, m2, OS_SingletonRead2, SS_AlignmentOK, false);
-                }
+            // orphaned mate 1
+            m1ResIter = GetBestAlignment(m1, m1BaseLnPcorrect, rog_mate1, aq, ConfigSettings.Mate1SeedLength, (uint32_t)m1.Alignments.size());
+            rf.Mate1Alignment = (uint32_t)(m1ResIter - m1.Alignments.begin());
 
+            // check if the read meets the minimum mate alignment quality
+            if(m1.MateAlignmentQuality < ConfigSettings.MinMateAlignmentQuality) {
+                UpdateReadFragmentStatistics(stats, m1, m2, OS_SingletonRead1, SS_AlignmentPoor, false);
             } else {
-
-                // orphaned mate 1
-                m1ResIter = GetBestAlignment(m1, m1BaseLnPcorrect, rog_mate1, aq, ConfigSettings.Mate1SeedLength, (uint32_t)m1.Alignments.size());
-                m2Writer.WriteUnaligned(m2);
-
-                // check if the read meets the minimum mate alignment quality
-                if(m1.MateAlignmentQuality < ConfigSettings.MinMateAlignmentQuality) {
-                    m1Writer.WriteUnaligned(m1);
-                    UpdateReadFragmentStatistics(m1, m2, OS_SingletonRead1, SS_AlignmentPoor, false);
-                } else {
-                    m1Writer.WriteOrphan(m1, m1ResIter);
-                    UpdateReadFragmentStatistics(m1, m2, OS_SingletonRead1, SS_AlignmentOK, false);
-                }
+                rf.Mate1Record = ER_Orphan;
+                UpdateReadFragmentStatistics(stats, m1, m2, OS_SingletonRead1, SS_AlignmentOK, false);
             }
-
-            if(writeAnomalies) anomWriter.WriteRead(m1, m2, true);
-            continue;
         }
 
-        // ================================
-        // handle concordant read fragments
-        // ================================
+        return;
+    }
 
-        // handle all cases where we have both mates
-        uint32_t numResolvedFragments = 0;
-        for(m1Iter = m1.Alignments.begin(); m1Iter != m1.Alignments.end(); ++m1Iter) {
-            for(m2Iter = m2.Alignments.begin(); m2Iter != m2.Alignments.end(); ++m2Iter) {
+    // ================================
+    // handle concordant read fragments
+    // ================================
 
-                // check that the mates appear on the same reference
-                if(m1Iter->ReferenceName == m2Iter->ReferenceName) {
+    // handle all cases where we have both mates
+    uint32_t numResolvedFragments = 0;
+    for(m1Iter = m1.Alignments.begin(); m1Iter != m1.Alignments.end(); ++m1Iter) {
+        for(m2Iter = m2.Alignments.begin(); m2Iter != m2.Alignments.end(); ++m2Iter) {
 
-                    // lookup the reference name if necessary
-                    if(m1Iter->ReferenceName != refName) {
-                        GetReferenceMetadata(m1Iter->ReferenceName, metadata);
-                        refName   = m1Iter->ReferenceName;
-                    }
+            // check that the mates appear on the same reference
+            if(m1Iter->ReferenceName == m2Iter->ReferenceName) {
+
+                // lookup the reference name if necessary
+                if(m1Iter->ReferenceName != refName) {
+                    GetReferenceMetadata(m1Iter->ReferenceName, metadata);
+                    refName   = m1Iter->ReferenceName;
+                }
 
-                    // check for the proper orientation and order
-                    metadata.UseCircularAlignmentModel = false;
-                    metadata.UsedCircularReference     = false;
-                    const uint32_t fragmentLength = CalculateFragmentLength(m1Iter, m2Iter, metadata);
-                    const bool isFragmentLengthOK = ((fragmentLength >= fls.Min) && (fragmentLength <= fls.Max) ? true : false);
-
-                    const uint8_t currentModel = GetAlignmentModel(m1Iter->ReferencePosition, m1Iter->IsReverseStrand, m2Iter->ReferencePosition, m2Iter->IsReverseStrand, metadata.UseCircularAlignmentModel);
-                    bool isProperlyOrdered = ((currentModel == ConfigSettings.AlignmentModel1) || (currentModel == ConfigSettings.AlignmentModel2) ? true : false);
-
-                    // update fragment statistics for unique vs unique pairs that passed filtering
-                    if(m1Unique && m2Unique && !m1.FailedFilters && !m2.FailedFilters) {
-                        ++mStatistics.NumUniqueFragmentsOnSameRefPerAlignmentModel[currentModel];
-                        if(isProperlyOrdered) {
-                            ++mStatistics.NumNominalUniqueFragments;
-                            if(fragmentLength < fls.Min)      ++mStatistics.NumNominalSmallFragmentLengths;
-                            else if(fragmentLength > fls.Max) ++mStatistics.NumNominalLargeFragmentLengths;
-                        }
+                // check for the proper orientation and order
+                metadata.UseCircularAlignmentModel = false;
+                metadata.UsedCircularReference     = false;
+                const uint32_t fragmentLength = CalculateFragmentLength(m1Iter, m2Iter, metadata);
+                const bool isFragmentLengthOK = ((fragmentLength >= fls.Min) && (fragmentLength <= fls.Max) ? true : false);
+
+                const uint8_t currentModel = GetAlignmentModel(m1Iter->ReferencePosition, m1Iter->IsReverseStrand, m2Iter->ReferencePosition, m2Iter->IsReverseStrand, metadata.UseCircularAlignmentModel);
+                bool isProperlyOrdered = ((currentModel == ConfigSettings.AlignmentModel1) || (currentModel == ConfigSettings.AlignmentModel2) ? true : false);
+
+                // update fragment statistics for unique vs unique pairs that passed filtering
+                if(m1Unique && m2Unique && !m1.FailedFilters && !m2.FailedFilters) {
+                    ++stats.NumUniqueFragmentsOnSameRefPerAlignmentModel[currentModel];
+                    if(isProperlyOrdered) {
+                        ++stats.NumNominalUniqueFragments;
+                        if(fragmentLength < fls.Min)      ++stats.NumNominalSmallFragmentLengths;
+                        else if(fragmentLength > fls.Max) ++stats.NumNominalLargeFragmentLengths;
                     }
+                }
 
-                    // set the iterator to the properly resolved pair with the best fragment alignment score
-                    if(isProperlyOrdered && isFragmentLengthOK) {
-
-                        const double m1LnPcorrect = aq.UpdateLnPcorrect(m1.Qualities, m1Iter->MatchDescriptor, m1BaseLnPcorrect);
-                        const double m2LnPcorrect = aq.UpdateLnPcorrect(m2.Qualities, m2Iter->MatchDescriptor, m2BaseLnPcorrect);
-                        const double fragmentLnPcorrect = m1LnPcorrect + m2LnPcorrect;
-                        totalFragmentPcorrect += exp(fragmentLnPcorrect);
-                        ++numResolvedFragments;
-
-                        if(fragmentLnPcorrect > bestFragmentLnPcorrect) {
-                            m1ResIter              = m1Iter;
-                            m2ResIter              = m2Iter;
-                            bestFragmentLnPcorrect = fragmentLnPcorrect;
-                            bestMate1LnPcorrect    = m1LnPcorrect;
-                            bestMate2LnPcorrect    = m2LnPcorrect;
-                            bestUseCircular        = metadata.UsedCircularReference;
-                        }
+                // set the iterator to the properly resolved pair with the best fragment alignment score
+                if(isProperlyOrdered && isFragmentLengthOK) {
+
+                    const double m1LnPcorrect = aq.UpdateLnPcorrect(m1.Qualities, m1Iter->MatchDescriptor, m1BaseLnPcorrect);
+                    const double m2LnPcorrect = aq.UpdateLnPcorrect(m2.Qualities, m2Iter->MatchDescriptor, m2BaseLnPcorrect);
+                    const double fragmentLnPcorrect = m1LnPcorrect + m2LnPcorrect;
+                    totalFragmentPcorrect += exp(fragmentLnPcorrect);
+                    ++numResolvedFragments;
+
+                    if(fragmentLnPcorrect > bestFragmentLnPcorrect) {
+                        m1ResIter              = m1Iter;
+                        m2ResIter              = m2Iter;
+                        bestFragmentLnPcorrect = fragmentLnPcorrect;
+                        bestMate1LnPcorrect    = m1LnPcorrect;
+                        bestMate2LnPcorrect    = m2LnPcorrect;
+                        bestUseCircular        = metadata.UsedCircularReference;
                     }
                 }
             }
         }
+    }
 
-        // -------------------------------------------------------------------------
-        // handle resolved read fragments (uu, um, mm) and unresolved read fragments
-        // -------------------------------------------------------------------------
+    // -------------------------------------------------------------------------
+    // handle resolved read fragments (uu, um, mm) and unresolved read fragments
+    // -------------------------------------------------------------------------
 
-        // save the resolved fragment
-        if(numResolvedFragments >= 1) {
+    // save the resolved fragment
+    if(numResolvedFragments >= 1) {
 
-            // calculate the alignment qualities for each mate
-            GetBestAlignment(m1, m1BaseLnPcorrect, rog_mate1, aq, ConfigSettings.Mate1SeedLength, (uint32_t)m1.Alignments.size());
-            GetBestAlignment(m2, m2BaseLnPcorrect, rog_mate2, aq, ConfigSettings.Mate2SeedLength, (uint32_t)m2.Alignments.size());
+        // calculate the alignment qualities for each mate
+        GetBestAlignment(m1, m1BaseLnPcorrect, rog_mate1, aq, ConfigSettings.Mate1SeedLength, (uint32_t)m1.Alignments.size());
+        GetBestAlignment(m2, m2BaseLnPcorrect, rog_mate2, aq, ConfigSettings.Mate2SeedLength, (uint32_t)m2.Alignments.size());
 
-            // calculate the fragment alignment quality
-            const bool uniqueFragment = numResolvedFragments == 1;
-            if(uniqueFragment) {
+        // calculate the fragment alignment quality
+        const bool uniqueFragment = numResolvedFragments == 1;
+        if(uniqueFragment) {
 
-                uint32_t m1AdjNeighborhood[3];
-                uint32_t m2AdjNeighborhood[3];
-                aq.AdjustNeighborhood(m1AdjNeighborhood);
-                aq.AdjustNeighborhood(m2AdjNeighborhood);
+            uint32_t m1AdjNeighborhood[3];
+            uint32_t m2AdjNeighborhood[3];
+            aq.AdjustNeighborhood(m1AdjNeighborhood);
+            aq.AdjustNeighborhood(m2AdjNeighborhood);
 
-                const uint16_t mate1AQ = aq.CalculateAlignmentQualityFromNeighbors(m1.Qualities, m1AdjNeighborhood, exp(bestMate1LnPcorrect), rog_mate1, numResolvedFragments, m1BaseLnPcorrect, ConfigSettings.Mate1SeedLength);
-                const uint16_t mate2AQ = aq.CalculateAlignmentQualityFromNeighbors(m2.Qualities, m2AdjNeighborhood, exp(bestMate2LnPcorrect), rog_mate2, numResolvedFragments, m2BaseLnPcorrect, ConfigSettings.Mate2SeedLength);
-                m1.FragmentAlignmentQuality = m2.FragmentAlignmentQuality = mate1AQ + mate2AQ;
+            const uint16_t mate1AQ = aq.CalculateAlignmentQualityFromNeighbors(m1.Qualities, m1AdjNeighborhood, exp(bestMate1LnPcorrect), rog_mate1, numResolvedFragments, m1BaseLnPcorrect, ConfigSettings.Mate1SeedLength);
+            const uint16_t mate2AQ = aq.CalculateAlignmentQualityFromNeighbors(m2.Qualities, m2AdjNeighborhood, exp(bestMate2LnPcorrect), rog_mate2, numResolvedFragments, m2BaseLnPcorrect, ConfigSettings.Mate2SeedLength);
+            m1.FragmentAlignmentQuality = m2.FragmentAlignmentQuality = mate1AQ + mate2AQ;
 
-            } else {
+        } else {
 
-                const double bestFragmentPcorrect = exp(bestFragmentLnPcorrect);
-                m1.FragmentAlignmentQuality = m2.FragmentAlignmentQuality = (uint16_t)floor(-10.0 * log10(1.0 - (bestFragmentPcorrect < totalFragmentPcorrect ? bestFragmentPcorrect / totalFragmentPcorrect : bestFragmentPcorrect)));
-            }
+            const double bestFragmentPcorrect = exp(bestFragmentLnPcorrect);
+            m1.FragmentAlignmentQuality = m2.FragmentAlignmentQuality = (uint16_t)floor(-10.0 * log10(1.0 - (bestFragmentPcorrect < totalFragmentPcorrect ? bestFragmentPcorrect / totalFragmentPcorrect : bestFragmentPcorrect)));
+        }
 
-            // write all reads that meet the are above the minimum fragment alignment quality
-            const bool failedAQ = m1.FragmentAlignmentQuality < ConfigSettings.MinFragmentAlignmentQuality;
-            if(failedAQ) {
+        // write all reads that meet the are above the minimum fragment alignment quality
+        const bool failedAQ = m1.FragmentAlignmentQuality < ConfigSettings.MinFragmentAlignmentQuality;
+        if(failedAQ) {
 
-                ++mStatistics.NumUnresolvedFragments;
-                m1Writer.WriteUnaligned(m1);
-                m2Writer.WriteUnaligned(m2);
-                if(writeAnomalies) anomWriter.WriteRead(m1, m2, true);
+            ++stats.NumUnresolvedFragments;
 
-            } else {
+        } else {
 
-                if(bestUseCircular) ++mStatistics.NumCircularResolved;
+            if(bestUseCircular) ++stats.NumCircularResolved;
 
-                ++mStatistics.NumResolvedFragments;
+            ++stats.NumResolvedFragments;
 
-                m1Writer.WriteFragment(m1, m1ResIter, m2ResIter);
-                m2Writer.WriteFragment(m2, m2ResIter, m1ResIter);
-                if(writeAnomalies) anomWriter.WriteRead(m1, m2, false);
-            }
+            rf.Mate1Record    = ER_Fragment;
+            rf.Mate2Record    = ER_Fragment;
+            rf.Mate1Alignment = (uint32_t)(m1ResIter - m1.Alignments.begin());
+            rf.Mate2Alignment = (uint32_t)(m2ResIter - m2.Alignments.begin());
+            rf.IsAnomalous    = false;
+        }
 
-            // update statistics
-            if(uniqueFragment) UpdateReadFragmentStatistics(m1, m2, OS_UniquePairedAlignment, SS_None, !failedAQ);
-            else               UpdateReadFragmentStatistics(m1, m2, OS_ManyPairedAlignments,  SS_None, !failedAQ);
+        // update statistics
+        if(uniqueFragment) UpdateReadFragmentStatistics(stats, m1, m2, OS_UniquePairedAlignment, SS_None, !failedAQ);
+        else               UpdateReadFragmentStatistics(stats, m1, m2, OS_ManyPairedAlignments,  SS_None, !failedAQ);
 
-        } else {
+    } else {
 
-            // none of the fragments could be resolved, treat the reads as single-end fragments
-            ++mStatistics.NumUnresolvedFragments;
+        // none of the fragments could be resolved, treat the reads as single-end fragments
+        ++stats.NumUnresolvedFragments;
+
+        m1ResIter = GetBestAlignment(m1, m1BaseLnPcorrect, rog_mate1, aq, ConfigSettings.Mate1SeedLength, (uint32_t)m1.Alignments.size());
+        m2ResIter = GetBestAlignment(m2, m2BaseLnPcorrect, rog_mate2, aq, ConfigSettings.Mate2SeedLength, (uint32_t)m2.Alignments.size());
+        rf.Mate1Alignment = (uint32_t)(m1ResIter - m1.Alignments.begin());
+        rf.Mate2Alignment = (uint32_t)(m2ResIter - m2.Alignments.begin());
+
+        const bool m1HasGoodAQ = (m1.MateAlignmentQuality < ConfigSettings.MinMateAlignmentQuality ? false : true);
+        const bool m2HasGoodAQ = (m2.MateAlignmentQuality < ConfigSettings.MinMateAlignmentQuality ? false : true);
+
+        if(m1HasGoodAQ && m2HasGoodAQ) {
+            rf.Mate1Record = ER_Mate;
+            rf.Mate2Record = ER_Mate;
+            UpdateReadFragmentStatistics(stats, m1, m2, OS_BothAlignButNoFeasiblePair, SS_BothAlignmentsOK, true);
+        } else if(m1HasGoodAQ  && !m2HasGoodAQ) {
+            rf.Mate1Record = ER_Orphan;
+            UpdateReadFragmentStatistics(stats, m1, m2, OS_BothAlignButNoFeasiblePair, SS_Read2Poor, false);
+        } else if(!m1HasGoodAQ && m2HasGoodAQ) {
+            rf.Mate2Record = ER_Orphan;
+            UpdateReadFragmentStatistics(stats, m1, m2, OS_BothAlignButNoFeasiblePair, SS_Read1Poor, false);
+        } else if(!m1HasGoodAQ && !m2HasGoodAQ) {
+            UpdateReadFragmentStatistics(stats, m1, m2, OS_BothAlignButNoFeasiblePair, SS_BothAlignButNoFeasiblePair, false);
+        }
+    }
+}
 
-            m1ResIter = GetBestAlignment(m1, m1BaseLnPcorrect, rog_mate1, aq, ConfigSettings.Mate1SeedLength, (uint32_t)m1.Alignments.size());
-            m2ResIter = GetBestAlignment(m2, m2BaseLnPcorrect, rog_mate2, aq, ConfigSettings.Mate2SeedLength, (uint32_t)m2.Alignments.size());
+// resolves the mate-pair or paired-end reads
+void AlignmentResolver::ResolveFragments(const FragmentLengthStatistics& fls) {
 
-            const bool m1HasGoodAQ = (m1.MateAlignmentQuality < ConfigSettings.MinMateAlignmentQuality ? false : true);
-            const bool m2HasGoodAQ = (m2.MateAlignmentQuality < ConfigSettings.MinMateAlignmentQuality ? false : true);
-
-            if(m1HasGoodAQ && m2HasGoodAQ) {
-                m1Writer.WriteMate(m1, m1ResIter, m2ResIter);
-                m2Writer.WriteMate(m2, m2ResIter, m1ResIter);
-                UpdateReadFragmentStatistics(m1, m2, OS_BothAlignButNoFeasiblePair, SS_BothAlignmentsOK, true);
-            } else if(m1HasGoodAQ  && !m2HasGoodAQ) {
-                m1Writer.WriteOrphan(m1, m1ResIter);
-                m2Writer.WriteUnaligned(m2);
-                UpdateReadFragmentStatistics(m1, m2, OS_BothAlignButNoFeasiblePair, SS_Read2Poor, false);
-            } else if(!m1HasGoodAQ && m2HasGoodAQ) {
-                m1Writer.WriteUnaligned(m1);
-                m2Writer.WriteOrphan(m2, m2ResIter);
-                UpdateReadFragmentStatistics(m1, m2, OS_BothAlignButNoFeasiblePair, SS_Read1Poor, false);
-            } else if(!m1HasGoodAQ && !m2HasGoodAQ) {
-                m1Writer.WriteUnaligned(m1);
-                m2Writer.WriteUnaligned(m2);
-                UpdateReadFragmentStatistics(m1, m2, OS_BothAlignButNoFeasiblePair, SS_BothAlignButNoFeasiblePair, false);
-            }
+    cout << "- phase 2 of 2: resolving read fragments... ";
+    cout.flush();
+    Timer resolveBenchmark;
 
-            if(writeAnomalies) anomWriter.WriteRead(m1, m2, true);
-        }
+    // open the export writers. They are driven by the pipeline's writer tasks, which already run
+    // alongside the resolver tasks on our threads, so each one compresses on its own task's thread.
+    ExportWriter m1Writer, m2Writer;
+    m1Writer.Open(ConfigSettings.Mate1ExportFilename, 1);
+    m2Writer.Open(ConfigSettings.Mate2ExportFilename, 1);
+
+    // open the anomaly writer
+    const bool writeAnomalies = !ConfigSettings.AnomalyFilename.empty();
+    AnomalyWriter anomWriter;
+    if(writeAnomalies) anomWriter.Open(ConfigSettings.AnomalyFilename);
+
+    // rewind both readers to the beginning
+    mMate1Reader.Rewind();
+    mMate2Reader.Rewind();
+    mMate1Reader.ProvideBaseQualities(true);
+    mMate2Reader.ProvideBaseQualities(true);
+
+    // create an instance of our alignment quality calculator
+    AlignmentQuality aq;
+
+    // read, resolve and write the fragments batch by batch
+    const uint32_t numThreads = max(ConfigSettings.NumThreads, 1u);
+    const uint32_t numSlices  = (numThreads == 1 ? 1 : 4 * numThreads);
+    FragmentPipeline pipeline(*this, fls, aq, m1Writer, m2Writer, (writeAnomalies ? &anomWriter : NULL), numSlices);
+
+    while(pipeline.HasWork()) {
+        cc::parallelFor(pipeline, pipeline.GetNumTasks(), numThreads);
+        pipeline.Advance();
     }
 
+    // combine the statistics from each slice
+    for(uint32_t i = 0; i < numSlices; ++i) mStatistics.AddFragmentStatistics(pipeline.SliceStatistics[i]);
+
     // print the processing time
     cout << "finished (" << fixed << setprecision(1) << resolveBenchmark.GetElapsedWallTime() << " s)." << endl;
 
@@ -1034,7 +1368,7 @@ void AlignmentResolver::ResolveMates(void) {
 
     // open the export writers
     ExportWriter writer;
-    writer.Open(ConfigSettings.Mate1ExportFilename);
+    writer.Open(ConfigSettings.Mate1ExportFilename, ConfigSettings.NumThreads);
 
     // rewind both readers to the beginning
     mMate1Reader.Rewind();
@@ -1096,7 +1430,7 @@ void AlignmentResolver::ResolveMatesRna(void) {
 
     // open the export writers
     ExportWriter writer;
-    writer.Open(ConfigSettings.Mate1ExportFilename);
+    writer.Open(ConfigSettings.Mate1ExportFilename, ConfigSettings.NumThreads);
 
     // open the contamination and splice readers
     cc::ElandExtendedReader contaminationReader;
@@ -1320,16 +1654,16 @@ void AlignmentResolver::SetUseBases(void) {
 }
 
 // updates the read fragment statistics
-void AlignmentResolver::UpdateReadFragmentStatistics(cc::CasavaRead& m1, cc::CasavaRead& m2, OutcomeStatus outcomeStatus, SecondaryStatus secondaryStatus, bool updateResolvedStats) {
+void AlignmentResolver::UpdateReadFragmentStatistics(Statistics& stats, cc::CasavaRead& m1, cc::CasavaRead& m2, OutcomeStatus outcomeStatus, SecondaryStatus secondaryStatus, bool updateResolvedStats) {
 
     // update our resolved fragment statistics
     const bool m1Unique  = (m1.Alignments.size() == 1 ? true : false);
     const bool m2Unique  = (m2.Alignments.size() == 1 ? true : false);
 
     if(updateResolvedStats) {
-        if(m1Unique && m2Unique)        ++mStatistics.NumUUResolved;
-        else if(!m1Unique && !m2Unique) ++mStatistics.NumMMResolved;
-        else                            ++mStatistics.NumUMResolved;
+        if(m1Unique && m2Unique)        ++stats.NumUUResolved;
+        else if(!m1Unique && !m2Unique) ++stats.NumMMResolved;
+        else                            ++stats.NumUMResolved;
     }
 
     // skip reads that failed filters
@@ -1339,12 +1673,24 @@ void AlignmentResolver::UpdateReadFragmentStatistics(cc::CasavaRead& m1, cc::Cas
     const uint32_t hashCode = mMate1StatusLUT[m1.MStatus] | mMate2StatusLUT[m2.MStatus] | outcomeStatus | secondaryStatus;
 
     // updated the counting statistics map
-    map<uint32_t, uint32_t>::iterator countIter = mStatistics.Counts.find(hashCode);
-    if(countIter == mStatistics.Counts.end()) {
-        mStatistics.Counts[hashCode] = 1;
+    map<uint32_t, uint32_t>::iterator countIter = stats.Counts.find(hashCode);
+    if(countIter == stats.Counts.end()) {
+        stats.Counts[hashCode] = 1;
     } else countIter->second++;
 }
 
+// writes a resolved mate to the export file
+void AlignmentResolver::WriteExportRecord(ExportWriter& writer, const cc::CasavaRead& cr, const ExportRecordType recordType, const uint32_t alignment, const cc::CasavaRead& mate, const uint32_t mateAlignment) {
+
+    cc::CasavaAlignments::const_iterator alIter   = cr.Alignments.begin() + alignment;
+    cc::CasavaAlignments::const_iterator mateIter = mate.Alignments.begin() + mateAlignment;
+
+    if(recordType == ER_Fragment)    writer.WriteFragment(cr, alIter, mateIter);
+    else if(recordType == ER_Mate)   writer.WriteMate(cr, alIter, mateIter);
+    else if(recordType == ER_Orphan) writer.WriteOrphan(cr, alIter);
+    else                             writer.WriteUnaligned(cr);
+}
+
 // writes the statistics into an XML output file
 void AlignmentResolver::WriteStatistics(const string& filename, const FragmentLengthStatistics& fls) {
 
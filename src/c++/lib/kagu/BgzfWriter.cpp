@@ -0,0 +1,265 @@
+/**
+ ** Copyright (c) 2007-2010 Illumina, Inc.
+ **
+ ** This software is covered by the "Illumina Genome Analyzer Software
+ ** License Agreement" and the "Illumina Source Code License Agreement",
+ ** and certain third party copyright/licenses, and any user of this
+ ** source file is bound by the terms therein (see accompanying files
+ ** Illumina_Genome_Analyzer_Software_License_Agreement.pdf and
+ ** Illumina_Source_Code_License_Agreement.pdf and third party
+ ** copyright/license notices).
+ **
+ ** This file is part of the Consensus Assessment of Sequence And VAriation
+ ** (CASAVA) software package.
+ **
+ ** @file BgzfWriter.cpp
+ **
+ ** @brief This class writes block gzip (BGZF) files. Blocks are compressed
+ **        on several threads and a .gzi index of the block offsets is
+ **        written next to the file.
+ **/
+
+#include "common/ParallelFor.hh"
+#include "kagu/BgzfWriter.h"
+
+using namespace std;
+namespace cc = casava::common;
+
+namespace casava {
+namespace kagu {
+
+// the empty block that marks the end of a BGZF file
+static const uint8_t BGZF_EOF_BLOCK[28] = {
+    0x1f, 0x8b, 0x08, 0x04, 0x00, 0x00, 0x00, 0x00, 0x00, 0xff, 0x06, 0x00, 0x42, 0x43,
+    0x02, 0x00, 0x1b, 0x00, 0x03, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00
+};
+
+// stores an unsigned integer in little-endian byte order
+static void PackUInt(uint8_t* pBuffer, uint64_t num, const uint32_t numBytes) {
+    for(uint32_t i = 0; i < numBytes; ++i, num >>= 8) pBuffer[i] = (uint8_t)(num & 0xff);
+}
+
+// deflates a block and wraps it in the BGZF header and footer. Returns false if zlib fails.
+static bool CompressBlock(BgzfBlock& block) {
+
+    z_stream& zs = block.Stream;
+    if(deflateReset(&zs) != Z_OK) return false;
+
+    uint8_t* pCompressed = (uint8_t*)&block.Compressed[0];
+
+    zs.next_in   = (Bytef*)block.Data.data();
+    zs.avail_in  = (uInt)block.Data.size();
+    zs.next_out  = pCompressed + BGZF_HEADER_SIZE;
+    zs.avail_out = (uInt)(block.Compressed.size() - BGZF_HEADER_SIZE - BGZF_FOOTER_SIZE);
+
+    if(deflate(&zs, Z_FINISH) != Z_STREAM_END) return false;
+
+    const uint32_t blockSize = BGZF_HEADER_SIZE + (uint32_t)zs.total_out + BGZF_FOOTER_SIZE;
+
+    // write the gzip header with the BC extra subfield holding the block size
+    static const uint8_t header[BGZF_HEADER_SIZE - 2] = {
+        0x1f, 0x8b, 0x08, 0x04, 0x00, 0x00, 0x00, 0x00, 0x00, 0xff, 0x06, 0x00, 0x42, 0x43, 0x02, 0x00
+    };
+
+    memcpy(pCompressed, header, BGZF_HEADER_SIZE - 2);
+    PackUInt(pCompressed + BGZF_HEADER_SIZE - 2, blockSize - 1, 2);
+
+    // write the gzip footer
+    uint8_t* pFooter = pCompressed + blockSize - BGZF_FOOTER_SIZE;
+    PackUInt(pFooter, crc32(crc32(0, Z_NULL, 0), (const Bytef*)block.Data.data(), (uInt)block.Data.size()), 4);
+    PackUInt(pFooter + 4, block.Data.size(), 4);
+
+    block.CompressedSize = blockSize;
+    return true;
+}
+
+// compresses a range of blocks with parallelFor
+struct BlockCompressor {
+    vector<BgzfBlock>& Blocks;
+    volatile unsigned int NumFailedBlocks;
+
+    // constructor
+    BlockCompressor(vector<BgzfBlock>& blocks)
+        : Blocks(blocks)
+        , NumFailedBlocks(0)
+    {}
+
+    // compresses a block
+    void operator()(const unsigned int blockIndex) {
+        if(!CompressBlock(Blocks[blockIndex])) __sync_fetch_and_add(&NumFailedBlocks, 1);
+    }
+};
+
+// constructor
+BgzfWriter::BgzfWriter(void)
+    : mIsOpen(false)
+    , mOutStream(NULL)
+    , mNumThreads(1)
+    , mCurrentBlock(0)
+    , mCompressedOffset(0)
+    , mUncompressedOffset(0)
+{}
+
+// destructor
+BgzfWriter::~BgzfWriter(void) {
+
+    // Close() reports write errors by throwing, here they can only be logged
+    if(mIsOpen) {
+        try {
+            Close();
+        } catch(const std::exception& e) {
+            cerr << "ERROR: Unable to close the BGZF file: " << e.what() << endl;
+        }
+    }
+
+    vector<BgzfBlock>::iterator blockIter;
+    for(blockIter = mBlocks.begin(); blockIter != mBlocks.end(); ++blockIter) {
+        if(blockIter->IsStreamInitialized) deflateEnd(&blockIter->Stream);
+    }
+}
+
+// flushes the remaining blocks, writes the EOF block and the index, and closes the file
+void BgzfWriter::Close(void) {
+
+    // toggle the writer state
+    mIsOpen = false;
+
+    // flush the partially filled block
+    if(!mBlocks[mCurrentBlock].Data.empty()) ++mCurrentBlock;
+    FlushBlocks();
+
+    if(fwrite(BGZF_EOF_BLOCK, 1, sizeof(BGZF_EOF_BLOCK), mOutStream) != sizeof(BGZF_EOF_BLOCK)) {
+        BOOST_THROW_EXCEPTION(cc::IoException(EINVAL, (boost::format("Unable to write to the BGZF file (%s).") % mFilename).str()));
+    }
+
+    if(fclose(mOutStream) != 0) {
+        BOOST_THROW_EXCEPTION(cc::IoException(EINVAL, (boost::format("Unable to close the BGZF file (%s).") % mFilename).str()));
+    }
+
+    WriteIndex();
+}
+
+// compresses the filled blocks and writes them to disk
+void BgzfWriter::FlushBlocks(void) {
+
+    if(mCurrentBlock == 0) return;
+
+    BlockCompressor compressor(mBlocks);
+    cc::parallelFor(compressor, mCurrentBlock, mNumThreads);
+
+    if(compressor.NumFailedBlocks != 0) {
+        BOOST_THROW_EXCEPTION(cc::IoException(EINVAL, (boost::format("Unable to compress a block for the BGZF file (%s).") % mFilename).str()));
+    }
+
+    // write the blocks in order
+    for(uint32_t i = 0; i < mCurrentBlock; ++i) {
+
+        BgzfBlock& block = mBlocks[i];
+
+        if(mCompressedOffset != 0) mIndex.push_back(make_pair(mCompressedOffset, mUncompressedOffset));
+
+        if(fwrite(&block.Compressed[0], 1, block.CompressedSize, mOutStream) != block.CompressedSize) {
+            BOOST_THROW_EXCEPTION(cc::IoException(EINVAL, (boost::format("Unable to write to the BGZF file (%s).") % mFilename).str()));
+        }
+
+        mCompressedOffset   += block.CompressedSize;
+        mUncompressedOffset += block.Data.size();
+        block.Data.clear();
+    }
+
+    mCurrentBlock = 0;
+}
+
+// opens the BGZF file and compresses the blocks on the specified number of threads
+void BgzfWriter::Open(const string& filename, const uint32_t numThreads) {
+
+    mOutStream = fopen(filename.c_str(), "wb");
+
+    if(!mOutStream) {
+        BOOST_THROW_EXCEPTION(cc::IoException(EINVAL, (boost::format("Unable to open the BGZF file (%s) for writing.") % filename).str()));
+    }
+
+    // allocate our blocks. The z_streams point back to themselves, so the
+    // vector is never resized after they are initialized.
+    mNumThreads = (numThreads == 0 ? 1 : numThreads);
+    if(mBlocks.empty()) {
+
+        mBlocks.resize(mNumThreads == 1 ? 1 : mNumThreads * BGZF_BLOCKS_PER_THREAD);
+
+        vector<BgzfBlock>::iterator blockIter;
+        for(blockIter = mBlocks.begin(); blockIter != mBlocks.end(); ++blockIter) {
+
+            memset(&blockIter->Stream, 0, sizeof(z_stream));
+            if(deflateInit2(&blockIter->Stream, BGZF_COMPRESSION_LEVEL, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+                BOOST_THROW_EXCEPTION(cc::IoException(EINVAL, (boost::format("Unable to initialize the compressor for the BGZF file (%s).") % filename).str()));
+            }
+
+            blockIter->IsStreamInitialized = true;
+            blockIter->Data.reserve(BGZF_BLOCK_SIZE);
+            blockIter->Compressed.resize(BGZF_HEADER_SIZE + deflateBound(&blockIter->Stream, BGZF_BLOCK_SIZE) + BGZF_FOOTER_SIZE);
+        }
+    }
+
+    // toggle the writer state
+    mFilename           = filename;
+    mCurrentBlock       = 0;
+    mCompressedOffset   = 0;
+    mUncompressedOffset = 0;
+    mIndex.clear();
+    mIsOpen             = true;
+}
+
+// adds a record. Records only span blocks when they are longer than a block.
+void BgzfWriter::Write(const char* s, const uint32_t len) {
+
+    // start a new block if the record does not fit in the current one
+    if((mBlocks[mCurrentBlock].Data.size() + len > BGZF_BLOCK_SIZE) && !mBlocks[mCurrentBlock].Data.empty()) {
+        ++mCurrentBlock;
+        if(mCurrentBlock == mBlocks.size()) FlushBlocks();
+    }
+
+    uint32_t numRemainingBytes = len;
+    while(true) {
+
+        string& data = mBlocks[mCurrentBlock].Data;
+        const uint32_t numBytes = min(numRemainingBytes, (uint32_t)(BGZF_BLOCK_SIZE - data.size()));
+
+        data.append(s, numBytes);
+        s                 += numBytes;
+        numRemainingBytes -= numBytes;
+
+        if(numRemainingBytes == 0) break;
+
+        ++mCurrentBlock;
+        if(mCurrentBlock == mBlocks.size()) FlushBlocks();
+    }
+}
+
+// writes the .gzi index file
+void BgzfWriter::WriteIndex(void) {
+
+    const string indexFilename = mFilename + ".gzi";
+    FILE* out = fopen(indexFilename.c_str(), "wb");
+
+    if(!out) {
+        BOOST_THROW_EXCEPTION(cc::IoException(EINVAL, (boost::format("Unable to open the BGZF index file (%s) for writing.") % indexFilename).str()));
+    }
+
+    // the number of entries followed by the compressed and uncompressed offset of each entry
+    vector<uint8_t> buffer(8 + 16 * mIndex.size());
+    PackUInt(&buffer[0], mIndex.size(), 8);
+
+    for(uint32_t i = 0; i < mIndex.size(); ++i) {
+        PackUInt(&buffer[8 + 16 * i],     mIndex[i].first,  8);
+        PackUInt(&buffer[8 + 16 * i + 8], mIndex[i].second, 8);
+    }
+
+    const bool isWriteOK = (fwrite(&buffer[0], 1, buffer.size(), out) == buffer.size());
+
+    if((fclose(out) != 0) || !isWriteOK) {
+        BOOST_THROW_EXCEPTION(cc::IoException(EINVAL, (boost::format("Unable to write to the BGZF index file (%s).") % indexFilename).str()));
+    }
+}
+
+}
+}
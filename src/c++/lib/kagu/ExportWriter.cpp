@@ -28,11 +28,20 @@ namespace casava {
 namespace kagu {
 
 // constructor
-ExportWriter::ExportWriter(void) {}
+ExportWriter::ExportWriter(void)
+    : mIsOpen(false)
+{}
 
-// destructor
+// destructor. Close() reports write errors by throwing, so call it explicitly to
+// see them: here they can only be logged.
 ExportWriter::~ExportWriter(void) {
-    if(mIsOpen) Close();
+    if(!mIsOpen) return;
+
+    try {
+        Close();
+    } catch(const std::exception& e) {
+        cerr << "ERROR: Unable to close the export file: " << e.what() << endl;
+    }
 }
 
 // closes the file streams
@@ -42,37 +51,33 @@ void ExportWriter::Close() {
     mIsOpen = false;
 
     // close our files
-    gzclose(mOutStream);
+    mOutStream.Close();
 }
 
-// opens the export file for the associated mate
-void ExportWriter::Open(const string& filename) {
+// opens the export file for the associated mate and compresses it on the specified number of threads
+void ExportWriter::Open(const string& filename, const uint32_t numThreads) {
 
     // open the export file
-    mOutStream = gzopen(filename.c_str(), "wb1");
-
-    if(!mOutStream) {
-        BOOST_THROW_EXCEPTION(cc::IoException(EINVAL, (boost::format("Unable to open the export file (%s) for writing.") % filename).str()));
-    }
+    mOutStream.Open(filename, numThreads);
 
     // toggle the writer state
-    mFilename = filename;
-    mIsOpen   = true;
+    mIsOpen = true;
 }
 
 // writes the alignment info for the current entry
 void ExportWriter::WriteAlignmentInfo(const cc::CasavaRead& cr, cc::CasavaAlignments::const_iterator& alIt) {
-    const int numBytesWritten = gzprintf(mOutStream, "%s\t%s\t%d\t%c\t%s\t%u\t",
-        alIt->ReferenceName.c_str(),
-        alIt->ContigName.c_str(),
-        alIt->ReferencePosition,
-        (alIt->IsReverseStrand ? 'R' : 'F'),
-        alIt->MatchDescriptor.c_str(),
-        cr.MateAlignmentQuality);
-
-    if(numBytesWritten == 0) {
-        BOOST_THROW_EXCEPTION(cc::IoException(EINVAL, (boost::format("Unable to write to the export file (%s).") % mFilename).str()));
-    }
+    mRecord.append(alIt->ReferenceName);
+    mRecord += '\t';
+    mRecord.append(alIt->ContigName);
+    mRecord += '\t';
+    AppendInteger(alIt->ReferencePosition);
+    mRecord += '\t';
+    mRecord += (alIt->IsReverseStrand ? 'R' : 'F');
+    mRecord += '\t';
+    mRecord.append(alIt->MatchDescriptor);
+    mRecord += '\t';
+    AppendUInteger(cr.MateAlignmentQuality);
+    mRecord += '\t';
 }
 
 // writes a resolved fragment entry to disk
@@ -86,36 +91,44 @@ void ExportWriter::WriteFragment(const cc::CasavaRead& cr, cc::CasavaAlignments:
     const bool isOnSameContig = (alIt->ContigName    == mateIt->ContigName    ? true : false);
     const int64_t fragmentOffset = (isOnSameRef ? mateIt->ReferencePosition - alIt->ReferencePosition : mateIt->ReferencePosition);
 
-    const int numBytesWritten = gzprintf(mOutStream, "%u\t%s\t%s\t%lld\t%c\t%c\n",
-        cr.FragmentAlignmentQuality,
-        (isOnSameRef ? "" : mateIt->ReferenceName.c_str()),
-        (isOnSameRef && !isOnSameContig ? mateIt->ContigName.c_str() : ""),
-        fragmentOffset,
-        (mateIt->IsReverseStrand ? 'R' : 'F'),
-        (cr.FailedFilters ? 'N' : 'Y'));
-
-    if(numBytesWritten == 0) {
-        BOOST_THROW_EXCEPTION(cc::IoException(EINVAL, (boost::format("Unable to write to the export file (%s).") % mFilename).str()));
-    }
+    AppendUInteger(cr.FragmentAlignmentQuality);
+    mRecord += '\t';
+    if(!isOnSameRef) mRecord.append(mateIt->ReferenceName);
+    mRecord += '\t';
+    if(isOnSameRef && !isOnSameContig) mRecord.append(mateIt->ContigName);
+    mRecord += '\t';
+    AppendInteger(fragmentOffset);
+    mRecord += '\t';
+    mRecord += (mateIt->IsReverseStrand ? 'R' : 'F');
+    mRecord += '\t';
+    mRecord += (cr.FailedFilters ? 'N' : 'Y');
+    mRecord += '\n';
+
+    WriteRecord();
 }
 
 // writes the header info for the current entry
 void ExportWriter::WriteHeader(const cc::CasavaRead& cr) {
-    const int numBytesWritten = gzprintf(mOutStream, "%s\t%s\t%s\t%s\t%s\t%s\t%s\t%s\t%s\t%s\t",
-        cr.Machine.c_str(),
-        cr.RunNumber.c_str(),
-        cr.Lane.c_str(),
-        cr.Tile.c_str(),
-        cr.XCoord.c_str(),
-        cr.YCoord.c_str(),
-        cr.Index.c_str(),
-        cr.ReadNumber.c_str(),
-        cr.Bases.c_str(),
-        cr.Qualities.c_str());
-
-    if(numBytesWritten == 0) {
-        BOOST_THROW_EXCEPTION(cc::IoException(EINVAL, (boost::format("Unable to write to the export file (%s).") % mFilename).str()));
-    }
+    mRecord.append(cr.Machine);
+    mRecord += '\t';
+    mRecord.append(cr.RunNumber);
+    mRecord += '\t';
+    mRecord.append(cr.Lane);
+    mRecord += '\t';
+    mRecord.append(cr.Tile);
+    mRecord += '\t';
+    mRecord.append(cr.XCoord);
+    mRecord += '\t';
+    mRecord.append(cr.YCoord);
+    mRecord += '\t';
+    mRecord.append(cr.Index);
+    mRecord += '\t';
+    mRecord.append(cr.ReadNumber);
+    mRecord += '\t';
+    mRecord.append(cr.Bases);
+    mRecord += '\t';
+    mRecord.append(cr.Qualities);
+    mRecord += '\t';
 }
 
 // writes a mate entry to disk
@@ -128,26 +141,22 @@ void ExportWriter::WriteMate(const cc::CasavaRead& cr, cc::CasavaAlignments::con
     const bool isOnSameRef = (alIt->ReferenceName == mateIt->ReferenceName ? true : false);
     const int64_t fragmentOffset = (isOnSameRef ? mateIt->ReferencePosition - alIt->ReferencePosition : mateIt->ReferencePosition);
 
-    int numBytesWritten = 0;
     if(!isOnSameRef) {
-
-        numBytesWritten = gzprintf(mOutStream, "0\t%s\t\t%d\t%c\t%c\n",
-            mateIt->ReferenceName.c_str(),
-            mateIt->ReferencePosition,
-            (mateIt->IsReverseStrand ? 'R' : 'F'),
-            (cr.FailedFilters ? 'N' : 'Y'));
-
+        mRecord.append("0\t");
+        mRecord.append(mateIt->ReferenceName);
+        mRecord.append("\t\t");
     } else {
-
-        numBytesWritten = gzprintf(mOutStream, "0\t\t\t%lld\t%c\t%c\n",
-            fragmentOffset,
-            (mateIt->IsReverseStrand ? 'R' : 'F'),
-            (cr.FailedFilters ? 'N' : 'Y'));
+        mRecord.append("0\t\t\t");
     }
 
-    if(numBytesWritten == 0) {
-        BOOST_THROW_EXCEPTION(cc::IoException(EINVAL, (boost::format("Unable to write to the export file (%s).") % mFilename).str()));
-    }
+    AppendInteger(fragmentOffset);
+    mRecord += '\t';
+    mRecord += (mateIt->IsReverseStrand ? 'R' : 'F');
+    mRecord += '\t';
+    mRecord += (cr.FailedFilters ? 'N' : 'Y');
+    mRecord += '\n';
+
+    WriteRecord();
 }
 
 // writes an orphan mate entry to disk
@@ -157,12 +166,11 @@ void ExportWriter::WriteOrphan(const cc::CasavaRead& cr, cc::CasavaAlignments::c
     WriteHeader(cr);
     WriteAlignmentInfo(cr, alIt);
 
-    const int numBytesWritten = gzprintf(mOutStream, "0\t\t\t0\tN\t%c\n",
-        (cr.FailedFilters ? 'N' : 'Y'));
+    mRecord.append("0\t\t\t0\tN\t");
+    mRecord += (cr.FailedFilters ? 'N' : 'Y');
+    mRecord += '\n';
 
-    if(numBytesWritten == 0) {
-        BOOST_THROW_EXCEPTION(cc::IoException(EINVAL, (boost::format("Unable to write to the export file (%s).") % mFilename).str()));
-    }
+    WriteRecord();
 }
 
 // writes a single end read entry to disk
@@ -172,12 +180,11 @@ void ExportWriter::WriteSingleEndRead(const cc::CasavaRead& cr, cc::CasavaAlignm
     WriteHeader(cr);
     WriteAlignmentInfo(cr, alIt);
 
-    const int numBytesWritten = gzprintf(mOutStream, "\t\t\t\t\t%c\n",
-        (cr.FailedFilters ? 'N' : 'Y'));
+    mRecord.append("\t\t\t\t\t");
+    mRecord += (cr.FailedFilters ? 'N' : 'Y');
+    mRecord += '\n';
 
-    if(numBytesWritten == 0) {
-        BOOST_THROW_EXCEPTION(cc::IoException(EINVAL, (boost::format("Unable to write to the export file (%s).") % mFilename).str()));
-    }
+    WriteRecord();
 }
 
 // writes an unaligned read entry to disk
@@ -186,13 +193,12 @@ void ExportWriter::WriteUnaligned(const cc::CasavaRead& cr) {
     CheckOpen();
     WriteHeader(cr);
 
-    const int numBytesWritten = gzprintf(mOutStream, "%s\t\t\t\t\t\t\t\t\t\t\t%c\n",
-        cr.Status.c_str(),
-        (cr.FailedFilters ? 'N' : 'Y'));
+    mRecord.append(cr.Status);
+    mRecord.append("\t\t\t\t\t\t\t\t\t\t\t");
+    mRecord += (cr.FailedFilters ? 'N' : 'Y');
+    mRecord += '\n';
 
-    if(numBytesWritten == 0) {
-        BOOST_THROW_EXCEPTION(cc::IoException(EINVAL, (boost::format("Unable to write to the export file (%s).") % mFilename).str()));
-    }
+    WriteRecord();
 }
 
 }
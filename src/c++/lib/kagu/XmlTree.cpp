@@ -32,7 +32,7 @@ namespace kagu {
 
 // our XML regular expressions
 boost::regex XmlTree::mAttributeRegex("(\\S+?)=\"(.+?)\"");
-boost::regex XmlTree::mElementRegex("^\\s*<(\\S+)\\s*([^/>]*)([/]*)>");
+boost::regex XmlTree::mElementRegex("^\\s*<([^\\s/>]+)\\s*([^/>]*)([/]*)>");
 boost::regex XmlTree::mEndElementRegex("^\\s*</[^>]+>");
 boost::regex XmlTree::mTextRegex("^(.+?)<");
 boost::regex XmlTree::mXmlDeclarationRegex("^<\\?xml.+?>");